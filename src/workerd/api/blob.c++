@@ -6,77 +6,178 @@
 #include "streams.h"
 #include "util.h"
 #include <workerd/util/mimetype.h>
+#include <algorithm>
 
 namespace workerd::api {
 
-// Concatenate an array of segments (parameter to Blob constructor).
-static kj::Array<byte> concat(jsg::Optional<Blob::Bits> maybeBits) {
-  // TODO(perf): Make it so that a Blob can keep references to the input data rather than copy it.
-  //   Note that we can't keep references to ArrayBuffers since they are mutable, but we can
-  //   reference other Blobs in the input.
+static kj::String normalizeType(kj::String type) {
+  // This does not properly parse mime types. We have the new workerd::MimeType impl
+  // but that handles mime types a bit more strictly than this. Ideally we'd be able to
+  // switch over to it but there's a non-zero risk of breaking running code. We might need
+  // a compat flag to switch at some point but for now we'll keep this as it is.
 
-  auto bits = kj::mv(maybeBits).orDefault(nullptr);
+  // https://www.w3.org/TR/FileAPI/#constructorBlob step 3 inexplicably insists that if the
+  // type contains non-printable-ASCII characters we should discard it, and otherwise we should
+  // lower-case it.
+  for (char& c: type) {
+    if (static_cast<signed char>(c) < 0x20) {
+      // Throw it away.
+      return nullptr;
+    } else if ('A' <= c && c <= 'Z') {
+      c = c - 'A' + 'a';
+    }
+  }
 
-  size_t size = 0;
-  for (auto& part: bits) {
-    KJ_SWITCH_ONEOF(part) {
-      KJ_CASE_ONEOF(bytes, kj::Array<const byte>) {
-        size += bytes.size();
-      }
-      KJ_CASE_ONEOF(text, kj::String) {
-        size += text.size();
-      }
-      KJ_CASE_ONEOF(blob, jsg::Ref<Blob>) {
-        size += blob->getData().size();
-      }
+  return kj::mv(type);
+}
+
+// Blobs passed to the Blob or File constructor that are smaller than this are copied rather than
+// referred to, so that building a Blob from many small pieces doesn't leave a long list of tiny
+// segments.
+static constexpr size_t MIN_SEGMENT_SIZE = 256;
+
+Blob::Blob(kj::Array<Segment> segments, kj::String type)
+    : ownData(kj::mv(segments)), type(kj::mv(type)) {
+  auto& list = ownData.get<kj::Array<Segment>>();
+  size = list.size() == 0 ? 0 : list.back().offset + list.back().bytes.size();
+}
+
+template <typename Func>
+void Blob::forEachPiece(size_t start, size_t end, Func&& func) {
+  if (start >= end) return;
+
+  if (isFlat()) {
+    func(*this, data.slice(start, end));
+  } else KJ_IF_SOME(segments, ownData.tryGet<kj::Array<Segment>>()) {
+    // Find the first segment that ends after `start`.
+    auto iter = std::upper_bound(segments.begin(), segments.end(), start,
+        [](size_t pos, const Segment& segment) {
+      return pos < segment.offset + segment.bytes.size();
+    });
+    for (; iter != segments.end() && iter->offset < end; ++iter) {
+      size_t from = kj::max(start, iter->offset) - iter->offset;
+      size_t to = kj::min(end, iter->offset + iter->bytes.size()) - iter->offset;
+      func(*iter->blob, iter->bytes.slice(from, to));
     }
+  } else {
+    auto& range = ownData.get<Range>();
+    range.blob->forEachPiece(range.start + start, range.start + end, func);
   }
+}
 
-  if (size == 0) return nullptr;
+void Blob::copyTo(size_t start, kj::ArrayPtr<byte> out) {
+  byte* ptr = out.begin();
+  forEachPiece(start, start + out.size(), [&](Blob&, kj::ArrayPtr<const byte> piece) {
+    memcpy(ptr, piece.begin(), piece.size());
+    ptr += piece.size();
+  });
+  KJ_ASSERT(ptr == out.end());
+}
 
-  auto result = kj::heapArray<byte>(size);
-  byte* ptr = result.begin();
+kj::ArrayPtr<const byte> Blob::getData() {
+  if (!isFlat()) {
+    auto flat = kj::heapArray<byte>(size);
+    copyTo(0, flat);
+    data = flat;
+    ownData = kj::mv(flat);
+  }
+  return data;
+}
 
-  for (auto& part: bits) {
+kj::OneOf<kj::Array<byte>, kj::Array<Blob::Segment>> Blob::concat(
+    jsg::Optional<Bits> maybeBits) {
+  // Note that we can't keep references to ArrayBuffers since they are mutable, so those are
+  // always copied.
+
+  auto bits = kj::mv(maybeBits).orDefault(nullptr);
+
+  auto partSize = [](auto& part) -> size_t {
     KJ_SWITCH_ONEOF(part) {
       KJ_CASE_ONEOF(bytes, kj::Array<const byte>) {
-        memcpy(ptr, bytes.begin(), bytes.size());
-        ptr += bytes.size();
+        return bytes.size();
       }
       KJ_CASE_ONEOF(text, kj::String) {
-        memcpy(ptr, text.begin(), text.size());
-        ptr += text.size();
+        return text.size();
       }
       KJ_CASE_ONEOF(blob, jsg::Ref<Blob>) {
-        memcpy(ptr, blob->getData().begin(), blob->getData().size());
-        ptr += blob->getData().size();
+        return blob->size;
+      }
+    }
+    KJ_UNREACHABLE;
+  };
+  auto isSegment = [](auto& part) {
+    KJ_IF_SOME(blob, part.template tryGet<jsg::Ref<Blob>>()) {
+      return blob->size >= MIN_SEGMENT_SIZE;
+    }
+    return false;
+  };
+  // Copies `parts` into a new array.
+  auto copyParts = [&](kj::ArrayPtr<kj::OneOf<kj::Array<const byte>, kj::String, jsg::Ref<Blob>>>
+                           parts, size_t size) {
+    auto result = kj::heapArray<byte>(size);
+    byte* ptr = result.begin();
+
+    for (auto& part: parts) {
+      KJ_SWITCH_ONEOF(part) {
+        KJ_CASE_ONEOF(bytes, kj::Array<const byte>) {
+          memcpy(ptr, bytes.begin(), bytes.size());
+          ptr += bytes.size();
+        }
+        KJ_CASE_ONEOF(text, kj::String) {
+          memcpy(ptr, text.begin(), text.size());
+          ptr += text.size();
+        }
+        KJ_CASE_ONEOF(blob, jsg::Ref<Blob>) {
+          blob->copyTo(0, kj::arrayPtr(ptr, blob->size));
+          ptr += blob->size;
+        }
       }
     }
-  }
 
-  KJ_ASSERT(ptr == result.end());
-  return result;
-}
+    KJ_ASSERT(ptr == result.end());
+    return result;
+  };
 
-static kj::String normalizeType(kj::String type) {
-  // This does not properly parse mime types. We have the new workerd::MimeType impl
-  // but that handles mime types a bit more strictly than this. Ideally we'd be able to
-  // switch over to it but there's a non-zero risk of breaking running code. We might need
-  // a compat flag to switch at some point but for now we'll keep this as it is.
+  size_t size = 0;
+  bool anySegments = false;
+  for (auto& part: bits) {
+    size += partSize(part);
+    anySegments = anySegments || isSegment(part);
+  }
 
-  // https://www.w3.org/TR/FileAPI/#constructorBlob step 3 inexplicably insists that if the
-  // type contains non-printable-ASCII characters we should discard it, and otherwise we should
-  // lower-case it.
-  for (char& c: type) {
-    if (static_cast<signed char>(c) < 0x20) {
-      // Throw it away.
-      return nullptr;
-    } else if ('A' <= c && c <= 'Z') {
-      c = c - 'A' + 'a';
+  if (size == 0) return kj::Array<byte>();
+  if (!anySegments) return copyParts(bits, size);
+
+  kj::Vector<Segment> segments;
+  size_t offset = 0;
+  size_t i = 0;
+  while (i < bits.size()) {
+    if (isSegment(bits[i])) {
+      // Refer to the pieces of the Blob directly, rather than to the Blob itself, so that Blobs
+      // built from Blobs built from Blobs don't get any slower to read.
+      auto& blob = bits[i++].get<jsg::Ref<Blob>>();
+      blob->forEachPiece(0, blob->size, [&](Blob& owner, kj::ArrayPtr<const byte> piece) {
+        segments.add(Segment { owner.selfRef(), piece, offset });
+        offset += piece.size();
+      });
+    } else {
+      // Copy the run of parts up to the next segment into a flat Blob of its own.
+      size_t runStart = i;
+      size_t runSize = 0;
+      while (i < bits.size() && !isSegment(bits[i])) {
+        runSize += partSize(bits[i++]);
+      }
+      if (runSize > 0) {
+        auto run = jsg::alloc<Blob>(copyParts(bits.slice(runStart, i), runSize), kj::String());
+        auto bytes = run->data;
+        segments.add(Segment { kj::mv(run), bytes, offset });
+        offset += bytes.size();
+      }
     }
   }
 
-  return kj::mv(type);
+  KJ_ASSERT(offset == size);
+  return segments.releaseAsArray();
 }
 
 jsg::Ref<Blob> Blob::constructor(jsg::Optional<Bits> bits, jsg::Optional<Options> options) {
@@ -87,53 +188,93 @@ jsg::Ref<Blob> Blob::constructor(jsg::Optional<Bits> bits, jsg::Optional<Options
     }
   }
 
-  return jsg::alloc<Blob>(concat(kj::mv(bits)), kj::mv(type));
+  KJ_SWITCH_ONEOF(concat(kj::mv(bits))) {
+    KJ_CASE_ONEOF(bytes, kj::Array<byte>) {
+      return jsg::alloc<Blob>(kj::mv(bytes), kj::mv(type));
+    }
+    KJ_CASE_ONEOF(segments, kj::Array<Segment>) {
+      return jsg::alloc<Blob>(kj::mv(segments), kj::mv(type));
+    }
+  }
+  KJ_UNREACHABLE;
 }
 
 jsg::Ref<Blob> Blob::slice(jsg::Optional<int> maybeStart, jsg::Optional<int> maybeEnd,
                             jsg::Optional<kj::String> type) {
   int start = maybeStart.orDefault(0);
-  int end = maybeEnd.orDefault(data.size());
+  int end = maybeEnd.orDefault(size);
 
   if (start < 0) {
     // Negative value interpreted as offset from end.
-    start += data.size();
+    start += size;
   }
   // Clamp start to range.
   if (start < 0) {
     start = 0;
-  } else if (start > data.size()) {
-    start = data.size();
+  } else if (start > size) {
+    start = size;
   }
 
   if (end < 0) {
     // Negative value interpreted as offset from end.
-    end += data.size();
+    end += size;
   }
   // Clamp end to range.
   if (end < start) {
     end = start;
-  } else if (end > data.size()) {
-    end = data.size();
+  } else if (end > size) {
+    end = size;
+  }
+
+  auto normalizedType = normalizeType(kj::mv(type).orDefault(nullptr));
+
+  if (isFlat()) {
+    return jsg::alloc<Blob>(JSG_THIS, data.slice(start, end), kj::mv(normalizedType));
+  }
+
+  // A slice that falls within a single piece can be a flat slice of the Blob holding that piece,
+  // which keeps slices of small ranges from holding on to the whole list of segments.
+  kj::Maybe<Blob&> onlyOwner;
+  kj::ArrayPtr<const byte> onlyPiece;
+  uint pieceCount = 0;
+  forEachPiece(start, end, [&](Blob& owner, kj::ArrayPtr<const byte> piece) {
+    if (pieceCount++ == 0) {
+      onlyOwner = owner;
+      onlyPiece = piece;
+    }
+  });
+  if (pieceCount == 0) {
+    return jsg::alloc<Blob>(kj::Array<byte>(), kj::mv(normalizedType));
+  } else if (pieceCount == 1) {
+    return jsg::alloc<Blob>(KJ_ASSERT_NONNULL(onlyOwner).selfRef(), onlyPiece,
+                            kj::mv(normalizedType));
   }
 
-  return jsg::alloc<Blob>(JSG_THIS, data.slice(start, end),
-      normalizeType(kj::mv(type).orDefault(nullptr)));
+  // Slices of slices refer to the Blob made of segments directly.
+  KJ_IF_SOME(range, ownData.tryGet<Range>()) {
+    return jsg::alloc<Blob>(Range { range.blob.addRef(), range.start + start },
+                            end - start, kj::mv(normalizedType));
+  }
+  return jsg::alloc<Blob>(Range { JSG_THIS, static_cast<size_t>(start) },
+                          end - start, kj::mv(normalizedType));
 }
 
 jsg::Promise<kj::Array<kj::byte>> Blob::arrayBuffer(jsg::Lock& js) {
   // TODO(perf): Find a way to avoid the copy.
-  return js.resolvedPromise(kj::heapArray<byte>(data));
+  auto result = kj::heapArray<byte>(size);
+  copyTo(0, result);
+  return js.resolvedPromise(kj::mv(result));
 }
 jsg::Promise<kj::String> Blob::text(jsg::Lock& js) {
-  return js.resolvedPromise(kj::str(data.asChars()));
+  auto result = kj::heapString(size);
+  copyTo(0, result.asBytes());
+  return js.resolvedPromise(kj::mv(result));
 }
 
 class Blob::BlobInputStream final: public ReadableStreamSource {
 public:
   BlobInputStream(jsg::Ref<Blob> blob)
-      : unread(blob->data),
-        blob(kj::mv(blob)) {}
+      : blob(kj::mv(blob)) {}
 
   // Attempt to read a maximum of maxBytes from the remaining unread content of the blob
   // into the given buffer. It is the caller's responsibility to ensure that buffer has
@@ -142,10 +283,10 @@ public:
   // The buffer must be kept alive by the caller until the returned promise is fulfilled.
   // The returned promise is fulfilled with the actual number of bytes read.
   kj::Promise<size_t> tryRead(void* buffer, size_t minBytes, size_t maxBytes) override {
-    size_t amount = kj::min(maxBytes, unread.size());
+    size_t amount = kj::min(maxBytes, blob->size - offset);
     if (amount > 0) {
-      memcpy(buffer, unread.begin(), amount);
-      unread = unread.slice(amount, unread.size());
+      blob->copyTo(offset, kj::arrayPtr(static_cast<byte*>(buffer), amount));
+      offset += amount;
     }
     return amount;
   }
@@ -154,20 +295,27 @@ public:
   // encoding is supported. This implementation only supports StreamEncoding::IDENTITY.
   kj::Maybe<uint64_t> tryGetLength(StreamEncoding encoding) override {
     if (encoding == StreamEncoding::IDENTITY) {
-      return unread.size();
+      return blob->size - offset;
     } else {
       return kj::none;
     }
   }
 
-  // Write all of the remaining unread content of the blob to output.
+  // Write all of the remaining unread content of the blob to output, one write per segment.
   // If end is true, output.end() will be called once the write has been completed.
   // Importantly, the WritableStreamSink must be kept alive by the caller until the
   // returned promise is fulfilled.
   kj::Promise<DeferredProxy<void>> pumpTo(WritableStreamSink& output, bool end) override {
-    if (unread.size() != 0) {
-      auto promise = output.write(unread.begin(), unread.size());
-      unread = nullptr;
+    if (offset < blob->size) {
+      // Hold on to the Blobs the pieces live in, in case `blob` is flattened during the write.
+      kj::Vector<kj::ArrayPtr<const byte>> pieces;
+      kj::Vector<jsg::Ref<Blob>> owners;
+      blob->forEachPiece(offset, blob->size, [&](Blob& owner, kj::ArrayPtr<const byte> piece) {
+        pieces.add(piece);
+        owners.add(owner.selfRef());
+      });
+      auto promise = output.write(pieces.asPtr());
+      offset = blob->size;
 
       co_await promise;
 
@@ -180,8 +328,8 @@ public:
   }
 
 private:
-  kj::ArrayPtr<const byte> unread;
   jsg::Ref<Blob> blob;
+  size_t offset = 0;
 };
 
 jsg::Ref<ReadableStream> Blob::stream() {
@@ -210,7 +358,15 @@ jsg::Ref<File> File::constructor(jsg::Optional<Bits> bits,
     lastModified = dateNow();
   }
 
-  return jsg::alloc<File>(concat(kj::mv(bits)), kj::mv(name), kj::mv(type), lastModified);
+  KJ_SWITCH_ONEOF(concat(kj::mv(bits))) {
+    KJ_CASE_ONEOF(bytes, kj::Array<byte>) {
+      return jsg::alloc<File>(kj::mv(bytes), kj::mv(name), kj::mv(type), lastModified);
+    }
+    KJ_CASE_ONEOF(segments, kj::Array<Segment>) {
+      return jsg::alloc<File>(kj::mv(segments), kj::mv(name), kj::mv(type), lastModified);
+    }
+  }
+  KJ_UNREACHABLE;
 }
 
 }  // namespace workerd::api
@@ -12,14 +12,41 @@ namespace workerd::api {
 class ReadableStream;
 
 // An implementation of the Web Platform Standard Blob API
+//
+// A Blob built from other Blobs doesn't copy them: since Blobs are immutable, it refers to their
+// contents instead, as a list of segments, and only copies them together when something needs them
+// in one piece. Slicing never copies.
 class Blob: public jsg::Object {
+protected:
+  // A range of the contents of a flat Blob, as a piece of a Blob made of segments.
+  struct Segment {
+    jsg::Ref<Blob> blob;
+    kj::ArrayPtr<const byte> bytes;
+
+    // Where `bytes` starts in the Blob made of segments.
+    size_t offset;
+  };
+
+  // A slice of a Blob made of segments.
+  struct Range {
+    jsg::Ref<Blob> blob;
+    size_t start;
+  };
+
 public:
   Blob(kj::Array<byte> data, kj::String type)
-      : ownData(kj::mv(data)), data(ownData.get<kj::Array<byte>>()), type(kj::mv(type)) {}
+      : ownData(kj::mv(data)), data(ownData.get<kj::Array<byte>>()), size(this->data.size()),
+        type(kj::mv(type)) {}
+  // `parent` must be flat, and `data` must point into its contents.
   Blob(jsg::Ref<Blob> parent, kj::ArrayPtr<const byte> data, kj::String type)
-      : ownData(kj::mv(parent)), data(data), type(kj::mv(type)) {}
+      : ownData(kj::mv(parent)), data(data), size(data.size()), type(kj::mv(type)) {}
+  Blob(kj::Array<Segment> segments, kj::String type);
+  Blob(Range range, size_t size, kj::String type)
+      : ownData(kj::mv(range)), size(size), type(kj::mv(type)) {}
 
-  inline kj::ArrayPtr<const byte> getData() const KJ_LIFETIMEBOUND { return data; }
+  // Returns the contents in one piece. If the Blob is made of segments, this copies them together
+  // first, and from then on the Blob holds the copy instead of the segments.
+  kj::ArrayPtr<const byte> getData() KJ_LIFETIMEBOUND;
 
   // ---------------------------------------------------------------------------
   // JS API
@@ -35,7 +62,7 @@ public:
 
   static jsg::Ref<Blob> constructor(jsg::Optional<Bits> bits, jsg::Optional<Options> options);
 
-  int getSize() const { return data.size(); }
+  int getSize() const { return size; }
   kj::StringPtr getType() const { return type; }
 
   jsg::Ref<Blob> slice(jsg::Optional<int> start, jsg::Optional<int> end,
@@ -68,18 +95,59 @@ public:
       KJ_CASE_ONEOF(data, jsg::Ref<Blob>) {
         tracker.trackField("ownData", data);
       }
+      KJ_CASE_ONEOF(segments, kj::Array<Segment>) {
+        for (auto& segment: segments) {
+          tracker.trackField("segment", segment.blob);
+        }
+      }
+      KJ_CASE_ONEOF(range, Range) {
+        tracker.trackField("range", range.blob);
+      }
     }
     tracker.trackField("type", type);
   }
 
+protected:
+  // Concatenates the parts passed to the Blob or File constructor, into either a flat copy or,
+  // when there are large enough Blobs among them to be worth referring to, segments.
+  static kj::OneOf<kj::Array<byte>, kj::Array<Segment>> concat(jsg::Optional<Bits> maybeBits);
+
 private:
-  kj::OneOf<kj::Array<byte>, jsg::Ref<Blob>> ownData;
+  // The contents are one of:
+  // - kj::Array<byte>: owned by this Blob.
+  // - jsg::Ref<Blob>: owned by another flat Blob, of which this is a slice.
+  // - kj::Array<Segment>: pieces of other Blobs.
+  // - Range: a slice of a Blob made of segments.
+  // In the first two cases the Blob is "flat" and `data` points to the contents; otherwise `data`
+  // is null.
+  kj::OneOf<kj::Array<byte>, jsg::Ref<Blob>, kj::Array<Segment>, Range> ownData;
   kj::ArrayPtr<const byte> data;
+  size_t size;
   kj::String type;
 
+  bool isFlat() const {
+    return ownData.is<kj::Array<byte>>() || ownData.is<jsg::Ref<Blob>>();
+  }
+
+  // Calls `func(Blob& owner, kj::ArrayPtr<const byte> piece)` for each contiguous piece of the
+  // contents from `start` to `end`, in order, where `owner` is the flat Blob holding the piece.
+  template <typename Func>
+  void forEachPiece(size_t start, size_t end, Func&& func);
+
+  // Copies the contents from `start` onwards into `out`, which must not extend past the end.
+  void copyTo(size_t start, kj::ArrayPtr<byte> out);
+
+  jsg::Ref<Blob> selfRef() { return JSG_THIS; }
+
   void visitForGc(jsg::GcVisitor& visitor) {
     KJ_IF_SOME(b, ownData.tryGet<jsg::Ref<Blob>>()) {
       visitor.visit(b);
+    } else KJ_IF_SOME(segments, ownData.tryGet<kj::Array<Segment>>()) {
+      for (auto& segment: segments) {
+        visitor.visit(segment.blob);
+      }
+    } else KJ_IF_SOME(range, ownData.tryGet<Range>()) {
+      visitor.visit(range.blob);
     }
   }
 
@@ -92,6 +160,13 @@ public:
   File(kj::Array<byte> data, kj::String name, kj::String type, double lastModified)
       : Blob(kj::mv(data), kj::mv(type)),
         name(kj::mv(name)), lastModified(lastModified) {}
+  File(jsg::Ref<Blob> parent, kj::ArrayPtr<const byte> data,
+       kj::String name, kj::String type, double lastModified)
+      : Blob(kj::mv(parent), data, kj::mv(type)),
+        name(kj::mv(name)), lastModified(lastModified) {}
+  File(kj::Array<Segment> segments, kj::String name, kj::String type, double lastModified)
+      : Blob(kj::mv(segments), kj::mv(type)),
+        name(kj::mv(name)), lastModified(lastModified) {}
 
   struct Options {
     jsg::Optional<kj::String> type;
@@ -5,6 +5,7 @@
 #include "encoding.h"
 #include <workerd/jsg/jsg.h>
 #include <workerd/jsg/buffersource.h>
+#include <workerd/util/utf8.h>
 #include <unicode/ucnv.h>
 #include <unicode/utf8.h>
 #include <algorithm>
@@ -317,8 +318,6 @@ kj::Maybe<jsg::JsString> IcuDecoder::decode(
     KJ_UNREACHABLE;
   };
 
-  const auto isUsAscii = [](const auto& b) { return b <= 0x7f; };
-
   KJ_DEFER({ if (flush) reset(); });
 
   // Evaluate fast-path options. These provide shortcuts for common cases with the caveat
@@ -326,18 +325,33 @@ kj::Maybe<jsg::JsString> IcuDecoder::decode(
   // conversions are being handled by v8 directly rather than by the ICU converter).
   if (buffer.size() > 0 && ucnv_toUCountPending(inner.get(), &status) == 0) {
     KJ_ASSERT(U_SUCCESS(status));
-    if (encoding == Encoding::Utf8 && std::all_of(buffer.begin(), buffer.end(), isUsAscii)) {
+    if (encoding == Encoding::Utf8 && isAscii(buffer)) {
       // This is a fast-path option for UTF-8 that can be taken when there
       // are no buffered inputs and the non-empty input buffer contains only
       // codepoints <= 0x7f. This path is safe because with ASCII range codepoints
-      // we know we won't accidentally split a multi-byte encoding. We also don't
-      // have to worry about the BOM here since the BOM bytes are > 0x7f.
+      // we know we won't accidentally split a multi-byte encoding. The input
+      // can't start with a BOM either, since the BOM bytes are > 0x7f, but any
+      // BOM in a later chunk is now past the start of the stream.
       // Note also that in this case we'll interpret as Latin1 since UTF-8 bytes
       // within this range are identical to Latin1 and v8 allocates these more
       // efficiently.
+      bomSeen = true;
       return js.str(buffer);
     }
 
+    if (encoding == Encoding::Utf8 && isValidUtf8(buffer)) {
+      // Likewise, input that is entirely well-formed UTF-8 (with no sequence
+      // split at the end) decodes the same whether or not the decoder is fatal,
+      // so v8 can decode it directly, once we've dealt with the BOM.
+      auto chars = buffer.asChars();
+      if (!ignoreBom && !bomSeen && buffer.size() >= 3 &&
+          buffer[0] == 0xef && buffer[1] == 0xbb && buffer[2] == 0xbf) {
+        chars = chars.slice(3, chars.size());
+      }
+      bomSeen = true;
+      return js.str(chars);
+    }
+
     if (encoding == Encoding::Utf16le && buffer.size() % sizeof(char16_t) == 0) {
       // This is a fast-path option for UTF-16le that can be taken when:
       // there are no buffered inputs, the non-empty input buffer length is an
@@ -10,7 +10,7 @@
 #include <kj/compat/http.h>
 #include <workerd/util/mimetype.h>
 #include <algorithm>
-#include <regex>
+#include <functional>
 
 #if !_MSC_VER
 #include <strings.h>
@@ -19,21 +19,48 @@
 namespace workerd::api {
 
 namespace {
-// Like split() in kj/compat/url.c++, but splits at a substring rather than a character.
-kj::ArrayPtr<const char> splitAtSubString(
-    kj::ArrayPtr<const char>& text, kj::StringPtr subString) {
-  // TODO(perf): Use a Boyer-Moore search?
-  auto iter = std::search(text.begin(), text.end(), subString.begin(), subString.end());
-  auto result = kj::arrayPtr(text.begin(), iter - text.begin());
-  text = text.slice(kj::min(text.size(), result.end() - text.begin() + subString.size()),
-                    text.size());
-  return result;
-}
+// Finds a boundary string in a multipart body. Parts can be large files, and boundaries are
+// typically dozens of characters long, so Boyer-Moore-Horspool lets us skip over most of a part
+// without looking at it.
+class SubStringSearcher {
+public:
+  SubStringSearcher(kj::ArrayPtr<const char> subString)
+      : subString(subString), searcher(subString.begin(), subString.end()) {}
+
+  // Like split() in kj/compat/url.c++, but splits at the substring rather than a character.
+  kj::ArrayPtr<const char> split(kj::ArrayPtr<const char>& text) const {
+    auto iter = std::search(text.begin(), text.end(), searcher);
+    auto result = kj::arrayPtr(text.begin(), iter - text.begin());
+    text = text.slice(kj::min(text.size(), result.end() - text.begin() + subString.size()),
+                      text.size());
+    return result;
+  }
+
+private:
+  kj::ArrayPtr<const char> subString;
+  std::boyer_moore_horspool_searcher<const char*> searcher;
+};
 
 bool startsWith(kj::ArrayPtr<const char> bytes, kj::StringPtr prefix) {
   return bytes.size() >= prefix.size() && bytes.slice(0, prefix.size()) == prefix;
 }
 
+// Returns the offset just past the first blank line in `text`, i.e. the end of the first match of
+// /\r?\n\r?\n/, if there is one.
+kj::Maybe<size_t> findBlankLineEnd(kj::ArrayPtr<const char> text) {
+  const char* pos = text.begin();
+  while (auto newline = static_cast<const char*>(memchr(pos, '\n', text.end() - pos))) {
+    auto rest = kj::arrayPtr(newline + 1, text.end());
+    if (startsWith(rest, "\n")) {
+      return rest.begin() + 1 - text.begin();
+    } else if (startsWith(rest, "\r\n")) {
+      return rest.begin() + 2 - text.begin();
+    }
+    pos = rest.begin();
+  }
+  return kj::none;
+}
+
 struct FormDataHeaderTable {
   kj::HttpHeaderId contentDispositionId;
   kj::Own<kj::HttpHeaderTable> table;
@@ -66,16 +93,20 @@ constexpr auto contentDisposition =
     p::sequence(p::discardWhitespace, httpIdentifier,
                 p::discardWhitespace, p::many(contentDispositionParam));
 
+// Parses a multipart/form-data `body`. If `bodyBlob` is given, it holds the body, and files refer
+// to their contents in it rather than copying them.
 void parseFormData(kj::Vector<FormData::Entry>& data, kj::StringPtr boundary,
-                   kj::ArrayPtr<const char> body, bool convertFilesToStrings) {
+                   kj::ArrayPtr<const char> body, bool convertFilesToStrings,
+                   kj::Maybe<jsg::Ref<Blob>&> bodyBlob) {
   // multipart/form-data messages are delimited by <CRLF>--<boundary>. We want to be able to handle
   // omitted carriage returns, though, so our delimiter only matches against a preceding line feed.
   const auto delimiter = kj::str("\n--", boundary);
+  SubStringSearcher delimiterSearcher(delimiter.asArray());
 
   // We want to slice off the delimiter's preceding newline for the initial search, because the very
   // first instance does not require one. In every subsequent multipart message, the preceding
   // newline is required.
-  auto message = splitAtSubString(body, delimiter.slice(1));
+  auto message = SubStringSearcher(delimiter.slice(1).asArray()).split(body);
 
   JSG_REQUIRE(body.size() > 0, TypeError,
       "No initial boundary string (or you have a truncated message).");
@@ -96,22 +127,15 @@ void parseFormData(kj::Vector<FormData::Entry>& data, kj::StringPtr boundary,
     return false;
   };
 
-  constexpr auto staticRegexFlags = std::regex_constants::ECMAScript
-                                  | std::regex_constants::optimize;
-
-  static const auto headerTerminationRegex = std::regex("\r?\n\r?\n", staticRegexFlags);
-
-  std::cmatch match;
-
   auto& formDataHeaderTable = getFormDataHeaderTable();
 
   while (!done(body)) {
-    JSG_REQUIRE(std::regex_search(body.begin(), body.end(), match, headerTerminationRegex),
-                 TypeError, "No multipart message header termination found.");
+    auto headersEnd = JSG_REQUIRE_NONNULL(findBlankLineEnd(body),
+        TypeError, "No multipart message header termination found.");
 
     // TODO(cleanup): Use kj-http to parse multipart headers. Right now that API isn't public, so
-    //   I'm just using a regex. For reference, multipart/form-data supports the following three
-    //   headers (https://tools.ietf.org/html/rfc7578#section-4.8):
+    //   I'm just looking for the blank line that ends them. For reference, multipart/form-data
+    //   supports the following three headers (https://tools.ietf.org/html/rfc7578#section-4.8):
     //
     //   Content-Disposition        (required)
     //   Content-Type               (optional, recommended for files)
@@ -119,8 +143,8 @@ void parseFormData(kj::Vector<FormData::Entry>& data, kj::StringPtr boundary,
     //
     // TODO(soon): Read the Content-Type to support files.
 
-    auto headersText = kj::str(body.slice(0, match[0].second - body.begin()));
-    body = body.slice(match[0].second - body.begin(), body.size());
+    auto headersText = kj::str(body.slice(0, headersEnd));
+    body = body.slice(headersEnd, body.size());
 
     kj::HttpHeaders headers(*formDataHeaderTable.table);
     JSG_REQUIRE(headers.tryParse(headersText), TypeError, "FormData part had invalid headers.");
@@ -153,7 +177,7 @@ void parseFormData(kj::Vector<FormData::Entry>& data, kj::StringPtr boundary,
 
     kj::Maybe<kj::StringPtr> type = headers.get(kj::HttpHeaderId::CONTENT_TYPE);
 
-    message = splitAtSubString(body, delimiter);
+    message = delimiterSearcher.split(body);
     JSG_REQUIRE(body.size() > 0, TypeError,
         "No subsequent boundary string after multipart message.");
 
@@ -164,6 +188,12 @@ void parseFormData(kj::Vector<FormData::Entry>& data, kj::StringPtr boundary,
 
     if (filename == kj::none || convertFilesToStrings) {
       data.add(FormData::Entry { kj::mv(name), kj::str(message) });
+    } else KJ_IF_SOME(blob, bodyBlob) {
+      data.add(FormData::Entry {
+        kj::mv(name),
+        jsg::alloc<File>(blob.addRef(), message.asBytes(), KJ_ASSERT_NONNULL(kj::mv(filename)),
+                          kj::str(type.orDefault(nullptr)), dateNow())
+      });
     } else {
       data.add(FormData::Entry {
         kj::mv(name),
@@ -299,6 +329,18 @@ FormData::EntryType FormData::clone(FormData::EntryType& value) {
 
 void FormData::parse(kj::ArrayPtr<const char> rawText, kj::StringPtr contentType,
                      bool convertFilesToStrings) {
+  parseImpl(rawText, contentType, convertFilesToStrings, kj::none);
+}
+
+void FormData::parse(kj::Array<kj::byte> rawBytes, kj::StringPtr contentType,
+                     bool convertFilesToStrings) {
+  auto rawText = rawBytes.asChars();
+  auto bodyBlob = jsg::alloc<Blob>(kj::mv(rawBytes), kj::String());
+  parseImpl(rawText, contentType, convertFilesToStrings, bodyBlob);
+}
+
+void FormData::parseImpl(kj::ArrayPtr<const char> rawText, kj::StringPtr contentType,
+                         bool convertFilesToStrings, kj::Maybe<jsg::Ref<Blob>&> bodyBlob) {
   KJ_IF_SOME(parsed, MimeType::tryParse(contentType)) {
     auto& params = parsed.params();
     if (MimeType::FORM_DATA == parsed) {
@@ -306,7 +348,7 @@ void FormData::parse(kj::ArrayPtr<const char> rawText, kj::StringPtr contentType
           "No boundary string in Content-Type header. The multipart/form-data MIME "
           "type requires a boundary parameter, e.g. 'Content-Type: multipart/form-data; "
           "boundary=\"abcd\"'. See RFC 7578, section 4.");
-      parseFormData(data, boundary, rawText, convertFilesToStrings);
+      parseFormData(data, boundary, rawText, convertFilesToStrings, bodyBlob);
       return;
     } else if (MimeType::FORM_URLENCODED == parsed) {
       // Let's read the charset so we can barf if the body isn't UTF-8.
@@ -52,6 +52,11 @@ public:
   void parse(kj::ArrayPtr<const char> rawText, kj::StringPtr contentType,
              bool convertFilesToStrings);
 
+  // Like the above, but takes ownership of the body, so that files parsed from it can refer to
+  // their contents in place rather than each holding a copy.
+  void parse(kj::Array<kj::byte> rawBytes, kj::StringPtr contentType,
+             bool convertFilesToStrings);
+
   struct Entry {
     kj::String name;
     kj::OneOf<jsg::Ref<File>, kj::String> value;
@@ -165,6 +170,9 @@ public:
 private:
   kj::Vector<Entry> data;
 
+  void parseImpl(kj::ArrayPtr<const char> rawText, kj::StringPtr contentType,
+                 bool convertFilesToStrings, kj::Maybe<jsg::Ref<Blob>&> bodyBlob);
+
   static EntryType clone(EntryType& value);
 
   template <typename Type>
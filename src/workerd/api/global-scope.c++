@@ -16,6 +16,7 @@
 #include <workerd/jsg/util.h>
 #include <workerd/io/io-context.h>
 #include <workerd/io/features.h>
+#include <workerd/util/base64.h>
 #include <workerd/util/sentry.h>
 #include <workerd/util/thread-scopes.h>
 #include <workerd/api/hibernatable-web-socket.h>
@@ -603,7 +604,7 @@ void ServiceWorkerGlobalScope::emitPromiseRejection(
   }
 }
 
-kj::String ServiceWorkerGlobalScope::btoa(jsg::Lock& js, jsg::JsValue data) {
+jsg::JsString ServiceWorkerGlobalScope::btoa(jsg::Lock& js, jsg::JsValue data) {
   auto str = data.toJsString(js);
 
   // We could implement btoa() by accepting a kj::String, but then we'd have to check that it
@@ -617,20 +618,32 @@ kj::String ServiceWorkerGlobalScope::btoa(jsg::Lock& js, jsg::JsValue data) {
   //   negatives. Conceivably we could take advantage of this fact to completely avoid the later
   //   WriteOneByte() call in some cases!
 
-  return kj::encodeBase64(str.toArray<kj::byte>(js));
+  auto bytes = str.toArray<kj::byte>(js);
+  auto text = kj::heapArray<kj::byte>(base64EncodedSize(bytes.size()));
+  encodeBase64Into(bytes, text);
+
+  // The encoded text is all ASCII, so we return it as a one-byte string rather than as a
+  // kj::String, which v8 would have to decode as UTF-8.
+  return js.str(text);
 }
 jsg::JsString ServiceWorkerGlobalScope::atob(jsg::Lock& js, kj::String data) {
-  auto decoded = kj::decodeBase64(data.asArray());
-
-  JSG_REQUIRE(!decoded.hadErrors, DOMInvalidCharacterError,
+  // Most input is unbroken base64, which decodeBase64Prefix() takes in bulk, leaving
+  // kj::decodeBase64() to deal with whatever follows, like padding or whitespace. Groups of four
+  // characters decode independently, so this is the same as decoding all of it with kj.
+  auto decoded = kj::heapArray<kj::byte>(data.size() / 4 * 3 + 2);
+  auto prefix = decodeBase64Prefix(data.asBytes(), decoded);
+  auto rest = kj::decodeBase64(data.asArray().slice(prefix.consumed, data.size()));
+
+  JSG_REQUIRE(!rest.hadErrors, DOMInvalidCharacterError,
       "atob() called with invalid base64-encoded data. (Only whitespace, '+', '/', alphanumeric "
       "ASCII, and up to two terminal '=' signs when the input data length is divisible by 4 are "
       "allowed.)");
 
   // Similar to btoa() taking a v8::Value, we return a v8::String directly, as this allows us to
-  // construct a string from the non-nul-terminated array returned from decodeBase64(). This avoids
-  // making a copy purely to append a nul byte.
-  return js.str(decoded.asBytes());
+  // construct a string from the non-nul-terminated array we decoded into. This avoids making a
+  // copy purely to append a nul byte.
+  memcpy(decoded.begin() + prefix.written, rest.begin(), rest.size());
+  return js.str(decoded.first(prefix.written + rest.size()));
 }
 
 void ServiceWorkerGlobalScope::queueMicrotask(
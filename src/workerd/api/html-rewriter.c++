@@ -8,6 +8,8 @@
 #include "c-api/include/lol_html.h"
 #include <workerd/io/features.h>
 #include <workerd/io/io-context.h>
+#include <workerd/util/utf8.h>
+#include <kj/arena.h>
 
 struct lol_html_HtmlRewriter {};
 struct lol_html_HtmlRewriterBuilder {};
@@ -83,6 +85,15 @@ private:
   kj::ArrayPtr<const char> chars;
 };
 
+// Creates a JS string straight from UTF-8 text lol-html hands us, rather than copying it into a
+// kj::String first. Markup is mostly ASCII, which V8 can take as one-byte without decoding it.
+jsg::JsString toJsString(jsg::Lock& js, kj::ArrayPtr<const char> text) {
+  if (isAscii(text.asBytes())) {
+    return js.str(text.asBytes());
+  }
+  return js.str(text);
+}
+
 // =======================================================================================
 // Error checking for lol-html
 
@@ -266,19 +277,19 @@ private:
     // A back-reference to the rewriter which owns this particular registered handler.
     Rewriter& rewriter;
 
-    ElementCallbackFunction callback;
+    // Null once an end tag handler has run, leaving it free for onEndTag() to reuse.
+    kj::Maybe<ElementCallbackFunction> callback;
   };
 
-  kj::Vector<kj::Own<RegisteredHandler>> registeredHandlers;
-  // TODO(perf): Don't store Owns. We need to pass stable pointers as the userdata parameter to
-  //   lol_html_rewriter_builder_add_*_content_handlers(), but don't have a really easy way to
-  //   know precisely how many handlers we're going to register beforehand, so we need a vector. But
-  //   vectors can grow, moving their objects around, invalidating pointers into their storage.
+  // Storage for every RegisteredHandler. We need to pass stable pointers as the userdata parameter
+  // to lol_html_rewriter_builder_add_*_content_handlers() and
+  // lol_html_element_add_end_tag_handler(); allocating them all from one arena gives us that
+  // without a heap allocation per handler. They live until the Rewriter is destroyed.
+  kj::Arena handlerArena;
 
-  // This is separate from `registeredHandlers` so we can delete them more eagerly when EndTags are
-  // destroyed, and not have to look through all other handlers.
-  kj::Vector<kj::Own<RegisteredHandler>> registeredEndTagHandlers;
-  // TODO(perf) Don't store Owns, same as `registeredHandlers` above.
+  // End tag handlers which have already run, so that onEndTag() can reuse them instead of growing
+  // `handlerArena` for every element in the document.
+  kj::Vector<RegisteredHandler*> freeEndTagHandlers;
 
   template <typename T, typename CType = typename T::CType>
   static lol_html_rewriter_directive_t thunk(CType* content, void* userdata);
@@ -287,12 +298,12 @@ private:
   template <typename T, typename CType = typename T::CType>
   kj::Promise<void> thunkPromise( CType* content, RegisteredHandler& registration);
 
-  // Eagerly free this handler. Should only be called if we're confident the handler will never be
-  // used again.
+  // Eagerly release this handler's callback and make it available for reuse. Should only be called
+  // if we're confident the handler will never be used again.
   void removeEndTagHandler(RegisteredHandler& registration);
 
-  // Must be constructed AFTER the registered handler vector, since the function which constructs
-  // this (buildRewriter()) modifies that vector.
+  // Must be constructed AFTER `handlerArena`, since the function which constructs this
+  // (buildRewriter()) allocates from it, and destroyed before it, since it points into it.
   kj::Own<lol_html_HtmlRewriter> rewriter;
 
   kj::Own<WritableStreamSink> inner;
@@ -331,8 +342,8 @@ kj::Own<lol_html_HtmlRewriter> Rewriter::buildRewriter(
   auto builder = LOL_HTML_OWN(rewriter_builder, lol_html_rewriter_builder_new());
 
   auto registerCallback = [&](ElementCallbackFunction& callback) {
-        auto registeredHandler = RegisteredHandler{rewriter, callback.addRef(js) };
-        return rewriter.registeredHandlers.add(kj::heap(kj::mv(registeredHandler))).get();
+    return &rewriter.handlerArena.allocate<RegisteredHandler>(
+        RegisteredHandler { rewriter, callback.addRef(js) });
   };
 
   for (auto& handlers: unregisteredHandlers) {
@@ -547,18 +558,8 @@ lol_html_rewriter_directive_t Rewriter::thunkImpl(
 }
 
 void Rewriter::removeEndTagHandler(RegisteredHandler& handler) {
-  auto size = registeredEndTagHandlers.size();
-  for (auto counter = size; counter != 0; --counter) {
-    auto idx = counter - 1;
-    if (registeredEndTagHandlers[idx].get() == &handler) {
-      // equivalent of `Vec::swap_remove` in Rust
-      if (counter != size) {
-        registeredEndTagHandlers[idx] = kj::mv(registeredEndTagHandlers[size - 1]);
-      }
-      registeredEndTagHandlers.removeLast();
-      break;
-    }
-  }
+  handler.callback = kj::none;
+  freeEndTagHandlers.add(&handler);
 }
 
 template <typename T, typename CType>
@@ -572,13 +573,13 @@ kj::Promise<void> Rewriter::thunkPromise( CType* content, RegisteredHandler& reg
     jsg::AsyncContextFrame::Scope asyncContextScope(lock, maybeAsyncContext);
     auto jsContent = jsg::alloc<T>(*content, *this);
     auto scope = HTMLRewriter::TokenScope(jsContent);
-    auto value = registeredHandler.callback(lock, kj::mv(jsContent));
+    auto value = KJ_ASSERT_NONNULL(registeredHandler.callback)(lock, kj::mv(jsContent));
 
     if constexpr (kj::isSameType<T, EndTag>()) {
-      // TODO(someday): We can't unconditionally pop the top of `registeredEndTagHandlers`,
+      // TODO(someday): We can't release end tag handlers as soon as their element is done,
       //   because that depends on https://github.com/cloudflare/lol-html/issues/110
       //   being resolved. For now we let handles to end tag handlers tags live for the duration of
-      //   the response transformation, but eagerly release ones that we can.
+      //   the response transformation, but eagerly release and reuse ones that we can.
       //   In particular, note that `thunkPromise` is never called for implied end tags.
       removeEndTagHandler(registeredHandler);
     }
@@ -588,8 +589,7 @@ kj::Promise<void> Rewriter::thunkPromise( CType* content, RegisteredHandler& reg
 }
 
 void Rewriter::onEndTag(lol_html_element_t *element, ElementCallbackFunction&& callback) {
-  auto registeredHandler = Rewriter::RegisteredHandler { *this, kj::mv(callback) };
-  // NOTE: this gets freed in `thunkPromise` above.
+  // NOTE: this gets released in `thunkPromise` above.
   // TODO(someday): this uses more memory than necessary for implied end tags, which lol-html
   // doesn't actually call `thunk` on.  LOL HTML drops the handler after it finishes transforming
   // the current element, but this code will keep it around until the entire HTML document is
@@ -598,9 +598,17 @@ void Rewriter::onEndTag(lol_html_element_t *element, ElementCallbackFunction&& c
   // this probably needs to happen in lol-html; see #110.
   // WARNING: if we ever start reusing the same Rewriter for multiple documents,
   // this will cause a memory leak!
-  auto& registeredHandlerPtr = registeredEndTagHandlers.add(kj::heap(kj::mv(registeredHandler)));
+  RegisteredHandler* registeredHandler;
+  if (freeEndTagHandlers.empty()) {
+    registeredHandler = &handlerArena.allocate<RegisteredHandler>(
+        RegisteredHandler { *this, kj::mv(callback) });
+  } else {
+    registeredHandler = freeEndTagHandlers.back();
+    freeEndTagHandlers.removeLast();
+    registeredHandler->callback = kj::mv(callback);
+  }
   lol_html_element_clear_end_tag_handlers(element);
-  check(lol_html_element_add_end_tag_handler(element, Rewriter::thunk<EndTag>, registeredHandlerPtr.get()));
+  check(lol_html_element_add_end_tag_handler(element, Rewriter::thunk<EndTag>, registeredHandler));
 }
 
 void Rewriter::output(const char* buffer, size_t size, void* userdata) {
@@ -660,15 +668,13 @@ jsg::Ref<Element::AttributesIterator> Element::getAttributes() {
   return kj::mv(jsIter);
 }
 
-kj::Maybe<kj::String> Element::getAttribute(kj::String name) {
+kj::Maybe<jsg::JsString> Element::getAttribute(jsg::Lock& js, kj::String name) {
   // NOTE: lol_html_element_get_attribute() returns NULL for both nonexistent attributes and for
   //   errors, so we can't use check() here.
   LolString attr(lol_html_element_get_attribute(
       &checkToken(impl).element, name.cStr(), name.size()));
-    // TODO(perf): We could construct a v8::String directly here, saving a copy.
-  kj::Maybe kjAttr = attr.asKjString();
-  if (kjAttr != kj::none) {
-    return kj::mv(kjAttr);
+  if (attr.asChars().begin() != nullptr) {
+    return toJsString(js, attr.asChars());
   }
 
   KJ_IF_SOME(exception, tryGetLastError()) {
@@ -830,9 +836,9 @@ void Element::AttributesIterator::htmlContentScopeEnd() {
 
 Comment::Comment(CType& comment, Rewriter&): impl(comment) {}
 
-kj::String Comment::getText() {
+jsg::JsString Comment::getText(jsg::Lock& js) {
   auto text = LolString(lol_html_comment_text_get(&checkToken(impl)));
-  return kj::str(text.asChars());
+  return toJsString(js, text.asChars());
 }
 
 void Comment::setText(kj::String text) {
@@ -889,9 +895,9 @@ void Comment::htmlContentScopeEnd() {
 
 Text::Text(CType& text, Rewriter&): impl(text) {}
 
-kj::String Text::getText() {
+jsg::JsString Text::getText(jsg::Lock& js) {
   auto content = lol_html_text_chunk_content_get(&checkToken(impl));
-  return kj::heapString(content.data, content.len);
+  return toJsString(js, kj::arrayPtr(content.data, content.len));
 }
 
 bool Text::getLastInTextNode() {
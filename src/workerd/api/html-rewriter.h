@@ -172,7 +172,7 @@ public:
 
   kj::StringPtr getNamespaceURI();
 
-  kj::Maybe<kj::String> getAttribute(kj::String name);
+  kj::Maybe<jsg::JsString> getAttribute(jsg::Lock& js, kj::String name);
   bool hasAttribute(kj::String name);
   jsg::Ref<Element> setAttribute(kj::String name, kj::String value);
   jsg::Ref<Element> removeAttribute(kj::String name);
@@ -313,7 +313,7 @@ public:
 
   explicit Comment(CType& comment, Rewriter&);
 
-  kj::String getText();
+  jsg::JsString getText(jsg::Lock& js);
   void setText(kj::String);
 
   bool getRemoved();
@@ -353,7 +353,7 @@ public:
 
   explicit Text(CType& text, Rewriter&);
 
-  kj::String getText();
+  jsg::JsString getText(jsg::Lock& js);
 
   bool getLastInTextNode();
 
@@ -205,3 +205,40 @@ export const inspect = {
     await messagePromise;
   }
 };
+
+export const headersCopyOnWrite = {
+  async test(ctrl, env, ctx) {
+    // Clones share their headers until one of them changes them.
+    const original = new Request("http://placeholder", {
+      headers: { "X-Foo": "1", "Set-Cookie": "a=1" },
+    });
+    const clone = new Request(original);
+    clone.headers.set("X-Foo", "2");
+    clone.headers.append("Set-Cookie", "b=2");
+    assert.strictEqual(original.headers.get("X-Foo"), "1");
+    assert.deepStrictEqual(original.headers.getSetCookie(), ["a=1"]);
+    assert.strictEqual(clone.headers.get("X-Foo"), "2");
+    assert.deepStrictEqual(clone.headers.getSetCookie(), ["a=1", "b=2"]);
+
+    // Iterators see the headers as they were when the iterator was created.
+    const headers = new Headers(clone.headers);
+    const entries = headers.entries();
+    headers.delete("X-Foo");
+    headers.set("X-Bar", "3");
+    assert.deepStrictEqual([...entries], [
+      ["set-cookie", "a=1"],
+      ["set-cookie", "b=2"],
+      ["x-foo", "2"],
+    ]);
+    assert.deepStrictEqual([...headers.keys()], ["set-cookie", "set-cookie", "x-bar"]);
+
+    // So does forEach(), even if the callback changes them.
+    const seen = [];
+    headers.forEach((value, key) => {
+      seen.push(key);
+      headers.delete(key);
+    });
+    assert.deepStrictEqual(seen, ["set-cookie", "set-cookie", "x-bar"]);
+    assert.deepStrictEqual([...headers], []);
+  }
+};
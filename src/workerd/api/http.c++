@@ -121,17 +121,8 @@ Headers::Headers(jsg::Dict<jsg::ByteString, jsg::ByteString> dict)
 }
 
 Headers::Headers(const Headers& other)
-    : guard(Guard::NONE) {
-  for (auto& header: other.headers) {
-    Header copy {
-      jsg::ByteString(kj::str(header.second.key)),
-      jsg::ByteString(kj::str(header.second.name)),
-      KJ_MAP(value, header.second.values) { return jsg::ByteString(kj::str(value)); },
-    };
-    kj::StringPtr keyRef = copy.key;
-    KJ_ASSERT(headers.insert(std::make_pair(keyRef, kj::mv(copy))).second);
-  }
-}
+    : guard(Guard::NONE),
+      headers(kj::addRef(*other.headers)) {}
 
 Headers::Headers(const kj::HttpHeaders& other, Guard guard)
     : guard(Guard::NONE) {
@@ -148,10 +139,32 @@ jsg::Ref<Headers> Headers::clone() const {
   return kj::mv(result);
 }
 
+kj::Own<Headers::HeaderMap> Headers::HeaderMap::clone() const {
+  auto result = kj::refcounted<HeaderMap>();
+  for (auto& header: entries) {
+    Header copy {
+      jsg::ByteString(kj::str(header.second.key)),
+      jsg::ByteString(kj::str(header.second.name)),
+      KJ_MAP(value, header.second.values) { return jsg::ByteString(kj::str(value)); },
+    };
+    kj::StringPtr keyRef = copy.key;
+    KJ_ASSERT(result->entries.insert(std::make_pair(keyRef, kj::mv(copy))).second);
+  }
+  return result;
+}
+
+std::map<kj::StringPtr, Headers::Header>& Headers::getMutableHeaders() {
+  if (headers->isShared()) {
+    // A clone or an iterator is still looking at this map, so leave it to them.
+    headers = headers->clone();
+  }
+  return headers->entries;
+}
+
 // Fill in the given HttpHeaders with these headers. Note that strings are inserted by
 // reference, so the output must be consumed immediately.
 void Headers::shallowCopyTo(kj::HttpHeaders& out) {
-  for (auto& entry: headers) {
+  for (auto& entry: headers->entries) {
     for (auto& value: entry.second.values) {
       out.add(entry.second.name, value);
     }
@@ -164,13 +177,13 @@ bool Headers::hasLowerCase(kj::StringPtr name) {
     KJ_DREQUIRE(!('A' <= c && c <= 'Z'));
   }
 #endif
-  return headers.find(name) != headers.end();
+  return headers->entries.find(name) != headers->entries.end();
 }
 
 kj::Array<Headers::DisplayedHeader> Headers::getDisplayedHeaders(jsg::Lock& js) {
   if (FeatureFlags::get(js).getHttpHeadersGetSetCookie()) {
     kj::Vector<Headers::DisplayedHeader> copy;
-    for (auto& entry : headers) {
+    for (auto& entry : headers->entries) {
       if (entry.first == "set-cookie") {
         // For set-cookie entries, we iterate each individually without
         // combining them.
@@ -190,7 +203,7 @@ kj::Array<Headers::DisplayedHeader> Headers::getDisplayedHeaders(jsg::Lock& js)
     return copy.releaseAsArray();
   } else {
     // The old behavior before the standard getSetCookie() API was introduced...
-    auto headersCopy = KJ_MAP(mapEntry, headers) {
+    auto headersCopy = KJ_MAP(mapEntry, headers->entries) {
       const auto& header = mapEntry.second;
       return DisplayedHeader {
         jsg::ByteString(kj::str(header.key)),
@@ -248,8 +261,8 @@ jsg::Ref<Headers> Headers::constructor(jsg::Lock& js, jsg::Optional<Initializer>
 
 kj::Maybe<jsg::ByteString> Headers::get(jsg::ByteString name) {
   requireValidHeaderName(name);
-  auto iter = headers.find(toLower(kj::mv(name)));
-  if (iter == headers.end()) {
+  auto iter = headers->entries.find(toLower(kj::mv(name)));
+  if (iter == headers->entries.end()) {
     return kj::none;
   } else {
     return jsg::ByteString(kj::strArray(iter->second.values, ", "));
@@ -257,8 +270,8 @@ kj::Maybe<jsg::ByteString> Headers::get(jsg::ByteString name) {
 }
 
 kj::ArrayPtr<jsg::ByteString> Headers::getSetCookie() {
-  auto iter = headers.find("set-cookie");
-  if (iter == headers.end()) {
+  auto iter = headers->entries.find("set-cookie");
+  if (iter == headers->entries.end()) {
     return nullptr;
   } else {
     return iter->second.values.asPtr();
@@ -280,7 +293,7 @@ kj::ArrayPtr<jsg::ByteString> Headers::getAll(jsg::ByteString name) {
 
 bool Headers::has(jsg::ByteString name) {
   requireValidHeaderName(name);
-  return headers.find(toLower(kj::mv(name))) != headers.end();
+  return headers->entries.find(toLower(kj::mv(name))) != headers->entries.end();
 }
 
 void Headers::set(jsg::ByteString name, jsg::ByteString value) {
@@ -293,7 +306,8 @@ void Headers::setUnguarded(jsg::ByteString name, jsg::ByteString value) {
   auto key = toLower(name);
   value = normalizeHeaderValue(kj::mv(value));
   requireValidHeaderValue(value);
-  auto [iter, emplaced] = headers.try_emplace(key, kj::mv(key), kj::mv(name), kj::mv(value));
+  auto [iter, emplaced] =
+      getMutableHeaders().try_emplace(key, kj::mv(key), kj::mv(name), kj::mv(value));
   if (!emplaced) {
     // Overwrite existing value(s).
     iter->second.values.clear();
@@ -307,7 +321,8 @@ void Headers::append(jsg::ByteString name, jsg::ByteString value) {
   auto key = toLower(name);
   value = normalizeHeaderValue(kj::mv(value));
   requireValidHeaderValue(value);
-  auto [iter, emplaced] = headers.try_emplace(key, kj::mv(key), kj::mv(name), kj::mv(value));
+  auto [iter, emplaced] =
+      getMutableHeaders().try_emplace(key, kj::mv(key), kj::mv(name), kj::mv(value));
   if (!emplaced) {
     iter->second.values.add(kj::mv(value));
   }
@@ -316,83 +331,78 @@ void Headers::append(jsg::ByteString name, jsg::ByteString value) {
 void Headers::delete_(jsg::ByteString name) {
   checkGuard();
   requireValidHeaderName(name);
-  headers.erase(toLower(kj::mv(name)));
+  getMutableHeaders().erase(toLower(kj::mv(name)));
 }
 
-// There are a couple implementation details of the Headers iterators worth calling out.
-//
-// 1. Each iterator gets its own copy of the keys and/or values of the headers. While nauseating
-//    from a performance perspective, this solves both the iterator -> iterable lifetime dependence
-//    and the iterator invalidation issue: i.e., it's impossible for a user to unsafely modify the
-//    Headers data structure while iterating over it, because they are simply two separate data
-//    structures. By empirical testing, this seems to be how Chrome implements Headers iteration.
+// Headers iterators share the header map with the Headers object they came from, which copies it
+// before making any change while it's shared. So an iterator walks a snapshot that can neither be
+// modified under it nor freed before it, without anything being copied up front. By empirical
+// testing, iterating over a snapshot seems to be how Chrome implements Headers iteration too.
 //
-//    Other alternatives bring their own pitfalls. We could store a Ref of the parent Headers
-//    object, solving the lifetime issue. To solve the iterator invalidation issue, we could store a
-//    copy of the currently-iterated-over key and use std::upper_bound() to find the next entry
-//    every time we want to increment the iterator (making the increment operation O(lg n) rather
-//    than O(1)); or we could make each Header entry in the map store a set of back-pointers to all
-//    live iterators pointing to it, with delete_() incrementing all iterators in the set whenever
-//    it deletes a header entry. Neither hack appealed to me.
-//
-// 2. Notice that the next() member function of the iterator classes moves the string(s) they
-//    contain, rather than making a copy of them as in the FormData iterators. This is safe to do
-//    because, unlike FormData, these iterators have their own copies of the strings, and since they
-//    are forward-only iterators, we know we won't need the strings again.
-//
-// TODO(perf): On point 1, perhaps we could avoid most copies by using a copy-on-write strategy
-//   applied to the header map elements? We'd still copy the whole data structure to avoid iterator
-//   invalidation, but the elements would be cheaper to copy.
+// Only the strings actually returned are copied, as each is reached.
 
-jsg::Ref<Headers::EntryIterator> Headers::entries(jsg::Lock& js) {
-  return jsg::alloc<EntryIterator>(IteratorState<DisplayedHeader> {
-    getDisplayedHeaders(js)
+kj::Maybe<Headers::IteratedHeader> Headers::iteratorNext(IteratorState& state) {
+  if (state.cursor == state.headers->entries.end()) {
+    return kj::none;
+  }
+
+  auto& header = state.cursor->second;
+  if (state.splitSetCookie && state.cursor->first == "set-cookie") {
+    // Set-Cookie headers must be handled specially. They should never be combined into a single
+    // value, so each value is seen separately, along with its own copy of the key.
+    auto& value = header.values[state.valueIndex++];
+    if (state.valueIndex == header.values.size()) {
+      ++state.cursor;
+      state.valueIndex = 0;
+    }
+    return IteratedHeader { header, value };
+  }
+
+  ++state.cursor;
+  return IteratedHeader { header, kj::none };
+}
+
+jsg::ByteString Headers::IteratedHeader::getKey() const {
+  return jsg::ByteString(kj::str(header.key));
+}
+
+jsg::ByteString Headers::IteratedHeader::getValue() const {
+  KJ_IF_SOME(v, value) {
+    return jsg::ByteString(kj::str(v));
+  }
+  return jsg::ByteString(kj::strArray(header.values, ", "));
+}
+
+kj::Maybe<kj::Array<jsg::ByteString>> Headers::entryIteratorNext(
+    jsg::Lock& js, IteratorState& state) {
+  return iteratorNext(state).map([](const IteratedHeader& entry) {
+    return kj::arr(entry.getKey(), entry.getValue());
+  });
+}
+
+kj::Maybe<jsg::ByteString> Headers::keyIteratorNext(jsg::Lock& js, IteratorState& state) {
+  return iteratorNext(state).map([](const IteratedHeader& entry) {
+    return entry.getKey();
+  });
+}
+
+kj::Maybe<jsg::ByteString> Headers::valueIteratorNext(jsg::Lock& js, IteratorState& state) {
+  return iteratorNext(state).map([](const IteratedHeader& entry) {
+    return entry.getValue();
   });
 }
+
+jsg::Ref<Headers::EntryIterator> Headers::entries(jsg::Lock& js) {
+  return jsg::alloc<EntryIterator>(IteratorState(
+      kj::addRef(*headers), FeatureFlags::get(js).getHttpHeadersGetSetCookie()));
+}
 jsg::Ref<Headers::KeyIterator> Headers::keys(jsg::Lock& js) {
-  if (FeatureFlags::get(js).getHttpHeadersGetSetCookie()) {
-    kj::Vector<jsg::ByteString> keysCopy;
-    for (auto& entry : headers) {
-      // Set-Cookie headers must be handled specially. They should never be combined into a
-      // single value, so the values iterator must separate them. It seems a bit silly, but
-      // the keys iterator can end up having multiple set-cookie instances.
-      if (entry.first == "set-cookie") {
-        for (auto n = 0; n < entry.second.values.size(); n++) {
-          keysCopy.add(jsg::ByteString(kj::str(entry.first)));
-        }
-      } else {
-        keysCopy.add(jsg::ByteString(kj::str(entry.first)));
-      }
-    }
-    return jsg::alloc<KeyIterator>(IteratorState<jsg::ByteString> { keysCopy.releaseAsArray() });
-  } else {
-    auto keysCopy = KJ_MAP(mapEntry, headers) {
-      return jsg::ByteString(kj::str(mapEntry.second.key));
-    };
-    return jsg::alloc<KeyIterator>(IteratorState<jsg::ByteString> { kj::mv(keysCopy) });
-  }
+  return jsg::alloc<KeyIterator>(IteratorState(
+      kj::addRef(*headers), FeatureFlags::get(js).getHttpHeadersGetSetCookie()));
 }
 jsg::Ref<Headers::ValueIterator> Headers::values(jsg::Lock& js) {
-  if (FeatureFlags::get(js).getHttpHeadersGetSetCookie()) {
-    kj::Vector<jsg::ByteString> values;
-    for (auto& entry : headers) {
-      // Set-Cookie headers must be handled specially. They should never be combined into a
-      // single value, so the values iterator must separate them.
-      if (entry.first == "set-cookie") {
-        for (auto& value : entry.second.values) {
-          values.add(jsg::ByteString(kj::str(value)));
-        }
-      } else {
-        values.add(jsg::ByteString(kj::strArray(entry.second.values, ", ")));
-      }
-    }
-    return jsg::alloc<ValueIterator>(IteratorState<jsg::ByteString> { values.releaseAsArray() });
-  } else {
-    auto valuesCopy = KJ_MAP(mapEntry, headers) {
-      return jsg::ByteString(kj::strArray(mapEntry.second.values, ", "));
-    };
-    return jsg::alloc<ValueIterator>(IteratorState<jsg::ByteString> { kj::mv(valuesCopy) });
-  }
+  return jsg::alloc<ValueIterator>(IteratorState(
+      kj::addRef(*headers), FeatureFlags::get(js).getHttpHeadersGetSetCookie()));
 }
 
 void Headers::forEach(
@@ -408,8 +418,14 @@ void Headers::forEach(
   }
   callback.setReceiver(js.v8Ref(receiver));
 
-  for (auto& entry: getDisplayedHeaders(js)) {
-    callback(js, entry.value, entry.key, JSG_THIS);
+  // Like the iterators, walk a snapshot, so that the callback may modify the headers.
+  IteratorState state(kj::addRef(*headers), FeatureFlags::get(js).getHttpHeadersGetSetCookie());
+  for (;;) {
+    KJ_IF_SOME(entry, iteratorNext(state)) {
+      callback(js, entry.getValue(), entry.getKey(), JSG_THIS);
+    } else {
+      break;
+    }
   }
 }
 
@@ -673,11 +689,11 @@ jsg::Promise<jsg::Ref<FormData>> Body::formData(jsg::Lock& js) {
     KJ_IF_SOME(i, impl) {
       KJ_ASSERT(!i.stream->isDisturbed());
       auto& context = IoContext::current();
-      return i.stream->getController().readAllText(js,
+      return i.stream->getController().readAllBytes(js,
           context.getLimitEnforcer().getBufferingLimit()).then(js,
           [contentType = kj::mv(contentType), formData = kj::mv(formData)]
-          (auto& js, kj::String rawText) mutable {
-        formData->parse(kj::mv(rawText), contentType,
+          (auto& js, kj::Array<kj::byte> rawBytes) mutable {
+        formData->parse(kj::mv(rawBytes), contentType,
             !FeatureFlags::get(js).getFormDataParserSupportsFiles());
         return kj::mv(formData);
       });
@@ -26,10 +26,61 @@ struct QueueResponse;
 
 class Headers: public jsg::Object {
 private:
-  template <typename T>
+  struct Header {
+    jsg::ByteString key;   // lower-cased name
+    jsg::ByteString name;
+
+    // We intentionally do not comma-concatenate header values of the same name, as we need to be
+    // able to re-serialize them separately. This is particularly important for the Set-Cookie
+    // header, which uses a date format that requires a comma. This would normally suggest using a
+    // std::multimap, but we also need to be able to display the values in comma-concatenated form
+    // via Headers.entries()[1] in order to be Fetch-conformant. Storing a vector of strings in a
+    // std::map makes this easier, and also makes it easy to honor the "first header name casing is
+    // used for all duplicate header names" rule[2] that the Fetch spec mandates.
+    //
+    // See: 1: https://fetch.spec.whatwg.org/#concept-header-list-sort-and-combine
+    //      2: https://fetch.spec.whatwg.org/#concept-header-list-append
+    kj::Vector<jsg::ByteString> values;
+
+    explicit Header(jsg::ByteString key, jsg::ByteString name,
+                    kj::Vector<jsg::ByteString> values)
+        : key(kj::mv(key)), name(kj::mv(name)), values(kj::mv(values)) {}
+    explicit Header(jsg::ByteString key, jsg::ByteString name, jsg::ByteString value)
+        : key(kj::mv(key)), name(kj::mv(name)), values(1) {
+      values.add(kj::mv(value));
+    }
+
+    JSG_MEMORY_INFO(Header) {
+      tracker.trackField("key", key);
+      tracker.trackField("name", name);
+      for (const auto& value : values) {
+        tracker.trackField(nullptr, value);
+      }
+    }
+  };
+
+  // The headers, keyed by lower-cased name. This is shared between Headers objects cloned from one
+  // another, and with their iterators, and only copied when one of the sharers modifies it.
+  struct HeaderMap final: public kj::Refcounted {
+    std::map<kj::StringPtr, Header> entries;
+
+    kj::Own<HeaderMap> clone() const;
+  };
+
+  // Iterators walk a snapshot of the map, which, being shared with them, will be copied before
+  // anything modifies it.
   struct IteratorState {
-    kj::Array<T> copy;
-    decltype(copy.begin()) cursor = copy.begin();
+    kj::Own<HeaderMap> headers;
+    std::map<kj::StringPtr, Header>::const_iterator cursor;
+
+    // Under the getSetCookie() compatibility flag, each of a set-cookie header's values is iterated
+    // separately, and this is the index of the next one.
+    bool splitSetCookie;
+    size_t valueIndex = 0;
+
+    IteratorState(kj::Own<HeaderMap> headersParam, bool splitSetCookie)
+        : headers(kj::mv(headersParam)), cursor(headers->entries.begin()),
+          splitSetCookie(splitSetCookie) {}
   };
 
 public:
@@ -118,16 +169,16 @@ public:
 
   JSG_ITERATOR(EntryIterator, entries,
                 kj::Array<jsg::ByteString>,
-                IteratorState<DisplayedHeader>,
+                IteratorState,
                 entryIteratorNext)
   JSG_ITERATOR(KeyIterator, keys,
                 jsg::ByteString,
-                IteratorState<jsg::ByteString>,
-                keyOrValueIteratorNext)
+                IteratorState,
+                keyIteratorNext)
   JSG_ITERATOR(ValueIterator, values,
                 jsg::ByteString,
-                IteratorState<jsg::ByteString>,
-                keyOrValueIteratorNext)
+                IteratorState,
+                valueIteratorNext)
 
   // JavaScript API.
 
@@ -165,67 +216,40 @@ public:
   }
 
   void visitForMemoryInfo(jsg::MemoryTracker& tracker) const {
-    for (const auto& entry : headers) {
+    for (const auto& entry : headers->entries) {
       tracker.trackField(entry.first, entry.second);
     }
   }
 
 private:
-  struct Header {
-    jsg::ByteString key;   // lower-cased name
-    jsg::ByteString name;
-
-    // We intentionally do not comma-concatenate header values of the same name, as we need to be
-    // able to re-serialize them separately. This is particularly important for the Set-Cookie
-    // header, which uses a date format that requires a comma. This would normally suggest using a
-    // std::multimap, but we also need to be able to display the values in comma-concatenated form
-    // via Headers.entries()[1] in order to be Fetch-conformant. Storing a vector of strings in a
-    // std::map makes this easier, and also makes it easy to honor the "first header name casing is
-    // used for all duplicate header names" rule[2] that the Fetch spec mandates.
-    //
-    // See: 1: https://fetch.spec.whatwg.org/#concept-header-list-sort-and-combine
-    //      2: https://fetch.spec.whatwg.org/#concept-header-list-append
-    kj::Vector<jsg::ByteString> values;
-
-    explicit Header(jsg::ByteString key, jsg::ByteString name,
-                    kj::Vector<jsg::ByteString> values)
-        : key(kj::mv(key)), name(kj::mv(name)), values(kj::mv(values)) {}
-    explicit Header(jsg::ByteString key, jsg::ByteString name, jsg::ByteString value)
-        : key(kj::mv(key)), name(kj::mv(name)), values(1) {
-      values.add(kj::mv(value));
-    }
-
-    JSG_MEMORY_INFO(Header) {
-      tracker.trackField("key", key);
-      tracker.trackField("name", name);
-      for (const auto& value : values) {
-        tracker.trackField(nullptr, value);
-      }
-    }
-  };
-
   Guard guard;
-  std::map<kj::StringPtr, Header> headers;
+
+  // Mutable so that a const Headers can share it with a clone, which doesn't modify it.
+  mutable kj::Own<HeaderMap> headers = kj::refcounted<HeaderMap>();
 
   void checkGuard() {
     JSG_REQUIRE(guard == Guard::NONE, TypeError, "Can't modify immutable headers.");
   }
 
-  static kj::Maybe<kj::Array<jsg::ByteString>> entryIteratorNext(jsg::Lock& js, auto& state) {
-    if (state.cursor == state.copy.end()) {
-      return kj::none;
-    }
-    auto& ret = *state.cursor++;
-    return kj::arr(kj::mv(ret.key), kj::mv(ret.value));
-  }
+  // Returns the map for modification, first copying it if it is shared.
+  std::map<kj::StringPtr, Header>& getMutableHeaders();
 
-  static kj::Maybe<jsg::ByteString> keyOrValueIteratorNext(jsg::Lock& js, auto& state) {
-    if (state.cursor == state.copy.end()) {
-      return kj::none;
-    }
-    auto& ret = *state.cursor++;
-    return kj::mv(ret);
-  }
+  // A header as seen by the iterators: a set-cookie header whose values are iterated separately
+  // is seen once for each `value`.
+  struct IteratedHeader {
+    const Header& header;
+    kj::Maybe<const jsg::ByteString&> value;
+
+    jsg::ByteString getKey() const;
+    jsg::ByteString getValue() const;
+  };
+
+  static kj::Maybe<IteratedHeader> iteratorNext(IteratorState& state);
+
+  static kj::Maybe<kj::Array<jsg::ByteString>> entryIteratorNext(jsg::Lock& js,
+                                                                 IteratorState& state);
+  static kj::Maybe<jsg::ByteString> keyIteratorNext(jsg::Lock& js, IteratorState& state);
+  static kj::Maybe<jsg::ByteString> valueIteratorNext(jsg::Lock& js, IteratorState& state);
 };
 
 // Base class for Request and Response. In JavaScript, this class is a mixin, meaning no one will
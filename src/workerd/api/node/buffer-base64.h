@@ -24,6 +24,7 @@
 // USE OR OTHER DEALINGS IN THE SOFTWARE.
 #pragma once
 
+#include <workerd/util/base64.h>
 #include <cmath>
 #include <cstddef>
 #include <cstdint>
@@ -61,7 +62,8 @@ size_t base64_decoded_size(const TypeName* src, size_t size);
 
 template <typename TypeName>
 size_t base64_decode(char* const dst, const size_t dstlen,
-                     const TypeName* const src, const size_t srclen);
+                     const TypeName* const src, const size_t srclen,
+                     Base64Mode mode = Base64Mode::NORMAL);
 
 inline size_t base64_encode(const char* src,
                             size_t slen,
@@ -127,12 +129,23 @@ bool base64_decode_group_slow(char* const dst, const size_t dstlen,
 template <typename TypeName>
 size_t base64_decode_fast(char* const dst, const size_t dstlen,
                           const TypeName* const src, const size_t srclen,
-                          const size_t decoded_size) {
+                          const size_t decoded_size,
+                          Base64Mode mode = Base64Mode::NORMAL) {
   const size_t available = dstlen < decoded_size ? dstlen : decoded_size;
   const size_t max_k = available / 3 * 3;
   size_t max_i = srclen / 4 * 4;
   size_t i = 0;
   size_t k = 0;
+  if constexpr (sizeof(TypeName) == 1) {
+    // Take as much as we can with the shared decoder first. It stops at the first group it can't
+    // decode, such as one with whitespace or padding in it, for the loop below to deal with.
+    auto prefix = decodeBase64Prefix(
+        kj::arrayPtr(reinterpret_cast<const kj::byte*>(src), max_i),
+        kj::arrayPtr(reinterpret_cast<kj::byte*>(dst), max_k),
+        mode == Base64Mode::URL ? Base64Alphabet::URL : Base64Alphabet::STANDARD);
+    i = prefix.consumed;
+    k = prefix.written;
+  }
   while (i < max_i && k < max_k) {
     const unsigned char txt[] = {
         static_cast<unsigned char>(unbase64(static_cast<uint8_t>(src[i + 0]))),
@@ -179,9 +192,10 @@ size_t base64_decoded_size(const TypeName* src, size_t size) {
 
 template <typename TypeName>
 size_t base64_decode(char* const dst, const size_t dstlen,
-                     const TypeName* const src, const size_t srclen) {
+                     const TypeName* const src, const size_t srclen,
+                     Base64Mode mode) {
   const size_t decoded_size = base64_decoded_size(src, srclen);
-  return base64_decode_fast(dst, dstlen, src, srclen, decoded_size);
+  return base64_decode_fast(dst, dstlen, src, srclen, decoded_size, mode);
 }
 
 
@@ -7,6 +7,8 @@
 #include "buffer-base64.h"
 #include "buffer-string-search.h"
 #include <workerd/jsg/buffersource.h>
+#include <workerd/util/base64.h>
+#include <workerd/util/utf8.h>
 #include <kj/encoding.h>
 #include <algorithm>
 
@@ -114,17 +116,6 @@ Encoding getEncoding(kj::StringPtr encoding) {
   KJ_UNREACHABLE;
 }
 
-kj::Maybe<uint> tryFromHexDigit(char c) {
-  if ('0' <= c && c <= '9') {
-    return c - '0';
-  } else if ('a' <= c && c <= 'f') {
-    return c - ('a' - 10);
-  } else if ('A' <= c && c <= 'F') {
-    return c - ('A' - 10);
-  }
-  return kj::none;
-}
-
 kj::Array<byte> decodeHexTruncated(kj::ArrayPtr<kj::byte> text, bool strict = false) {
   // We do not use kj::decodeHex because we need to match Node.js'
   // behavior of truncating the response at the first invalid hex
@@ -136,30 +127,15 @@ kj::Array<byte> decodeHexTruncated(kj::ArrayPtr<kj::byte> text, bool strict = fa
     }
     text = text.slice(0, text.size() - 1);
   }
-  kj::Vector vec = kj::Vector<kj::byte>(text.size() / 2);
-
-  for (size_t i = 0; i < text.size(); i += 2) {
-    byte b = 0;
-    KJ_IF_SOME(d1, tryFromHexDigit(text[i])) {
-      b = d1 << 4;
-    } else {
-      if (strict) {
-        JSG_FAIL_REQUIRE(TypeError, "The text is not valid hex");
-      }
-      break;
-    }
-    KJ_IF_SOME(d2, tryFromHexDigit(text[i+1])) {
-      b |= d2;
-    } else {
-      if (strict) {
-        JSG_FAIL_REQUIRE(TypeError, "The text is not valid hex");
-      }
-      break;
+  auto bytes = kj::heapArray<kj::byte>(text.size() / 2);
+  auto size = decodeHexPrefix(text, bytes);
+  if (size < bytes.size()) {
+    if (strict) {
+      JSG_FAIL_REQUIRE(TypeError, "The text is not valid hex");
     }
-    vec.add(b);
+    return bytes.slice(0, size).attach(kj::mv(bytes));
   }
-
-  return vec.releaseAsArray();
+  return bytes;
 }
 
 uint32_t writeInto(
@@ -202,7 +178,8 @@ uint32_t writeInto(
           dest.asChars().begin(),
           dest.size(),
           str.begin(),
-          str.size());
+          str.size(),
+          encoding == Encoding::BASE64URL ? Base64Mode::URL : Base64Mode::NORMAL);
     }
     case Encoding::HEX: {
       KJ_STACK_ARRAY(kj::byte, buf, string.length(js), 1024, 536870888);
@@ -210,10 +187,7 @@ uint32_t writeInto(
           static_cast<jsg::JsString::WriteOptions>(jsg::JsString::NO_NULL_TERMINATION |
                                                    jsg::JsString::REPLACE_INVALID_UTF8);
       string.writeInto(js, buf, options);
-      auto bytes = decodeHexTruncated(buf, false);
-      auto amountToCopy = kj::min(bytes.size(), dest.size());
-      memcpy(dest.begin(), bytes.begin(), amountToCopy);
-      return amountToCopy;
+      return decodeHexPrefix(buf, dest);
     }
   }
   KJ_UNREACHABLE;
@@ -263,7 +237,8 @@ kj::Array<kj::byte> decodeStringImpl(
         dest.asChars().begin(),
         dest.size(),
         buf.begin(),
-        buf.size());
+        buf.size(),
+        encoding == Encoding::BASE64URL ? Base64Mode::URL : Base64Mode::NORMAL);
       return dest.slice(0, len).attach(kj::mv(dest));
     }
     case Encoding::HEX: {
@@ -528,10 +503,9 @@ jsg::JsString toStringImpl(
   if (slice.size() == 0) return js.str();
   switch (encoding) {
     case Encoding::ASCII: {
-      // TODO(perf): We can look at making this more performant later.
-      // Essentially we have to modify the buffer such that every byte
-      // has the highest bit turned off. Whee! Node.js has a faster
-      // algorithm that it implements so we can likely adopt that.
+      // Every byte has to have its highest bit turned off, but usually
+      // there are none set, and we can skip the copy.
+      if (isAscii(slice)) return js.str(slice);
       kj::Array<kj::byte> copy = KJ_MAP(b, slice) -> kj::byte { return b & 0x7f; };
       return js.str(copy);
     }
@@ -539,6 +513,8 @@ jsg::JsString toStringImpl(
       return js.str(slice);
     }
     case Encoding::UTF8: {
+      // ASCII text reads the same as Latin1, which v8 can take as is.
+      if (isAscii(slice)) return js.str(slice);
       return js.str(slice.asChars());
     }
     case Encoding::UTF16LE: {
@@ -547,14 +523,21 @@ jsg::JsString toStringImpl(
           reinterpret_cast<uint16_t*>(slice.begin()), slice.size() / 2);
       return js.str(data);
     }
-    case Encoding::BASE64: {
-      return js.str(kj::encodeBase64(slice));
-    }
+    case Encoding::BASE64:
+      // Fall-through
     case Encoding::BASE64URL: {
-      return js.str(kj::encodeBase64Url(slice));
+      // Encoded text is all ASCII, so it can go to v8 as a one-byte string without being decoded
+      // as UTF-8 on the way.
+      auto alphabet = encoding == Encoding::BASE64URL ? Base64Alphabet::URL
+                                                      : Base64Alphabet::STANDARD;
+      auto text = kj::heapArray<kj::byte>(base64EncodedSize(slice.size(), alphabet));
+      encodeBase64Into(slice, text, alphabet);
+      return js.str(text);
     }
     case Encoding::HEX: {
-      return js.str(kj::encodeHex(slice));
+      auto text = kj::heapArray<kj::byte>(slice.size() * 2);
+      encodeHexInto(slice, text);
+      return js.str(text);
     }
   }
   KJ_UNREACHABLE;
@@ -6,6 +6,31 @@ import assert from "node:assert";
 import { Buffer } from "node:buffer";
 
 let serializedBody;
+let binaryBatchReceived = false;
+
+// Parses a batch in the binary format that `sendBatch()` uses once the queue service accepts it.
+function parseBinaryBatch(buffer) {
+  const view = new DataView(buffer);
+  const messages = [];
+  let pos = 0;
+  while (pos < buffer.byteLength) {
+    const bodySize = view.getUint32(pos, true);
+    pos += 4;
+    const contentTypeSize = view.getUint8(pos);
+    pos += 1;
+    const contentType = contentTypeSize > 0
+        ? Buffer.from(buffer, pos, contentTypeSize).toString() : undefined;
+    pos += contentTypeSize;
+    let delaySecs;
+    if (view.getUint8(pos++)) {
+      delaySecs = view.getInt32(pos, true);
+      pos += 4;
+    }
+    messages.push({ contentType, delaySecs, body: new Uint8Array(buffer, pos, bodySize) });
+    pos += bodySize;
+  }
+  return messages;
+}
 
 export default {
   // Producer receiver (from `env.QUEUE`)
@@ -30,6 +55,24 @@ export default {
       } else {
         assert.fail(`Unexpected format: ${JSON.stringify(format)}`);
       }
+    } else if (pathname === "/batch" &&
+               request.headers.get("CF-Queue-Batch-Format") === "binary") {
+      assert.strictEqual(request.headers.get("Content-Type"), "application/octet-stream");
+      const messages = parseBinaryBatch(await request.arrayBuffer());
+      assert.strictEqual(messages.length, 3);
+
+      assert.strictEqual(messages[0].contentType, "text");
+      assert.strictEqual(messages[0].delaySecs, undefined);
+      assert.strictEqual(Buffer.from(messages[0].body).toString(), "jkl");
+
+      assert.strictEqual(messages[1].contentType, "bytes");
+      assert.strictEqual(messages[1].delaySecs, 2);
+      assert.strictEqual(messages[1].body.byteLength, 100000);
+      assert(messages[1].body.every(b => b === 7));
+
+      assert.strictEqual(messages[2].contentType, undefined);
+      assert(Buffer.from(messages[2].body).includes("value"));
+      binaryBatchReceived = true;
     } else if (pathname === "/batch") {
       const body = await request.json();
 
@@ -48,6 +91,9 @@ export default {
 
       assert.strictEqual(body.messages[3].contentType, "v8");
       assert(Buffer.from(body.messages[3].body, "base64").includes("value"));
+
+      // Ask for further batches in the binary format.
+      return new Response(null, { headers: { "CF-Queue-Batch-Format": "binary" } });
     } else {
       assert.fail(`Unexpected pathname: ${JSON.stringify(pathname)}`);
     }
@@ -91,6 +137,17 @@ export default {
       { body: new Set(["value"]), contentType: "v8" },
     ]);
 
+    // The queue said it accepts binary batches, so this one is sent in binary. The bytes aren't
+    // detached.
+    const bytes = new Uint8Array(100000).fill(7);
+    await env.QUEUE.sendBatch([
+      { body: "jkl", contentType: "text" },
+      { body: bytes, contentType: "bytes", delaySeconds: 2 },
+      { body: new Map([["key", "value"]]) },
+    ]);
+    assert(binaryBatchReceived);
+    assert.strictEqual(bytes.byteLength, 100000);
+
     const timestamp = new Date();
     const response = await env.SERVICE.queue("test-queue", [
       { id: "#0", timestamp, body: "ghi" },
@@ -9,9 +9,10 @@
 #include <workerd/jsg/buffersource.h>
 #include <workerd/jsg/jsg.h>
 #include <workerd/jsg/ser.h>
+#include <workerd/util/base64.h>
 #include <workerd/util/mimetype.h>
 #include <workerd/api/global-scope.h>
-#include <kj/encoding.h>
+#include <kj/vector.h>
 
 namespace workerd::api {
 
@@ -61,11 +62,13 @@ Serialized serializeV8(jsg::Lock& js, const jsg::JsValue& body) {
   return kj::mv(result);
 }
 
-// Control whether the serialize() method makes a deep copy of provided ArrayBuffer types or if it
-// just returns a shallow reference that is only valid until the given method returns.
+// Control whether the serialize() method may take provided ArrayBuffer types by detaching them, or
+// must leave them intact and copy them.
 enum class SerializeArrayBufferBehavior {
-  DEEP_COPY,
-  SHALLOW_REFERENCE,
+  // Detach the buffer if it is detachable, otherwise copy it.
+  DETACH_OR_COPY,
+  // Always copy the buffer, leaving the caller's intact.
+  COPY,
 };
 
 Serialized serialize(jsg::Lock& js,
@@ -102,13 +105,7 @@ Serialized serialize(jsg::Lock& js,
     );
 
     jsg::BufferSource source(js, body);
-    if (bufferBehavior == SerializeArrayBufferBehavior::SHALLOW_REFERENCE) {
-      // If we know the data will be consumed synchronously, we can avoid copying it.
-      Serialized result;
-      result.data = source.asArrayPtr();
-      result.own = kj::mv(source);
-      return kj::mv(result);
-    } else if (source.canDetach(js)) {
+    if (bufferBehavior == SerializeArrayBufferBehavior::DETACH_OR_COPY && source.canDetach(js)) {
       // Prefer detaching the input ArrayBuffer whenever possible to avoid needing to copy it.
       auto backingSource = source.detach(js);
       Serialized result;
@@ -179,6 +176,173 @@ jsg::JsValue deserialize(jsg::Lock& js, rpc::QueueMessage::Reader message) {
     JSG_FAIL_REQUIRE(TypeError, kj::str("Unsupported queue message content type: ", type));
   }
 }
+
+// The body of a sendBatch() request. Message bodies are referenced rather than copied, and are
+// only encoded as the body is written to the request stream, a buffer at a time, so the encoded
+// batch never has to be held in memory all at once.
+class BatchBody {
+public:
+  // Appends bytes that frame the messages. These are copied.
+  void addFraming(kj::ArrayPtr<const kj::byte> bytes) {
+    if (pieces.empty() || pieces.back().encoding != Encoding::FRAMING) {
+      pieces.add(Piece { .encoding = Encoding::FRAMING, .framingStart = framing.size() });
+    }
+    framing.addAll(bytes);
+    pieces.back().framingEnd = framing.size();
+    totalSize += bytes.size();
+  }
+  void addFraming(kj::StringPtr text) { addFraming(text.asBytes()); }
+
+  // Appends a little-endian integer to the framing.
+  template <typename T>
+  void addInt(T value) {
+    kj::byte bytes[sizeof(T)];
+    for (auto i: kj::zeroTo(sizeof(T))) {
+      bytes[i] = static_cast<kj::byte>(static_cast<uint64_t>(value) >> (i * 8));
+    }
+    addFraming(kj::arrayPtr(bytes, sizeof(T)));
+  }
+
+  // Appends a message body, which must outlive the BatchBody.
+  void addBytes(kj::ArrayPtr<const kj::byte> bytes) {
+    pieces.add(Piece { .encoding = Encoding::RAW, .data = bytes });
+    totalSize += bytes.size();
+  }
+
+  // Like addBytes(), but base64-encoded.
+  void addBase64(kj::ArrayPtr<const kj::byte> bytes) {
+    pieces.add(Piece { .encoding = Encoding::BASE64, .data = bytes });
+    totalSize += base64EncodedSize(bytes.size());
+  }
+
+  uint64_t size() const { return totalSize; }
+
+  kj::Promise<void> writeTo(kj::AsyncOutputStream& out) {
+    auto buffer = kj::heapArray<kj::byte>(WRITE_BUFFER_SIZE);
+    size_t used = 0;
+
+    for (auto& piece: pieces) {
+      auto data = piece.encoding == Encoding::FRAMING
+          ? framing.asPtr().slice(piece.framingStart, piece.framingEnd).asConst()
+          : piece.data;
+
+      if (piece.encoding == Encoding::BASE64) {
+        while (data.size() > 0) {
+          if (buffer.size() - used < 4) {
+            co_await out.write(buffer.begin(), used);
+            used = 0;
+          }
+          // Encode whole groups of three bytes until the end of the data, so that padding only
+          // appears at the end.
+          auto n = kj::min(data.size(), (buffer.size() - used) / 4 * 3);
+          used += encodeBase64Into(data.first(n), buffer.slice(used, buffer.size()));
+          data = data.slice(n, data.size());
+        }
+      } else if (data.size() >= buffer.size()) {
+        // Big enough to be worth writing on its own rather than copying into the buffer.
+        if (used > 0) {
+          co_await out.write(buffer.begin(), used);
+          used = 0;
+        }
+        co_await out.write(data.begin(), data.size());
+      } else {
+        if (data.size() > buffer.size() - used) {
+          co_await out.write(buffer.begin(), used);
+          used = 0;
+        }
+        memcpy(buffer.begin() + used, data.begin(), data.size());
+        used += data.size();
+      }
+    }
+
+    if (used > 0) {
+      co_await out.write(buffer.begin(), used);
+    }
+  }
+
+private:
+  static constexpr size_t WRITE_BUFFER_SIZE = 64 * 1024;
+
+  enum class Encoding {
+    FRAMING,
+    RAW,
+    BASE64,
+  };
+
+  struct Piece {
+    Encoding encoding;
+
+    // For FRAMING, the range of `framing` to write.
+    size_t framingStart = 0;
+    size_t framingEnd = 0;
+
+    // Otherwise, the message body to write.
+    kj::ArrayPtr<const kj::byte> data;
+  };
+
+  kj::Vector<Piece> pieces;
+  kj::Vector<kj::byte> framing;
+  uint64_t totalSize = 0;
+};
+
+// Frames a batch in JSON, as
+//
+//     {"messages":[{"body":"<base64>","contentType":"<type>","delaySecs": <secs>},...]}
+//
+// where `contentType` and `delaySecs` are only present if specified for the message.
+void frameJsonBatch(BatchBody& body, kj::ArrayPtr<const SerializedWithOptions> messages) {
+  body.addFraming("{\"messages\":["_kj);
+  for (auto i: kj::indices(messages)) {
+    auto& message = messages[i];
+    body.addFraming("{\"body\":\""_kj);
+    body.addBase64(message.body.data);
+    body.addFraming("\""_kj);
+
+    KJ_IF_SOME(contentType, message.contentType) {
+      body.addFraming(",\"contentType\":\""_kj);
+      body.addFraming(contentType);
+      body.addFraming("\""_kj);
+    }
+
+    KJ_IF_SOME(delaySecs, message.delaySeconds) {
+      body.addFraming(",\"delaySecs\": "_kj);
+      body.addFraming(kj::str(delaySecs));
+    }
+
+    body.addFraming(i < messages.size() - 1 ? "},"_kj : "}"_kj);
+  }
+  body.addFraming("]}"_kj);
+}
+
+// Frames a batch in the binary format, which is each message in turn as:
+//
+// * The size of the body, as a 32-bit little-endian integer.
+// * The size of the content type, as one byte, followed by the content type. Zero if the message
+//   doesn't specify one.
+// * One byte which is 1 if the message specifies a delay, followed by the delay in seconds as a
+//   32-bit little-endian integer, or else 0.
+// * The body itself.
+void frameBinaryBatch(BatchBody& body, kj::ArrayPtr<const SerializedWithOptions> messages) {
+  for (auto& message: messages) {
+    JSG_REQUIRE(message.body.data.size() <= uint32_t(kj::maxValue), Error,
+        "Queue message body is too large.");
+    body.addInt(static_cast<uint32_t>(message.body.data.size()));
+
+    auto contentType = message.contentType.orDefault(nullptr);
+    KJ_ASSERT(contentType.size() <= 255);
+    body.addInt(static_cast<uint8_t>(contentType.size()));
+    body.addFraming(contentType);
+
+    KJ_IF_SOME(delaySecs, message.delaySeconds) {
+      body.addInt(uint8_t(1));
+      body.addInt(static_cast<int32_t>(delaySecs));
+    } else {
+      body.addInt(uint8_t(0));
+    }
+
+    body.addBytes(message.body.data);
+  }
+}
 }  // namespace
 
 kj::Promise<void> WorkerQueue::send(jsg::Lock& js,
@@ -205,10 +369,10 @@ kj::Promise<void> WorkerQueue::send(jsg::Lock& js,
 
   Serialized serialized;
   KJ_IF_SOME(type, contentType) {
-    serialized = serialize(js, body, type, SerializeArrayBufferBehavior::DEEP_COPY);
+    serialized = serialize(js, body, type, SerializeArrayBufferBehavior::DETACH_OR_COPY);
   } else if (workerd::FeatureFlags::get(js).getQueuesJsonMessages()) {
     headers.add("X-Msg-Fmt", IncomingQueueMessage::ContentType::JSON);
-    serialized = serialize(js, body, IncomingQueueMessage::ContentType::JSON, SerializeArrayBufferBehavior::DEEP_COPY);
+    serialized = serialize(js, body, IncomingQueueMessage::ContentType::JSON, SerializeArrayBufferBehavior::DETACH_OR_COPY);
   } else {
     // TODO(cleanup) send message format header (v8) by default
     serialized = serializeV8(js, body);
@@ -239,8 +403,9 @@ kj::Promise<void> WorkerQueue::send(jsg::Lock& js,
       .attach(context.registerPendingEvent());
 };
 
-kj::Promise<void> WorkerQueue::sendBatch(jsg::Lock& js, jsg::Sequence<MessageSendRequest> batch,
-                                         jsg::Optional<SendBatchOptions> options) {
+jsg::Promise<void> WorkerQueue::sendBatch(jsg::Lock& js,
+                                          jsg::Sequence<MessageSendRequest> batch,
+                                          jsg::Optional<SendBatchOptions> options) {
   auto& context = IoContext::current();
 
   JSG_REQUIRE(batch.size() > 0, TypeError, "sendBatch() requires at least one message");
@@ -259,13 +424,14 @@ kj::Promise<void> WorkerQueue::sendBatch(jsg::Lock& js, jsg::Sequence<MessageSen
       item.delaySeconds = secs;
     }
 
+    // The body is encoded as it's written to the request, after we return, so ArrayBuffers are
+    // copied rather than referenced. (They aren't detached, since that would be observable.)
     KJ_IF_SOME(contentType, message.contentType) {
       item.contentType = validateContentType(contentType);
-      item.body = serialize(js, body, contentType,
-          SerializeArrayBufferBehavior::SHALLOW_REFERENCE);
+      item.body = serialize(js, body, contentType, SerializeArrayBufferBehavior::COPY);
     } else if (workerd::FeatureFlags::get(js).getQueuesJsonMessages()) {
       item.contentType = IncomingQueueMessage::ContentType::JSON;
-      item.body = serialize(js, body, IncomingQueueMessage::ContentType::JSON, SerializeArrayBufferBehavior::SHALLOW_REFERENCE);
+      item.body = serialize(js, body, IncomingQueueMessage::ContentType::JSON, SerializeArrayBufferBehavior::COPY);
     }
     else {
       item.body = serializeV8(js, body);
@@ -277,52 +443,27 @@ kj::Promise<void> WorkerQueue::sendBatch(jsg::Lock& js, jsg::Sequence<MessageSen
   }
   auto serializedBodies = builder.finish();
 
-  // Construct the request body by concatenating the messages together into a JSON message.
-  // Done manually to minimize copies, although it'd be nice to make this safer.
-  // (totalSize + 2) / 3 * 4 is equivalent to ceil(totalSize / 3) * 4 for base64 encoding overhead.
-  auto estimatedSize = (totalSize + 2) / 3 * 4 + messageCount * 64 + 32;
-  kj::Vector<char> bodyBuilder(estimatedSize);
-  bodyBuilder.addAll("{\"messages\":["_kj);
-  for (size_t i = 0; i < messageCount; ++i) {
-    bodyBuilder.addAll("{\"body\":\""_kj);
-    // TODO(perf): We should be able to encode the data directly into bodyBuilder's buffer to
-    // eliminate a lot of data copying (whereas now encodeBase64 allocates a new buffer of its own
-    // to hold its result, which we then have to copy into bodyBuilder).
-    bodyBuilder.addAll(kj::encodeBase64(serializedBodies[i].body.data));
-    bodyBuilder.add('"');
-
-    KJ_IF_SOME(contentType, serializedBodies[i].contentType) {
-      bodyBuilder.addAll(",\"contentType\":\""_kj);
-      bodyBuilder.addAll(contentType);
-      bodyBuilder.add('"');
-    }
-
-    KJ_IF_SOME(delaySecs, serializedBodies[i].delaySeconds) {
-      bodyBuilder.addAll(",\"delaySecs\": "_kj);
-      bodyBuilder.addAll(kj::str(delaySecs));
-    }
+  auto& headerIds = context.getHeaderIds();
+  auto headers = kj::HttpHeaders(context.getHeaderTable());
 
-    bodyBuilder.addAll("}"_kj);
-    if (i < messageCount - 1) {
-      bodyBuilder.add(',');
-    }
+  BatchBody body;
+  if (binaryBatches) {
+    frameBinaryBatch(body, serializedBodies);
+    headers.set(headerIds.cfQueueBatchFormat, BATCH_FORMAT_BINARY);
+    headers.set(kj::HttpHeaderId::CONTENT_TYPE, MimeType::OCTET_STREAM.toString());
+  } else {
+    frameJsonBatch(body, serializedBodies);
+    headers.set(kj::HttpHeaderId::CONTENT_TYPE, MimeType::JSON.toString());
   }
-  bodyBuilder.addAll("]}"_kj);
-  bodyBuilder.add('\0');
-  KJ_DASSERT(bodyBuilder.size() <= estimatedSize);
-  kj::String body(bodyBuilder.releaseAsArray());
-  KJ_DASSERT(jsg::JsValue::fromJson(js, body).isObject());
 
   auto client = context.getHttpClient(subrequestChannel, true, kj::none, "queue_send"_kjc);
 
   // We add info about the size of the batch to the headers so that the queue implementation can
   // decide whether it's too large.
   // TODO(someday): Enforce the size limits here instead for very slightly better performance.
-  auto headers = kj::HttpHeaders(context.getHeaderTable());
   headers.add("CF-Queue-Batch-Count"_kj, kj::str(messageCount));
   headers.add("CF-Queue-Batch-Bytes"_kj, kj::str(totalSize));
   headers.add("CF-Queue-Largest-Msg"_kj, kj::str(largestMessage));
-  headers.set(kj::HttpHeaderId::CONTENT_TYPE, MimeType::JSON.toString());
 
   KJ_IF_SOME(opts, options) {
     KJ_IF_SOME(secs, opts.delaySeconds) {
@@ -338,19 +479,34 @@ kj::Promise<void> WorkerQueue::sendBatch(jsg::Lock& js, jsg::Sequence<MessageSen
                              "https://fake-host/batch"_kjc,
                              headers, body.size());
 
-  static constexpr auto handleWrite = [](auto req, auto body, auto client) -> kj::Promise<void> {
-    co_await req.body->write(body.begin(), body.size());
+  // Resolves to whether the queue service accepts binary batches.
+  static constexpr auto handleWrite = [](auto req, BatchBody body, auto serializedBodies,
+                                         auto client, auto& headerIds) -> kj::Promise<bool> {
+    co_await body.writeTo(*req.body);
     auto response = co_await req.response;
 
     JSG_REQUIRE(response.statusCode == 200, Error,
                 kj::str("Queue sendBatch failed: ", response.statusText));
 
+    bool acceptsBinary = false;
+    KJ_IF_SOME(format, response.headers->get(headerIds.cfQueueBatchFormat)) {
+      acceptsBinary = format == BATCH_FORMAT_BINARY;
+    }
+
     // Read and discard response body, otherwise we might burn the HTTP connection.
     co_await response.body->readAllBytes().ignoreResult();
+    co_return acceptsBinary;
   };
 
-  return handleWrite(kj::mv(req), kj::mv(body), kj::mv(client))
+  auto promise = handleWrite(kj::mv(req), kj::mv(body), kj::mv(serializedBodies),
+                             kj::mv(client), headerIds)
       .attach(context.registerPendingEvent());
+  return context.awaitIo(js, kj::mv(promise),
+      [self = JSG_THIS](jsg::Lock&, bool acceptsBinary) {
+    if (acceptsBinary) {
+      self->binaryBatches = true;
+    }
+  });
 };
 
 QueueMessage::QueueMessage(jsg::Lock& js,
@@ -68,8 +68,8 @@ public:
 
   kj::Promise<void> send(jsg::Lock& js, jsg::JsValue body, jsg::Optional<SendOptions> options);
 
-  kj::Promise<void> sendBatch(jsg::Lock& js, jsg::Sequence<MessageSendRequest> batch,
-                              jsg::Optional<SendBatchOptions> options);
+  jsg::Promise<void> sendBatch(jsg::Lock& js, jsg::Sequence<MessageSendRequest> batch,
+                               jsg::Optional<SendBatchOptions> options);
 
   JSG_RESOURCE_TYPE(WorkerQueue) {
     JSG_METHOD(send);
@@ -85,8 +85,16 @@ public:
     JSG_TS_DEFINE(type QueueContentType = "text" | "bytes" | "json" | "v8");
   }
 
+  // Value of the `CF-Queue-Batch-Format` header, which marks batches sent in the binary format.
+  // A queue service that accepts that format says so by setting the same header on its responses
+  // to JSON batches, after which the binding sends all further batches in binary.
+  static constexpr kj::StringPtr BATCH_FORMAT_BINARY = "binary"_kj;
+
 private:
   uint subrequestChannel;
+
+  // Set once the queue service has said it accepts binary batches.
+  bool binaryBatches = false;
 };
 
 // Event handler types
@@ -55,6 +55,86 @@ public:
   }
 };
 
+// A source that hands out as much of `data` as each read has room for.
+class BufferSource final: public ReadableStreamSource {
+public:
+  explicit BufferSource(kj::ArrayPtr<const kj::byte> data): remaining(data) {}
+
+  kj::Promise<size_t> tryRead(void* buffer, size_t minBytes, size_t maxBytes) override {
+    auto amount = kj::min(remaining.size(), maxBytes);
+    memcpy(buffer, remaining.begin(), amount);
+    remaining = remaining.slice(amount, remaining.size());
+    return amount;
+  }
+
+private:
+  kj::ArrayPtr<const kj::byte> remaining;
+};
+
+// A sink that records what it's given, and what it was asked to pump from.
+class RecordingSink final: public WritableStreamSink {
+public:
+  kj::Vector<kj::byte> data;
+  bool ended = false;
+  kj::Maybe<ReadableStreamSource&> pumpedFrom;
+
+  kj::Promise<void> write(const void* buffer, size_t size) override {
+    data.addAll(kj::arrayPtr(static_cast<const kj::byte*>(buffer), size));
+    return kj::READY_NOW;
+  }
+  kj::Promise<void> write(kj::ArrayPtr<const kj::ArrayPtr<const kj::byte>> pieces) override {
+    for (auto piece: pieces) {
+      data.addAll(piece);
+    }
+    return kj::READY_NOW;
+  }
+  kj::Promise<void> end() override {
+    ended = true;
+    return kj::READY_NOW;
+  }
+  kj::Maybe<kj::Promise<DeferredProxy<void>>> tryPumpFrom(
+      ReadableStreamSource& input, bool end) override {
+    pumpedFrom = input;
+    return kj::none;
+  }
+  void abort(kj::Exception reason) override {}
+};
+
+// A source whose reads never complete, noting when one is canceled.
+class HangingSource final: public ReadableStreamSource {
+public:
+  bool readCanceled = false;
+
+  kj::Promise<size_t> tryRead(void* buffer, size_t minBytes, size_t maxBytes) override {
+    return kj::Promise<size_t>(kj::NEVER_DONE).attach(kj::defer([this]() {
+      readCanceled = true;
+    }));
+  }
+};
+
+// A sink whose writes never complete, noting when one is canceled, or which fail right away.
+class HangingSink final: public WritableStreamSink {
+public:
+  bool fail = false;
+  bool writeCanceled = false;
+
+  kj::Promise<void> write(const void* buffer, size_t size) override {
+    if (fail) {
+      return KJ_EXCEPTION(DISCONNECTED, "write failed");
+    }
+    return kj::Promise<void>(kj::NEVER_DONE).attach(kj::defer([this]() {
+      writeCanceled = true;
+    }));
+  }
+  kj::Promise<void> write(kj::ArrayPtr<const kj::ArrayPtr<const kj::byte>> pieces) override {
+    return write(pieces[0].begin(), pieces[0].size());
+  }
+  kj::Promise<void> end() override {
+    return kj::READY_NOW;
+  }
+  void abort(kj::Exception reason) override {}
+};
+
 KJ_TEST("test") {
   kj::EventLoop loop;
   kj::WaitScope waitScope(loop);
@@ -185,5 +265,176 @@ KJ_TEST("honest small stream") {
   KJ_ASSERT(stream.maxMaxBytesSeen(), 100);
 }
 
+KJ_TEST("identity transform coalesces small writes into one read") {
+  kj::EventLoop loop;
+  kj::WaitScope waitScope(loop);
+
+  auto stream = kj::refcounted<IdentityTransformStreamImpl>();
+  kj::byte buffer[16];
+  auto read = stream->tryRead(buffer, 10, sizeof(buffer));
+
+  // Each write completes once copied, even though the read still wants more.
+  for (auto chunk: { "abc"_kj, "def"_kj, "ghi"_kj }) {
+    auto write = stream->write(chunk.begin(), chunk.size());
+    KJ_ASSERT(write.poll(waitScope));
+    write.wait(waitScope);
+    KJ_ASSERT(!read.poll(waitScope));
+  }
+
+  // The write that reaches minBytes completes the read, and what doesn't fit waits for the next.
+  auto write = stream->write("jklmnopqrs", 10);
+  KJ_ASSERT(read.wait(waitScope) == 16);
+  KJ_EXPECT(kj::str(kj::arrayPtr(buffer).asChars()) == "abcdefghijklmnop");
+  KJ_ASSERT(!write.poll(waitScope));
+
+  auto rest = stream->tryRead(buffer, 10, sizeof(buffer));
+  write.wait(waitScope);
+  auto end = stream->end();
+  KJ_ASSERT(rest.wait(waitScope) == 3);
+  KJ_EXPECT(kj::str(kj::arrayPtr(buffer, 3).asChars()) == "qrs");
+  end.wait(waitScope);
+  KJ_ASSERT(stream->tryRead(buffer, 1, sizeof(buffer)).wait(waitScope) == 0);
+}
+
+KJ_TEST("identity transform splices a pipe onto its pump") {
+  kj::EventLoop loop;
+  kj::WaitScope waitScope(loop);
+
+  auto stream = kj::refcounted<IdentityTransformStreamImpl>();
+  RecordingSink sink;
+  auto pump = stream->pumpTo(sink, true);
+  KJ_ASSERT(!pump.poll(waitScope));
+
+  // Writes go straight to the pump's output.
+  auto write = stream->write("abc", 3);
+  KJ_ASSERT(write.poll(waitScope));
+  write.wait(waitScope);
+  KJ_EXPECT(kj::str(sink.data.asPtr().asChars()) == "abc");
+
+  // A pipe into the writable side is offered to the output, which could pump it natively.
+  BufferSource source("defghi"_kj.asBytes());
+  auto pipe = KJ_ASSERT_NONNULL(stream->tryPumpFrom(source, true));
+  pipe.wait(waitScope).proxyTask.wait(waitScope);
+  KJ_EXPECT(&KJ_ASSERT_NONNULL(sink.pumpedFrom) == &source);
+
+  pump.wait(waitScope).proxyTask.wait(waitScope);
+  KJ_EXPECT(kj::str(sink.data.asPtr().asChars()) == "abcdefghi");
+  KJ_EXPECT(sink.ended);
+}
+
+KJ_TEST("identity transform reads straight from a pipe into it") {
+  kj::EventLoop loop;
+  kj::WaitScope waitScope(loop);
+
+  auto stream = kj::refcounted<IdentityTransformStreamImpl>();
+  BufferSource source("hello"_kj.asBytes());
+  auto pipe = KJ_ASSERT_NONNULL(stream->tryPumpFrom(source, true));
+
+  kj::byte buffer[16];
+  KJ_ASSERT(stream->tryRead(buffer, 1, sizeof(buffer)).wait(waitScope) == 5);
+  KJ_EXPECT(kj::str(kj::arrayPtr(buffer, 5).asChars()) == "hello");
+  KJ_ASSERT(!pipe.poll(waitScope));
+
+  // Reaching the end of the source completes the pipe, and closes the stream.
+  KJ_ASSERT(stream->tryRead(buffer, 1, sizeof(buffer)).wait(waitScope) == 0);
+  pipe.wait(waitScope).proxyTask.wait(waitScope);
+}
+
+KJ_TEST("identity transform cancels writes in flight when its pump is canceled") {
+  kj::EventLoop loop;
+  kj::WaitScope waitScope(loop);
+
+  auto stream = kj::refcounted<IdentityTransformStreamImpl>();
+  HangingSink sink;
+  kj::Maybe<kj::Promise<DeferredProxy<void>>> pump = stream->pumpTo(sink, true);
+
+  auto write = stream->write("abc", 3);
+  KJ_ASSERT(!write.poll(waitScope));
+
+  pump = kj::none;
+  KJ_EXPECT(sink.writeCanceled);
+  KJ_ASSERT(write.poll(waitScope));
+  KJ_EXPECT(kj::runCatchingExceptions([&]() { write.wait(waitScope); }) != kj::none);
+
+  // The stream is errored from then on.
+  KJ_EXPECT(kj::runCatchingExceptions([&]() {
+    stream->write("def", 3).wait(waitScope);
+  }) != kj::none);
+}
+
+KJ_TEST("identity transform fails its pump when a write to the output fails") {
+  kj::EventLoop loop;
+  kj::WaitScope waitScope(loop);
+
+  auto stream = kj::refcounted<IdentityTransformStreamImpl>();
+  HangingSink sink;
+  sink.fail = true;
+  auto pump = stream->pumpTo(sink, true);
+  KJ_ASSERT(!pump.poll(waitScope));
+
+  KJ_EXPECT_THROW_MESSAGE("write failed", stream->write("abc", 3).wait(waitScope));
+  KJ_EXPECT_THROW_MESSAGE("write failed", pump.wait(waitScope));
+}
+
+KJ_TEST("identity transform cancels reads from a pipe when the pipe is canceled") {
+  kj::EventLoop loop;
+  kj::WaitScope waitScope(loop);
+
+  auto stream = kj::refcounted<IdentityTransformStreamImpl>();
+  HangingSource source;
+  kj::Maybe<kj::Promise<DeferredProxy<void>>> pipe =
+      KJ_ASSERT_NONNULL(stream->tryPumpFrom(source, true));
+
+  kj::byte buffer[16];
+  auto read = stream->tryRead(buffer, 1, sizeof(buffer));
+  KJ_ASSERT(!read.poll(waitScope));
+
+  pipe = kj::none;
+  KJ_EXPECT(source.readCanceled);
+  KJ_ASSERT(read.poll(waitScope));
+  KJ_EXPECT(kj::runCatchingExceptions([&]() { read.wait(waitScope); }) != kj::none);
+}
+
+KJ_TEST("identity transform cancels a splice when the pipe is canceled") {
+  kj::EventLoop loop;
+  kj::WaitScope waitScope(loop);
+
+  auto stream = kj::refcounted<IdentityTransformStreamImpl>();
+  RecordingSink sink;
+  auto pump = stream->pumpTo(sink, true);
+  KJ_ASSERT(!pump.poll(waitScope));
+
+  // The sink can't pump natively, so the pump reads from the source itself.
+  HangingSource source;
+  kj::Maybe<kj::Promise<DeferredProxy<void>>> pipe =
+      KJ_ASSERT_NONNULL(stream->tryPumpFrom(source, true));
+  KJ_ASSERT(!pump.poll(waitScope));
+
+  pipe = kj::none;
+  KJ_EXPECT(source.readCanceled);
+  KJ_ASSERT(pump.poll(waitScope));
+  KJ_EXPECT(kj::runCatchingExceptions([&]() { pump.wait(waitScope); }) != kj::none);
+}
+
+KJ_TEST("identity transform cancels a splice when its pump is canceled") {
+  kj::EventLoop loop;
+  kj::WaitScope waitScope(loop);
+
+  auto stream = kj::refcounted<IdentityTransformStreamImpl>();
+  RecordingSink sink;
+  kj::Maybe<kj::Promise<DeferredProxy<void>>> pump = stream->pumpTo(sink, true);
+
+  HangingSource source;
+  auto pipe = KJ_ASSERT_NONNULL(stream->tryPumpFrom(source, true));
+  KJ_ASSERT(!pipe.poll(waitScope));
+
+  pump = kj::none;
+  KJ_EXPECT(source.readCanceled);
+
+  // Part of the source may already have been consumed, so the pipe fails rather than waiting for
+  // another reader.
+  KJ_EXPECT_THROW_MESSAGE("reader canceled", pipe.wait(waitScope));
+}
+
 }  // namespace
 }  // namespace workerd::api
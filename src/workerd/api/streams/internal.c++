@@ -45,6 +45,13 @@ kj::Promise<void> pumpTo(ReadableStreamSource& input, WritableStreamSink& output
   }
 }
 
+// Pumps all of `input` into `output` without ending it. If both are native, `output.tryPumpFrom()`
+// lets kj move the bytes directly; otherwise this falls back to pumpTo() above.
+kj::Promise<void> splice(ReadableStreamSource& input, WritableStreamSink& output) {
+  auto proxy = co_await input.pumpTo(output, false);
+  co_await proxy.proxyTask;
+}
+
 // Modified from AllReader in kj/async-io.c++.
 class AllReader {
 public:
@@ -2024,29 +2031,18 @@ kj::Promise<size_t> IdentityTransformStreamImpl::tryRead(
     void* buffer,
     size_t minBytes,
     size_t maxBytes) {
-  size_t total = 0;
-  while (total < minBytes) {
-    // TODO(perf): tryReadInternal was written assuming minBytes would always be 1 but we've now
-    // introduced an API for user to specify a larger minBytes. For now, this is implemented as a
-    // naiive loop dispatching to the 1 byte version but would be better to bake it deeper into
-    // the implementation where it can be more efficient.
-    auto amount = co_await tryReadInternal(buffer, maxBytes);
-    KJ_ASSERT(amount <= maxBytes);
-    if (amount == 0) {
-      // EOF.
-      break;
-    }
-
-    total += amount;
-    buffer = reinterpret_cast<char*>(buffer) + amount;
-    maxBytes -= amount;
+  if (maxBytes == 0) {
+    return size_t(0);
   }
 
-  co_return total;
+  // readHelper() satisfies the whole of `minBytes` in one pass, copying from as many writes as it
+  // takes, so we don't need to loop here.
+  return tryReadInternal(buffer, kj::max(kj::min(minBytes, maxBytes), size_t(1)), maxBytes);
 }
 
-kj::Promise<size_t> IdentityTransformStreamImpl::tryReadInternal(void* buffer, size_t maxBytes) {
-  auto promise = readHelper(kj::arrayPtr(static_cast<kj::byte*>(buffer), maxBytes));
+kj::Promise<size_t> IdentityTransformStreamImpl::tryReadInternal(
+    void* buffer, size_t minBytes, size_t maxBytes) {
+  auto promise = readHelper(kj::arrayPtr(static_cast<kj::byte*>(buffer), maxBytes), minBytes);
 
   KJ_IF_SOME(l, limit) {
     promise = promise.then([this, &l = l](size_t amount) -> kj::Promise<size_t> {
@@ -2082,7 +2078,84 @@ kj::Promise<DeferredProxy<void>> IdentityTransformStreamImpl::pumpTo(
   JSG_REQUIRE(kj::dynamicDowncastIfAvailable<IdentityTransformStreamImpl>(output) == kj::none,
       TypeError, "Inter-TransformStream ReadableStream.pipeTo() is not implemented.");
 
-  return ReadableStreamSource::pumpTo(output, end);
+  KJ_IF_SOME(p, output.tryPumpFrom(*this, end)) {
+    return kj::mv(p);
+  }
+
+  if (limit != kj::none) {
+    // FixedLengthStream has to count the bytes passing through, so it can't hand its input over.
+    return addNoopDeferredProxy(api::pumpTo(*this, output, end));
+  }
+
+  // The writable side is driven by JavaScript, and any input spliced onto `output` belongs to the
+  // IoContext, so no part of this pump may outlive it.
+  return addNoopDeferredProxy(pumpToHelper(output, end));
+}
+
+kj::Promise<void> IdentityTransformStreamImpl::pumpToHelper(WritableStreamSink& output, bool end) {
+  // Wraps the writes the writable side makes directly to `output`; destroying it when this pump is
+  // canceled cancels any of them still in flight.
+  kj::Canceler canceler;
+
+  for (;;) {
+    if (state.is<Idle>()) {
+      // Wait for the writable side to be closed, or piped into.
+      auto paf = kj::newPromiseAndFulfiller<void>();
+      state = PumpToRequest { output, kj::mv(paf.fulfiller), canceler };
+      co_await paf.promise;
+    } else KJ_IF_SOME(request, state.tryGet<WriteRequest>()) {
+      // Pass on the write that was waiting for a reader; later writes go straight to `output`.
+      auto bytes = request.bytes;
+      try {
+        co_await output.write(bytes.begin(), bytes.size());
+      } catch (...) {
+        cancel(kj::getCaughtExceptionAsKj());
+        throw;
+      }
+      KJ_IF_SOME(written, state.tryGet<WriteRequest>()) {
+        written.fulfiller->fulfill();
+        state = Idle();
+      }
+    } else KJ_IF_SOME(request, state.tryGet<PumpFromRequest>()) {
+      if (!request.fulfiller->isWaiting()) {
+        // The pipe was canceled, so `input` may no longer be valid.
+        state = KJ_EXCEPTION(DISCONNECTED, "pipe canceled");
+      } else {
+        bool inputEnd = request.end;
+
+        // If this pump is canceled partway through the splice, some of `input` is already gone,
+        // so a later reader couldn't pick up where it left off; fail the pipe instead.
+        bool finished = false;
+        KJ_DEFER(if (!finished) cancel(KJ_EXCEPTION(DISCONNECTED, "reader canceled")));
+
+        try {
+          co_await request.canceler.wrap(splice(request.input, output));
+        } catch (...) {
+          cancel(kj::getCaughtExceptionAsKj());
+          throw;
+        }
+        finished = true;
+        KJ_IF_SOME(spliced, state.tryGet<PumpFromRequest>()) {
+          spliced.fulfiller->fulfill();
+          if (inputEnd) {
+            state = StreamStates::Closed();
+          } else {
+            state = Idle();
+          }
+        }
+      }
+    } else KJ_IF_SOME(exception, state.tryGet<kj::Exception>()) {
+      kj::throwFatalException(kj::cp(exception));
+    } else if (state.is<StreamStates::Closed>()) {
+      break;
+    } else {
+      KJ_FAIL_ASSERT("read operation already in flight");
+    }
+  }
+
+  if (end) {
+    co_await output.end();
+  }
 }
 
 kj::Maybe<uint64_t> IdentityTransformStreamImpl::tryGetLength(StreamEncoding encoding) {
@@ -2104,6 +2177,12 @@ void IdentityTransformStreamImpl::cancel(kj::Exception reason) {
     KJ_CASE_ONEOF(request, WriteRequest) {
       request.fulfiller->reject(kj::cp(reason));
     }
+    KJ_CASE_ONEOF(request, PumpToRequest) {
+      request.fulfiller->reject(kj::cp(reason));
+    }
+    KJ_CASE_ONEOF(request, PumpFromRequest) {
+      request.fulfiller->reject(kj::cp(reason));
+    }
     KJ_CASE_ONEOF(exception, kj::Exception) {
       // Already errored.
       return;
@@ -2140,6 +2219,60 @@ kj::Promise<void> IdentityTransformStreamImpl::end() {
   return writeHelper(kj::ArrayPtr<const kj::byte>());
 }
 
+kj::Maybe<kj::Promise<DeferredProxy<void>>> IdentityTransformStreamImpl::tryPumpFrom(
+    ReadableStreamSource& input, bool end) {
+  if (limit != kj::none) {
+    // FixedLengthStream has to count the bytes passing through; see pumpTo().
+    return kj::none;
+  }
+
+  // Rather than copying `input` through this stream, hand it to the readable side, which will
+  // read from it directly or splice it onto whatever it's being pumped to. Either way the work
+  // happens under the reader's pump or read, so that canceling those can't leave a splice writing
+  // to an output that no longer exists.
+  KJ_SWITCH_ONEOF(state) {
+    KJ_CASE_ONEOF(idle, Idle) {
+      auto paf = kj::newPromiseAndFulfiller<void>();
+      auto canceler = kj::heap<kj::Canceler>();
+      state = PumpFromRequest { input, end, kj::mv(paf.fulfiller), *canceler };
+      return addNoopDeferredProxy(paf.promise.attach(kj::mv(canceler)));
+    }
+    KJ_CASE_ONEOF(request, ReadRequest) {
+      // The reader already has a buffer waiting; let the caller fill it with plain writes.
+      return kj::none;
+    }
+    KJ_CASE_ONEOF(request, WriteRequest) {
+      KJ_FAIL_ASSERT("write operation already in flight");
+    }
+    KJ_CASE_ONEOF(request, PumpToRequest) {
+      if (!request.fulfiller->isWaiting()) {
+        // The pump was canceled; see writeHelper().
+        state = KJ_EXCEPTION(DISCONNECTED, "reader canceled");
+        return tryPumpFrom(input, end);
+      }
+
+      // Wake up the pump, which will find `input` waiting.
+      auto pumpFulfiller = kj::mv(request.fulfiller);
+      auto paf = kj::newPromiseAndFulfiller<void>();
+      auto canceler = kj::heap<kj::Canceler>();
+      state = PumpFromRequest { input, end, kj::mv(paf.fulfiller), *canceler };
+      pumpFulfiller->fulfill();
+      return addNoopDeferredProxy(paf.promise.attach(kj::mv(canceler)));
+    }
+    KJ_CASE_ONEOF(request, PumpFromRequest) {
+      KJ_FAIL_ASSERT("pump operation already in flight");
+    }
+    KJ_CASE_ONEOF(exception, kj::Exception) {
+      return addNoopDeferredProxy(kj::Promise<void>(kj::cp(exception)));
+    }
+    KJ_CASE_ONEOF(closed, StreamStates::Closed) {
+      KJ_FAIL_ASSERT("close operation already in flight");
+    }
+  }
+
+  KJ_UNREACHABLE;
+}
+
 void IdentityTransformStreamImpl::abort(kj::Exception reason) {
   KJ_SWITCH_ONEOF(state) {
     KJ_CASE_ONEOF(idle, Idle) {
@@ -2151,6 +2284,12 @@ void IdentityTransformStreamImpl::abort(kj::Exception reason) {
     KJ_CASE_ONEOF(request, WriteRequest) {
       KJ_FAIL_ASSERT("abort() is supposed to wait for any pending write() to finish");
     }
+    KJ_CASE_ONEOF(request, PumpToRequest) {
+      request.fulfiller->reject(kj::cp(reason));
+    }
+    KJ_CASE_ONEOF(request, PumpFromRequest) {
+      request.fulfiller->reject(kj::cp(reason));
+    }
     KJ_CASE_ONEOF(exception, kj::Exception) {
       // Already errored.
       return;
@@ -2165,13 +2304,14 @@ void IdentityTransformStreamImpl::abort(kj::Exception reason) {
   // TODO(conform): Proactively put ReadableStream into Errored state.
 }
 
-kj::Promise<size_t> IdentityTransformStreamImpl::readHelper(kj::ArrayPtr<kj::byte> bytes) {
+kj::Promise<size_t> IdentityTransformStreamImpl::readHelper(
+    kj::ArrayPtr<kj::byte> bytes, size_t minBytes) {
   KJ_SWITCH_ONEOF(state) {
     KJ_CASE_ONEOF(idle, Idle) {
       // No outstanding write request, switch to ReadRequest state.
 
       auto paf = kj::newPromiseAndFulfiller<size_t>();
-      state = ReadRequest { bytes, kj::mv(paf.fulfiller) };
+      state = ReadRequest { bytes, minBytes, 0, kj::mv(paf.fulfiller) };
       return kj::mv(paf.promise);
     }
     KJ_CASE_ONEOF(request, ReadRequest) {
@@ -2179,15 +2319,22 @@ kj::Promise<size_t> IdentityTransformStreamImpl::readHelper(kj::ArrayPtr<kj::byt
     }
     KJ_CASE_ONEOF(request, WriteRequest) {
       if (bytes.size() >= request.bytes.size()) {
-        // The write buffer will entirely fit into our read buffer; fulfill both requests.
+        // The write buffer will entirely fit into our read buffer; fulfill the write request.
         memcpy(bytes.begin(), request.bytes.begin(), request.bytes.size());
         auto result = request.bytes.size();
         request.fulfiller->fulfill();
 
-        // Switch to idle state.
-        state = Idle();
+        if (result >= minBytes) {
+          // That's enough to fulfill the read request too. Switch to idle state.
+          state = Idle();
+          return result;
+        }
 
-        return result;
+        // Keep filling our read buffer from subsequent writes.
+        auto paf = kj::newPromiseAndFulfiller<size_t>();
+        state = ReadRequest { bytes.slice(result, bytes.size()), minBytes, result,
+                              kj::mv(paf.fulfiller) };
+        return kj::mv(paf.promise);
       }
 
       // The write buffer won't quite fit into our read buffer; fulfill only the read request.
@@ -2195,6 +2342,17 @@ kj::Promise<size_t> IdentityTransformStreamImpl::readHelper(kj::ArrayPtr<kj::byt
       request.bytes = request.bytes.slice(bytes.size(), request.bytes.size());
       return bytes.size();
     }
+    KJ_CASE_ONEOF(request, PumpToRequest) {
+      KJ_FAIL_ASSERT("pump operation already in flight");
+    }
+    KJ_CASE_ONEOF(request, PumpFromRequest) {
+      if (!request.fulfiller->isWaiting()) {
+        // The pipe was canceled, so `input` may no longer be valid.
+        state = KJ_EXCEPTION(DISCONNECTED, "pipe canceled");
+        return readHelper(bytes, minBytes);
+      }
+      return readFromPumpSource(bytes, minBytes);
+    }
     KJ_CASE_ONEOF(exception, kj::Exception) {
       return kj::cp(exception);
     }
@@ -2206,6 +2364,38 @@ kj::Promise<size_t> IdentityTransformStreamImpl::readHelper(kj::ArrayPtr<kj::byt
   KJ_UNREACHABLE;
 }
 
+kj::Promise<size_t> IdentityTransformStreamImpl::readFromPumpSource(
+    kj::ArrayPtr<kj::byte> bytes, size_t minBytes) {
+  auto& source = state.get<PumpFromRequest>();
+
+  size_t amount;
+  try {
+    amount = co_await source.canceler.wrap(
+        source.input.tryRead(bytes.begin(), minBytes, bytes.size()));
+  } catch (...) {
+    cancel(kj::getCaughtExceptionAsKj());
+    throw;
+  }
+
+  if (amount >= minBytes) {
+    co_return amount;
+  }
+
+  // A short read means `input` is exhausted, which completes the pipe.
+  KJ_IF_SOME(request, state.tryGet<PumpFromRequest>()) {
+    bool end = request.end;
+    request.fulfiller->fulfill();
+    if (end) {
+      state = StreamStates::Closed();
+    } else {
+      // Whatever is written next makes up the rest of this read.
+      state = Idle();
+      amount += co_await readHelper(bytes.slice(amount, bytes.size()), minBytes - amount);
+    }
+  }
+  co_return amount;
+}
+
 kj::Promise<void> IdentityTransformStreamImpl::writeHelper(kj::ArrayPtr<const kj::byte> bytes) {
   KJ_SWITCH_ONEOF(state) {
     KJ_CASE_ONEOF(idle, Idle) {
@@ -2235,8 +2425,8 @@ kj::Promise<void> IdentityTransformStreamImpl::writeHelper(kj::ArrayPtr<const kj
       }
 
       if (bytes.size() == 0) {
-        // This is a close operation.
-        request.fulfiller->fulfill(size_t(0));
+        // This is a close operation. The read gets whatever it has collected so far.
+        request.fulfiller->fulfill(kj::cp(request.filled));
         state = StreamStates::Closed();
         return kj::READY_NOW;
       }
@@ -2244,17 +2434,25 @@ kj::Promise<void> IdentityTransformStreamImpl::writeHelper(kj::ArrayPtr<const kj
       KJ_ASSERT(request.bytes.size() > 0);
 
       if (request.bytes.size() >= bytes.size()) {
-        // Our write buffer will entirely fit into the read buffer; fulfill both requests.
+        // Our write buffer will entirely fit into the read buffer; fulfill the write request.
         memcpy(request.bytes.begin(), bytes.begin(), bytes.size());
-        request.fulfiller->fulfill(bytes.size());
-        state = Idle();
+        request.filled += bytes.size();
+
+        if (request.filled >= request.minBytes) {
+          request.fulfiller->fulfill(kj::cp(request.filled));
+          state = Idle();
+        } else {
+          // The reader wants more than this; the rest of its buffer collects the following
+          // writes, each of which completes as soon as it has been copied.
+          request.bytes = request.bytes.slice(bytes.size(), request.bytes.size());
+        }
         return kj::READY_NOW;
       }
 
       // Our write buffer won't quite fit into the read buffer; fulfill only the read request.
       memcpy(request.bytes.begin(), bytes.begin(), request.bytes.size());
       bytes = bytes.slice(request.bytes.size(), bytes.size());
-      request.fulfiller->fulfill(request.bytes.size());
+      request.fulfiller->fulfill(request.filled + request.bytes.size());
 
       auto paf = kj::newPromiseAndFulfiller<void>();
       state = WriteRequest { bytes, kj::mv(paf.fulfiller) };
@@ -2263,6 +2461,31 @@ kj::Promise<void> IdentityTransformStreamImpl::writeHelper(kj::ArrayPtr<const kj
     KJ_CASE_ONEOF(request, WriteRequest) {
       KJ_FAIL_ASSERT("write operation already in flight");
     }
+    KJ_CASE_ONEOF(request, PumpToRequest) {
+      if (!request.fulfiller->isWaiting()) {
+        // The pump was canceled, as with a canceled read above.
+        state = KJ_EXCEPTION(DISCONNECTED, "reader canceled");
+        return writeHelper(bytes);
+      }
+
+      if (bytes.size() == 0) {
+        // This is a close operation; let the pump finish up.
+        request.fulfiller->fulfill();
+        state = StreamStates::Closed();
+        return kj::READY_NOW;
+      }
+
+      // The write belongs to the pump: it's canceled along with it, and if it fails, so does the
+      // pump.
+      return request.canceler.wrap(request.output.write(bytes.begin(), bytes.size()))
+          .catch_([this](kj::Exception&& exception) -> kj::Promise<void> {
+        cancel(kj::cp(exception));
+        return kj::mv(exception);
+      });
+    }
+    KJ_CASE_ONEOF(request, PumpFromRequest) {
+      KJ_FAIL_ASSERT("pump operation already in flight");
+    }
     KJ_CASE_ONEOF(exception, kj::Exception) {
       return kj::cp(exception);
     }
@@ -359,6 +359,10 @@ private:
 //
 // This class is also used as the implementation of FixedLengthStream, in which case `limit` is
 // non-nullptr.
+//
+// When the readable side is pumped somewhere, writes bypass the request/response handoff and go
+// straight to the pump's output, and a pipe into the writable side is spliced onto it, so that a
+// native stream piped through an identity transform to a native sink is pumped entirely by kj.
 class IdentityTransformStreamImpl: public kj::Refcounted,
                                    public ReadableStreamSource,
                                    public WritableStreamSink {
@@ -382,7 +386,7 @@ public:
 
   kj::Promise<size_t> tryRead(void* buffer, size_t minBytes, size_t maxBytes) override;
 
-  kj::Promise<size_t> tryReadInternal(void* buffer, size_t maxBytes);
+  kj::Promise<size_t> tryReadInternal(void* buffer, size_t minBytes, size_t maxBytes);
 
   kj::Promise<DeferredProxy<void>> pumpTo(WritableStreamSink& output, bool end) override;
 
@@ -398,20 +402,35 @@ public:
 
   kj::Promise<void> end() override;
 
+  kj::Maybe<kj::Promise<DeferredProxy<void>>> tryPumpFrom(
+      ReadableStreamSource& input, bool end) override;
+
   void abort(kj::Exception reason) override;
 
 private:
-  kj::Promise<size_t> readHelper(kj::ArrayPtr<kj::byte> bytes);
+  kj::Promise<size_t> readHelper(kj::ArrayPtr<kj::byte> bytes, size_t minBytes);
 
   kj::Promise<void> writeHelper(kj::ArrayPtr<const kj::byte> bytes);
 
+  kj::Promise<size_t> readFromPumpSource(kj::ArrayPtr<kj::byte> bytes, size_t minBytes);
+  kj::Promise<void> pumpToHelper(WritableStreamSink& output, bool end);
+
   kj::Maybe<uint64_t> limit;
 
   struct ReadRequest {
     kj::ArrayPtr<kj::byte> bytes;
+    // The part of the reader's buffer not yet filled.
+    //
     // WARNING: `bytes` may be invalid if fulfiller->isWaiting() returns false! (This indicates the
     //   read was canceled.)
 
+    size_t minBytes;
+    size_t filled;
+    // The read completes once `filled` reaches `minBytes`. Until then, the reader's buffer
+    // coalesces successive writes, completing each one as soon as it has been copied, so that a
+    // read for many bytes through a stream of small writes takes one pass instead of one read per
+    // write.
+
     kj::Own<kj::PromiseFulfiller<size_t>> fulfiller;
   };
 
@@ -420,9 +439,41 @@ private:
     kj::Own<kj::PromiseFulfiller<void>> fulfiller;
   };
 
+  // The readable side is being pumped to `output`. Writes go straight to `output` instead of
+  // waiting for a read, and a pipe into the writable side is spliced onto it, so that when both
+  // ends are native the bytes are moved by kj without passing through this stream at all.
+  //
+  // WARNING: `output` and `canceler` may be invalid if fulfiller->isWaiting() returns false! (This
+  //   indicates the pump was canceled.)
+  struct PumpToRequest {
+    WritableStreamSink& output;
+    kj::Own<kj::PromiseFulfiller<void>> fulfiller;
+
+    // Owned by the pump. Every write to `output` is wrapped by it, so that canceling the pump
+    // cancels any write still in flight, as kj's AsyncPipe does.
+    kj::Canceler& canceler;
+  };
+
+  // A pipe into the writable side is waiting for the readable side to be read or pumped, which
+  // will then draw directly from `input`. The pipe completes once `input` is exhausted, closing
+  // this stream if `end` is true.
+  //
+  // WARNING: `input` and `canceler` may be invalid if fulfiller->isWaiting() returns false! (This
+  //   indicates the pipe was canceled.)
+  struct PumpFromRequest {
+    ReadableStreamSource& input;
+    bool end;
+    kj::Own<kj::PromiseFulfiller<void>> fulfiller;
+
+    // Owned by the pipe's promise. Every read from or splice of `input` is wrapped by it, so that
+    // canceling the pipe cancels any of them still in flight.
+    kj::Canceler& canceler;
+  };
+
   struct Idle {};
 
-  kj::OneOf<Idle, ReadRequest, WriteRequest, kj::Exception, StreamStates::Closed> state = Idle();
+  kj::OneOf<Idle, ReadRequest, WriteRequest, PumpToRequest, PumpFromRequest,
+            kj::Exception, StreamStates::Closed> state = Idle();
 };
 
 }  // namespace workerd::api
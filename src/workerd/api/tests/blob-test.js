@@ -80,6 +80,54 @@ export const test1 = {
   }
 };
 
+export const testLargeComposition = {
+  async test(ctrl, env, ctx) {
+    // Blobs big enough to be referred to, rather than copied, by Blobs built from them.
+    const a = "a".repeat(300) + "A";
+    const b = "b".repeat(500) + "B";
+    const blobA = new Blob([a]);
+    const blobB = new Blob([b]);
+
+    const rope = new Blob(["<", blobA, "-", blobB, ">"]);
+    const expected = "<" + a + "-" + b + ">";
+    strictEqual(rope.size, expected.length);
+    strictEqual(await rope.text(), expected);
+    strictEqual(new TextDecoder().decode(await rope.arrayBuffer()), expected);
+
+    // Blobs built from those, and slices crossing between their parts.
+    const nested = new Blob([rope, blobA.slice(0, 10), rope]);
+    strictEqual(await nested.text(), expected + a.slice(0, 10) + expected);
+    for (const [start, end] of [[0, 1], [1, 302], [290, 310], [300, 900], [-20, -1], [5, 5]]) {
+      strictEqual(await rope.slice(start, end).text(), expected.slice(start, end));
+      strictEqual(await nested.slice(start, end).text(), expected.slice(start, end));
+    }
+
+    // Slices of slices.
+    const slice = nested.slice(250, 1400);
+    const text = (expected + a.slice(0, 10) + expected).slice(250, 1400);
+    strictEqual(await slice.text(), text);
+    strictEqual(await slice.slice(40, 700).text(), text.slice(40, 700));
+    strictEqual(await slice.slice(40, 700).slice(-300).text(), text.slice(40, 700).slice(-300));
+    strictEqual(await new File([slice, slice], "f").text(), text + text);
+
+    // Reading as a stream.
+    {
+      let result = "";
+      for await (const chunk of nested.slice(100).stream()) {
+        result += new TextDecoder().decode(chunk);
+      }
+      strictEqual(result, (expected + a.slice(0, 10) + expected).slice(100));
+    }
+
+    // Piping to a response body, and reading it back through FormData.
+    strictEqual(await new Response(rope).text(), expected);
+    const form = new FormData();
+    form.append("file", new File([rope], "rope.txt"));
+    const parsed = await new Response(form).formData();
+    strictEqual(await parsed.get("file").text(), expected);
+  }
+};
+
 export const test2 = {
   async test(ctrl, env, ctx) {
     // This test verifies that a Blob created from a request/response properly reflects
@@ -150,6 +150,52 @@ qux-content
   }
 };
 
+export const formDataWithLargeBinaryFiles = {
+  async test() {
+    const boundary = '2a2a2a2a2a2a2a2a2a2a2a2a2a2a2a2a';
+    const encoder = new TextEncoder();
+
+    // Binary content, including near-misses of the delimiter, some long enough to straddle where
+    // a skipping search would land.
+    const first = new Uint8Array(1024 * 1024);
+    for (let i = 0; i < first.length; i++) first[i] = (i * 7919) & 0xff;
+    first.set(encoder.encode(`\r\n--${boundary.slice(0, -1)}x`), 4096);
+    first.set(encoder.encode(`\n-${boundary}`), 8192);
+    const second = encoder.encode(`--${boundary}`);
+
+    const body = new Blob([
+      `--${boundary}\r\n`,
+      'Content-Disposition: form-data; name="first"; filename="first.bin"\r\n',
+      'Content-Type: application/octet-stream\r\n\r\n',
+      first,
+      `\r\n--${boundary}\r\n`,
+      'Content-Disposition: form-data; name="second"; filename="second.bin"\r\n\r\n',
+      second,
+      `\r\n--${boundary}\r\n`,
+      'Content-Disposition: form-data; name="text"\r\n\r\n',
+      'hello',
+      `\r\n--${boundary}--\r\n`,
+    ]);
+
+    const req = new Request('https://example.org', {
+      method: 'POST',
+      body,
+      headers: { 'content-type': `multipart/form-data; boundary=${boundary}` },
+    });
+    const form = await req.formData();
+
+    const firstFile = form.get('first');
+    strictEqual(firstFile.name, 'first.bin');
+    strictEqual(firstFile.size, first.length);
+    deepStrictEqual(new Uint8Array(await firstFile.arrayBuffer()), first);
+    deepStrictEqual(new Uint8Array(await firstFile.slice(4096, 8192).arrayBuffer()),
+                    first.slice(4096, 8192));
+
+    deepStrictEqual(new Uint8Array(await form.get('second').arrayBuffer()), second);
+    strictEqual(form.get('text'), 'hello');
+  }
+};
+
 export const sendFilesInFormdata = {
   async test() {
     const INPUT = `--2a2a2a2a2a2a2a2a2a2a2a2a2a2a2a2a
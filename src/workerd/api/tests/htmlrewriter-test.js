@@ -777,3 +777,41 @@ export const svgNamespace = {
     strictEqual(namespace, "http://www.w3.org/2000/svg");
   }
 };
+
+export const manyEndTagHandlers = {
+  async test() {
+    const kCount = 1000;
+    const kInput = '<ul>' + '<li class="été">café<!-- ☃ --></li>'.repeat(kCount) + '</ul>';
+    let ends = 0;
+    const texts = [];
+    const comments = [];
+    const classes = [];
+
+    const result = await new HTMLRewriter()
+      .on('li', {
+        element(element) {
+          classes.push(element.getAttribute('class'));
+          strictEqual(element.getAttribute('missing'), null);
+          element.onEndTag((end) => {
+            ends++;
+            end.before(`[${ends}]`);
+          });
+        },
+        text(text) {
+          if (text.text.length > 0) texts.push(text.text);
+        },
+        comments(comment) {
+          comments.push(comment.text);
+        },
+      })
+      .transform(new Response(kInput))
+      .text();
+
+    strictEqual(ends, kCount);
+    strictEqual(texts.join(''), 'café'.repeat(kCount));
+    deepStrictEqual(comments, new Array(kCount).fill(' ☃ '));
+    deepStrictEqual(classes, new Array(kCount).fill('été'));
+    strictEqual(result.split('</li>').length, kCount + 1);
+    strictEqual(result.includes(`[${kCount}]</li>`), true);
+  }
+};
@@ -34,42 +34,78 @@ rpc::JsValue::External::Reader RpcDeserializerExternalHander::read() {
 
 namespace {
 
+// Lets the serializer write directly into a Data blob in the outgoing Cap'n Proto message, so
+// that the serialized value doesn't have to be copied into the message afterwards.
+class RpcSerializerBufferAllocator final: public jsg::Serializer::BufferAllocator {
+public:
+  explicit RpcSerializerBufferAllocator(capnp::Orphanage orphanage): orphanage(orphanage) {}
+
+  kj::ArrayPtr<kj::byte> reallocate(size_t size) override {
+    if (orphan == nullptr) {
+      orphan = orphanage.newOrphan<capnp::Data>(size);
+    } else {
+      // Nothing else is allocated in the message during serialization, so the blob is normally
+      // the last thing in its segment and can be extended in place. Only when the segment is
+      // full does Cap'n Proto have to move it.
+      orphan.truncate(size);
+    }
+    return orphan.get();
+  }
+
+  // Returns the blob, trimmed to the `size` bytes that were actually written. Since the blob is
+  // at the end of its segment, the space trimmed off is reclaimed.
+  capnp::Orphan<capnp::Data> finish(size_t size) {
+    orphan.truncate(size);
+    return kj::mv(orphan);
+  }
+
+private:
+  capnp::Orphanage orphanage;
+  capnp::Orphan<capnp::Data> orphan;
+};
+
+// Size hint for a message containing an `rpc::JsValue`. The hint can't account for the value
+// itself, which is serialized into the message only once it exists, so it leaves room for a
+// modestly-sized value in the first segment, the same as Cap'n Proto does by default.
+constexpr capnp::MessageSize JS_VALUE_SIZE_HINT {
+  capnp::SUGGESTED_FIRST_SEGMENT_WORDS + capnp::sizeInWords<rpc::JsValue>(), 0
+};
+
 // Call to construct an `rpc::JsValue` from a JS value.
 //
-// `makeBuilder` is a function which takes a capnp::MessageSize hint and returns the
-// rpc::JsValue::Builder to fill in.
+// `makeBuilder` is a function which returns the rpc::JsValue::Builder to fill in. It is called
+// before serialization starts, since the value is serialized directly into the message. Any
+// message it allocates should use a size hint of at least `JS_VALUE_SIZE_HINT`.
 template <typename Func>
 void serializeJsValue(jsg::Lock& js, jsg::JsValue value, Func makeBuilder) {
+  rpc::JsValue::Builder builder = makeBuilder();
+  auto orphanage = capnp::Orphanage::getForMessageContaining(builder);
+
   RpcSerializerExternalHander externalHandler;
+  RpcSerializerBufferAllocator allocator(orphanage);
 
+  // Once the value outgrows MAX_JS_RPC_MESSAGE_SIZE, the rest of it is no longer written into the
+  // message.
   jsg::Serializer serializer(js, jsg::Serializer::Options {
     .version = 15,
     .omitHeader = false,
     .treatClassInstancesAsPlainObjects = false,
     .externalHandler = externalHandler,
+    .bufferAllocator = allocator,
+    .maxSize = MAX_JS_RPC_MESSAGE_SIZE,
+    .sizeLimitMessage = kj::Function<kj::String(size_t)>([](size_t size) {
+      return kj::str(
+          "Serialized RPC arguments or return values are limited to 1MiB, but the size of this "
+          "value was: ", size, " bytes.");
+    }),
   });
   serializer.write(js, value);
-  kj::Array<const byte> data = serializer.release().data;
-  JSG_ASSERT(data.size() <= MAX_JS_RPC_MESSAGE_SIZE, Error,
-      "Serialized RPC arguments or return values are limited to 1MiB, but the size of this value "
-      "was: ", data.size(), " bytes.");
-
-  capnp::MessageSize hint {0, 0};
-  hint.wordCount += (data.size() + sizeof(capnp::word) - 1) / sizeof(capnp::word);
-  hint.wordCount += capnp::sizeInWords<rpc::JsValue>();
-  hint.wordCount += externalHandler.size() * capnp::sizeInWords<rpc::JsValue::External>();
-  hint.capCount += externalHandler.size();
-
-  rpc::JsValue::Builder builder = makeBuilder(hint);
+  size_t size = serializer.release().data.size();
 
-  // TODO(perf): It would be nice if we could serialize directly into the capnp message to avoid
-  // a redundant copy of the bytes here. Maybe we could even cancel serialization early if it
-  // goes over the size limit.
-  builder.setV8Serialized(data);
+  builder.adoptV8Serialized(allocator.finish(size));
 
   if (externalHandler.size() > 0) {
-    builder.adoptExternals(externalHandler.build(
-        capnp::Orphanage::getForMessageContaining(builder)));
+    builder.adoptExternals(externalHandler.build(orphanage));
   }
 }
 
@@ -207,7 +243,8 @@ JsRpcPromiseAndPipleine callImpl(
 
     auto& ioContext = IoContext::current();
 
-    auto builder = client.callRequest();
+    auto builder = client.callRequest(capnp::MessageSize {
+        JS_VALUE_SIZE_HINT.wordCount + capnp::sizeInWords<rpc::JsRpcTarget::CallParams>(), 0 });
 
     // This code here is slightly overcomplicated in order to avoid pushing anything to the
     // kj::Vector in the common case that the parent path is empty. I'm probably trying too hard
@@ -239,8 +276,7 @@ JsRpcPromiseAndPipleine callImpl(
       // If we have arguments, serialize them.
       // Note that we may fail to serialize some element, in which case this will throw back to JS.
       if (argv.size() > 0) {
-        serializeJsValue(js, js.arr(argv.asPtr()), [&](capnp::MessageSize hint) {
-          // TODO(perf): Actually use the size hint.
+        serializeJsValue(js, js.arr(argv.asPtr()), [&]() {
           return builder.getOperation().initCallWithArgs();
         });
       }
@@ -508,7 +544,8 @@ public:
                 [callContext, ownCallContext = kj::mv(ownCallContext)]
                 (jsg::Lock& js, jsg::Value value) mutable {
           jsg::JsValue resultValue(value.getHandle(js));
-          serializeJsValue(js, resultValue, [&](capnp::MessageSize hint) {
+          serializeJsValue(js, resultValue, [&]() {
+            auto hint = JS_VALUE_SIZE_HINT;
             hint.wordCount += capnp::sizeInWords<CallResults>();
             hint.capCount += 1;
             auto results = callContext.initResults(hint);
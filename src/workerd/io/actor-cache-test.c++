@@ -197,6 +197,7 @@ struct ActorCacheTestOptions {
   size_t maxKeysPerRpc = 128;
   bool noCache = false;
   bool neverFlush = false;
+  size_t maxFlushBytesInFlight = kj::maxValue;
 };
 
 struct ActorCacheTest: public ActorCacheConvenienceWrappers {
@@ -221,7 +222,7 @@ struct ActorCacheTest: public ActorCacheConvenienceWrappers {
         ws(loop), mockStorage(kj::mv(mockPair.mock)),
         lru({options.softLimit, options.hardLimit,
              options.staleTimeout, options.dirtyListByteLimit, options.maxKeysPerRpc,
-             options.noCache, options.neverFlush}),
+             options.noCache, options.neverFlush, options.maxFlushBytesInFlight}),
         cache(kj::mv(mockPair.client), lru, gate),
         gateBrokenPromise(options.monitorOutputGate
             ? eagerlyReportExceptions(gate.onBroken())
@@ -678,6 +679,109 @@ KJ_TEST("ActorCache batching due to maxKeysPerRpc") {
   KJ_EXPECT(deleteProm3.wait(ws) == 2);
 }
 
+KJ_TEST("ActorCache flush batches limited by maxFlushBytesInFlight") {
+  // Allow only one batch in flight at a time.
+  ActorCacheTest test({.maxKeysPerRpc = 2, .maxFlushBytesInFlight = 1});
+  auto& ws = test.ws;
+  auto& mockStorage = test.mockStorage;
+
+  test.put({{"foo", "123"}, {"bar", "456"}, {"baz", "789"}});
+  test.delete_("qux");
+  test.setAlarm(12345 * kj::MILLISECONDS + kj::UNIX_EPOCH);
+
+  auto mockTxn = mockStorage->expectCall("txn", ws).returnMock("transaction");
+
+  auto deleteCall = mockTxn->expectCall("delete", ws)
+      .withParams(CAPNP(keys = ["qux"]));
+  mockTxn->expectNoActivity(ws);
+  kj::mv(deleteCall).thenReturn(CAPNP(numDeleted = 1));
+
+  auto putCall1 = mockTxn->expectCall("put", ws)
+      .withParams(CAPNP(entries = [(key = "foo", value = "123"),
+                                   (key = "bar", value = "456")]));
+  mockTxn->expectNoActivity(ws);
+  kj::mv(putCall1).thenReturn(CAPNP());
+
+  // The alarm and commit are only sent after the last batch.
+  auto putCall2 = mockTxn->expectCall("put", ws)
+      .withParams(CAPNP(entries = [(key = "baz", value = "789")]));
+  mockTxn->expectNoActivity(ws);
+  kj::mv(putCall2).thenReturn(CAPNP());
+
+  mockTxn->expectCall("setAlarm", ws)
+      .withParams(CAPNP(scheduledTimeMs = 12345))
+      .thenReturn(CAPNP());
+  mockTxn->expectCall("commit", ws).thenReturn(CAPNP());
+  mockTxn->expectDropped(ws);
+}
+
+KJ_TEST("ActorCache counted deletes count toward maxFlushBytesInFlight") {
+  ActorCacheTest test({.maxKeysPerRpc = 2, .maxFlushBytesInFlight = 1});
+  auto& ws = test.ws;
+  auto& mockStorage = test.mockStorage;
+
+  auto deleteProm = expectUncached(test.delete_({"bar"_kj, "baz"_kj, "foo"_kj}));
+  test.put("qux", "123");
+
+  auto mockTxn = mockStorage->expectCall("txn", ws).returnMock("transaction");
+
+  auto deleteCall1 = mockTxn->expectCall("delete", ws)
+      .withParams(CAPNP(keys = ["bar", "baz"]));
+  mockTxn->expectNoActivity(ws);
+  kj::mv(deleteCall1).thenReturn(CAPNP(numDeleted = 1));
+
+  auto deleteCall2 = mockTxn->expectCall("delete", ws)
+      .withParams(CAPNP(keys = ["foo"]));
+  mockTxn->expectNoActivity(ws);
+  kj::mv(deleteCall2).thenReturn(CAPNP(numDeleted = 1));
+
+  mockTxn->expectCall("put", ws)
+      .withParams(CAPNP(entries = [(key = "qux", value = "123")]))
+      .thenReturn(CAPNP());
+  mockTxn->expectCall("commit", ws).thenReturn(CAPNP());
+  mockTxn->expectDropped(ws);
+
+  KJ_EXPECT(deleteProm.wait(ws) == 2);
+}
+
+KJ_TEST("ActorCache alarm set while a flush is limited by maxFlushBytesInFlight waits for the next flush") {
+  ActorCacheTest test({.maxKeysPerRpc = 1, .maxFlushBytesInFlight = 1});
+  auto& ws = test.ws;
+  auto& mockStorage = test.mockStorage;
+
+  auto oneMs = 1 * kj::MILLISECONDS + kj::UNIX_EPOCH;
+  auto twoMs = 2 * kj::MILLISECONDS + kj::UNIX_EPOCH;
+
+  test.put({{"bar", "456"}, {"foo", "123"}});
+  test.setAlarm(oneMs);
+
+  auto mockTxn = mockStorage->expectCall("txn", ws).returnMock("transaction");
+
+  auto putCall1 = mockTxn->expectCall("put", ws)
+      .withParams(CAPNP(entries = [(key = "bar", value = "456")]));
+
+  // Changing the alarm while the first batch is outstanding must not change what this flush
+  // commits.
+  test.setAlarm(twoMs);
+  mockTxn->expectNoActivity(ws);
+  kj::mv(putCall1).thenReturn(CAPNP());
+
+  mockTxn->expectCall("put", ws)
+      .withParams(CAPNP(entries = [(key = "foo", value = "123")]))
+      .thenReturn(CAPNP());
+  mockTxn->expectCall("setAlarm", ws)
+      .withParams(CAPNP(scheduledTimeMs = 1))
+      .thenReturn(CAPNP());
+  mockTxn->expectCall("commit", ws).thenReturn(CAPNP());
+  mockTxn->expectDropped(ws);
+
+  mockStorage->expectCall("setAlarm", ws)
+      .withParams(CAPNP(scheduledTimeMs = 2))
+      .thenReturn(CAPNP());
+
+  KJ_ASSERT(expectCached(test.getAlarm()) == twoMs);
+}
+
 KJ_TEST("ActorCache batching due to max storage RPC words") {
   ActorCacheTest test({.hardLimit = 128 * 1024 * 1024});
   auto& ws = test.ws;
@@ -700,6 +804,33 @@ KJ_TEST("ActorCache batching due to max storage RPC words") {
   mockTxn->expectDropped(ws);
 }
 
+KJ_TEST("ActorCache default maxFlushBytesInFlight allows one full storage RPC in flight") {
+  ActorCacheTest test({
+    .hardLimit = 128 * 1024 * 1024,
+    .maxFlushBytesInFlight = ActorCacheSharedLruOptions{}.maxFlushBytesInFlight,
+  });
+  auto& ws = test.ws;
+  auto& mockStorage = test.mockStorage;
+
+  // As above, this splits into a full 16 MiB put and a small one. Together they exceed the default
+  // limit, so the second must wait for the first.
+  auto bigVal = kj::heapArray<const byte>(128 * 1024);
+  for (int i = 0; i < 128; ++i) {
+    test.cache.put(kj::str(i),
+        kj::Array<const byte>(bigVal.begin(), bigVal.size(), kj::NullArrayDisposer::instance),
+        ActorCache::WriteOptions());
+  }
+
+  auto mockTxn = mockStorage->expectCall("txn", ws).returnMock("transaction");
+  auto putCall1 = mockTxn->expectCall("put", ws);
+  mockTxn->expectNoActivity(ws);
+  kj::mv(putCall1).thenReturn(CAPNP());
+  mockTxn->expectCall("put", ws)
+      .thenReturn(CAPNP());
+  mockTxn->expectCall("commit", ws).thenReturn(CAPNP());
+  mockTxn->expectDropped(ws);
+}
+
 KJ_TEST("ActorCache deleteAll()") {
   ActorCacheTest test;
   auto& ws = test.ws;
@@ -1746,6 +1877,80 @@ KJ_TEST("ActorCache list() with limit") {
       kvs({{"bar", "456"}, {"baz", "789"}, {"foo", "123"}, {"garply", "54321"}}));
 }
 
+KJ_TEST("ActorCache list() reads ahead when paginating") {
+  ActorCacheTest test;
+  auto& ws = test.ws;
+  auto& mockStorage = test.mockStorage;
+
+  // The first page is listed normally.
+  {
+    auto promise = expectUncached(test.list("a", "z", 2));
+
+    mockStorage->expectCall("list", ws)
+        .withParams(CAPNP(start = "a", end = "z", limit = 2), "stream"_kj)
+        .useCallback("stream", [&](MockClient stream) {
+      stream.call("values", CAPNP(list = [(key = "b", value = "1"),
+                                          (key = "c", value = "2")]))
+          .expectReturns(CAPNP(), ws);
+      stream.call("end", CAPNP()).expectReturns(CAPNP(), ws);
+    }).expectCanceled();
+
+    KJ_ASSERT(promise.wait(ws) == kvs({{"b", "1"}, {"c", "2"}}));
+  }
+
+  // The second page starts after the first with the same limit, so we also fetch the next page.
+  {
+    auto promise = expectUncached(test.list("ca", "z", 2));
+
+    mockStorage->expectCall("list", ws)
+        .withParams(CAPNP(start = "ca", end = "z", limit = 4), "stream"_kj)
+        .useCallback("stream", [&](MockClient stream) {
+      stream.call("values", CAPNP(list = [(key = "d", value = "3"),
+                                          (key = "e", value = "4"),
+                                          (key = "f", value = "5"),
+                                          (key = "g", value = "6")]))
+          .expectReturns(CAPNP(), ws);
+      stream.call("end", CAPNP()).expectReturns(CAPNP(), ws);
+    }).expectCanceled();
+
+    KJ_ASSERT(promise.wait(ws) == kvs({{"d", "3"}, {"e", "4"}}));
+  }
+
+  // The third page was read ahead.
+  KJ_ASSERT(expectCached(test.list("ea", "z", 2)) == kvs({{"f", "5"}, {"g", "6"}}));
+
+  // The scan keeps going, so we read further ahead.
+  {
+    auto promise = expectUncached(test.list("ga", "z", 2));
+
+    mockStorage->expectCall("list", ws)
+        .withParams(CAPNP(start = "ga", end = "z", limit = 8), "stream"_kj)
+        .useCallback("stream", [&](MockClient stream) {
+      stream.call("values", CAPNP(list = [(key = "h", value = "7")]))
+          .expectReturns(CAPNP(), ws);
+      stream.call("end", CAPNP()).expectReturns(CAPNP(), ws);
+    }).expectCanceled();
+
+    KJ_ASSERT(promise.wait(ws) == kvs({{"h", "7"}}));
+  }
+
+  // Storage ran out of keys, so the rest of the range is known to be empty.
+  KJ_ASSERT(expectCached(test.list("ha", "z", 2)) == kvs({}));
+
+  // A list that doesn't continue the scan doesn't read ahead.
+  {
+    auto promise = expectUncached(test.list("0", "a", 2));
+
+    mockStorage->expectCall("list", ws)
+        .withParams(CAPNP(start = "0", end = "a", limit = 2), "stream"_kj)
+        .useCallback("stream", [&](MockClient stream) {
+      stream.call("end", CAPNP()).expectReturns(CAPNP(), ws);
+    }).expectCanceled();
+
+    KJ_ASSERT(promise.wait(ws) == kvs({}));
+  }
+}
+
 KJ_TEST("ActorCache list() with limit around negative entries") {
   // This checks for a bug where the initial scan through cache for list() applies the limit to
   // the total number of entries seen (positive or negative), when it really needs to apply only
@@ -1920,6 +2125,60 @@ KJ_TEST("ActorCache list() with some already-cached keys in range") {
   KJ_ASSERT(deletePromise.wait(ws) == 1);
 }
 
+KJ_TEST("ActorCache list() interleaving new keys with many already-cached keys") {
+  ActorCacheTest test;
+  auto& ws = test.ws;
+  auto& mockStorage = test.mockStorage;
+
+  // Cache a run of consecutive keys, alternating present and absent, so that placing the list
+  // results below mostly steps through existing entries.
+  {
+    auto promise = expectUncached(test.get(
+        {"bbb"_kj, "ccc"_kj, "ddd"_kj, "eee"_kj, "fff"_kj, "ggg"_kj}));
+
+    mockStorage->expectCall("getMultiple", ws)
+        .withParams(CAPNP(keys = ["bbb", "ccc", "ddd", "eee", "fff", "ggg"]), "stream"_kj)
+        .useCallback("stream", [&](MockClient stream) {
+      stream.call("values", CAPNP(list = [(key = "bbb", value = "bval"),
+                                          (key = "ddd", value = "dval"),
+                                          (key = "fff", value = "fval")]))
+          .expectReturns(CAPNP(), ws);
+      stream.call("end", CAPNP()).expectReturns(CAPNP(), ws);
+    }).expectCanceled();
+
+    KJ_ASSERT(promise.wait(ws) == kvs({{"bbb", "bval"}, {"ddd", "dval"}, {"fff", "fval"}}));
+  }
+
+  // List a range that also contains keys we haven't seen, before, between, and after the cached
+  // ones.
+  {
+    auto promise = expectUncached(test.list("aaa", "zzz"));
+
+    mockStorage->expectCall("list", ws)
+        .withParams(CAPNP(start = "aaa", end = "zzz"), "stream"_kj)
+        .useCallback("stream", [&](MockClient stream) {
+      stream.call("values", CAPNP(list = [(key = "aaa", value = "aval"),
+                                          (key = "bbb", value = "bval"),
+                                          (key = "ddd", value = "dval")]))
+          .expectReturns(CAPNP(), ws);
+      stream.call("values", CAPNP(list = [(key = "ddd2", value = "d2val"),
+                                          (key = "fff", value = "fval"),
+                                          (key = "hhh", value = "hval")]))
+          .expectReturns(CAPNP(), ws);
+      stream.call("end", CAPNP()).expectReturns(CAPNP(), ws);
+    }).expectCanceled();
+
+    KJ_ASSERT(promise.wait(ws) == kvs({{"aaa", "aval"}, {"bbb", "bval"}, {"ddd", "dval"},
+                                       {"ddd2", "d2val"}, {"fff", "fval"}, {"hhh", "hval"}}));
+  }
+
+  // The whole range is now cached.
+  KJ_ASSERT(expectCached(test.list("aaa", "zzz")) ==
+      kvs({{"aaa", "aval"}, {"bbb", "bval"}, {"ddd", "dval"},
+           {"ddd2", "d2val"}, {"fff", "fval"}, {"hhh", "hval"}}));
+  KJ_ASSERT(expectCached(test.get("eee")) == nullptr);
+}
+
 KJ_TEST("ActorCache list() with seemingly-redundant dirty entries") {
   ActorCacheTest test;
   auto& ws = test.ws;
@@ -73,6 +73,42 @@ ActorCache::Entry::Entry(Key key, Value value)
 ActorCache::Entry::Entry(Key key, EntryValueStatus valueStatus)
   : key(kj::mv(key)), valueStatus(valueStatus) {}
 
+kj::Own<ActorCache::Entry> ActorCache::Entry::makeInline(
+    kj::Maybe<ActorCache&> cache, KeyPtr key, kj::Maybe<ValuePtr> value) {
+  size_t valueSize = value.map([](ValuePtr v) { return v.size(); }).orDefault(0);
+
+  // Layout: the Entry, then the value, then the NUL-terminated key. The value and key are wrapped
+  // in arrays with a null disposer; the memory is freed along with the Entry.
+  void* memory = ::operator new(sizeof(Entry) + valueSize + key.size() + 1);
+  KJ_ON_SCOPE_FAILURE(::operator delete(memory));
+
+  byte* valueBytes = reinterpret_cast<byte*>(memory) + sizeof(Entry);
+  char* keyChars = reinterpret_cast<char*>(valueBytes + valueSize);
+  memcpy(keyChars, key.begin(), key.size());
+  keyChars[key.size()] = '\0';
+  Key inlineKey(kj::Array<char>(keyChars, key.size() + 1, kj::NullArrayDisposer::instance));
+
+  Entry* entry;
+  KJ_IF_SOME(v, value) {
+    memcpy(valueBytes, v.begin(), valueSize);
+    Value inlineValue(valueBytes, valueSize, kj::NullArrayDisposer::instance);
+    KJ_IF_SOME(c, cache) {
+      entry = new (memory) Entry(c, kj::mv(inlineKey), kj::mv(inlineValue));
+    } else {
+      entry = new (memory) Entry(kj::mv(inlineKey), kj::mv(inlineValue));
+    }
+  } else {
+    KJ_IF_SOME(c, cache) {
+      entry = new (memory) Entry(c, kj::mv(inlineKey), EntryValueStatus::ABSENT);
+    } else {
+      entry = new (memory) Entry(kj::mv(inlineKey), EntryValueStatus::ABSENT);
+    }
+  }
+
+  // A new AtomicRefcounted object has a refcount of zero; this takes the first reference.
+  return kj::atomicAddRef(*entry);
+}
+
 ActorCache::Entry::~Entry() noexcept(false) {
   KJ_IF_SOME(c, maybeCache) {
     size_t size = this->size();
@@ -381,7 +417,7 @@ auto ActorCache::getImpl(kj::Own<Entry> entry, ReadOptions options)
     value = response.getValue();
   }
   auto lock = lru.cleanList.lockExclusive();
-  auto newEntry = addReadResultToCache(lock, cloneKey(entry->key), value, options);
+  auto newEntry = addReadResultToCache(lock, entry->key, value, options);
   evictOrOomIfNeeded(lock);
   co_return newEntry->getValue();
 }
@@ -407,6 +443,7 @@ public:
     auto lock = cache.lru.cleanList.lockExclusive();
     auto params = context.getParams();
     kj::String prevKey;
+    ReadResultHint hint;
     for (auto kv: params.getList()) {
       KJ_ASSERT(kv.hasValue());  // values that don't exist aren't listed!
       KJ_ASSERT(nextExpectedKey != keysToFetch.end());
@@ -425,14 +462,14 @@ public:
           break;
         } else if (key == *nextExpectedKey) {
           fetchedEntries.add(cache.addReadResultToCache(
-              lock, kj::mv(*nextExpectedKey), kv.getValue(), options));
+              lock, *nextExpectedKey, kv.getValue(), options, hint));
           ++nextExpectedKey;
           break;
         }
 
         // It seems the list results have moved past `nextExpectedKey`, meaning it wasn't present
         // on disk. Write a negative cache entry.
-        cache.addReadResultToCache(lock, kj::mv(*nextExpectedKey), kj::none, options);
+        cache.addReadResultToCache(lock, *nextExpectedKey, kj::none, options, hint);
         ++nextExpectedKey;
       }
 
@@ -455,8 +492,9 @@ public:
     if (nextExpectedKey < keysToFetch.end()) {
       // Some trailing keys weren't seen, better mark them as not present.
       auto lock = cache.lru.cleanList.lockExclusive();
+      ReadResultHint hint;
       while (nextExpectedKey < keysToFetch.end()) {
-        cache.addReadResultToCache(lock, kj::mv(*nextExpectedKey++), kj::none, options);
+        cache.addReadResultToCache(lock, *nextExpectedKey++, kj::none, options, hint);
       }
       cache.evictOrOomIfNeeded(lock);
     }
@@ -713,6 +751,7 @@ public:
       auto list = context.getParams().getList();
 
       bool insertedAny = false;
+      ReadResultHint hint;
 
       for (auto kv: list) {
         Key key = kj::str(kv.getKey().asChars());
@@ -723,7 +762,7 @@ public:
             // point of the list. Therefore, we should insert an entry with a null value, to make
             // sure the whole range can be marked as empty. We'll end up marking this entry as
             // part of markGapsEmpty(), later.
-            markBeginAsEmpty(lock);
+            markBeginAsEmpty(lock, hint);
           }
         } else {
           if (key <= beginKey) {
@@ -735,7 +774,7 @@ public:
         }
 
         KJ_ASSERT(kv.hasValue());  // values that don't exist aren't listed!
-        auto entry = cache.addReadResultToCache(lock, kj::mv(key), kv.getValue(), options);
+        auto entry = cache.addReadResultToCache(lock, key, kv.getValue(), options, hint);
         fetchedEntries.add(kj::mv(entry));
         insertedAny = true;
       }
@@ -801,8 +840,8 @@ public:
   //    so the insertion of a new null entry is ignored for being redundant. This case is
   //    fine too, as the gap is already marked. Our markGapsEmpty() call will start with the
   //    following entry.
-  void markBeginAsEmpty(Lock& lock) {
-    cache.addReadResultToCache(lock, cloneKey(beginKey), kj::none, options);
+  void markBeginAsEmpty(Lock& lock, kj::Maybe<ReadResultHint&> hint = kj::none) {
+    cache.addReadResultToCache(lock, beginKey, kj::none, options, hint);
   }
 
   // Indicates that the operation is being canceled. Proactively drops all entries. This
@@ -875,6 +914,18 @@ kj::OneOf<ActorCache::GetResultList, kj::Promise<ActorCache::GetResultList>>
   // negative entries in the range, since each of those negative entries could potentially negate a
   // positive entry read from disk.
 
+  uint readAhead = 0;
+  kj::Maybe<uint64_t> listPage;
+  // If the application appears to be paginating through the range, we ask storage for more than
+  // `limit` entries, so that the next pages will be served from cache. The extra entries aren't
+  // returned, but they (and the gaps between them) are cached like any other list results.
+  KJ_IF_SOME(l, limit) {
+    if (!options.noCache) {
+      readAhead = startListPage(beginKey, l);
+      listPage = KJ_ASSERT_NONNULL(listCursor).generation;
+    }
+  }
+
   auto lock = lru.cleanList.lockExclusive();
   auto& map = currentValues.get(lock);
   auto ordered = map.ordered();
@@ -980,11 +1031,15 @@ kj::OneOf<ActorCache::GetResultList, kj::Promise<ActorCache::GetResultList>>
 
   if (storageListStart == kj::none || knownPrefixSize >= limit.orDefault(kj::maxValue)) {
     // We fully satisfied the list operation from cache.
-    return GetResultList(kj::mv(cachedEntries), {}, GetResultList::FORWARD, limit);
+    auto results = GetResultList(kj::mv(cachedEntries), {}, GetResultList::FORWARD, limit);
+    KJ_IF_SOME(g, listPage) {
+      finishListPage(g, results.size());
+    }
+    return kj::mv(results);
   }
 
   auto adjustedLimit = limit.map([&](uint orig) {
-    return orig + limitAdjustment - knownPrefixSize;
+    return orig + limitAdjustment - knownPrefixSize + readAhead;
   });
 
   auto paf = kj::newPromiseAndFulfiller<GetResultList>();
@@ -1052,10 +1107,50 @@ kj::OneOf<ActorCache::GetResultList, kj::Promise<ActorCache::GetResultList>>
     }
   });
 
-  return paf.promise.exclusiveJoin(kj::mv(promise))
+  auto result = paf.promise.exclusiveJoin(kj::mv(promise))
       .attach(kj::defer([client = kj::mv(streamClient), &streamServerRef]() {
     streamServerRef.cancel();
   }));
+
+  KJ_IF_SOME(g, listPage) {
+    result = result.then([this, g](GetResultList results) {
+      finishListPage(g, results.size());
+      return kj::mv(results);
+    });
+  }
+
+  return kj::mv(result);
+}
+
+uint ActorCache::startListPage(KeyPtr beginKey, uint limit) {
+  KJ_IF_SOME(c, listCursor) {
+    if (c.lastPageWasFull && limit == c.limit && beginKey > c.beginKey) {
+      // Looks like the application is asking for the page after the one it just got.
+      ++c.sequentialPages;
+    } else {
+      c.sequentialPages = 0;
+    }
+    c.beginKey = cloneKey(beginKey);
+    c.limit = limit;
+    c.lastPageWasFull = false;
+    ++c.generation;
+  } else {
+    listCursor = ListCursor { .beginKey = cloneKey(beginKey), .limit = limit };
+  }
+
+  auto& c = KJ_ASSERT_NONNULL(listCursor);
+
+  // Read ahead one more page for each page the scan has gone on so far, so that long scans make
+  // fewer and fewer round trips.
+  return kj::min(uint64_t(limit) * c.sequentialPages, uint64_t(MAX_LIST_READ_AHEAD));
+}
+
+void ActorCache::finishListPage(uint64_t generation, size_t resultCount) {
+  KJ_IF_SOME(c, listCursor) {
+    if (c.generation == generation) {
+      c.lastPageWasFull = resultCount >= c.limit;
+    }
+  }
 }
 
 // -----------------------------------------------------------------------------
@@ -1134,7 +1229,7 @@ public:
         // We may need to insert a negative entry at the beginning of the list range, since we
         // didn't see it, implying it's not present on disk. addResultToCache() will conveniently
         // avoid adding anything if it turns out this is already in a known-empty gap.
-        auto beginEntry = cache.addReadResultToCache(lock, cloneKey(beginKey), kj::none, options);
+        auto beginEntry = cache.addReadResultToCache(lock, beginKey, kj::none, options);
 
         // And we need to mark gaps empty from there to the final entry we actually saw.
         cache.markGapsEmpty(lock, beginEntry->key, endKey, options);
@@ -1411,66 +1506,41 @@ kj::Own<ActorCache::Entry> ActorCache::findInCache(
 }
 
 kj::Own<ActorCache::Entry> ActorCache::addReadResultToCache(
-    Lock& lock, Key key, kj::Maybe<capnp::Data::Reader> maybeReader, const ReadOptions& options) {
+    Lock& lock, KeyPtr key, kj::Maybe<capnp::Data::Reader> maybeReader,
+    const ReadOptions& options, kj::Maybe<ReadResultHint&> hint) {
+  auto maybeValue = maybeReader.map([](capnp::Data::Reader reader) -> ValuePtr { return reader; });
+
   if (options.noCache) {
     // We don't actually want to add this to the cache, just return the entry.
-    KJ_IF_SOME(reader, maybeReader) {
-      return kj::atomicRefcounted<Entry>(kj::mv(key), kj::heapArray(reader));
-    } else {
-      return kj::atomicRefcounted<Entry>(kj::mv(key), EntryValueStatus::ABSENT);
-    }
+    return Entry::makeInline(kj::none, key, maybeValue);
   }
 
   auto& map = currentValues.get(lock);
+  auto ordered = map.ordered();
 
-  kj::Own<Entry> entry;
-  KJ_IF_SOME(reader, maybeReader) {
-    entry = kj::atomicRefcounted<Entry>(*this, kj::mv(key), kj::heapArray(reader));
-  } else {
-    // Inserting a negative entry. Let's check if the new insertion is redundant due to the
-    // previous entry having `gapIsKnownEmpty`.
-    auto iter = map.seek(key);
-    auto ordered = map.ordered();
-    if ((iter == ordered.end() || iter->get()->key != key) && iter != ordered.begin()) {
-      // We did not find an exact match for the key, so we got an iterator pointing to the next
-      // entry after the key. It's not the first entry, so we can back it up one to get the
-      // entry before the key.
-      --iter;
-
-      if (iter->get()->gapIsKnownEmpty) {
-        // This entry is redundant, so we won't insert it.
-        return kj::atomicRefcounted<Entry>(kj::mv(key), EntryValueStatus::ABSENT);;
+  // Find the first entry whose key is not less than ours. A single search tells us both whether
+  // the key is already present and, if not, what precedes it.
+  auto iter = [&]() {
+    KJ_IF_SOME(h, hint) {
+      KJ_IF_SOME(prev, h.iter) {
+        if (prev->get()->key <= key) {
+          // Results are arriving in ascending order, so this one most likely belongs at or just
+          // after the previous one.
+          auto next = prev;
+          for (uint i = 0; i < MAX_HINT_STEPS; i++) {
+            if (next == ordered.end() || next->get()->key >= key) return next;
+            ++next;
+          }
+        }
       }
     }
+    return map.seek(key);
+  }();
 
-    entry = kj::atomicRefcounted<Entry>(*this, kj::mv(key), EntryValueStatus::ABSENT);
-    // TODO(perf): It's a little sad that we are going to do a findOrCreate() below that is going
-    //   to repeat the same lookup that produced `iter`. Maybe we could extend kj::Table with a
-    //   way to provide an existing iterator as a hint when inserting?
-  }
-
-  // At this point, we know we definitely want there to exist an entry matching this key. So now
-  // try to insert it.
-  auto& slot = map.findOrCreate(entry->key, [&]() {
-    // No existing entry has this key, so insert our new entry.
-    //
-    // Note that it's definitely guaranteed that the entry *before* the one we're inserting cannot
-    // possibly have `gapIsKnownEmpty = true`, because:
-    // 1. If our new entry has a null value, then we could have returned early above in this case.
-    // 2. If our new entry has a non-null value, then it would be inconsistent for a previous
-    //    entry to claim that the gap is empty -- this new entry proves it was not! Remember that
-    //    we are inserting an entry that was the result of reading from disk, so it *must* be
-    //    consistent with any existing knowledge about the state of disk -- unless we have a bug in
-    //    the caching logic.
-    //
-    // Because of this, we know it is correct to leave `gapIsKnownEmpty = false` on our new entry.
-    entry->syncStatus = EntrySyncStatus::CLEAN;
-    lock->add(*entry);
-    return kj::atomicAddRef(*entry);
-  });
-
-  if (slot.get() != entry.get()) {
-    // There was a pre-existing entry with the key, so ours wasn't inserted.
+  if (iter != ordered.end() && iter->get()->key == key) {
+    // There was a pre-existing entry with the key, so ours won't be inserted.
+    auto& slot = *iter;
+    auto entry = Entry::makeInline(*this, key, maybeValue);
     switch (slot->valueStatus) {
       case EntryValueStatus::UNKNOWN: {
         // Oh, it's just a marker for the end of a list range. Go ahead and insert our new entry
@@ -1506,6 +1576,50 @@ kj::Own<ActorCache::Entry> ActorCache::addReadResultToCache(
         break;
       }
     }
+
+    // Replacing the contents of a slot doesn't disturb the index, so `iter` remains valid.
+    KJ_IF_SOME(h, hint) {
+      h.iter = iter;
+    }
+    return kj::mv(entry);
+  }
+
+  if (maybeValue == kj::none && iter != ordered.begin()) {
+    // Inserting a negative entry. Let's check if the new insertion is redundant due to the
+    // previous entry having `gapIsKnownEmpty`.
+    auto prev = iter;
+    --prev;
+
+    if (prev->get()->gapIsKnownEmpty) {
+      // This entry is redundant, so we won't insert it.
+      KJ_IF_SOME(h, hint) {
+        h.iter = prev;
+      }
+      return Entry::makeInline(kj::none, key, kj::none);
+    }
+  }
+
+  // No existing entry has this key, so insert our new entry.
+  //
+  // Note that it's definitely guaranteed that the entry *before* the one we're inserting cannot
+  // possibly have `gapIsKnownEmpty = true`, because:
+  // 1. If our new entry has a null value, then we could have returned early above in this case.
+  // 2. If our new entry has a non-null value, then it would be inconsistent for a previous
+  //    entry to claim that the gap is empty -- this new entry proves it was not! Remember that
+  //    we are inserting an entry that was the result of reading from disk, so it *must* be
+  //    consistent with any existing knowledge about the state of disk -- unless we have a bug in
+  //    the caching logic.
+  //
+  // Because of this, we know it is correct to leave `gapIsKnownEmpty = false` on our new entry.
+  //
+  // TODO(perf): kj::TreeIndex can't take `iter` as a hint for where to insert, so this repeats
+  //   the search. Since the insertion changes the tree, it also invalidates any hint.
+  auto entry = Entry::makeInline(*this, key, maybeValue);
+  entry->syncStatus = EntrySyncStatus::CLEAN;
+  lock->add(*entry);
+  map.insert(kj::atomicAddRef(*entry));
+  KJ_IF_SOME(h, hint) {
+    h.iter = kj::none;
   }
 
   return kj::mv(entry);
@@ -1657,7 +1771,8 @@ void ActorCache::markGapsEmpty(Lock& lock, KeyPtr beginKey, kj::Maybe<KeyPtr> en
 ActorCache::GetResultList::GetResultList(kj::Vector<KeyValuePair> contents)
     : entries(contents.size()), cacheStatuses(contents.size()) {
   // TODO(perf): Allocating an `Entry` object for every key/value pair is lame but to avoid it
-  //   we'd have to make the common case worse...
+  //   we'd have to make the common case worse. The key and value are already owned here, so move
+  //   them in rather than copying them with makeInline().
   for (auto& kv: contents) {
     entries.add(kj::atomicRefcounted<Entry>(kj::mv(kv.key), kj::mv(kv.value)));
     cacheStatuses.add(CacheStatus::UNCACHED);
@@ -2226,6 +2341,49 @@ using RpcPutRequest = capnp::Request<rpc::ActorStorage::Operations::PutParams,
 
 using RpcDeleteRequest = capnp::Request<rpc::ActorStorage::Operations::DeleteParams,
     rpc::ActorStorage::Operations::DeleteResults>;
+
+// One request of a flush transaction: its size, and a function that sends it.
+struct FlushRpc {
+  size_t bytes;
+  kj::Function<kj::Promise<void>()> send;
+};
+
+template <typename Request>
+size_t flushRpcBytes(Request& request) {
+  return request.totalSize().wordCount * sizeof(capnp::word);
+}
+
+// Sends all of `rpcs`, in order, without letting more than `maxBytesInFlight` bytes of them be
+// outstanding at once (except that one request is always allowed). Once the last one has been
+// sent, calls `sendTail()` to send whatever must follow them in the transaction, such as the
+// commit.
+//
+// Everything that fits within the limit is sent before this returns, so if there is no limit, all
+// requests and the tail are sent synchronously.
+kj::Promise<void> sendFlushBatches(
+    kj::Array<FlushRpc> rpcs, size_t maxBytesInFlight,
+    kj::Function<kj::Promise<void>()> sendTail) {
+  kj::Vector<kj::Promise<void>> inFlight(rpcs.size() + 1);
+  size_t oldest = 0;
+  size_t bytesInFlight = 0;
+
+  for (auto& rpc: rpcs) {
+    while (oldest < inFlight.size() && bytesInFlight + rpc.bytes > maxBytesInFlight) {
+      co_await kj::mv(inFlight[oldest]);
+      bytesInFlight -= rpcs[oldest].bytes;
+      ++oldest;
+    }
+
+    inFlight.add(rpc.send());
+    bytesInFlight += rpc.bytes;
+  }
+
+  inFlight.add(sendTail());
+
+  co_await kj::joinPromises(KJ_MAP(promise, inFlight.slice(oldest, inFlight.size())) {
+    return kj::mv(promise);
+  });
+}
 }
 
 kj::Promise<void> ActorCache::flushImpl(uint retryCount) {
@@ -2268,11 +2426,9 @@ kj::Promise<void> ActorCache::flushImpl(uint retryCount) {
   // muted deletes, we go ahead and construct batches of no more than 128 keys. They all end up
   // being part of the same transaction in the end, though.
   //
-  // TODO(perf): Currently we send all the batches at the same time. If the batches are large,
-  //   it could be worth spacing them out a bit so we don't saturate the connection. However, we
-  //   still need to make sure that the whole transaction represents a consistent snapshot in time,
-  //   so getting this right, without making a copy of everything upfront, could get complicated.
-  //   Punting for now.
+  // The batches are all built upfront, so the transaction represents a consistent snapshot in
+  // time, but flushImplUsingTxn() only keeps `maxFlushBytesInFlight` bytes of them outstanding at
+  // once so that a huge flush doesn't saturate the connection.
 
   PutFlush putFlush;
   MutedDeleteFlush mutedDeleteFlush;
@@ -2700,9 +2856,32 @@ kj::Promise<void> ActorCache::flushImplUsingTxn(
   auto txnProm = storage.txnRequest(capnp::MessageSize { 4, 0 }).send();
   auto txn = txnProm.getTransaction();
 
+  // Decide now which alarm request, if any, goes with the commit, since the commit may only be
+  // sent once earlier batches have completed.
+  struct NoAlarmRequest {};
+  struct SetAlarmRequest { kj::Date scheduledTime; };
+  struct DeleteAlarmRequest { kj::Maybe<kj::Date> timeToDelete; };
+  kj::OneOf<NoAlarmRequest, SetAlarmRequest, DeleteAlarmRequest> alarmRequest = NoAlarmRequest {};
+  KJ_IF_SOME(dirty, maybeAlarmChange.tryGet<DirtyAlarm>()) {
+    KJ_IF_SOME(newTime, dirty.newTime) {
+      alarmRequest = SetAlarmRequest { newTime };
+    } else KJ_IF_SOME(deferredDelete, currentAlarmTime.tryGet<DeferredAlarmDelete>()) {
+      // Not sending a delete request for WAITING or READY is intentional. The WAITING state
+      // refers to when the alarm run has started but has not completed successfully, and READY
+      // is set when the run completes -- only FLUSHING indicates we actually need to send a
+      // request.
+      if (deferredDelete.status == DeferredAlarmDelete::Status::FLUSHING) {
+        alarmRequest = DeleteAlarmRequest { deferredDelete.timeToDelete };
+      }
+    } else {
+      alarmRequest = DeleteAlarmRequest { kj::none };
+    }
+  }
+
   struct RpcCountedDelete {
     kj::Own<CountedDelete> countedDelete;
     kj::Array<RpcDeleteRequest> rpcDeletes;
+    size_t remaining;  // Number of `rpcDeletes` that haven't completed yet.
   };
   auto rpcCountedDeletes = kj::heapArrayBuilder<RpcCountedDelete>(countedDeleteFlushes.size());
   auto rpcMutedDeletes = kj::heapArrayBuilder<RpcDeleteRequest>(mutedDeleteFlush.batches.size());
@@ -2724,9 +2903,11 @@ kj::Promise<void> ActorCache::flushImplUsingTxn(
 
       rpcDeletes.add(kj::mv(request));
     }
+    auto remaining = rpcDeletes.size();
     rpcCountedDeletes.add(RpcCountedDelete{
       .countedDelete = kj::mv(flush.countedDelete),
       .rpcDeletes = rpcDeletes.releaseAsArray(),
+      .remaining = remaining,
     });
     KJ_ASSERT(entryIt == flush.entries.end());
   }
@@ -2799,105 +2980,117 @@ kj::Promise<void> ActorCache::flushImplUsingTxn(
   // put() on the same key. These two writes may have been coalesced into a single flush.
   // Unfortunately, we can't just skip the delete because we still need to count it. So we issue
   // a delete, followed by a put, in the same transaction.
-  // The constant extra 2 promises are those added outside of the rpc batches, currently one
-  // to work around a bug in capnp::autoreconnect, and one to actually commit the flush txn
-  // A 3rd promise may be added to write the alarm time if necessary.
-  auto promises = kj::heapArrayBuilder<kj::Promise<void>>(
-      rpcPuts.size() + rpcMutedDeletes.size() + rpcCountedDeletes.size()
-      + 2 + !maybeAlarmChange.is<CleanAlarm>());
-
-  auto joinCountedDelete = [](RpcCountedDelete& rpcCountedDelete) -> kj::Promise<void> {
-    auto promises = KJ_MAP(request, rpcCountedDelete.rpcDeletes) {
-      return request.send().then(
-          [](capnp::Response<rpc::ActorStorage::Operations::DeleteResults>&& response) mutable
-          -> uint {
-        return response.getNumDeleted();
-      });
-    };
-
-    for (auto& promise : promises) {
-      // Reuse `countDeleted` since it's already in a state object anyway.
-      rpcCountedDelete.countedDelete->countDeleted += co_await promise;
-    }
+  //
+  // All of them, counted deletes included, count toward `maxFlushBytesInFlight`.
+  kj::Vector<FlushRpc> rpcs(rpcMutedDeletes.size() + rpcPuts.size());
+
+  auto fulfillCountedDelete = [](CountedDelete& countedDelete) {
+    // Note that it's OK to trust the delete count even if the transaction ultimately gets rolled
+    // back, because:
+    // - We know that nothing else could be concurrently modifying our storage in a way that
+    //   makes the count different on a retry.
+    // - If retries fail and the flush never completes at all, the output gate will kick in and
+    //   make it impossible for anyone to observe the bogus result.
+    // HACK: This uses a `kj::mv()` because promise fulfillers require rvalues even for trivially
+    // copyable types.
+    countedDelete.resultFulfiller->fulfill(kj::mv(countedDelete.countDeleted));
   };
   for (auto& rpcCountedDelete: rpcCountedDeletes) {
-    promises.add(joinCountedDelete(rpcCountedDelete).then(
-        [&countedDelete = *rpcCountedDelete.countedDelete]() mutable {
-      // Note that it's OK to trust the delete count even if the transaction ultimately gets rolled
-      // back, because:
-      // - We know that nothing else could be concurrently modifying our storage in a way that
-      //   makes the count different on a retry.
-      // - If retries fail and the flush never completes at all, the output gate will kick in and
-      //   make it impossible for anyone to observe the bogus result.
-      // HACK: This uses a `kj::mv()` because promise fulfillers require rvalues even for trivially
-      // copyable types.
-      countedDelete.resultFulfiller->fulfill(kj::mv(countedDelete.countDeleted));
-    }, [&countedDelete = *rpcCountedDelete.countedDelete](kj::Exception&& e) {
-      if (e.getType() == kj::Exception::Type::DISCONNECTED) {
-        // This deletion will be retried, so don't touch the fulfiller.
-      } else {
-        countedDelete.resultFulfiller->reject(kj::mv(e));
-      }
-    }));
+    if (rpcCountedDelete.rpcDeletes.size() == 0) {
+      fulfillCountedDelete(*rpcCountedDelete.countedDelete);
+      continue;
+    }
+
+    for (auto& request: rpcCountedDelete.rpcDeletes) {
+      rpcs.add(FlushRpc {
+        .bytes = flushRpcBytes(request),
+        .send = [&request, &rpcCountedDelete, fulfillCountedDelete]() {
+          return request.send().then(
+              [&rpcCountedDelete, fulfillCountedDelete](
+                  capnp::Response<rpc::ActorStorage::Operations::DeleteResults>&& response) {
+            // Reuse `countDeleted` since it's already in a state object anyway.
+            auto& countedDelete = *rpcCountedDelete.countedDelete;
+            countedDelete.countDeleted += response.getNumDeleted();
+            if (--rpcCountedDelete.remaining == 0) {
+              fulfillCountedDelete(countedDelete);
+            }
+          }, [&countedDelete = *rpcCountedDelete.countedDelete](kj::Exception&& e) {
+            if (e.getType() == kj::Exception::Type::DISCONNECTED) {
+              // This deletion will be retried, so don't touch the fulfiller.
+            } else if (countedDelete.resultFulfiller->isWaiting()) {
+              countedDelete.resultFulfiller->reject(kj::mv(e));
+            }
+          });
+        },
+      });
+    }
   }
-
   for (auto& request: rpcMutedDeletes) {
-    promises.add(request.send().ignoreResult());
+    rpcs.add(FlushRpc {
+      .bytes = flushRpcBytes(request),
+      .send = [&request]() { return request.send().ignoreResult(); },
+    });
   }
-
   for (auto& request: rpcPuts) {
-    promises.add(request.send().ignoreResult());
+    rpcs.add(FlushRpc {
+      .bytes = flushRpcBytes(request),
+      .send = [&request]() { return request.send().ignoreResult(); },
+    });
   }
 
-  KJ_SWITCH_ONEOF(maybeAlarmChange) {
-    KJ_CASE_ONEOF(dirty, DirtyAlarm) {
-      KJ_IF_SOME(newTime, dirty.newTime) {
+  // The alarm change and commit must follow all the puts and deletes, which may not all be sent
+  // right away if they exceed `maxFlushBytesInFlight`. So the alarm request is decided above, as
+  // of when the flush started, rather than from whatever the alarm state is by then.
+  auto sendAlarmAndCommit = [this, txn, alarmRequest = kj::mv(alarmRequest)]() mutable
+      -> kj::Promise<void> {
+    kj::Vector<kj::Promise<void>> tail(2);
+
+    KJ_SWITCH_ONEOF(alarmRequest) {
+      KJ_CASE_ONEOF(_, NoAlarmRequest) {}
+      KJ_CASE_ONEOF(set, SetAlarmRequest) {
         auto req = txn.setAlarmRequest();
-        req.setScheduledTimeMs((newTime - kj::UNIX_EPOCH) / kj::MILLISECONDS);
-        promises.add(req.send().ignoreResult());
-      } else {
+        req.setScheduledTimeMs((set.scheduledTime - kj::UNIX_EPOCH) / kj::MILLISECONDS);
+        tail.add(req.send().ignoreResult());
+      }
+      KJ_CASE_ONEOF(del, DeleteAlarmRequest) {
         auto req = txn.deleteAlarmRequest();
-        KJ_IF_SOME(deferredDelete, currentAlarmTime.tryGet<DeferredAlarmDelete>()) {
-          if (deferredDelete.status == DeferredAlarmDelete::Status::FLUSHING) {
-            req.setTimeToDeleteMs((deferredDelete.timeToDelete - kj::UNIX_EPOCH) / kj::MILLISECONDS);
-            auto prom = req.send().then([this](auto response) {
-              KJ_IF_SOME(deferredDelete, currentAlarmTime.tryGet<DeferredAlarmDelete>()) {
-                if (deferredDelete.status == DeferredAlarmDelete::Status::FLUSHING) {
-                  // We always update wasDeleted regardless of whether or not it is true
-                  // because this continuation can succeed even if the greater transaction fails,
-                  // and so we want to make sure we end up with the correct value if the first
-                  // attempt succeeds to delete, the txn fails, and the retry fails to delete.
-                  // The early update is OK because we don't actually use the incorrect state until
-                  // the transaction succeeds in the .then() below.
-                  deferredDelete.wasDeleted = response.getDeleted();
-                }
+        KJ_IF_SOME(timeToDelete, del.timeToDelete) {
+          req.setTimeToDeleteMs((timeToDelete - kj::UNIX_EPOCH) / kj::MILLISECONDS);
+          tail.add(req.send().then([this](auto response) {
+            KJ_IF_SOME(deferredDelete, currentAlarmTime.tryGet<DeferredAlarmDelete>()) {
+              if (deferredDelete.status == DeferredAlarmDelete::Status::FLUSHING) {
+                // We always update wasDeleted regardless of whether or not it is true
+                // because this continuation can succeed even if the greater transaction
+                // fails, and so we want to make sure we end up with the correct value if the
+                // first attempt succeeds to delete, the txn fails, and the retry fails to
+                // delete. The early update is OK because we don't actually use the incorrect
+                // state until the transaction succeeds in the .then() below.
+                deferredDelete.wasDeleted = response.getDeleted();
               }
-            });
-            promises.add(kj::mv(prom));
-          }
-          // Not sending a delete request for WAITING or READY is intentional. The WAITING
-          // state refers to when the alarm run has started but has not completed successfully,
-          // and READY is set when the run completes -- only FLUSHING indicates we actually
-          // need to send a request.
+            }
+          }));
         } else {
-          promises.add(req.send().ignoreResult());
+          tail.add(req.send().ignoreResult());
         }
       }
     }
-    KJ_CASE_ONEOF(_, CleanAlarm) {}
-  }
+
+    tail.add(txn.commitRequest(capnp::MessageSize { 4, 0 }).send().ignoreResult());
+    return kj::joinPromises(tail.releaseAsArray());
+  };
 
   // We have to wait on the transaction promise so we don't cancel the catch_ branch that triggers
   // our autoReconnect logic on storage failures.
   // TODO(cleanup): We should probably fix ReconnectHook so the catch_ doesn't get canceled
   // if the promise is dropped but the pipeline stays alive.
-  promises.add(txnProm.ignoreResult());
+  auto txnDone = txnProm.ignoreResult();
 
   {
     util::DurationExceededLogger logger(clock, 1*kj::SECONDS, "storage operation took longer than expected: commit flush transaction");
-    promises.add(txn.commitRequest(capnp::MessageSize { 4, 0 }).send().ignoreResult());
+    auto promises = kj::arr(kj::mv(txnDone), sendFlushBatches(
+        rpcs.releaseAsArray(), lru.options.maxFlushBytesInFlight, kj::mv(sendAlarmAndCommit)));
 
-    co_await kj::joinPromises(promises.finish());
+    co_await kj::joinPromises(kj::mv(promises));
   }
 }
 
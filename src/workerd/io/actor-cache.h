@@ -388,6 +388,21 @@ private:
     ~Entry() noexcept(false);
     KJ_DISALLOW_COPY_AND_MOVE(Entry);
 
+    // Creates an entry holding copies of `key` and `value`, stored in the same allocation as the
+    // `Entry` itself rather than in two more. A null `value` creates an ABSENT entry. The entry is
+    // charged to `cache`'s LRU if given.
+    //
+    // Use this only when the key and value are borrowed and would have to be copied anyway, e.g.
+    // when they are read out of a storage response. An owned key and value should be moved into
+    // one of the constructors instead. Besides saving allocations, this saves the allocator's per-block overhead,
+    // which for small keys and values can be larger than the data itself.
+    static kj::Own<Entry> makeInline(kj::Maybe<ActorCache&> cache, KeyPtr key,
+                                     kj::Maybe<ValuePtr> value);
+
+    // makeInline() allocates more than sizeof(Entry), so an `Entry` must always be freed with the
+    // unsized operator delete.
+    static void operator delete(void* ptr) { ::operator delete(ptr); }
+
     kj::Maybe<ActorCache&> maybeCache;
     const Key key;
 
@@ -546,8 +561,21 @@ private:
   //
   // This map is protected by the same lock as lru.cleanList. ExternalMutexGuarded helps enforce
   // this.
-  kj::ExternalMutexGuarded<kj::Table<kj::Own<Entry>, kj::TreeIndex<EntryTableCallbacks>>>
-      currentValues;
+  using EntryTable = kj::Table<kj::Own<Entry>, kj::TreeIndex<EntryTableCallbacks>>;
+  kj::ExternalMutexGuarded<EntryTable> currentValues;
+
+  // Remembers where in `currentValues` the previous call to addReadResultToCache() left off, so
+  // that a batch of read results arriving in ascending key order -- as from a forward list() --
+  // can be placed by stepping forward from there rather than searching the tree from the root.
+  //
+  // A hint is only valid as long as nothing else modifies `currentValues`, so it must not outlive
+  // the lock under which it was created.
+  struct ReadResultHint {
+    kj::Maybe<decltype(kj::instance<EntryTable&>().ordered().begin())> iter;
+  };
+
+  // How far addReadResultToCache() will step forward from a hint before giving up and searching.
+  static constexpr uint MAX_HINT_STEPS = 8;
 
   struct UnknownAlarmTime{};
   struct KnownAlarmTime{
@@ -605,6 +633,30 @@ private:
 
   kj::Maybe<DeleteAllState> requestedDeleteAll;
 
+  // Tracks limited forward list() calls in order to detect an application paginating through a
+  // range, one page per call, so that list() can read ahead the following pages from storage in
+  // the same round trip.
+  struct ListCursor {
+    // `beginKey` and `limit` of the most recent limited forward list().
+    Key beginKey;
+    uint limit;
+
+    // Whether that list() returned a full page, i.e. `limit` results.
+    bool lastPageWasFull = false;
+
+    // Number of consecutive list() calls, before the most recent one, that each began after the
+    // previous one with the same limit, following a full page.
+    uint sequentialPages = 0;
+
+    // Incremented on every limited forward list(), so that a list() completing asynchronously
+    // can tell whether it is still the most recent one.
+    uint64_t generation = 0;
+  };
+  kj::Maybe<ListCursor> listCursor;
+
+  // Maximum number of entries list() will read ahead beyond the requested limit.
+  static constexpr uint MAX_LIST_READ_AHEAD = 8192;
+
 
   // Promise for the completion of the previous flush. We can only execute one flushImpl() at a time
   // because we can't allow out-of-order writes.
@@ -644,13 +696,24 @@ private:
   // inserted and will instead immediately have state NOT_IN_CACHE.
   //
   // Either way, a strong reference to the entry is returned.
-  kj::Own<Entry> addReadResultToCache(Lock& lock, Key key, kj::Maybe<capnp::Data::Reader> value,
-                                      const ReadOptions& readOptions);
+  //
+  // When adding a series of results in ascending key order, pass the same `hint` to each call.
+  kj::Own<Entry> addReadResultToCache(Lock& lock, KeyPtr key,
+                                      kj::Maybe<capnp::Data::Reader> value,
+                                      const ReadOptions& readOptions,
+                                      kj::Maybe<ReadResultHint&> hint = kj::none);
 
 
   // Mark all gaps empty between the begin and end key.
   void markGapsEmpty(Lock& lock, KeyPtr begin, kj::Maybe<KeyPtr> end, const ReadOptions& options);
 
+  // Updates `listCursor` for a new limited forward list(), and returns how many entries beyond
+  // `limit` the list should read ahead if it has to go to storage.
+  uint startListPage(KeyPtr beginKey, uint limit);
+
+  // Records how many results the list() that called startListPage() returned.
+  void finishListPage(uint64_t generation, size_t resultCount);
+
   // Implements put() or delete(). Multi-key variants call this for each key.
   void putImpl(Lock& lock, kj::Own<Entry> newEntry,
                const WriteOptions& options,  kj::Maybe<CountedDelete&> counted);
@@ -829,6 +892,16 @@ struct ActorCacheSharedLruOptions {
   // If true, don't actually flush anything. This is used in preview sessions, since they keep
   // state strictly in memory.
   bool neverFlush = false;
+
+  // Maximum bytes of put and delete RPCs that a flush transaction will have outstanding at once.
+  // When a flush is split into several batches whose total exceeds this, later batches are sent
+  // only as earlier ones complete, so that a large flush doesn't saturate the connection. At
+  // least one batch is always allowed in flight, and the transaction is still committed as a
+  // whole once every batch has been sent.
+  //
+  // The default matches the storage RPC size limit, so that a flush whose batches add up to more
+  // than a single RPC could carry is spread out over several round trips.
+  size_t maxFlushBytesInFlight = 16 * (1ull << 20);  // 16 MiB
 };
 
 class ActorCache::SharedLru {
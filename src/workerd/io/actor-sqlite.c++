@@ -197,11 +197,12 @@ kj::OneOf<ActorCacheOps::GetResultList, kj::Promise<ActorCacheOps::GetResultList
   requireNotBroken();
 
   kj::Vector<KeyValuePair> results;
-  for (auto& key: keys) {
-    kv.get(key, [&](ValuePtr value) {
-      results.add(KeyValuePair { kj::mv(key), kj::heapArray(value) });
-    });
-  }
+  auto keyPtrs = KJ_MAP(key, keys) -> KeyPtr { return key; };
+  kv.getMultiple(keyPtrs, [&](KeyPtr key, ValuePtr value) {
+    results.add(KeyValuePair { kj::str(key), kj::heapArray(value) });
+  });
+
+  // Each batch is sorted, but batches are not sorted relative to each other.
   std::sort(results.begin(), results.end(),
       [](auto& a, auto& b) { return a.key < b.key; });
   return GetResultList(kj::mv(results));
@@ -252,9 +253,10 @@ kj::Maybe<kj::Promise<void>> ActorSqlite::put(
     kj::Array<KeyValuePair> pairs, WriteOptions options) {
   requireNotBroken();
 
-  for (auto& pair: pairs) {
-    kv.put(pair.key, pair.value);
-  }
+  auto pairPtrs = KJ_MAP(pair, pairs) -> SqliteKv::KeyValuePtr {
+    return { pair.key, pair.value };
+  };
+  kv.putMultiple(pairPtrs);
   return kj::none;
 }
 
@@ -268,11 +270,8 @@ kj::OneOf<uint, kj::Promise<uint>> ActorSqlite::delete_(
     kj::Array<Key> keys, WriteOptions options) {
   requireNotBroken();
 
-  uint count = 0;
-  for (auto& key: keys) {
-    count += kv.delete_(key);
-  }
-  return count;
+  auto keyPtrs = KJ_MAP(key, keys) -> KeyPtr { return key; };
+  return kv.deleteMultiple(keyPtrs);
 }
 
 kj::Maybe<kj::Promise<void>> ActorSqlite::setAlarm(
@@ -23,6 +23,7 @@ public:
     const kj::HttpHeaderId cfBlobMetadataSize;    // used by R2 binding implementation
     const kj::HttpHeaderId cfBlobRequest;         // used by R2 binding implementation
     const kj::HttpHeaderId authorization;         // used by R2 binding implementation
+    const kj::HttpHeaderId cfQueueBatchFormat;    // used by Queue binding implementation
     const kj::HttpHeaderId secWebSocketProtocol;
   };
 
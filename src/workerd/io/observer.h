@@ -133,6 +133,13 @@ public:
     virtual void gcEpilogue() {}
   };
 
+  // Called each time a thread is granted the isolate's async lock after joining the queue for it.
+  // `waitTime` is how long the thread spent in the queue and `queueDepth` is how many threads
+  // were ahead of it when it joined. Unlike LockTiming, this is reported for every lock attempt,
+  // so implementations should keep it cheap (e.g. by bumping histogram buckets). It may be called
+  // from any thread.
+  virtual void asyncLockGranted(kj::Duration waitTime, uint queueDepth) const {}
+
   // Construct a LockTiming if config.reportScriptLockTiming is true, or if the
   // request (if any) is being traced.
   virtual kj::Maybe<kj::Own<LockTiming>> tryCreateLockTiming(
@@ -215,6 +222,10 @@ public:
   virtual void addStorageWriteUnits(uint32_t units) {}
   virtual void addStorageDeletes(uint32_t count) {}
 
+  // Reports the page cache statistics of the actor's SQLite database, if it has one stored on
+  // local disk. Called periodically while the database is in use.
+  virtual void sqlitePageCacheStats(uint64_t hits, uint64_t misses, uint64_t bytesUsed) {}
+
   virtual void inputGateLocked() {}
   virtual void inputGateReleased() {}
   virtual void inputGateWaiterAdded() {}
@@ -303,6 +303,11 @@ private:
   kj::ForkedPromise<void> releasePromise = nullptr;
   kj::Own<kj::PromiseFulfiller<void>> releaseFulfiller;
 
+  // When this waiter joined the queue, and how many waiters were ahead of it, for reporting to
+  // `IsolateObserver::asyncLockGranted()`.
+  kj::TimePoint enqueueTime;
+  uint queueDepth;
+
   // Protected by the lock on `Isolate::asyncWaiters` for the isolate identified by
   // `currentIsolate`. Must be null if `currentIsolate` is null. (All other members of `Waiter`
   // can only be accessed by the thread that created the `Waiter`.)
@@ -1960,6 +1965,7 @@ Worker::Isolate::AsyncWaiterList::~AsyncWaiterList() noexcept {
   // dangling pointers.
   KJ_ASSERT(head == kj::none, "destroying non-empty waiter list?");
   KJ_ASSERT(tail == &head, "tail pointer corrupted?");
+  KJ_ASSERT(size == 0, "waiter list size corrupted?");
 }
 
 kj::Promise<Worker::AsyncLock> Worker::Isolate::takeAsyncLockWithoutRequest(
@@ -1993,6 +1999,9 @@ kj::Promise<Worker::AsyncLock> Worker::Isolate::takeAsyncLockImpl(
       }
       auto newWaiter = kj::refcounted<AsyncWaiter>(kj::atomicAddRef(*this));
       co_await newWaiter->readyPromise;
+      getMetrics().asyncLockGranted(
+          kj::systemPreciseMonotonicClock().now() - newWaiter->enqueueTime,
+          newWaiter->queueDepth);
       co_return AsyncLock(kj::mv(newWaiter), kj::mv(lockTiming));
     } else if (waiter->isolate == this) {
       // Thread is waiting on a lock already, and it's for the same isolate. We can coalesce the
@@ -2028,7 +2037,8 @@ kj::Promise<Worker::AsyncLock> Worker::takeAsyncLock(RequestObserver& request) c
 
 Worker::AsyncWaiter::AsyncWaiter(kj::Own<const Isolate> isolateParam)
     : executor(kj::getCurrentThreadExecutor()),
-      isolate(kj::mv(isolateParam)) {
+      isolate(kj::mv(isolateParam)),
+      enqueueTime(kj::systemPreciseMonotonicClock().now()) {
   // Init `releasePromise` / `releaseFulfiller`.
   {
     auto paf = kj::newPromiseAndFulfiller<void>();
@@ -2053,6 +2063,7 @@ Worker::AsyncWaiter::AsyncWaiter(kj::Own<const Isolate> isolateParam)
   prev = lock->tail;
   *lock->tail = this;
   lock->tail = &next;
+  queueDepth = lock->size++;
 
   threadCurrentWaiter = this;
 
@@ -2065,26 +2076,38 @@ Worker::AsyncWaiter::~AsyncWaiter() noexcept {
 
   __atomic_sub_fetch(&isolate->impl->lockAttemptGauge, 1, __ATOMIC_RELAXED);
 
-  auto lock = isolate->asyncWaiters.lockExclusive();
-
+  // `releaseFulfiller` belongs to this thread, so there's no need to hold the list lock for this.
   releaseFulfiller->fulfill();
 
-  // Remove ourselves from the list.
-  *prev = next;
-  KJ_IF_SOME(n, next) {
-    n.prev = prev;
-  } else {
-    lock->tail = prev;
-  }
+  kj::Own<kj::CrossThreadPromiseFulfiller<void>> nextFulfiller;
+  {
+    auto lock = isolate->asyncWaiters.lockExclusive();
 
-  if (prev == &lock->head) {
-    // We held the lock before now. Alert the next waiter that they are now at the front of the
-    // line.
+    // Remove ourselves from the list.
+    *prev = next;
     KJ_IF_SOME(n, next) {
-      n.readyFulfiller->fulfill();
+      n.prev = prev;
+    } else {
+      lock->tail = prev;
+    }
+    --lock->size;
+
+    if (prev == &lock->head) {
+      // We held the lock before now. The next waiter is now at the front of the line. We take
+      // its fulfiller and alert it after releasing the list lock, so that other threads joining
+      // or leaving the queue don't have to wait on the cross-thread wakeup. If the next waiter is
+      // canceled in the meantime, fulfilling its dropped promise is harmless; meanwhile it will
+      // see itself at the head of the list and pass the lock along.
+      KJ_IF_SOME(n, next) {
+        nextFulfiller = kj::mv(n.readyFulfiller);
+      }
     }
   }
 
+  if (nextFulfiller.get() != nullptr) {
+    nextFulfiller->fulfill();
+  }
+
   KJ_ASSERT(threadCurrentWaiter == this);
   threadCurrentWaiter = nullptr;
 }
@@ -373,15 +373,21 @@ private:
     kj::Maybe<AsyncWaiter&> head = kj::none;
     kj::Maybe<AsyncWaiter&>* tail = &head;
 
+    // Number of waiters in the list, including the one at the head holding the lock.
+    uint size = 0;
+
     ~AsyncWaiterList() noexcept;
   };
 
   // Mutex-guarded linked list of threads waiting for an async lock on this worker. The lock
   // protects the `AsyncWaiterList` as well as the next/prev pointers in each `AsyncWaiter` that
   // is currently in the list.
+  //
+  // The mutex is only ever held for a few pointer updates. In particular, waking the next waiter
+  // -- which goes through its thread's executor and may make a syscall -- happens after the mutex
+  // is released. A lock-free queue wouldn't buy much beyond that, and would be hard to get right
+  // given that a waiter may be canceled while it's in the middle of the list.
   kj::MutexGuarded<AsyncWaiterList> asyncWaiters;
-  // TODO(perf): Use a lock-free list? Tricky to get right. `asyncWaiters` should only be locked
-  //   briefly so there's probably not that much to gain.
 
   friend class Worker::AsyncLock;
 
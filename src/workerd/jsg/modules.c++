@@ -243,6 +243,56 @@ v8::MaybeLocal<v8::Value> evaluateSyntheticModuleCallback(
   return scope.EscapeMaybe(result);
 }
 
+v8::Local<v8::UnboundModuleScript> getUnboundScript(v8::Local<v8::Module> module) {
+  return module->GetUnboundModuleScript();
+}
+v8::Local<v8::UnboundScript> getUnboundScript(v8::Local<v8::UnboundScript> script) {
+  return script;
+}
+
+// Compiles `contentStr` by calling `compile(source, options)`, using the isolate's CodeCache if
+// there is one: data cached by an earlier compile of the same content is consumed if available,
+// otherwise the code cache produced by this compile is added for next time.
+template <typename T, typename Func>
+v8::Local<T> compileWithCodeCache(jsg::Lock& js,
+                                  kj::ArrayPtr<const char> content,
+                                  v8::Local<v8::String> contentStr,
+                                  const v8::ScriptOrigin& origin,
+                                  Func&& compile) {
+  KJ_IF_SOME(cache, IsolateBase::from(js.v8Isolate).getCodeCache()) {
+    auto addToCache = [&](v8::Local<T> result) {
+      std::unique_ptr<v8::ScriptCompiler::CachedData> created(
+          v8::ScriptCompiler::CreateCodeCache(getUnboundScript(result)));
+      if (created != nullptr) {
+        cache.add(content, kj::arrayPtr(created->data, created->length));
+      }
+    };
+
+    KJ_IF_SOME(data, cache.find(content)) {
+      // The Source takes ownership of the CachedData object, but with BufferNotOwned it won't
+      // free the buffer, which `data` keeps alive until we're done.
+      v8::ScriptCompiler::Source source(contentStr, origin,
+          new v8::ScriptCompiler::CachedData(data.begin(), data.size(),
+              v8::ScriptCompiler::CachedData::BufferNotOwned));
+      v8::Local<T> result = compile(source, v8::ScriptCompiler::kConsumeCodeCache);
+      if (source.GetCachedData()->rejected) {
+        // The data came from a different V8 version or different flags, so V8 compiled from
+        // scratch. Replace the entry with one that will work next time.
+        addToCache(result);
+      }
+      return result;
+    }
+
+    v8::ScriptCompiler::Source source(contentStr, origin);
+    v8::Local<T> result = compile(source, v8::ScriptCompiler::kNoCompileOptions);
+    addToCache(result);
+    return result;
+  }
+
+  v8::ScriptCompiler::Source source(contentStr, origin);
+  return compile(source, v8::ScriptCompiler::kNoCompileOptions);
+}
+
 }  // namespace
 
 ModuleRegistry* getModulesForResolveCallback(v8::Isolate* isolate) {
@@ -322,9 +372,11 @@ NonModuleScript NonModuleScript::compile(kj::StringPtr code, jsg::Lock& js, kj::
   // Create a dummy script origin for it to appear in Sources panel.
   auto isolate = js.v8Isolate;
   v8::ScriptOrigin origin(v8StrIntern(isolate, name));
-  v8::ScriptCompiler::Source source(v8Str(isolate, code), origin);
-  return NonModuleScript(js,
-      check(v8::ScriptCompiler::CompileUnboundScript(isolate, &source)));
+  return NonModuleScript(js, compileWithCodeCache<v8::UnboundScript>(
+      js, code.asArray(), v8Str(isolate, code), origin,
+      [&](v8::ScriptCompiler::Source& source, v8::ScriptCompiler::CompileOptions options) {
+    return check(v8::ScriptCompiler::CompileUnboundScript(isolate, &source, options));
+  }));
 }
 
 void instantiateModule(jsg::Lock& js, v8::Local<v8::Module>& module) {
@@ -430,10 +482,10 @@ v8::Local<v8::Module> compileEsmModule(
 
   contentStr = jsg::v8Str(js.v8Isolate, content);
 
-  v8::ScriptCompiler::Source source(contentStr, origin);
-  auto module = jsg::check(v8::ScriptCompiler::CompileModule(js.v8Isolate, &source));
-
-  return module;
+  return compileWithCodeCache<v8::Module>(js, content, contentStr, origin,
+      [&](v8::ScriptCompiler::Source& source, v8::ScriptCompiler::CompileOptions options) {
+    return jsg::check(v8::ScriptCompiler::CompileModule(js.v8Isolate, &source, options));
+  });
 }
 
 v8::Local<v8::Module> createSyntheticModule(
@@ -159,6 +159,24 @@ private:
   jsg::Value exports;
 };
 
+// Caches V8 "code cache" data -- the serialized result of parsing and compiling a script -- keyed
+// by the script's source text, so that compiling the same source again, in any isolate, can skip
+// most of that work. Install one for the whole process with V8System::setCodeCache(). Used for
+// Worker bundle modules and non-module scripts; built-in modules have their own cache.
+//
+// Implementations must be thread-safe, since isolates on different threads share the cache.
+class CodeCache {
+public:
+  virtual ~CodeCache() noexcept(false) = default;
+
+  // Returns the data previously added for `source`, if any.
+  virtual kj::Maybe<kj::Array<const kj::byte>> find(kj::ArrayPtr<const char> source) const = 0;
+
+  // Records the data for `source`, replacing any previous entry (which may have been rejected by
+  // V8 for having been produced by a different V8 version or different flags).
+  virtual void add(kj::ArrayPtr<const char> source, kj::ArrayPtr<const kj::byte> data) const = 0;
+};
+
 // jsg::NonModuleScript wraps a v8::UnboundScript.
 class NonModuleScript {
 public:
@@ -115,11 +115,48 @@ struct SerTestContext: public ContextGlobalObject {
     return result;
   }
 
+  // Like roundTrip(), but serializes into a buffer supplied by a BufferAllocator, with a size
+  // limit.
+  JsValue roundTripLimited(Lock& js, JsValue in, uint maxSize, Optional<bool> customMessage) {
+    class VectorAllocator final: public Serializer::BufferAllocator {
+    public:
+      kj::ArrayPtr<kj::byte> reallocate(size_t size) override {
+        buffer.resize(size);
+        return buffer.asPtr();
+      }
+
+      kj::Vector<kj::byte> buffer;
+    };
+
+    VectorAllocator allocator;
+    Serializer::Options options {
+      .bufferAllocator = allocator,
+      .maxSize = maxSize,
+    };
+    if (customMessage.orDefault(false)) {
+      options.sizeLimitMessage = kj::Function<kj::String(size_t)>([](size_t size) {
+        return kj::str("Too big: ", size, " bytes.");
+      });
+    }
+
+    auto content = ({
+      Serializer ser(js, kj::mv(options));
+      ser.write(js, in);
+      ser.release();
+    });
+    KJ_EXPECT(content.data.begin() == allocator.buffer.begin());
+    KJ_EXPECT(content.data.size() <= maxSize);
+
+    Deserializer deser(js, content);
+    return deser.readValue(js);
+  }
+
   JSG_RESOURCE_TYPE(SerTestContext) {
     JSG_NESTED_TYPE(Foo);
     JSG_NESTED_TYPE(Bar);
     JSG_NESTED_TYPE(Baz);
     JSG_METHOD(roundTrip);
+    JSG_METHOD(roundTripLimited);
   }
 };
 JSG_DECLARE_ISOLATE_TYPE(
@@ -248,5 +285,23 @@ KJ_TEST("serialization") {
       "roundTrip(obj).bar.val.bar.val.bar.val.i", "number", "321");
 }
 
+KJ_TEST("serialization with a buffer allocator and size limit") {
+  Evaluator<SerTestContext, SerTestIsolate> e(v8System);
+
+  e.expectEval("roundTripLimited({foo: 'x'.repeat(1000)}, 2000).foo.length", "number", "1000");
+  e.expectEval("roundTripLimited(new Foo(123), 100).i", "number", "125");
+
+  // Too big, whether caught while growing the buffer or only once the data is complete.
+  e.expectEval("roundTripLimited(new Array(1000000).fill('x'), 2000)", "throws",
+      "Error: Serialized value exceeds the size limit of 2000 bytes.");
+  e.expectEval("roundTripLimited('x'.repeat(1000), 1000)", "throws",
+      "Error: Serialized value exceeds the size limit of 1000 bytes.");
+
+  // The caller can supply the message, which is given the value's full size even though the
+  // buffer stopped growing at the limit.
+  e.expectEval("roundTripLimited('x'.repeat(100000), 2000, true)", "throws",
+      "Error: Too big: 100006 bytes.");
+}
+
 }  // namespace
 }  // namespace workerd::jsg::test
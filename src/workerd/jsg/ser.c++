@@ -14,6 +14,9 @@ void Serializer::ExternalHandler::serializeFunction(
 
 Serializer::Serializer(Lock& js, Options options)
     : externalHandler(options.externalHandler),
+      bufferAllocator(options.bufferAllocator),
+      maxSize(options.maxSize),
+      sizeLimitMessage(kj::mv(options.sizeLimitMessage)),
       treatClassInstancesAsPlainObjects(options.treatClassInstancesAsPlainObjects),
       ser(js.v8Isolate, this) {
 #ifdef KJ_DEBUG
@@ -76,6 +79,57 @@ void Serializer::ThrowDataCloneError(v8::Local<v8::String> message) {
   }
 }
 
+void* Serializer::ReallocateBufferMemory(void* oldBuffer, size_t size, size_t* actualSize) {
+  KJ_IF_SOME(allocator, bufferAllocator) {
+    if (!spilled) {
+      bool tooBig = false;
+      KJ_IF_SOME(limit, maxSize) {
+        // V8 only grows the buffer once the data no longer fits, so if the buffer already holds
+        // `limit` bytes, the value is certainly too big. (`size` itself says little, since V8 asks
+        // for double what it needs.)
+        tooBig = buffer.size() >= limit;
+      }
+
+      if (tooBig) {
+        // release() will reject the value, but it needs the value's full size for the error
+        // message. Finish serializing into memory of our own rather than making the allocator
+        // hold the excess.
+        void* newBuffer = malloc(size);
+        if (newBuffer == nullptr) return nullptr;
+        memcpy(newBuffer, buffer.begin(), buffer.size());
+        spilled = true;
+        buffer = kj::arrayPtr(static_cast<kj::byte*>(newBuffer), size);
+      } else {
+        try {
+          buffer = allocator.reallocate(size);
+        } catch (...) {
+          // V8 will throw a DataCloneError saying it ran out of memory.
+          KJ_LOG(ERROR, "BufferAllocator failed", kj::getCaughtExceptionAsKj());
+          return nullptr;
+        }
+        KJ_DASSERT(buffer.size() >= size);
+      }
+
+      *actualSize = buffer.size();
+      return buffer.begin();
+    }
+  }
+
+  void* newBuffer = realloc(oldBuffer, size);
+  if (newBuffer == nullptr) return nullptr;
+  buffer = kj::arrayPtr(static_cast<kj::byte*>(newBuffer), size);
+
+  *actualSize = buffer.size();
+  return buffer.begin();
+}
+
+void Serializer::FreeBufferMemory(void* buffer) {
+  // A BufferAllocator's buffer belongs to the allocator, unless we spilled out of it.
+  if (bufferAllocator == kj::none || spilled) {
+    free(buffer);
+  }
+}
+
 bool Serializer::HasCustomHostObject(v8::Isolate* isolate) {
   // V8 will always call WriteHostObject() for objects that have internal fields. We only need
   // to override IsHostObject() if we want to treat pure-JS objects differently, which we do if
@@ -150,8 +204,22 @@ Serializer::Released Serializer::release() {
   sharedArrayBuffers.clear();
   arrayBuffers.clear();
   auto pair = ser.Release();
+  auto data = bufferAllocator == kj::none || spilled
+      ? kj::Array(pair.first, pair.second, jsg::SERIALIZED_BUFFER_DISPOSER)
+      : kj::Array(pair.first, pair.second, kj::NullArrayDisposer::instance);
+  KJ_IF_SOME(limit, maxSize) {
+    // The buffer may have been allowed to grow somewhat past the limit, so check the exact size.
+    if (data.size() > limit) {
+      KJ_IF_SOME(message, sizeLimitMessage) {
+        JSG_FAIL_REQUIRE(DOMDataCloneError, message(data.size()));
+      } else {
+        JSG_FAIL_REQUIRE(DOMDataCloneError,
+            "Serialized value exceeds the size limit of ", limit, " bytes.");
+      }
+    }
+  }
   return Released {
-    .data = kj::Array(pair.first, pair.second, jsg::SERIALIZED_BUFFER_DISPOSER),
+    .data = kj::mv(data),
     .sharedArrayBuffers = sharedBackingStores.releaseAsArray(),
     .transferredArrayBuffers = backingStores.releaseAsArray(),
   };
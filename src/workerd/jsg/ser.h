@@ -72,6 +72,19 @@ public:
         jsg::Lock& js, jsg::Serializer& serializer, v8::Local<v8::Function> func);
   };
 
+  // Supplies the memory that the serialized data is written into, so that the caller can have it
+  // written directly where it's needed (e.g. into a Cap'n Proto message) instead of copying it
+  // out of a temporary buffer afterwards. By default, the buffer is allocated with malloc().
+  class BufferAllocator {
+  public:
+    // Grows the buffer to at least `size` bytes, preserving its current content, and returns the
+    // whole buffer. The first call allocates the buffer. May return more than was asked for.
+    //
+    // The allocator owns the buffer: the Serializer never frees it, and the data returned by
+    // `release()` merely points into it.
+    virtual kj::ArrayPtr<kj::byte> reallocate(size_t size) = 0;
+  };
+
   struct Options {
     // When set, overrides the default wire format version with the one provided.
     kj::Maybe<uint32_t> version;
@@ -101,10 +114,23 @@ public:
     // ExternalHandler, if any. Typically this would be allocated on the stack just before the
     // Serializer.
     kj::Maybe<ExternalHandler&> externalHandler;
+
+    // BufferAllocator, if any. Like the ExternalHandler, it must outlive the Serializer.
+    kj::Maybe<BufferAllocator&> bufferAllocator;
+
+    // If set, serializing a value larger than this many bytes fails with DataCloneError. Once the
+    // value outgrows the limit, the rest of it is written to a temporary buffer rather than the
+    // BufferAllocator's, so that the error can report its size.
+    kj::Maybe<size_t> maxSize;
+
+    // Builds the message of the error thrown when the value exceeds `maxSize`, given the value's
+    // size in bytes. If not set, a generic message is used.
+    kj::Maybe<kj::Function<kj::String(size_t size)>> sizeLimitMessage;
   };
 
   struct Released {
-    // The serialized data.
+    // The serialized data. If a BufferAllocator was used, this points into its buffer and does
+    // not own the memory.
     kj::Array<kj::byte> data;
 
     // All instances of SharedArrayBuffer seen during serialization. Pass these along to the
@@ -162,7 +188,20 @@ private:
       v8::Isolate* isolate,
       v8::Local<v8::SharedArrayBuffer> sab) override;
 
+  void* ReallocateBufferMemory(void* oldBuffer, size_t size, size_t* actualSize) override;
+  void FreeBufferMemory(void* buffer) override;
+
   kj::Maybe<ExternalHandler&> externalHandler;
+  kj::Maybe<BufferAllocator&> bufferAllocator;
+  kj::Maybe<size_t> maxSize;
+  kj::Maybe<kj::Function<kj::String(size_t size)>> sizeLimitMessage;
+
+  // The buffer V8 is currently writing into, and its capacity.
+  kj::ArrayPtr<kj::byte> buffer;
+
+  // Set once the value has outgrown `maxSize` and `buffer` has been moved out of the
+  // BufferAllocator's memory into memory from malloc().
+  bool spilled = false;
 
   kj::Vector<JsValue> sharedArrayBuffers;
   kj::Vector<JsValue> arrayBuffers;
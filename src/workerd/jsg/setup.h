@@ -55,9 +55,14 @@ public:
   typedef void FatalErrorCallback(kj::StringPtr location, kj::StringPtr message);
   static void setFatalErrorCallback(FatalErrorCallback* callback);
 
+  // Installs a cache of compiled code shared by all isolates. Must be called before any isolates
+  // are created.
+  void setCodeCache(kj::Own<const CodeCache> cache) { codeCache = kj::mv(cache); }
+
 private:
   kj::Own<v8::Platform> platformInner;
   V8PlatformWrapper platformWrapper;
+  kj::Maybe<kj::Own<const CodeCache>> codeCache;
   friend class IsolateBase;
 
   explicit V8System(kj::Own<v8::Platform>, kj::ArrayPtr<const kj::StringPtr>);
@@ -132,6 +137,13 @@ public:
 
   IsolateObserver& getObserver() { return *observer; }
 
+  kj::Maybe<const CodeCache&> getCodeCache() const {
+    KJ_IF_SOME(cache, system.codeCache) {
+      return *cache;
+    }
+    return kj::none;
+  }
+
   // Implementation of MemoryRetainer
   void jsgGetMemoryInfo(MemoryTracker& tracker) const;
   kj::StringPtr jsgGetMemoryName() const { return "IsolateBase"_kjc; }
@@ -0,0 +1,64 @@
+// Copyright (c) 2017-2022 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+#include "code-cache.h"
+#include <kj/test.h>
+
+namespace workerd::server {
+namespace {
+
+KJ_TEST("CodeCacheImpl in memory") {
+  CodeCacheImpl cache;
+
+  KJ_EXPECT(cache.find("export default 1;"_kj) == kj::none);
+
+  cache.add("export default 1;"_kj, "data1"_kj.asBytes());
+  cache.add("export default 2;"_kj, "data2"_kj.asBytes());
+
+  KJ_EXPECT(kj::str(KJ_ASSERT_NONNULL(cache.find("export default 1;"_kj)).asChars()) == "data1");
+  KJ_EXPECT(kj::str(KJ_ASSERT_NONNULL(cache.find("export default 2;"_kj)).asChars()) == "data2");
+
+  // Data found before a replacement stays valid.
+  auto old = KJ_ASSERT_NONNULL(cache.find("export default 1;"_kj));
+  cache.add("export default 1;"_kj, "replaced"_kj.asBytes());
+  KJ_EXPECT(kj::str(old.asChars()) == "data1");
+  KJ_EXPECT(kj::str(KJ_ASSERT_NONNULL(cache.find("export default 1;"_kj)).asChars()) == "replaced");
+}
+
+KJ_TEST("CodeCacheImpl persisted to directory") {
+  auto dir = kj::newInMemoryDirectory(kj::nullClock());
+
+  {
+    CodeCacheImpl cache(dir->clone());
+    cache.add("export default 1;"_kj, "data1"_kj.asBytes());
+  }
+
+  KJ_EXPECT(dir->listNames().size() == 1);
+
+  // A new cache, as after a restart, finds the entry on disk.
+  CodeCacheImpl cache(dir->clone());
+  KJ_EXPECT(kj::str(KJ_ASSERT_NONNULL(cache.find("export default 1;"_kj)).asChars()) == "data1");
+  KJ_EXPECT(cache.find("export default 2;"_kj) == kj::none);
+}
+
+KJ_TEST("CodeCacheImpl entries round trip") {
+  CodeCacheImpl cache;
+  cache.add("export default 1;"_kj, "data1"_kj.asBytes());
+  cache.add("export default 2;"_kj, "data2"_kj.asBytes());
+
+  // Copy the entries into a new cache, as when embedding them with `workerd compile --code-cache`.
+  CodeCacheImpl copy;
+  uint count = 0;
+  cache.forEachEntry([&](kj::StringPtr key, kj::ArrayPtr<const kj::byte> data) {
+    copy.addEntry(kj::str(key), kj::heapArray(data));
+    ++count;
+  });
+  KJ_EXPECT(count == 2);
+
+  KJ_EXPECT(kj::str(KJ_ASSERT_NONNULL(copy.find("export default 1;"_kj)).asChars()) == "data1");
+  KJ_EXPECT(kj::str(KJ_ASSERT_NONNULL(copy.find("export default 2;"_kj)).asChars()) == "data2");
+}
+
+}  // namespace
+}  // namespace workerd::server
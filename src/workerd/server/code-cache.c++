@@ -0,0 +1,67 @@
+// Copyright (c) 2017-2022 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+#include "code-cache.h"
+#include <kj/encoding.h>
+#include <openssl/sha.h>
+
+namespace workerd::server {
+
+kj::String CodeCacheImpl::keyFor(kj::ArrayPtr<const char> source) {
+  kj::byte hash[SHA256_DIGEST_LENGTH];
+  SHA256(source.asBytes().begin(), source.size(), hash);
+  return kj::encodeHex(kj::arrayPtr(hash, sizeof(hash)));
+}
+
+kj::Array<const kj::byte> CodeCacheImpl::share(const Entry& entry) {
+  return entry.data.asPtr().attach(kj::atomicAddRef(entry));
+}
+
+kj::Maybe<kj::Array<const kj::byte>> CodeCacheImpl::find(kj::ArrayPtr<const char> source) const {
+  auto key = keyFor(source);
+
+  {
+    auto lock = entries.lockShared();
+    KJ_IF_SOME(entry, lock->find(key)) {
+      return share(*entry);
+    }
+  }
+
+  KJ_IF_SOME(dir, directory) {
+    KJ_IF_SOME(file, dir->tryOpenFile(kj::Path(kj::str(key)))) {
+      auto entry = kj::atomicRefcounted<Entry>(file->readAllBytes());
+      auto result = share(*entry);
+      // If another thread loaded the same file concurrently, either copy is fine.
+      entries.lockExclusive()->upsert(kj::mv(key), kj::mv(entry), [](auto&, auto&&) {});
+      return kj::mv(result);
+    }
+  }
+
+  return kj::none;
+}
+
+void CodeCacheImpl::add(kj::ArrayPtr<const char> source,
+                        kj::ArrayPtr<const kj::byte> data) const {
+  auto key = keyFor(source);
+
+  KJ_IF_SOME(dir, directory) {
+    // A failure to persist only costs a recompile after restart, so don't fail the compile.
+    KJ_IF_SOME(exception, kj::runCatchingExceptions([&]() {
+      auto replacer = dir->replaceFile(kj::Path(kj::str(key)),
+          kj::WriteMode::CREATE | kj::WriteMode::MODIFY);
+      replacer->get().writeAll(data);
+      replacer->commit();
+    })) {
+      KJ_LOG(WARNING, "failed to persist compile cache entry", exception);
+    }
+  }
+
+  auto entry = kj::atomicRefcounted<Entry>(kj::heapArray(data));
+  entries.lockExclusive()->upsert(kj::mv(key), kj::mv(entry),
+      [](kj::Own<const Entry>& existing, kj::Own<const Entry>&& replacement) {
+    existing = kj::mv(replacement);
+  });
+}
+
+}  // namespace workerd::server
@@ -0,0 +1,63 @@
+// Copyright (c) 2017-2022 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+#pragma once
+
+#include <kj/filesystem.h>
+#include <kj/map.h>
+#include <kj/mutex.h>
+#include <workerd/jsg/jsg.h>
+
+namespace workerd::server {
+
+// Implements jsg::CodeCache for `Config.compileCache`. Entries are kept in memory, keyed by the
+// SHA-256 of the source, and optionally also written to files in a directory so that they survive
+// restarts and `--watch` reloads.
+//
+// Entries are never evicted. workerd compiles a fixed set of scripts determined by its config, so
+// the cache is bounded by the size of the config's code.
+class CodeCacheImpl final: public jsg::CodeCache {
+public:
+  explicit CodeCacheImpl(kj::Maybe<kj::Own<const kj::Directory>> directory = kj::none)
+      : directory(kj::mv(directory)) {}
+
+  kj::Maybe<kj::Array<const kj::byte>> find(kj::ArrayPtr<const char> source) const override;
+  void add(kj::ArrayPtr<const char> source, kj::ArrayPtr<const kj::byte> data) const override;
+
+  // Adds an entry under a key previously reported by forEachEntry(). Used to load the entries
+  // embedded in a config by `workerd compile --code-cache`. The data is not copied.
+  void addEntry(kj::String key, kj::Array<const kj::byte> data) {
+    entries.lockExclusive()->upsert(kj::mv(key), kj::atomicRefcounted<Entry>(kj::mv(data)),
+        [](kj::Own<const Entry>& existing, kj::Own<const Entry>&& replacement) {
+      existing = kj::mv(replacement);
+    });
+  }
+
+  // Calls `func(kj::StringPtr key, kj::ArrayPtr<const kj::byte> data)` for each entry.
+  template <typename Func>
+  void forEachEntry(Func&& func) const {
+    auto lock = entries.lockShared();
+    for (auto& entry: *lock) {
+      func(entry.key.asPtr(), entry.value->data.asPtr());
+    }
+  }
+
+private:
+  struct Entry: public kj::AtomicRefcounted {
+    kj::Array<const kj::byte> data;
+
+    explicit Entry(kj::Array<const kj::byte> data): data(kj::mv(data)) {}
+  };
+
+  kj::Maybe<kj::Own<const kj::Directory>> directory;
+
+  // Maps hex-encoded SHA-256 of the source to the entry. The hex key is also the file name when
+  // persisting to `directory`.
+  kj::MutexGuarded<kj::HashMap<kj::String, kj::Own<const Entry>>> entries;
+
+  static kj::String keyFor(kj::ArrayPtr<const char> source);
+  static kj::Array<const kj::byte> share(const Entry& entry);
+};
+
+}  // namespace workerd::server
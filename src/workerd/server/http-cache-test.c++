@@ -0,0 +1,231 @@
+// Copyright (c) 2017-2022 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+#include "http-cache.h"
+#include "storage-test-util.h"
+#include <kj/test.h>
+
+namespace workerd::server {
+namespace {
+
+constexpr HttpCache::Options DEFAULT_OPTIONS {
+  .memoryLimit = 1024 * 1024,
+  .maxEntrySize = 64 * 1024,
+};
+
+// Drives an HttpCache the way a Worker's Cache API calls reach it.
+struct CacheTest: public StorageServiceTest<HttpCache> {
+  kj::HttpHeaderId hCfCacheNamespace;
+  kj::HttpHeaderId hCfCacheStatus;
+
+  explicit CacheTest(HttpCache::Options options = DEFAULT_OPTIONS, bool useDisk = false) {
+    restart(options, useDisk);
+  }
+
+  // Replaces the cache with a fresh one over the same directory, as after a restart.
+  void restart(HttpCache::Options options = DEFAULT_OPTIONS, bool useDisk = true) {
+    StorageServiceTest::restart([&](kj::HttpHeaderTable::Builder& builder) {
+      hCfCacheNamespace = builder.add("CF-Cache-Namespace");
+      hCfCacheStatus = builder.add("CF-Cache-Status");
+      auto cache = kj::heap<HttpCache>(builder, options, clock);
+      if (useDisk) cache->setDirectory(*dir);
+      return cache;
+    });
+  }
+
+  kj::HttpHeaders makeHeaders(
+      kj::ArrayPtr<const kj::StringPtr> nameValuePairs, kj::Maybe<kj::StringPtr> cacheName) {
+    kj::HttpHeaders headers(*headerTable);
+    for (size_t i = 0; i + 1 < nameValuePairs.size(); i += 2) {
+      headers.addPtrPtr(nameValuePairs[i], nameValuePairs[i + 1]);
+    }
+    KJ_IF_SOME(name, cacheName) {
+      headers.set(hCfCacheNamespace, name);
+    }
+    return headers;
+  }
+
+  uint put(kj::StringPtr url, kj::StringPtr response,
+           kj::ArrayPtr<const kj::StringPtr> requestHeaders = nullptr,
+           kj::Maybe<kj::StringPtr> cacheName = kj::none) {
+    return StorageServiceTest::request(kj::HttpMethod::PUT, url,
+        makeHeaders(requestHeaders, cacheName), response.asBytes()).statusCode;
+  }
+
+  TestResponse request(kj::HttpMethod method, kj::StringPtr url,
+                       kj::ArrayPtr<const kj::StringPtr> requestHeaders = nullptr,
+                       kj::Maybe<kj::StringPtr> cacheName = kj::none) {
+    return StorageServiceTest::request(method, url, makeHeaders(requestHeaders, cacheName));
+  }
+
+  TestResponse get(kj::StringPtr url, kj::ArrayPtr<const kj::StringPtr> requestHeaders = nullptr,
+                   kj::Maybe<kj::StringPtr> cacheName = kj::none) {
+    return request(kj::HttpMethod::GET, url, requestHeaders, cacheName);
+  }
+
+  kj::Maybe<kj::StringPtr> cacheStatus(const TestResponse& response) {
+    return response.headers.get(hCfCacheStatus);
+  }
+};
+
+KJ_TEST("HttpCache stores and serves responses") {
+  CacheTest test;
+
+  auto miss = test.get("https://example.com/a");
+  KJ_EXPECT(miss.statusCode == 504);
+  KJ_EXPECT(KJ_ASSERT_NONNULL(test.cacheStatus(miss)) == "MISS");
+
+  KJ_EXPECT(test.put("https://example.com/a",
+      "HTTP/1.1 200 OK\r\nContent-Length: 5\r\nCache-Control: max-age=60\r\n\r\nhello") == 204);
+
+  auto hit = test.get("https://example.com/a");
+  KJ_EXPECT(hit.statusCode == 200);
+  KJ_EXPECT(hit.body == "hello");
+  KJ_EXPECT(KJ_ASSERT_NONNULL(test.cacheStatus(hit)) == "HIT");
+
+  auto head = test.request(kj::HttpMethod::HEAD, "https://example.com/a");
+  KJ_EXPECT(head.statusCode == 200);
+  KJ_EXPECT(head.body == "");
+
+  auto range = test.get("https://example.com/a", { "Range"_kj, "bytes=1-3"_kj });
+  KJ_EXPECT(range.statusCode == 206);
+  KJ_EXPECT(range.body == "ell");
+
+  KJ_EXPECT(test.get("https://example.com/b").statusCode == 504);
+
+  // A chunked response is stored with the transfer coding already removed.
+  KJ_EXPECT(test.put("https://example.com/b",
+      "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\nchunks") == 204);
+  KJ_EXPECT(test.get("https://example.com/b").body == "chunks");
+}
+
+KJ_TEST("HttpCache honors freshness") {
+  CacheTest test;
+
+  // Not storable.
+  KJ_EXPECT(test.put("https://example.com/no-store",
+      "HTTP/1.1 200 OK\r\nCache-Control: no-store\r\n\r\nx") == 204);
+  KJ_EXPECT(test.put("https://example.com/private",
+      "HTTP/1.1 200 OK\r\nCache-Control: private, max-age=60\r\n\r\nx") == 204);
+  KJ_EXPECT(test.put("https://example.com/cookie",
+      "HTTP/1.1 200 OK\r\nSet-Cookie: a=b\r\n\r\nx") == 204);
+  KJ_EXPECT(test.get("https://example.com/no-store").statusCode == 504);
+  KJ_EXPECT(test.get("https://example.com/private").statusCode == 504);
+  KJ_EXPECT(test.get("https://example.com/cookie").statusCode == 504);
+
+  // s-maxage wins over max-age, and Age counts against both.
+  KJ_EXPECT(test.put("https://example.com/a",
+      "HTTP/1.1 200 OK\r\nCache-Control: max-age=10, s-maxage=100\r\nAge: 40\r\n\r\na") == 204);
+  KJ_EXPECT(test.put("https://example.com/b",
+      "HTTP/1.1 200 OK\r\n"
+      "Date: Sun, 06 Nov 1994 08:49:37 GMT\r\n"
+      "Expires: Sun, 06 Nov 1994 08:50:07 GMT\r\n\r\nb") == 204);
+  KJ_EXPECT(test.put("https://example.com/c", "HTTP/1.1 200 OK\r\n\r\nc") == 204);
+
+  test.clock.time += 20 * kj::SECONDS;
+  KJ_EXPECT(test.get("https://example.com/a").statusCode == 200);
+  KJ_EXPECT(test.get("https://example.com/b").statusCode == 200);
+
+  test.clock.time += 20 * kj::SECONDS;
+  KJ_EXPECT(test.get("https://example.com/a").statusCode == 200);
+  KJ_EXPECT(test.get("https://example.com/b").statusCode == 504);
+
+  test.clock.time += 40 * kj::SECONDS;
+  KJ_EXPECT(test.get("https://example.com/a").statusCode == 504);
+
+  // No freshness information at all: kept until evicted.
+  KJ_EXPECT(test.get("https://example.com/c").statusCode == 200);
+}
+
+KJ_TEST("HttpCache selects variants with Vary") {
+  CacheTest test;
+
+  KJ_EXPECT(test.put("https://example.com/a",
+      "HTTP/1.1 200 OK\r\nVary: Accept-Encoding\r\n\r\ngzipped",
+      { "Accept-Encoding"_kj, "gzip"_kj }) == 204);
+  KJ_EXPECT(test.put("https://example.com/a",
+      "HTTP/1.1 200 OK\r\nVary: Accept-Encoding\r\n\r\nplain") == 204);
+
+  KJ_EXPECT(test.get("https://example.com/a", { "accept-encoding"_kj, "gzip"_kj }).body ==
+      "gzipped");
+  KJ_EXPECT(test.get("https://example.com/a").body == "plain");
+  KJ_EXPECT(test.get("https://example.com/a", { "Accept-Encoding"_kj, "br"_kj }).statusCode ==
+      504);
+
+  KJ_EXPECT(test.put("https://example.com/b",
+      "HTTP/1.1 200 OK\r\nVary: *\r\n\r\nnever") == 204);
+  KJ_EXPECT(test.get("https://example.com/b").statusCode == 504);
+}
+
+KJ_TEST("HttpCache keeps named caches separate and purges") {
+  CacheTest test;
+
+  KJ_EXPECT(test.put("https://example.com/a", "HTTP/1.1 200 OK\r\n\r\ndefault") == 204);
+  KJ_EXPECT(test.put("https://example.com/a", "HTTP/1.1 200 OK\r\n\r\nnamed",
+                     nullptr, "foo"_kj) == 204);
+
+  KJ_EXPECT(test.get("https://example.com/a").body == "default");
+  KJ_EXPECT(test.get("https://example.com/a", nullptr, "foo"_kj).body == "named");
+  KJ_EXPECT(test.get("https://example.com/a", nullptr, "bar"_kj).statusCode == 504);
+
+  KJ_EXPECT(test.request(kj::HttpMethod::PURGE, "https://example.com/a", nullptr, "foo"_kj)
+      .statusCode == 200);
+  KJ_EXPECT(test.request(kj::HttpMethod::PURGE, "https://example.com/a", nullptr, "foo"_kj)
+      .statusCode == 404);
+  KJ_EXPECT(test.get("https://example.com/a", nullptr, "foo"_kj).statusCode == 504);
+  KJ_EXPECT(test.get("https://example.com/a").body == "default");
+}
+
+KJ_TEST("HttpCache evicts least-recently-used entries") {
+  CacheTest test({ .memoryLimit = 4096, .maxEntrySize = 2048 });
+
+  auto body = kj::str(kj::repeat('x', 900));
+  auto response = kj::str("HTTP/1.1 200 OK\r\n\r\n", body);
+
+  KJ_EXPECT(test.put("https://example.com/1", response) == 204);
+  KJ_EXPECT(test.put("https://example.com/2", response) == 204);
+  KJ_EXPECT(test.put("https://example.com/3", response) == 204);
+
+  // Touch 1 so that 2 is the least-recently-used.
+  KJ_EXPECT(test.get("https://example.com/1").statusCode == 200);
+  KJ_EXPECT(test.put("https://example.com/4", response) == 204);
+
+  KJ_EXPECT(test.service->getMemoryUsage() <= 4096);
+  KJ_EXPECT(test.get("https://example.com/2").statusCode == 504);
+  KJ_EXPECT(test.get("https://example.com/1").statusCode == 200);
+  KJ_EXPECT(test.get("https://example.com/4").statusCode == 200);
+
+  // Bodies larger than maxEntrySize are refused.
+  KJ_EXPECT(test.put("https://example.com/5",
+      kj::str("HTTP/1.1 200 OK\r\n\r\n", kj::repeat('x', 3000))) == 413);
+}
+
+KJ_TEST("HttpCache persists entries to disk") {
+  CacheTest test(DEFAULT_OPTIONS, true);
+
+  KJ_EXPECT(test.put("https://example.com/a",
+      "HTTP/1.1 200 OK\r\nCache-Control: max-age=60\r\nVary: Accept\r\n\r\npersisted",
+      { "Accept"_kj, "text/plain"_kj }) == 204);
+
+  test.restart();
+  KJ_EXPECT(test.get("https://example.com/a").statusCode == 504);
+  auto hit = test.get("https://example.com/a", { "Accept"_kj, "text/plain"_kj });
+  KJ_EXPECT(hit.statusCode == 200);
+  KJ_EXPECT(hit.body == "persisted");
+
+  // Purging removes the entry from disk too.
+  KJ_EXPECT(test.request(kj::HttpMethod::PURGE, "https://example.com/a").statusCode == 200);
+  test.restart();
+  KJ_EXPECT(test.get("https://example.com/a", { "Accept"_kj, "text/plain"_kj }).statusCode == 504);
+
+  // Entries too big for memory are still served from disk.
+  test.restart({ .memoryLimit = 100, .maxEntrySize = 64 * 1024 });
+  KJ_EXPECT(test.put("https://example.com/big",
+      kj::str("HTTP/1.1 200 OK\r\n\r\n", kj::repeat('x', 1000))) == 204);
+  KJ_EXPECT(test.service->getMemoryUsage() == 0);
+  KJ_EXPECT(test.get("https://example.com/big").body.size() == 1000);
+}
+
+}  // namespace
+}  // namespace workerd::server
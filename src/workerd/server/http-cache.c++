@@ -0,0 +1,625 @@
+// Copyright (c) 2017-2022 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+#include "http-cache.h"
+#include <kj/debug.h>
+#include <kj/encoding.h>
+#include <openssl/sha.h>
+#include <workerd/util/stream-utils.h>
+#include <workerd/util/strings.h>
+
+namespace workerd::server {
+
+namespace {
+
+// Allowance for the response head on top of `Options::maxEntrySize` when reading a PUT payload.
+constexpr uint64_t MAX_HEAD_SIZE = 128 * 1024;
+
+kj::ArrayPtr<const char> trim(kj::ArrayPtr<const char> text) {
+  while (text.size() > 0 && (text.front() == ' ' || text.front() == '\t')) {
+    text = text.slice(1, text.size());
+  }
+  while (text.size() > 0 && (text.back() == ' ' || text.back() == '\t')) {
+    text = text.slice(0, text.size() - 1);
+  }
+  return text;
+}
+
+// Splits a comma-separated header value into trimmed, non-empty elements.
+kj::Vector<kj::String> splitList(kj::StringPtr value) {
+  kj::Vector<kj::String> result;
+  while (value.size() > 0) {
+    kj::ArrayPtr<const char> element;
+    KJ_IF_SOME(comma, value.findFirst(',')) {
+      element = value.slice(0, comma);
+      value = value.slice(comma + 1);
+    } else {
+      element = value;
+      value = nullptr;
+    }
+    auto trimmed = trim(element);
+    if (trimmed.size() > 0) {
+      result.add(kj::str(trimmed));
+    }
+  }
+  return result;
+}
+
+bool equalsIgnoreCase(kj::StringPtr a, kj::StringPtr b) {
+  if (a.size() != b.size()) return false;
+  for (auto i: kj::indices(a)) {
+    char ca = a[i], cb = b[i];
+    if ('A' <= ca && ca <= 'Z') ca += 'a' - 'A';
+    if ('A' <= cb && cb <= 'Z') cb += 'a' - 'A';
+    if (ca != cb) return false;
+  }
+  return true;
+}
+
+struct CacheControl {
+  bool noStore = false;
+  bool noCache = false;
+  bool isPrivate = false;
+  kj::Maybe<uint64_t> maxAge;
+  kj::Maybe<uint64_t> sMaxAge;
+};
+
+CacheControl parseCacheControl(kj::StringPtr value) {
+  CacheControl result;
+  for (auto& directive: splitList(value)) {
+    kj::String name;
+    kj::Maybe<kj::String> argument;
+    KJ_IF_SOME(eq, directive.findFirst('=')) {
+      name = toLowerCopy(directive.slice(0, eq));
+      kj::ArrayPtr<const char> arg = directive.slice(eq + 1);
+      if (arg.size() >= 2 && arg.front() == '"' && arg.back() == '"') {
+        arg = arg.slice(1, arg.size() - 1);
+      }
+      argument = kj::str(arg);
+    } else {
+      name = toLowerCopy(directive.asPtr());
+    }
+
+    if (name == "no-store") {
+      result.noStore = true;
+    } else if (name == "no-cache") {
+      // With or without a list of fields, we can't revalidate, so we can't store the response.
+      result.noCache = true;
+    } else if (name == "private") {
+      result.isPrivate = true;
+    } else if (name == "max-age" || name == "s-maxage") {
+      auto& field = name == "max-age" ? result.maxAge : result.sMaxAge;
+      KJ_IF_SOME(a, argument) {
+        KJ_IF_SOME(seconds, a.tryParseAs<uint64_t>()) {
+          field = seconds;
+        } else {
+          // RFC 9111 says to treat an invalid freshness directive as stale.
+          field = uint64_t(0);
+        }
+      } else {
+        field = uint64_t(0);
+      }
+    }
+  }
+  return result;
+}
+
+// Parses an HTTP date in the IMF-fixdate format, e.g. "Sun, 06 Nov 1994 08:49:37 GMT". This is the
+// format all current servers send; RFC 9110 asks recipients to also accept two obsolete formats,
+// but an unparseable date is treated as being in the past, which for a cache is a miss.
+kj::Maybe<kj::Date> parseHttpDate(kj::StringPtr text) {
+  static constexpr kj::StringPtr MONTHS[] = {
+    "Jan"_kj, "Feb"_kj, "Mar"_kj, "Apr"_kj, "May"_kj, "Jun"_kj,
+    "Jul"_kj, "Aug"_kj, "Sep"_kj, "Oct"_kj, "Nov"_kj, "Dec"_kj,
+  };
+
+  if (text.size() != 29 || text[3] != ',' || text[4] != ' ' || text[7] != ' ' ||
+      text[11] != ' ' || text[16] != ' ' || text[19] != ':' || text[22] != ':' ||
+      text.slice(25) != " GMT"_kj) {
+    return kj::none;
+  }
+
+  auto number = [&](size_t begin, size_t end) -> kj::Maybe<int64_t> {
+    int64_t result = 0;
+    for (size_t i = begin; i < end; i++) {
+      if (text[i] < '0' || text[i] > '9') return kj::none;
+      result = result * 10 + (text[i] - '0');
+    }
+    return result;
+  };
+
+  int64_t day = KJ_UNWRAP_OR_RETURN(number(5, 7), kj::none);
+  int64_t year = KJ_UNWRAP_OR_RETURN(number(12, 16), kj::none);
+  int64_t hour = KJ_UNWRAP_OR_RETURN(number(17, 19), kj::none);
+  int64_t minute = KJ_UNWRAP_OR_RETURN(number(20, 22), kj::none);
+  int64_t second = KJ_UNWRAP_OR_RETURN(number(23, 25), kj::none);
+
+  int64_t month = 0;
+  auto monthName = text.slice(8, 11);
+  for (auto i: kj::indices(MONTHS)) {
+    if (monthName == MONTHS[i]) {
+      month = i + 1;
+      break;
+    }
+  }
+  if (month == 0 || day < 1 || day > 31 || hour > 23 || minute > 59 || second > 60) {
+    return kj::none;
+  }
+
+  // Days since the Unix epoch of the given civil date, per Howard Hinnant's `days_from_civil`.
+  int64_t y = month <= 2 ? year - 1 : year;
+  int64_t era = y / 400;
+  int64_t yearOfEra = y - era * 400;
+  int64_t dayOfYear = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+  int64_t dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+  int64_t days = era * 146097 + dayOfEra - 719468;
+
+  return kj::UNIX_EPOCH + ((days * 24 + hour) * 60 + minute) * kj::MINUTES + second * kj::SECONDS;
+}
+
+// Returns true if the `If-None-Match` header value matches the entity tag, using the weak
+// comparison that RFC 9110 prescribes for this header.
+bool ifNoneMatchMatches(kj::StringPtr ifNoneMatch, kj::StringPtr etag) {
+  auto strip = [](kj::StringPtr tag) {
+    return tag.startsWith("W/") ? tag.slice(2) : tag;
+  };
+  auto target = strip(kj::str(trim(etag)));
+  for (auto& tag: splitList(ifNoneMatch)) {
+    if (tag == "*" || strip(tag) == target) return true;
+  }
+  return false;
+}
+
+}  // namespace
+
+HttpCache::Entry::Entry(kj::String key, kj::String varyKey, uint statusCode, kj::String statusText,
+                        kj::HttpHeaders headers, kj::Array<const kj::byte> body,
+                        kj::Date responseTime, kj::Maybe<kj::Date> expires)
+    : key(kj::mv(key)), varyKey(kj::mv(varyKey)), statusCode(statusCode),
+      statusText(kj::mv(statusText)), headers(kj::mv(headers)), body(kj::mv(body)),
+      responseTime(responseTime), expires(expires),
+      size(sizeof(*this) + this->key.size() + this->varyKey.size() +
+           this->headers.serializeResponse(statusCode, this->statusText).size() +
+           this->body.size()) {}
+
+bool HttpCache::Entry::isFresh(kj::Date now) const {
+  KJ_IF_SOME(e, expires) {
+    return now < e;
+  } else {
+    return true;
+  }
+}
+
+HttpCache::HttpCache(kj::HttpHeaderTable::Builder& headerTableBuilder, Options options,
+                     const kj::Clock& clock)
+    : headerTable(headerTableBuilder.getFutureTable()), options(options), clock(clock),
+      hCacheControl(headerTableBuilder.add("Cache-Control")),
+      hCfCacheNamespace(headerTableBuilder.add("CF-Cache-Namespace")),
+      hCfCacheStatus(headerTableBuilder.add("CF-Cache-Status")),
+      hAge(headerTableBuilder.add("Age")),
+      hDate(headerTableBuilder.add("Date")),
+      hExpires(headerTableBuilder.add("Expires")),
+      hEtag(headerTableBuilder.add("ETag")),
+      hIfNoneMatch(headerTableBuilder.add("If-None-Match")),
+      hSetCookie(headerTableBuilder.add("Set-Cookie")),
+      hVary(headerTableBuilder.add("Vary")),
+      hStoredKey(headerTableBuilder.add("X-Workerd-Cache-Key")),
+      hStoredVary(headerTableBuilder.add("X-Workerd-Cache-Vary")),
+      hStoredAt(headerTableBuilder.add("X-Workerd-Cache-Response-Time")),
+      hStoredExpires(headerTableBuilder.add("X-Workerd-Cache-Expires")) {}
+
+HttpCache::~HttpCache() noexcept(false) {
+  // Entries may outlive us if a response is still streaming one, so unlink them all.
+  while (!lru.empty()) {
+    lru.remove(*lru.begin());
+  }
+}
+
+kj::Promise<void> HttpCache::request(
+    kj::HttpMethod method, kj::StringPtr url, const kj::HttpHeaders& headers,
+    kj::AsyncInputStream& requestBody, Response& response) {
+  // Named caches get a prefix that can't collide with a URL, so that each is its own key space.
+  kj::String key;
+  KJ_IF_SOME(name, headers.get(hCfCacheNamespace)) {
+    key = kj::str("cache:", name, ' ', url);
+  } else {
+    key = kj::str(url);
+  }
+
+  switch (method) {
+    case kj::HttpMethod::GET:
+    case kj::HttpMethod::HEAD:
+      return handleGet(method, kj::mv(key), headers, response);
+    case kj::HttpMethod::PUT:
+      return handlePut(kj::mv(key), headers, requestBody, response);
+    case kj::HttpMethod::PURGE:
+      return handlePurge(kj::mv(key), response);
+    default:
+      return response.sendError(501, "Not Implemented", headerTable);
+  }
+}
+
+kj::Promise<void> HttpCache::handleGet(kj::HttpMethod method, kj::String key,
+                                       const kj::HttpHeaders& headers, Response& response) {
+  kj::Own<Entry> entry;
+  KJ_IF_SOME(e, find(key, headers)) {
+    entry = kj::mv(e);
+  } else {
+    kj::HttpHeaders responseHeaders(headerTable);
+    responseHeaders.set(hCfCacheStatus, "MISS");
+    co_return co_await response.sendError(504, "Gateway Timeout", responseHeaders);
+  }
+
+  auto responseHeaders = entry->headers.clone();
+  responseHeaders.set(hCfCacheStatus, "HIT");
+  responseHeaders.set(hAge, kj::str((clock.now() - entry->responseTime) / kj::SECONDS));
+
+  KJ_IF_SOME(etag, entry->headers.get(hEtag)) {
+    KJ_IF_SOME(ifNoneMatch, headers.get(hIfNoneMatch)) {
+      if (ifNoneMatchMatches(ifNoneMatch, etag)) {
+        response.send(304, "Not Modified", responseHeaders, uint64_t(0));
+        co_return;
+      }
+    }
+  }
+
+  uint statusCode = entry->statusCode;
+  kj::StringPtr statusText = entry->statusText;
+  auto body = entry->body.asPtr();
+
+  // Serve a single satisfiable range of a complete response as partial content.
+  // TODO(someday): consider supporting multiple ranges with multipart/byteranges
+  if (method == kj::HttpMethod::GET && statusCode == 200) {
+    KJ_IF_SOME(header, headers.get(kj::HttpHeaderId::RANGE)) {
+      KJ_SWITCH_ONEOF(kj::tryParseHttpRangeHeader(header.asArray(), body.size())) {
+        KJ_CASE_ONEOF(ranges, kj::Array<kj::HttpByteRange>) {
+          KJ_ASSERT(ranges.size() > 0);
+          if (ranges.size() == 1) {
+            auto& r = ranges[0];
+            responseHeaders.set(kj::HttpHeaderId::CONTENT_RANGE,
+                kj::str("bytes ", r.start, "-", r.end, "/", body.size()));
+            statusCode = 206;
+            statusText = "Partial Content";
+            body = body.slice(r.start, r.end + 1);
+          }
+        }
+        KJ_CASE_ONEOF(_, kj::HttpEverythingRange) {}
+        KJ_CASE_ONEOF(_, kj::HttpUnsatisfiableRange) {
+          kj::HttpHeaders errorHeaders(headerTable);
+          errorHeaders.set(hCfCacheStatus, "HIT");
+          errorHeaders.set(kj::HttpHeaderId::CONTENT_RANGE, kj::str("bytes */", body.size()));
+          co_return co_await response.sendError(416, "Range Not Satisfiable", errorHeaders);
+        }
+      }
+    }
+  }
+
+  // As in DiskDirectoryService, set Content-Length explicitly so that a Worker calling us without
+  // an HTTP connection in between can see it.
+  responseHeaders.set(kj::HttpHeaderId::CONTENT_LENGTH, kj::str(body.size()));
+
+  auto out = response.send(statusCode, statusText, responseHeaders, body.size());
+  if (method == kj::HttpMethod::GET) {
+    // `entry` holds the body alive even if the entry is evicted in the meantime.
+    co_await out->write(body.begin(), body.size());
+  }
+}
+
+kj::Promise<void> HttpCache::handlePut(kj::String key, const kj::HttpHeaders& headers,
+                                       kj::AsyncInputStream& requestBody, Response& response) {
+  auto maybePayload = co_await readAllBytesUpTo(requestBody, options.maxEntrySize + MAX_HEAD_SIZE);
+  kj::Maybe<ParsedResponse> maybeParsed;
+  KJ_IF_SOME(payload, maybePayload) {
+    maybeParsed = parseResponse(kj::mv(payload));
+  } else {
+    co_return co_await response.sendError(413, "Payload Too Large", headerTable);
+  }
+  if (maybeParsed == kj::none) {
+    co_return co_await response.sendError(400, "Bad Request", headerTable);
+  }
+  auto& parsed = KJ_ASSERT_NONNULL(maybeParsed);
+
+  if (parsed.body.size() > options.maxEntrySize) {
+    co_return co_await response.sendError(413, "Payload Too Large", headerTable);
+  }
+
+  KJ_IF_SOME(entry, makeEntry(kj::mv(key), kj::mv(parsed), headers, clock.now())) {
+    KJ_IF_SOME(dir, directory) {
+      // The memory tier can still serve the entry, so a failure to persist isn't fatal.
+      KJ_IF_SOME(exception, kj::runCatchingExceptions([&]() {
+        writeToDisk(dir, *entry);
+      })) {
+        KJ_LOG(WARNING, "failed to persist cache entry", exception);
+      }
+    } else if (entry->size > options.memoryLimit) {
+      co_return co_await response.sendError(413, "Payload Too Large", headerTable);
+    }
+
+    if (entry->size <= options.memoryLimit) {
+      insert(kj::mv(entry));
+    }
+  }
+
+  // Responses that aren't storable are accepted and dropped, as a cache is always free not to
+  // store something.
+  kj::HttpHeaders responseHeaders(headerTable);
+  response.send(204, "No Content", responseHeaders);
+}
+
+kj::Promise<void> HttpCache::handlePurge(kj::String key, Response& response) {
+  bool found = false;
+
+  KJ_IF_SOME(variants, entries.find(key)) {
+    for (auto& entry: variants) {
+      lru.remove(*entry);
+      memoryUsage -= entry->size;
+    }
+    entries.erase(key);
+    found = true;
+  }
+
+  KJ_IF_SOME(dir, directory) {
+    if (dir.tryRemove(kj::Path({ hashName(key) }))) {
+      found = true;
+    }
+  }
+
+  kj::HttpHeaders responseHeaders(headerTable);
+  if (found) {
+    response.send(200, "OK", responseHeaders, uint64_t(0));
+    return kj::READY_NOW;
+  } else {
+    return response.sendError(404, "Not Found", responseHeaders);
+  }
+}
+
+kj::Maybe<kj::Own<HttpCache::Entry>> HttpCache::find(
+    kj::StringPtr key, const kj::HttpHeaders& requestHeaders) {
+  auto now = clock.now();
+
+  KJ_IF_SOME(variants, entries.find(key)) {
+    for (auto& entry: variants) {
+      auto vary = entry->headers.get(hVary).orDefault(nullptr);
+      if (makeVaryKey(vary, requestHeaders) != entry->varyKey) continue;
+
+      if (!entry->isFresh(now)) {
+        KJ_IF_SOME(dir, directory) {
+          dir.tryRemove(pathFor(*entry));
+        }
+        remove(*entry);
+        return kj::none;
+      }
+
+      lru.remove(*entry);
+      lru.add(*entry);
+      return kj::addRef(*entry);
+    }
+  }
+
+  auto& dir = KJ_UNWRAP_OR_RETURN(directory, kj::none);
+  auto subdir = KJ_UNWRAP_OR_RETURN(dir.tryOpenSubdir(kj::Path({ hashName(key) })), kj::none);
+  for (auto& name: subdir->listNames()) {
+    auto file = KJ_UNWRAP_OR(subdir->tryOpenFile(kj::Path({ kj::str(name) })), continue);
+    auto entry = KJ_UNWRAP_OR(readFromDisk(*file), continue);
+
+    // Different keys can only share a directory if their hashes collide.
+    if (entry->key != key) continue;
+
+    if (!entry->isFresh(now)) {
+      subdir->tryRemove(kj::Path({ kj::str(name) }));
+      continue;
+    }
+
+    auto vary = entry->headers.get(hVary).orDefault(nullptr);
+    if (makeVaryKey(vary, requestHeaders) != entry->varyKey) continue;
+
+    auto result = kj::addRef(*entry);
+    if (entry->size <= options.memoryLimit) {
+      insert(kj::mv(entry));
+    }
+    return kj::mv(result);
+  }
+
+  return kj::none;
+}
+
+kj::Maybe<HttpCache::ParsedResponse> HttpCache::parseResponse(kj::Array<kj::byte> serialized) {
+  // Find the end of the head.
+  size_t headSize = 0;
+  for (size_t i = 3; i < serialized.size(); i++) {
+    if (serialized[i] == '\n' && serialized[i - 1] == '\r' &&
+        serialized[i - 2] == '\n' && serialized[i - 3] == '\r') {
+      headSize = i + 1;
+      break;
+    }
+  }
+  if (headSize == 0) return kj::none;
+
+  kj::HttpHeaders headers(headerTable);
+  auto head = serialized.slice(0, headSize).asChars();
+  auto result = headers.tryParseResponse(head);
+  auto& parsed = KJ_UNWRAP_OR_RETURN(result.tryGet<kj::HttpHeaders::Response>(), kj::none);
+
+  // The body isn't transfer-coded, whatever the head says, and we'll compute our own
+  // Content-Length when serving it.
+  headers.unset(kj::HttpHeaderId::CONTENT_LENGTH);
+  headers.unset(kj::HttpHeaderId::TRANSFER_ENCODING);
+
+  auto statusText = kj::str(parsed.statusText);
+  auto ownHeaders = headers.clone();
+  auto body = serialized.slice(headSize, serialized.size()).asConst();
+  return ParsedResponse {
+    .statusCode = parsed.statusCode,
+    .statusText = kj::mv(statusText),
+    .headers = kj::mv(ownHeaders),
+    .body = body.attach(kj::mv(serialized)),
+  };
+}
+
+kj::Maybe<kj::Own<HttpCache::Entry>> HttpCache::makeEntry(
+    kj::String key, ParsedResponse response, const kj::HttpHeaders& requestHeaders,
+    kj::Date now) {
+  auto& headers = response.headers;
+
+  if (response.statusCode == 206 || response.statusCode == 304) return kj::none;
+  if (headers.get(hSetCookie) != kj::none) return kj::none;
+
+  kj::StringPtr vary = headers.get(hVary).orDefault(nullptr);
+  for (auto& name: splitList(vary)) {
+    if (name == "*") return kj::none;
+  }
+
+  auto cacheControl = parseCacheControl(headers.get(hCacheControl).orDefault(nullptr));
+  if (cacheControl.noStore || cacheControl.noCache || cacheControl.isPrivate) return kj::none;
+
+  kj::Maybe<kj::Duration> lifetime;
+  KJ_IF_SOME(seconds, cacheControl.sMaxAge) {
+    lifetime = int64_t(seconds) * kj::SECONDS;
+  } else KJ_IF_SOME(seconds, cacheControl.maxAge) {
+    lifetime = int64_t(seconds) * kj::SECONDS;
+  } else KJ_IF_SOME(expiresHeader, headers.get(hExpires)) {
+    KJ_IF_SOME(expires, parseHttpDate(expiresHeader)) {
+      kj::Date date = now;
+      KJ_IF_SOME(dateHeader, headers.get(hDate)) {
+        date = parseHttpDate(dateHeader).orDefault(now);
+      }
+      lifetime = expires > date ? expires - date : 0 * kj::SECONDS;
+    } else {
+      lifetime = 0 * kj::SECONDS;
+    }
+  }
+
+  int64_t age = 0;
+  KJ_IF_SOME(ageHeader, headers.get(hAge)) {
+    age = ageHeader.tryParseAs<uint>().orDefault(0);
+  }
+  kj::Date responseTime = now - age * kj::SECONDS;
+
+  kj::Maybe<kj::Date> expires = lifetime.map([&](kj::Duration d) { return responseTime + d; });
+  KJ_IF_SOME(e, expires) {
+    if (e <= now) return kj::none;
+  }
+
+  auto varyKey = makeVaryKey(vary, requestHeaders);
+  return kj::refcounted<Entry>(kj::mv(key), kj::mv(varyKey), response.statusCode,
+      kj::mv(response.statusText), kj::mv(response.headers), kj::mv(response.body),
+      responseTime, expires);
+}
+
+void HttpCache::insert(kj::Own<Entry> entry) {
+  auto& variants = entries.findOrCreate(entry->key, [&]() {
+    return decltype(entries)::Entry { kj::str(entry->key), {} };
+  });
+
+  memoryUsage += entry->size;
+  lru.add(*entry);
+
+  bool replaced = false;
+  for (auto& existing: variants) {
+    if (existing->varyKey == entry->varyKey) {
+      lru.remove(*existing);
+      memoryUsage -= existing->size;
+      existing = kj::mv(entry);
+      replaced = true;
+      break;
+    }
+  }
+  if (!replaced) {
+    variants.add(kj::mv(entry));
+  }
+
+  while (memoryUsage > options.memoryLimit) {
+    remove(*lru.begin());
+  }
+}
+
+void HttpCache::remove(Entry& entry) {
+  lru.remove(entry);
+  memoryUsage -= entry.size;
+
+  auto& variants = KJ_ASSERT_NONNULL(entries.find(entry.key));
+  for (auto i: kj::indices(variants)) {
+    if (variants[i].get() == &entry) {
+      auto own = kj::mv(variants[i]);
+      if (i != variants.size() - 1) {
+        variants[i] = kj::mv(variants.back());
+      }
+      variants.removeLast();
+      if (variants.empty()) {
+        entries.erase(own->key);
+      }
+      return;
+    }
+  }
+  KJ_FAIL_ASSERT("cache entry not found in its key's variants", entry.key);
+}
+
+kj::Maybe<kj::Own<HttpCache::Entry>> HttpCache::readFromDisk(const kj::ReadableFile& file) {
+  auto parsed = KJ_UNWRAP_OR_RETURN(parseResponse(file.readAllBytes()), kj::none);
+  auto& headers = parsed.headers;
+
+  auto key = kj::str(KJ_UNWRAP_OR_RETURN(headers.get(hStoredKey), kj::none));
+  auto varyKey = kj::str(headers.get(hStoredVary).orDefault(nullptr));
+  auto responseTimeMs = KJ_UNWRAP_OR_RETURN(
+      KJ_UNWRAP_OR_RETURN(headers.get(hStoredAt), kj::none).tryParseAs<int64_t>(), kj::none);
+  kj::Maybe<kj::Date> expires;
+  KJ_IF_SOME(expiresHeader, headers.get(hStoredExpires)) {
+    auto expiresMs = KJ_UNWRAP_OR_RETURN(expiresHeader.tryParseAs<int64_t>(), kj::none);
+    expires = kj::UNIX_EPOCH + expiresMs * kj::MILLISECONDS;
+  }
+
+  headers.unset(hStoredKey);
+  headers.unset(hStoredVary);
+  headers.unset(hStoredAt);
+  headers.unset(hStoredExpires);
+
+  return kj::refcounted<Entry>(kj::mv(key), kj::mv(varyKey), parsed.statusCode,
+      kj::mv(parsed.statusText), kj::mv(parsed.headers), kj::mv(parsed.body),
+      kj::UNIX_EPOCH + responseTimeMs * kj::MILLISECONDS, expires);
+}
+
+void HttpCache::writeToDisk(const kj::Directory& dir, const Entry& entry) {
+  auto headers = entry.headers.clone();
+  headers.set(hStoredKey, entry.key);
+  if (entry.varyKey.size() > 0) {
+    headers.set(hStoredVary, entry.varyKey);
+  }
+  headers.set(hStoredAt, kj::str((entry.responseTime - kj::UNIX_EPOCH) / kj::MILLISECONDS));
+  KJ_IF_SOME(e, entry.expires) {
+    headers.set(hStoredExpires, kj::str((e - kj::UNIX_EPOCH) / kj::MILLISECONDS));
+  }
+  auto head = headers.serializeResponse(entry.statusCode, entry.statusText);
+
+  auto replacer = dir.replaceFile(pathFor(entry),
+      kj::WriteMode::CREATE | kj::WriteMode::MODIFY | kj::WriteMode::CREATE_PARENT);
+  auto& file = replacer->get();
+  file.write(0, head.asBytes());
+  file.write(head.size(), entry.body);
+  replacer->commit();
+}
+
+kj::Path HttpCache::pathFor(const Entry& entry) {
+  return kj::Path({ hashName(entry.key), hashName(entry.varyKey) });
+}
+
+kj::String HttpCache::makeVaryKey(kj::StringPtr vary, const kj::HttpHeaders& requestHeaders) {
+  kj::Vector<kj::String> parts;
+  for (auto& name: splitList(vary)) {
+    kj::Vector<kj::StringPtr> values;
+    requestHeaders.forEach([&](kj::StringPtr headerName, kj::StringPtr value) {
+      if (equalsIgnoreCase(headerName, name)) values.add(value);
+    });
+    parts.add(kj::str(kj::encodeUriComponent(toLowerCopy(name.asPtr())), '=',
+                      kj::encodeUriComponent(kj::strArray(values, ", "))));
+  }
+  return kj::strArray(parts, "&");
+}
+
+kj::String HttpCache::hashName(kj::StringPtr text) {
+  kj::byte hash[SHA256_DIGEST_LENGTH];
+  SHA256(text.asBytes().begin(), text.size(), hash);
+  return kj::encodeHex(kj::arrayPtr(hash, sizeof(hash)));
+}
+
+}  // namespace workerd::server
@@ -0,0 +1,168 @@
+// Copyright (c) 2017-2022 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+#pragma once
+
+#include <kj/compat/http.h>
+#include <kj/filesystem.h>
+#include <kj/list.h>
+#include <kj/map.h>
+#include <kj/time.h>
+
+namespace workerd::server {
+
+// An in-process HTTP cache, used to implement the `cache` service type. It speaks the protocol
+// that the Cache API (api/cache.c++) uses with a Worker's `cacheApiOutbound`:
+//
+// * GET looks up a stored response. A hit is returned with `CF-Cache-Status: HIT`; a miss is a
+//   504 with `CF-Cache-Status: MISS`.
+// * PUT stores a response. The request body is the serialized response to store, head and body,
+//   with no transfer coding applied to the body. Replies 204, or 413 if the response is too big.
+// * PURGE removes all stored variants of the URL. Replies 200 if anything was removed, else 404.
+//
+// Each cache name given in the `CF-Cache-Namespace` header is a separate key space;
+// `caches.default` sends no name.
+//
+// Responses are stored following the parts of RFC 9111 that apply to a shared cache which never
+// revalidates: responses marked `no-store`, `no-cache` or `private`, or which set cookies, are not
+// stored. Freshness comes from `s-maxage`, `max-age` or `Expires`, less any `Age`, and stale
+// entries are never served. A response with no freshness information is kept until evicted, as
+// the Cache API does. `Vary` selects among variants of a URL.
+//
+// Entries are kept in memory up to a byte limit, evicting the least-recently-used. If a directory
+// is configured, entries are also written through to it, and memory misses are looked up there.
+// Entries on disk survive restarts; they are removed when found stale or when purged.
+class HttpCache final: public kj::HttpService {
+public:
+  struct Options {
+    // Bytes of entries -- bodies plus headers -- to keep in memory.
+    uint64_t memoryLimit;
+
+    // Largest response body that will be stored.
+    uint64_t maxEntrySize;
+  };
+
+  HttpCache(kj::HttpHeaderTable::Builder& headerTableBuilder, Options options,
+            const kj::Clock& clock = kj::systemPreciseCalendarClock());
+  ~HttpCache() noexcept(false);
+  KJ_DISALLOW_COPY_AND_MOVE(HttpCache);
+
+  // Writes entries through to `dir`, and looks up memory misses there.
+  void setDirectory(const kj::Directory& dir) { directory = dir; }
+
+  // Bytes of entries currently held in memory.
+  uint64_t getMemoryUsage() const { return memoryUsage; }
+
+  kj::Promise<void> request(
+      kj::HttpMethod method, kj::StringPtr url, const kj::HttpHeaders& headers,
+      kj::AsyncInputStream& requestBody, Response& response) override;
+
+private:
+  // A stored response.
+  class Entry final: public kj::Refcounted {
+  public:
+    Entry(kj::String key, kj::String varyKey, uint statusCode, kj::String statusText,
+          kj::HttpHeaders headers, kj::Array<const kj::byte> body, kj::Date responseTime,
+          kj::Maybe<kj::Date> expires);
+
+    // Cache name and URL.
+    const kj::String key;
+
+    // Identifies which variant of `key` this is: the values of the request headers named by the
+    // response's `Vary` header, encoded as `name=value&name=value`. Empty if there's no `Vary`.
+    const kj::String varyKey;
+
+    const uint statusCode;
+    const kj::String statusText;
+    const kj::HttpHeaders headers;
+    const kj::Array<const kj::byte> body;
+
+    // When the response had an age of zero, i.e. when it was stored less its `Age` header.
+    const kj::Date responseTime;
+
+    // When the response goes stale, if ever.
+    const kj::Maybe<kj::Date> expires;
+
+    // Bytes charged against the memory limit.
+    const size_t size;
+
+    kj::ListLink<Entry> link;
+
+    bool isFresh(kj::Date now) const;
+  };
+
+  kj::HttpHeaderTable& headerTable;
+  Options options;
+  const kj::Clock& clock;
+  kj::Maybe<const kj::Directory&> directory;
+
+  kj::HttpHeaderId hCacheControl;
+  kj::HttpHeaderId hCfCacheNamespace;
+  kj::HttpHeaderId hCfCacheStatus;
+  kj::HttpHeaderId hAge;
+  kj::HttpHeaderId hDate;
+  kj::HttpHeaderId hExpires;
+  kj::HttpHeaderId hEtag;
+  kj::HttpHeaderId hIfNoneMatch;
+  kj::HttpHeaderId hSetCookie;
+  kj::HttpHeaderId hVary;
+
+  // Metadata headers used only in entries stored on disk.
+  kj::HttpHeaderId hStoredKey;
+  kj::HttpHeaderId hStoredVary;
+  kj::HttpHeaderId hStoredAt;
+  kj::HttpHeaderId hStoredExpires;
+
+  // Maps a cache key -- the cache name and URL -- to the stored variants of that URL.
+  kj::HashMap<kj::String, kj::Vector<kj::Own<Entry>>> entries;
+
+  // All entries in `entries`, least-recently-used first.
+  kj::List<Entry, &Entry::link> lru;
+  uint64_t memoryUsage = 0;
+
+  kj::Promise<void> handleGet(kj::HttpMethod method, kj::String key,
+                              const kj::HttpHeaders& headers, Response& response);
+  kj::Promise<void> handlePut(kj::String key, const kj::HttpHeaders& headers,
+                              kj::AsyncInputStream& requestBody, Response& response);
+  kj::Promise<void> handlePurge(kj::String key, Response& response);
+
+  // Finds a fresh entry matching the request, in memory or on disk.
+  kj::Maybe<kj::Own<Entry>> find(kj::StringPtr key, const kj::HttpHeaders& requestHeaders);
+
+  struct ParsedResponse {
+    uint statusCode;
+    kj::String statusText;
+    kj::HttpHeaders headers;
+    kj::Array<const kj::byte> body;
+  };
+
+  // Splits a serialized response into its head and body.
+  kj::Maybe<ParsedResponse> parseResponse(kj::Array<kj::byte> serialized);
+
+  // Builds an entry for a response being stored, or returns none if the response isn't storable.
+  kj::Maybe<kj::Own<Entry>> makeEntry(kj::String key, ParsedResponse response,
+                                      const kj::HttpHeaders& requestHeaders, kj::Date now);
+
+  // Adds an entry to memory, replacing any existing entry for the same variant and evicting others
+  // as needed to stay within `options.memoryLimit`.
+  void insert(kj::Own<Entry> entry);
+
+  // Removes an entry from memory. Does not touch the disk.
+  void remove(Entry& entry);
+
+  // Entries are stored on disk as one file per variant, at `<hash of key>/<hash of varyKey>`.
+  // The file holds the response head, with some extra headers describing the entry, followed by
+  // the body.
+  kj::Maybe<kj::Own<Entry>> readFromDisk(const kj::ReadableFile& file);
+  void writeToDisk(const kj::Directory& dir, const Entry& entry);
+  static kj::Path pathFor(const Entry& entry);
+
+  // Computes the `varyKey` that a request would match, given the `Vary` header of a stored
+  // response.
+  static kj::String makeVaryKey(kj::StringPtr vary, const kj::HttpHeaders& requestHeaders);
+
+  static kj::String hashName(kj::StringPtr text);
+};
+
+}  // namespace workerd::server
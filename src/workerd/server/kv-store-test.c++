@@ -0,0 +1,207 @@
+// Copyright (c) 2017-2022 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+#include "kv-store.h"
+#include "storage-test-util.h"
+#include <kj/encoding.h>
+#include <kj/test.h>
+
+namespace workerd::server {
+namespace {
+
+constexpr KvStore::Options DEFAULT_OPTIONS {
+  .cacheLimit = 1024 * 1024,
+  .maxValueSize = 64 * 1024,
+};
+
+// Drives a KvStore the way a Worker's KV binding reaches it.
+struct KvTest: public StorageServiceTest<KvStore> {
+  kj::HttpHeaderId hCfCacheStatus;
+  kj::HttpHeaderId hCfKvMetadata;
+
+  explicit KvTest(KvStore::Options options = DEFAULT_OPTIONS) {
+    restart(options);
+  }
+
+  // Replaces the store with a fresh one over the same database, as after a restart or as another
+  // thread would see it.
+  void restart(KvStore::Options options = DEFAULT_OPTIONS) {
+    StorageServiceTest::restart([&](kj::HttpHeaderTable::Builder& builder) {
+      hCfCacheStatus = builder.add("CF-Cache-Status");
+      hCfKvMetadata = builder.add("CF-KV-Metadata");
+      auto store = kj::heap<KvStore>(builder, options, clock);
+      store->open(*vfs, kj::Path({ "kv.sqlite" }));
+      return store;
+    });
+  }
+
+  TestResponse request(kj::HttpMethod method, kj::StringPtr url, kj::StringPtr body = nullptr,
+                       kj::Maybe<kj::StringPtr> metadata = kj::none) {
+    kj::HttpHeaders headers(*headerTable);
+    KJ_IF_SOME(m, metadata) {
+      headers.set(hCfKvMetadata, m);
+    }
+    return StorageServiceTest::request(method, url, headers, body.asBytes());
+  }
+
+  uint put(kj::StringPtr key, kj::StringPtr value, kj::StringPtr query = nullptr,
+           kj::Maybe<kj::StringPtr> metadata = kj::none) {
+    return request(kj::HttpMethod::PUT,
+        kj::str("https://fake-host/", kj::encodeUriComponent(key), "?urlencoded=true", query),
+        value, metadata).statusCode;
+  }
+
+  TestResponse get(kj::StringPtr key, kj::StringPtr query = nullptr) {
+    return request(kj::HttpMethod::GET,
+        kj::str("https://fake-host/", kj::encodeUriComponent(key), "?urlencoded=true", query));
+  }
+
+  kj::String list(kj::StringPtr query) {
+    auto response = request(kj::HttpMethod::GET, kj::str("https://fake-host?", query));
+    KJ_EXPECT(response.statusCode == 200);
+    return kj::mv(response.body);
+  }
+
+  kj::Maybe<kj::StringPtr> cacheStatus(const TestResponse& response) {
+    return response.headers.get(hCfCacheStatus);
+  }
+
+  kj::Maybe<kj::StringPtr> metadata(const TestResponse& response) {
+    return response.headers.get(hCfKvMetadata);
+  }
+};
+
+KJ_TEST("KvStore get, put and delete") {
+  KvTest test;
+
+  auto miss = test.get("foo");
+  KJ_EXPECT(miss.statusCode == 404);
+  KJ_EXPECT(KJ_ASSERT_NONNULL(test.cacheStatus(miss)) == "MISS");
+
+  KJ_EXPECT(test.put("foo", "bar", nullptr, "{\"a\":1}"_kj) == 200);
+  KJ_EXPECT(test.put("dir/with spaces", "baz") == 200);
+
+  auto hit = test.get("foo");
+  KJ_EXPECT(hit.statusCode == 200);
+  KJ_EXPECT(hit.body == "bar");
+  KJ_EXPECT(KJ_ASSERT_NONNULL(test.metadata(hit)) == "{\"a\":1}");
+  KJ_EXPECT(KJ_ASSERT_NONNULL(test.cacheStatus(hit)) == "HIT");
+  KJ_EXPECT(test.get("dir/with spaces").body == "baz");
+
+  KJ_EXPECT(test.request(kj::HttpMethod::DELETE,
+      "https://fake-host/foo?urlencoded=true").statusCode == 200);
+  KJ_EXPECT(test.get("foo").statusCode == 404);
+
+  // Values persist in the database.
+  test.restart();
+  auto persisted = test.get("dir/with spaces");
+  KJ_EXPECT(persisted.body == "baz");
+  KJ_EXPECT(KJ_ASSERT_NONNULL(test.cacheStatus(persisted)) == "MISS");
+  KJ_EXPECT(test.get("foo").statusCode == 404);
+
+  KJ_EXPECT(test.put("big", kj::str(kj::repeat('x', 64 * 1024 + 1))) == 413);
+}
+
+KJ_TEST("KvStore caches reads for cacheTtl") {
+  KvTest test;
+  KJ_EXPECT(test.put("foo", "one") == 200);
+
+  // A second store over the same database, as on another thread, caches what it reads.
+  kj::HttpHeaderTable::Builder builder;
+  KvStore other(builder, DEFAULT_OPTIONS, test.clock);
+  auto table = builder.build();
+  other.open(*test.vfs, kj::Path({ "kv.sqlite" }));
+  auto otherClient = kj::newHttpClient(*table, other);
+  auto otherGet = [&](kj::StringPtr query) {
+    kj::HttpHeaders headers(*table);
+    auto req = otherClient->request(kj::HttpMethod::GET,
+        kj::str("https://fake-host/foo?urlencoded=true", query), headers, uint64_t(0));
+    req.body = nullptr;
+    auto resp = req.response.wait(test.waitScope);
+    return resp.body->readAllText().wait(test.waitScope);
+  };
+
+  KJ_EXPECT(otherGet(nullptr) == "one");
+  KJ_EXPECT(test.put("foo", "two") == 200);
+
+  // The writer sees its own write at once; the other store serves its cached copy until the
+  // cache TTL passes.
+  KJ_EXPECT(test.get("foo").body == "two");
+  KJ_EXPECT(otherGet(nullptr) == "one");
+  test.clock.time += 30 * kj::SECONDS;
+  KJ_EXPECT(otherGet(nullptr) == "one");
+  KJ_EXPECT(otherGet("&cache_ttl=10") == "two");
+  test.clock.time += 61 * kj::SECONDS;
+  KJ_EXPECT(otherGet(nullptr) == "two");
+}
+
+KJ_TEST("KvStore expires keys") {
+  KvTest test;
+  auto now = (test.clock.time - kj::UNIX_EPOCH) / kj::SECONDS;
+
+  KJ_EXPECT(test.put("ttl", "a", "&expiration_ttl=100") == 200);
+  KJ_EXPECT(test.put("abs", "b", kj::str("&expiration=", now + 200)) == 200);
+  KJ_EXPECT(test.put("forever", "c") == 200);
+  KJ_EXPECT(test.put("past", "d", kj::str("&expiration=", now - 1)) == 400);
+
+  KJ_EXPECT(test.list("") ==
+      kj::str("{\"keys\":[{\"name\":\"abs\",\"expiration\":", now + 200, "},"
+              "{\"name\":\"forever\"},"
+              "{\"name\":\"ttl\",\"expiration\":", now + 100, "}],\"list_complete\":true}"));
+
+  test.clock.time += 150 * kj::SECONDS;
+  KJ_EXPECT(test.get("ttl").statusCode == 404);
+  KJ_EXPECT(test.get("abs").statusCode == 200);
+
+  // A restarted store doesn't see the expired key either, whether or not it has been swept.
+  test.restart();
+  KJ_EXPECT(test.get("ttl").statusCode == 404);
+  KJ_EXPECT(test.list("").startsWith("{\"keys\":[{\"name\":\"abs\""));
+
+  test.clock.time += 100 * kj::SECONDS;
+  KJ_EXPECT(test.list("") == "{\"keys\":[{\"name\":\"forever\"}],\"list_complete\":true}");
+}
+
+KJ_TEST("KvStore lists by prefix with cursors") {
+  KvTest test;
+
+  for (auto key: { "a", "b/1", "b/2", "b/3", "b/4", "b/5", "c" }) {
+    KJ_EXPECT(test.put(key, "x", nullptr, "\"meta\""_kj) == 200);
+  }
+
+  auto page1 = test.list("prefix=b%2F&key_count_limit=2");
+  auto expectedCursor = kj::encodeBase64("b/2"_kj.asBytes());
+  KJ_EXPECT(page1 == kj::str(
+      "{\"keys\":[{\"name\":\"b/1\",\"metadata\":\"\\\"meta\\\"\"},"
+      "{\"name\":\"b/2\",\"metadata\":\"\\\"meta\\\"\"}],"
+      "\"list_complete\":false,\"cursor\":\"", expectedCursor, "\"}"), page1);
+
+  auto page2 = test.list(kj::str("prefix=b%2F&key_count_limit=2&cursor=",
+                                 kj::encodeUriComponent(expectedCursor)));
+  KJ_EXPECT(page2.startsWith("{\"keys\":[{\"name\":\"b/3\""), page2);
+  KJ_EXPECT(page2.endsWith(kj::str("\"list_complete\":false,\"cursor\":\"",
+                                   kj::encodeBase64("b/4"_kj.asBytes()), "\"}")), page2);
+
+  auto page3 = test.list(kj::str("prefix=b%2F&key_count_limit=2&cursor=",
+                                 kj::encodeUriComponent(kj::encodeBase64("b/4"_kj.asBytes()))));
+  KJ_EXPECT(page3 == "{\"keys\":[{\"name\":\"b/5\",\"metadata\":\"\\\"meta\\\"\"}],"
+                     "\"list_complete\":true}", page3);
+}
+
+KJ_TEST("KvStore bounds its read cache") {
+  KvTest test({ .cacheLimit = 4096, .maxValueSize = 64 * 1024 });
+
+  auto value = kj::str(kj::repeat('x', 1000));
+  for (auto key: { "1", "2", "3", "4", "5", "6" }) {
+    KJ_EXPECT(test.put(key, value) == 200);
+  }
+  KJ_EXPECT(test.service->getCacheUsage() <= 4096);
+
+  // Evicted values are read back from the database.
+  KJ_EXPECT(test.get("1").body == value);
+  KJ_EXPECT(test.get("6").body == value);
+}
+
+}  // namespace
+}  // namespace workerd::server
@@ -0,0 +1,395 @@
+// Copyright (c) 2017-2022 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+#include "kv-store.h"
+#include <kj/compat/url.h>
+#include <kj/debug.h>
+#include <kj/encoding.h>
+#include <workerd/util/stream-utils.h>
+#include <workerd/util/strings.h>
+
+namespace workerd::server {
+
+namespace {
+
+int64_t toUnixSeconds(kj::Date date) {
+  return (date - kj::UNIX_EPOCH) / kj::SECONDS;
+}
+
+// Returns the smallest string greater than every string starting with `prefix`, or none if there
+// is no such string (the prefix is empty or all 0xff bytes).
+kj::Maybe<kj::String> prefixEnd(kj::StringPtr prefix) {
+  auto result = kj::str(prefix);
+  while (result.size() > 0) {
+    auto& last = reinterpret_cast<kj::byte&>(result[result.size() - 1]);
+    if (last != 0xff) {
+      ++last;
+      return kj::mv(result);
+    }
+    result = kj::str(result.slice(0, result.size() - 1));
+  }
+  return kj::none;
+}
+
+}  // namespace
+
+KvStore::CachedValue::CachedValue(kj::String key, kj::Maybe<kj::Array<const kj::byte>> value,
+                                  kj::Maybe<kj::String> metadata, kj::Maybe<int64_t> expiration,
+                                  kj::Date cachedAt)
+    : key(kj::mv(key)), value(kj::mv(value)), metadata(kj::mv(metadata)),
+      expiration(expiration), cachedAt(cachedAt),
+      size(sizeof(*this) + this->key.size() +
+           this->value.map([](auto& v) { return v.size(); }).orDefault(0) +
+           this->metadata.map([](auto& m) { return m.size(); }).orDefault(0)) {}
+
+KvStore::Database::Database(const SqliteDatabase::Vfs& vfs, kj::PathPtr path)
+    : db(vfs, path, kj::WriteMode::CREATE | kj::WriteMode::MODIFY | kj::WriteMode::CREATE_PARENT) {}
+
+bool KvStore::Database::ensureInitialized(SqliteDatabase& db) {
+  db.run("PRAGMA journal_mode=WAL;");
+
+  // Keys are compared bytewise, which gives list() the same ordering as KV. The partial index on
+  // `expiration` lets sweeps find expired keys without scanning keys that never expire.
+  db.run(R"(
+    CREATE TABLE IF NOT EXISTS _cf_KV_NAMESPACE (
+      key TEXT PRIMARY KEY,
+      value BLOB NOT NULL,
+      metadata TEXT,
+      expiration INTEGER
+    ) WITHOUT ROWID;
+  )");
+  db.run(R"(
+    CREATE INDEX IF NOT EXISTS _cf_KV_NAMESPACE_expiration
+      ON _cf_KV_NAMESPACE (expiration) WHERE expiration IS NOT NULL;
+  )");
+
+  return true;
+}
+
+KvStore::KvStore(kj::HttpHeaderTable::Builder& headerTableBuilder, Options options,
+                 const kj::Clock& clock)
+    : headerTable(headerTableBuilder.getFutureTable()), options(options), clock(clock),
+      hCfCacheStatus(headerTableBuilder.add("CF-Cache-Status")),
+      hCfKvMetadata(headerTableBuilder.add("CF-KV-Metadata")) {}
+
+KvStore::~KvStore() noexcept(false) {
+  // Cached values may outlive us if a response is still streaming one, so unlink them all.
+  while (!lru.empty()) {
+    lru.remove(*lru.begin());
+  }
+}
+
+void KvStore::open(const SqliteDatabase::Vfs& vfs, kj::PathPtr path) {
+  KJ_REQUIRE(database == kj::none, "already opened");
+  database = kj::heap<Database>(vfs, path);
+}
+
+KvStore::Database& KvStore::getDatabase() {
+  return *KJ_REQUIRE_NONNULL(database, "KV store used before it was opened");
+}
+
+kj::Promise<void> KvStore::request(
+    kj::HttpMethod method, kj::StringPtr urlStr, const kj::HttpHeaders& headers,
+    kj::AsyncInputStream& requestBody, Response& response) {
+  auto url = KJ_UNWRAP_OR(kj::Url::tryParse(urlStr, kj::Url::HTTP_PROXY_REQUEST), {
+    return response.sendError(400, "Bad Request", headerTable);
+  });
+
+  maybeSweep(clock.now());
+
+  kj::Maybe<kj::StringPtr> cacheTtl;
+  kj::Maybe<kj::StringPtr> expiration;
+  kj::Maybe<kj::StringPtr> expirationTtl;
+  kj::StringPtr prefix;
+  kj::Maybe<kj::StringPtr> limit;
+  kj::Maybe<kj::StringPtr> cursor;
+  for (auto& param: url.query) {
+    if (param.name == "cache_ttl") {
+      cacheTtl = param.value;
+    } else if (param.name == "expiration") {
+      expiration = param.value;
+    } else if (param.name == "expiration_ttl") {
+      expirationTtl = param.value;
+    } else if (param.name == "prefix") {
+      prefix = param.value;
+    } else if (param.name == "key_count_limit") {
+      limit = param.value;
+    } else if (param.name == "cursor") {
+      cursor = param.value;
+    }
+  }
+
+  if (url.path.empty()) {
+    if (method != kj::HttpMethod::GET) {
+      return response.sendError(405, "Method Not Allowed", headerTable);
+    }
+
+    uint listLimit = DEFAULT_LIST_LIMIT;
+    KJ_IF_SOME(l, limit) {
+      listLimit = KJ_UNWRAP_OR(l.tryParseAs<uint>(), {
+        return response.sendError(400, "Bad Request", headerTable);
+      });
+      if (listLimit == 0 || listLimit > DEFAULT_LIST_LIMIT) {
+        return response.sendError(400, "Bad Request", headerTable);
+      }
+    }
+
+    kj::Maybe<kj::String> cursorKey;
+    KJ_IF_SOME(c, cursor) {
+      auto decoded = kj::decodeBase64(c);
+      if (decoded.hadErrors) {
+        return response.sendError(400, "Bad Request", headerTable);
+      }
+      cursorKey = kj::str(decoded.asChars());
+    }
+
+    return handleList(kj::str(prefix), listLimit, kj::mv(cursorKey), response);
+  }
+
+  // kj::Url splits the key on '/' and decodes each component, so put it back together.
+  auto key = kj::strArray(url.path, "/");
+  if (url.hasTrailingSlash) {
+    key = kj::str(key, '/');
+  }
+
+  switch (method) {
+    case kj::HttpMethod::GET: {
+      kj::Duration ttl = DEFAULT_CACHE_TTL;
+      KJ_IF_SOME(t, cacheTtl) {
+        ttl = KJ_UNWRAP_OR(t.tryParseAs<uint>(), {
+          return response.sendError(400, "Bad Request", headerTable);
+        }) * kj::SECONDS;
+      }
+      return handleGet(kj::mv(key), ttl, response);
+    }
+
+    case kj::HttpMethod::PUT: {
+      kj::Maybe<int64_t> expiresAt;
+      KJ_IF_SOME(e, expiration) {
+        expiresAt = KJ_UNWRAP_OR(e.tryParseAs<int64_t>(), {
+          return response.sendError(400, "Bad Request", headerTable);
+        });
+      }
+      KJ_IF_SOME(t, expirationTtl) {
+        auto seconds = KJ_UNWRAP_OR(t.tryParseAs<uint>(), {
+          return response.sendError(400, "Bad Request", headerTable);
+        });
+        expiresAt = toUnixSeconds(clock.now()) + seconds;
+      }
+      KJ_IF_SOME(e, expiresAt) {
+        if (e <= toUnixSeconds(clock.now())) {
+          return response.sendError(400, "Bad Request", headerTable);
+        }
+      }
+      return handlePut(kj::mv(key), expiresAt, headers, requestBody, response);
+    }
+
+    case kj::HttpMethod::DELETE:
+      return handleDelete(kj::mv(key), response);
+
+    default:
+      return response.sendError(501, "Not Implemented", headerTable);
+  }
+}
+
+kj::Promise<void> KvStore::handleGet(kj::String key, kj::Duration cacheTtl, Response& response) {
+  auto now = clock.now();
+  kj::Own<CachedValue> value;
+  bool hit = false;
+
+  KJ_IF_SOME(cached, cache.find(key)) {
+    bool expired = false;
+    KJ_IF_SOME(e, cached->expiration) {
+      expired = e <= toUnixSeconds(now);
+    }
+    if (!expired && now - cached->cachedAt < cacheTtl) {
+      lru.remove(*cached);
+      lru.add(*cached);
+      value = kj::addRef(*cached);
+      hit = true;
+    }
+  }
+
+  if (!hit) {
+    auto& db = getDatabase();
+    auto query = db.stmtGet.run(key.asPtr(), toUnixSeconds(now));
+    if (query.isDone()) {
+      value = kj::refcounted<CachedValue>(kj::mv(key), kj::none, kj::none, kj::none, now);
+    } else {
+      value = kj::refcounted<CachedValue>(kj::mv(key),
+          kj::Array<const kj::byte>(kj::heapArray(query.getBlob(0))),
+          query.getMaybeText(1).map([](kj::StringPtr m) { return kj::str(m); }),
+          query.getMaybeInt64(2), now);
+    }
+    addToCache(kj::addRef(*value));
+  }
+
+  kj::HttpHeaders headers(headerTable);
+  headers.set(hCfCacheStatus, hit ? "HIT"_kj : "MISS"_kj);
+
+  KJ_IF_SOME(bytes, value->value) {
+    KJ_IF_SOME(m, value->metadata) {
+      headers.set(hCfKvMetadata, m);
+    }
+    auto out = response.send(200, "OK", headers, bytes.size());
+    // `value` keeps the bytes alive even if the entry is evicted in the meantime.
+    co_await out->write(bytes.begin(), bytes.size());
+  } else {
+    co_await response.sendError(404, "Not Found", headers);
+  }
+}
+
+kj::Promise<void> KvStore::handleList(kj::String prefix, uint limit,
+                                      kj::Maybe<kj::String> cursor, Response& response) {
+  auto& db = getDatabase();
+  auto now = toUnixSeconds(clock.now());
+
+  // A listing resumes at the cursor, the last key of the previous page, which it must then skip.
+  kj::StringPtr start = prefix;
+  KJ_IF_SOME(c, cursor) {
+    if (prefix < c) start = c;
+  }
+
+  kj::Vector<kj::String> entries(limit);
+  kj::Maybe<kj::String> lastKey;
+  bool complete = true;
+
+  auto iterate = [&](SqliteDatabase::Query&& query) {
+    for (; !query.isDone(); query.nextRow()) {
+      auto key = query.getText(0);
+      KJ_IF_SOME(c, cursor) {
+        if (key == c) continue;
+      }
+      if (entries.size() == limit) {
+        complete = false;
+        break;
+      }
+
+      kj::Vector<kj::String> fields(3);
+      fields.add(kj::str("\"name\":\"", escapeJsonString(key), '"'));
+      KJ_IF_SOME(e, query.getMaybeInt64(2)) {
+        fields.add(kj::str("\"expiration\":", e));
+      }
+      KJ_IF_SOME(m, query.getMaybeText(1)) {
+        // The binding expects the metadata as a JSON string, which it parses itself.
+        fields.add(kj::str("\"metadata\":\"", escapeJsonString(m), '"'));
+      }
+      entries.add(kj::str('{', kj::strArray(fields, ","), '}'));
+      lastKey = kj::str(key);
+    }
+  };
+
+  // Fetch up to two more rows than needed: one may be the cursor, and one tells us whether
+  // there are any more keys.
+  int64_t rows = int64_t(limit) + 2;
+  KJ_IF_SOME(end, prefixEnd(prefix)) {
+    iterate(db.stmtListEnd.run(start, end.asPtr(), now, rows));
+  } else {
+    iterate(db.stmtList.run(start, now, rows));
+  }
+
+  kj::String body;
+  if (complete) {
+    body = kj::str("{\"keys\":[", kj::strArray(entries, ","), "],\"list_complete\":true}");
+  } else {
+    auto nextCursor = kj::encodeBase64(KJ_ASSERT_NONNULL(lastKey).asBytes());
+    body = kj::str("{\"keys\":[", kj::strArray(entries, ","),
+                   "],\"list_complete\":false,\"cursor\":\"", nextCursor, "\"}");
+  }
+
+  kj::HttpHeaders headers(headerTable);
+  headers.set(kj::HttpHeaderId::CONTENT_TYPE, "application/json");
+  auto out = response.send(200, "OK", headers, body.size());
+  co_await out->write(body.begin(), body.size());
+}
+
+kj::Promise<void> KvStore::handlePut(kj::String key, kj::Maybe<int64_t> expiration,
+                                     const kj::HttpHeaders& headers,
+                                     kj::AsyncInputStream& requestBody, Response& response) {
+  auto maybeValue = co_await readAllBytesUpTo(requestBody, options.maxValueSize);
+  if (maybeValue == kj::none) {
+    co_return co_await response.sendError(413, "Payload Too Large", headerTable);
+  }
+  auto value = kj::mv(KJ_ASSERT_NONNULL(maybeValue));
+
+  kj::Maybe<kj::String> metadata = headers.get(hCfKvMetadata).map([](kj::StringPtr m) {
+    return kj::str(m);
+  });
+
+  SqliteDatabase::Query::ValuePtr bindings[4];
+  bindings[0].init<kj::StringPtr>(key);
+  bindings[1].init<kj::ArrayPtr<const kj::byte>>(value);
+  KJ_IF_SOME(m, metadata) {
+    bindings[2].init<kj::StringPtr>(m);
+  } else {
+    bindings[2].init<decltype(nullptr)>(nullptr);
+  }
+  KJ_IF_SOME(e, expiration) {
+    bindings[3].init<int64_t>(e);
+  } else {
+    bindings[3].init<decltype(nullptr)>(nullptr);
+  }
+  getDatabase().stmtPut.run(kj::ArrayPtr<const SqliteDatabase::Query::ValuePtr>(bindings));
+
+  // Write through to the cache, so that reads through this store see the new value immediately.
+  addToCache(kj::refcounted<CachedValue>(kj::mv(key), kj::Array<const kj::byte>(kj::mv(value)),
+      kj::mv(metadata), expiration, clock.now()));
+
+  kj::HttpHeaders responseHeaders(headerTable);
+  response.send(200, "OK", responseHeaders, uint64_t(0));
+}
+
+kj::Promise<void> KvStore::handleDelete(kj::String key, Response& response) {
+  getDatabase().stmtDelete.run(key.asPtr());
+
+  // Cache the deletion, as KV caches the absence of a key.
+  addToCache(kj::refcounted<CachedValue>(kj::mv(key), kj::none, kj::none, kj::none, clock.now()));
+
+  kj::HttpHeaders headers(headerTable);
+  response.send(200, "OK", headers, uint64_t(0));
+  return kj::READY_NOW;
+}
+
+void KvStore::maybeSweep(kj::Date now) {
+  if (now < nextSweep || database == kj::none) return;
+  nextSweep = now + SWEEP_INTERVAL;
+  getDatabase().stmtSweep.run(toUnixSeconds(now));
+}
+
+void KvStore::addToCache(kj::Own<CachedValue> value) {
+  if (value->size > options.cacheLimit) {
+    KJ_IF_SOME(existing, cache.find(value->key)) {
+      removeFromCache(*existing);
+    }
+    return;
+  }
+
+  cacheUsage += value->size;
+  lru.add(*value);
+  KJ_IF_SOME(entry, cache.findEntry(value->key)) {
+    lru.remove(*entry.value);
+    cacheUsage -= entry.value->size;
+    // The map's key points into the value, so repoint it at the replacement's equal key.
+    entry.key = value->key;
+    entry.value = kj::mv(value);
+  } else {
+    kj::StringPtr key = value->key;
+    cache.insert(key, kj::mv(value));
+  }
+
+  while (cacheUsage > options.cacheLimit) {
+    removeFromCache(*lru.begin());
+  }
+}
+
+void KvStore::removeFromCache(CachedValue& value) {
+  lru.remove(value);
+  cacheUsage -= value.size;
+  // Erasing drops the last reference the cache holds, which may destroy `value` and the key the
+  // map entry points to, so erase by the entry rather than by key.
+  auto& entry = KJ_ASSERT_NONNULL(cache.findEntry(value.key));
+  cache.erase(entry);
+}
+
+}  // namespace workerd::server
@@ -0,0 +1,169 @@
+// Copyright (c) 2017-2022 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+#pragma once
+
+#include <kj/compat/http.h>
+#include <kj/filesystem.h>
+#include <kj/list.h>
+#include <kj/map.h>
+#include <kj/time.h>
+#include <workerd/util/sqlite.h>
+
+namespace workerd::server {
+
+// A KV namespace stored in SQLite, used to implement the `kv` service type. It speaks the protocol
+// that KvNamespace (api/kv.c++) uses with the service a `kvNamespace` binding points at:
+//
+// * GET /<key>?urlencoded=true[&cache_ttl=<seconds>] returns the value, with its metadata JSON in
+//   `CF-KV-Metadata`. 404 if there is no such key.
+// * GET /?prefix=<prefix>&key_count_limit=<n>&cursor=<cursor> returns a JSON listing of keys, in
+//   order, with their expirations and metadata.
+// * PUT /<key>?urlencoded=true[&expiration=<unix time>][&expiration_ttl=<seconds>] stores the
+//   request body, with any metadata given in `CF-KV-Metadata`.
+// * DELETE /<key>?urlencoded=true deletes the key.
+//
+// Since the binding's subrequest channel calls straight into the service, none of this is ever
+// serialized as HTTP; only the URL is formatted and parsed.
+//
+// Reads are cached in memory for `cache_ttl` seconds (60 by default), like KV's edge caches. Writes
+// made through this object update the cache immediately; writes made by other threads' instances
+// over the same database become visible when the cached copy expires.
+//
+// Expired keys are never returned, and are deleted from the database in periodic sweeps that
+// use an index on the expiration time.
+class KvStore final: public kj::HttpService {
+public:
+  struct Options {
+    // Bytes of values and metadata to cache in memory.
+    uint64_t cacheLimit;
+
+    // Largest value that can be stored.
+    uint64_t maxValueSize;
+  };
+
+  KvStore(kj::HttpHeaderTable::Builder& headerTableBuilder, Options options,
+          const kj::Clock& clock = kj::systemPreciseCalendarClock());
+  ~KvStore() noexcept(false);
+  KJ_DISALLOW_COPY_AND_MOVE(KvStore);
+
+  // Opens (creating if needed) the database at `path` within `vfs`. Must be called once before
+  // any requests.
+  void open(const SqliteDatabase::Vfs& vfs, kj::PathPtr path);
+
+  // Bytes of values currently cached in memory.
+  uint64_t getCacheUsage() const { return cacheUsage; }
+
+  kj::Promise<void> request(
+      kj::HttpMethod method, kj::StringPtr url, const kj::HttpHeaders& headers,
+      kj::AsyncInputStream& requestBody, Response& response) override;
+
+  static constexpr auto DEFAULT_CACHE_TTL = 60 * kj::SECONDS;
+  static constexpr uint DEFAULT_LIST_LIMIT = 1000;
+  static constexpr auto SWEEP_INTERVAL = 60 * kj::SECONDS;
+
+private:
+  // A value read from or written to the database, or the fact that a key doesn't exist.
+  class CachedValue final: public kj::Refcounted {
+  public:
+    CachedValue(kj::String key, kj::Maybe<kj::Array<const kj::byte>> value,
+                kj::Maybe<kj::String> metadata, kj::Maybe<int64_t> expiration,
+                kj::Date cachedAt);
+
+    const kj::String key;
+
+    // None if the key doesn't exist.
+    const kj::Maybe<kj::Array<const kj::byte>> value;
+    const kj::Maybe<kj::String> metadata;
+
+    // Unix time, in seconds, at which the key expires.
+    const kj::Maybe<int64_t> expiration;
+
+    // When the value was read or written.
+    const kj::Date cachedAt;
+
+    // Bytes charged against the cache limit.
+    const size_t size;
+
+    kj::ListLink<CachedValue> link;
+  };
+
+  // The database, and the statements prepared against it.
+  struct Database {
+    SqliteDatabase db;
+
+    // Creates the table before the statements below are prepared against it.
+    bool initialized = ensureInitialized(db);
+
+    Database(const SqliteDatabase::Vfs& vfs, kj::PathPtr path);
+
+    SqliteDatabase::Statement stmtGet = db.prepare(R"(
+      SELECT value, metadata, expiration FROM _cf_KV_NAMESPACE
+      WHERE key = ? AND (expiration IS NULL OR expiration > ?)
+    )");
+    SqliteDatabase::Statement stmtPut = db.prepare(R"(
+      INSERT INTO _cf_KV_NAMESPACE VALUES(?, ?, ?, ?)
+        ON CONFLICT DO UPDATE SET
+          value = excluded.value, metadata = excluded.metadata, expiration = excluded.expiration
+    )");
+    SqliteDatabase::Statement stmtDelete = db.prepare(R"(
+      DELETE FROM _cf_KV_NAMESPACE WHERE key = ?
+    )");
+    SqliteDatabase::Statement stmtList = db.prepare(R"(
+      SELECT key, metadata, expiration FROM _cf_KV_NAMESPACE
+      WHERE key >= ? AND (expiration IS NULL OR expiration > ?)
+      ORDER BY key
+      LIMIT ?
+    )");
+    SqliteDatabase::Statement stmtListEnd = db.prepare(R"(
+      SELECT key, metadata, expiration FROM _cf_KV_NAMESPACE
+      WHERE key >= ? AND key < ? AND (expiration IS NULL OR expiration > ?)
+      ORDER BY key
+      LIMIT ?
+    )");
+    SqliteDatabase::Statement stmtSweep = db.prepare(R"(
+      DELETE FROM _cf_KV_NAMESPACE WHERE expiration <= ?
+    )");
+
+    static bool ensureInitialized(SqliteDatabase& db);
+  };
+
+  kj::HttpHeaderTable& headerTable;
+  Options options;
+  const kj::Clock& clock;
+  kj::Maybe<kj::Own<Database>> database;
+
+  kj::HttpHeaderId hCfCacheStatus;
+  kj::HttpHeaderId hCfKvMetadata;
+
+  // Values read recently, by key.
+  kj::HashMap<kj::StringPtr, kj::Own<CachedValue>> cache;
+
+  // All entries in `cache`, least-recently-used first.
+  kj::List<CachedValue, &CachedValue::link> lru;
+  uint64_t cacheUsage = 0;
+
+  // When to next delete expired keys from the database.
+  kj::Date nextSweep = kj::UNIX_EPOCH;
+
+  kj::Promise<void> handleGet(kj::String key, kj::Duration cacheTtl, Response& response);
+  kj::Promise<void> handleList(kj::String prefix, uint limit, kj::Maybe<kj::String> cursor,
+                               Response& response);
+  kj::Promise<void> handlePut(kj::String key, kj::Maybe<int64_t> expiration,
+                              const kj::HttpHeaders& headers, kj::AsyncInputStream& requestBody,
+                              Response& response);
+  kj::Promise<void> handleDelete(kj::String key, Response& response);
+
+  Database& getDatabase();
+
+  // Deletes expired keys from the database, if a sweep is due.
+  void maybeSweep(kj::Date now);
+
+  // Adds a value to the cache, replacing any existing entry for the key, and evicts others as
+  // needed to stay within `options.cacheLimit`.
+  void addToCache(kj::Own<CachedValue> value);
+  void removeFromCache(CachedValue& value);
+};
+
+}  // namespace workerd::server
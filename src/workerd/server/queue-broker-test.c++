@@ -0,0 +1,298 @@
+// Copyright (c) 2017-2022 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+#include "queue-broker.h"
+#include "storage-test-util.h"
+#include <kj/encoding.h>
+#include <kj/test.h>
+
+namespace workerd::server {
+namespace {
+
+constexpr QueueBroker::Options DEFAULT_OPTIONS {
+  .maxBatchSize = 3,
+  .maxBatchTimeout = 1 * kj::SECONDS,
+  .maxConcurrency = 1,
+  .maxRetries = 2,
+  .retryDelay = 5 * kj::SECONDS,
+  .maxBacklog = 100,
+  .maxMessageSize = 1024,
+};
+
+struct DeliveredMessage {
+  kj::String id;
+  kj::String body;
+  kj::Maybe<kj::String> contentType;
+};
+
+// Drives a QueueBroker the way a Worker's queue binding reaches it, and records what it delivers.
+struct QueueTest: public StorageServiceTest<QueueBroker> {
+  kj::TimerImpl timer { kj::origin<kj::TimePoint>() };
+  kj::HttpHeaderId hMsgFmt;
+  kj::HttpHeaderId hMsgDelaySecs;
+  kj::HttpHeaderId hCfQueueBatchFormat;
+
+  kj::Vector<kj::Array<DeliveredMessage>> batches;
+
+  // Decides the consumer's result for each batch. By default, the handler succeeds.
+  kj::Function<QueueBroker::DeliveryResult(kj::ArrayPtr<const DeliveredMessage>)> respond =
+      [](auto) { return QueueBroker::DeliveryResult { .succeeded = true }; };
+
+  explicit QueueTest(QueueBroker::Options options = DEFAULT_OPTIONS, bool deliver = true) {
+    restart(options, deliver);
+  }
+
+  ~QueueTest() noexcept(false) {
+    // The broker uses `timer` and our delivery callback, so it must go first.
+    client = nullptr;
+    service = nullptr;
+  }
+
+  // Replaces the broker with a fresh one over the same database, as after a restart.
+  void restart(QueueBroker::Options options = DEFAULT_OPTIONS, bool deliver = true) {
+    StorageServiceTest::restart([&](kj::HttpHeaderTable::Builder& builder) {
+      hMsgFmt = builder.add("X-Msg-Fmt");
+      hMsgDelaySecs = builder.add("X-Msg-Delay-Secs");
+      hCfQueueBatchFormat = builder.add("CF-Queue-Batch-Format");
+      auto broker = kj::heap<QueueBroker>(builder, options, timer, clock);
+      broker->open(*vfs, kj::Path({ "queue.sqlite" }));
+      return broker;
+    });
+    if (deliver) startDelivery();
+  }
+
+  void startDelivery() {
+    service->startDelivery([this](kj::Array<QueueBroker::Message> batch)
+        -> kj::Promise<QueueBroker::DeliveryResult> {
+      auto messages = KJ_MAP(m, batch) {
+        return DeliveredMessage {
+          .id = kj::mv(m.id),
+          .body = kj::str(m.body.asPtr().asChars()),
+          .contentType = kj::mv(m.contentType),
+        };
+      };
+      auto result = respond(messages);
+      batches.add(kj::mv(messages));
+      return kj::mv(result);
+    });
+  }
+
+  uint send(kj::StringPtr path, kj::ArrayPtr<const kj::byte> body,
+            kj::Maybe<kj::StringPtr> format = kj::none, kj::Maybe<kj::StringPtr> delay = kj::none,
+            bool binary = false) {
+    kj::HttpHeaders headers(*headerTable);
+    KJ_IF_SOME(f, format) headers.set(hMsgFmt, f);
+    KJ_IF_SOME(d, delay) headers.set(hMsgDelaySecs, d);
+    if (binary) headers.set(hCfQueueBatchFormat, "binary");
+    auto resp = request(kj::HttpMethod::POST, kj::str("https://fake-host/", path), headers, body);
+    if (resp.statusCode == 200) {
+      KJ_EXPECT(KJ_ASSERT_NONNULL(resp.headers.get(hCfQueueBatchFormat)) == "binary");
+    }
+    return resp.statusCode;
+  }
+
+  uint sendMessage(kj::StringPtr body, kj::Maybe<kj::StringPtr> delay = kj::none) {
+    return send("message", body.asBytes(), "text"_kj, delay);
+  }
+
+  // Advances both clocks and runs whatever becomes due.
+  void advance(kj::Duration duration) {
+    clock.time += duration;
+    timer.advanceTo(timer.now() + duration);
+    waitScope.poll();
+  }
+
+  // Returns the bodies of the batches delivered since the last call, as "a,b|c".
+  kj::String takeDelivered() {
+    waitScope.poll();
+    auto result = kj::strArray(KJ_MAP(batch, batches) {
+      return kj::strArray(KJ_MAP(m, batch) { return kj::str(m.body); }, ",");
+    }, "|");
+    batches.clear();
+    return result;
+  }
+};
+
+KJ_TEST("QueueBroker delivers full batches at once and partial ones after the timeout") {
+  QueueTest test;
+
+  KJ_EXPECT(test.sendMessage("a") == 200);
+  KJ_EXPECT(test.sendMessage("b") == 200);
+  KJ_EXPECT(test.takeDelivered() == "");
+
+  test.advance(500 * kj::MILLISECONDS);
+  KJ_EXPECT(test.takeDelivered() == "");
+  test.advance(500 * kj::MILLISECONDS);
+  KJ_EXPECT(test.takeDelivered() == "a,b");
+  KJ_EXPECT(test.service->getBacklog() == 0);
+
+  KJ_EXPECT(test.sendMessage("c") == 200);
+  KJ_EXPECT(test.sendMessage("d") == 200);
+  KJ_EXPECT(test.sendMessage("e") == 200);
+  KJ_EXPECT(test.sendMessage("f") == 200);
+  KJ_EXPECT(test.takeDelivered() == "c,d,e");
+  test.advance(1 * kj::SECONDS);
+  KJ_EXPECT(test.takeDelivered() == "f");
+}
+
+KJ_TEST("QueueBroker retries what the consumer doesn't acknowledge") {
+  QueueTest test;
+
+  // The handler fails, but acknowledges "a" explicitly.
+  test.respond = [](kj::ArrayPtr<const DeliveredMessage> batch) {
+    kj::Vector<kj::String> acks;
+    for (auto& message: batch) {
+      if (message.body == "a") acks.add(kj::str(message.id));
+    }
+    return QueueBroker::DeliveryResult {
+      .succeeded = false,
+      .explicitAcks = acks.releaseAsArray(),
+    };
+  };
+  KJ_EXPECT(test.sendMessage("a") == 200);
+  KJ_EXPECT(test.sendMessage("b") == 200);
+  KJ_EXPECT(test.sendMessage("c") == 200);
+  KJ_EXPECT(test.takeDelivered() == "a,b,c");
+
+  // The rest become visible again after the retry delay, and go out once their batch times out.
+  // They are dropped once out of retries.
+  test.advance(5 * kj::SECONDS);
+  KJ_EXPECT(test.takeDelivered() == "");
+  test.advance(1 * kj::SECONDS);
+  KJ_EXPECT(test.takeDelivered() == "b,c");
+  test.advance(6 * kj::SECONDS);
+  KJ_EXPECT(test.takeDelivered() == "b,c");
+  test.advance(6 * kj::SECONDS);
+  KJ_EXPECT(test.takeDelivered() == "b,c");
+  test.advance(6 * kj::SECONDS);
+  KJ_EXPECT(test.takeDelivered() == "");
+  KJ_EXPECT(test.service->getBacklog() == 0);
+
+  // retryAll overrides a successful handler, except for messages acknowledged explicitly.
+  test.respond = [](kj::ArrayPtr<const DeliveredMessage> batch) {
+    return QueueBroker::DeliveryResult {
+      .succeeded = true,
+      .retryAll = true,
+      .explicitAcks = kj::arr(kj::str(batch[1].id)),
+    };
+  };
+  KJ_EXPECT(test.sendMessage("d") == 200);
+  KJ_EXPECT(test.sendMessage("e") == 200);
+  test.advance(1 * kj::SECONDS);
+  KJ_EXPECT(test.takeDelivered() == "d,e");
+  test.respond = [](auto) { return QueueBroker::DeliveryResult { .succeeded = true }; };
+  test.advance(5 * kj::SECONDS);
+  test.advance(1 * kj::SECONDS);
+  KJ_EXPECT(test.takeDelivered() == "d");
+  KJ_EXPECT(test.service->getBacklog() == 0);
+}
+
+KJ_TEST("QueueBroker keeps messages across restarts") {
+  QueueTest test(DEFAULT_OPTIONS, false);
+
+  KJ_EXPECT(test.sendMessage("a") == 200);
+  KJ_EXPECT(test.sendMessage("b", "10"_kj) == 200);
+  KJ_EXPECT(test.service->getBacklog() == 2);
+
+  test.restart();
+  KJ_EXPECT(test.service->getBacklog() == 2);
+  test.advance(1 * kj::SECONDS);
+  KJ_EXPECT(test.takeDelivered() == "a");
+
+  // Delayed messages become visible only after their delay.
+  test.advance(8 * kj::SECONDS);
+  KJ_EXPECT(test.takeDelivered() == "");
+  test.advance(2 * kj::SECONDS);
+  test.advance(1 * kj::SECONDS);
+  KJ_EXPECT(test.takeDelivered() == "b");
+}
+
+KJ_TEST("QueueBroker accepts JSON and binary batches") {
+  QueueTest test;
+
+  auto json = kj::str(
+      "{\"messages\":["
+      "{\"body\":\"", kj::encodeBase64("one"_kj.asBytes()), "\",\"contentType\":\"text\"},"
+      "{\"body\":\"", kj::encodeBase64("two"_kj.asBytes()), "\",\"contentType\":\"bytes\","
+      "\"delaySecs\":30}]}");
+  KJ_EXPECT(test.send("batch", json.asBytes()) == 200);
+
+  // "three" as text with no delay, then "four" with the default format and a 2 second delay.
+  kj::Vector<kj::byte> binary;
+  binary.addAll(kj::ArrayPtr<const kj::byte>({ 5, 0, 0, 0, 4, 't', 'e', 'x', 't', 0 }));
+  binary.addAll("three"_kj.asBytes());
+  binary.addAll(kj::ArrayPtr<const kj::byte>({ 4, 0, 0, 0, 0, 1, 2, 0, 0, 0 }));
+  binary.addAll("four"_kj.asBytes());
+  KJ_EXPECT(test.send("batch", binary.asPtr(), kj::none, kj::none, true) == 200);
+
+  KJ_EXPECT(test.takeDelivered() == "");
+  test.advance(1 * kj::SECONDS);
+  KJ_EXPECT(test.batches.size() == 1);
+  auto& batch = test.batches[0];
+  KJ_ASSERT(batch.size() == 2);
+  KJ_EXPECT(batch[0].body == "one");
+  KJ_EXPECT(KJ_ASSERT_NONNULL(batch[0].contentType) == "text");
+  KJ_EXPECT(batch[1].body == "three");
+  KJ_EXPECT(test.takeDelivered() == "one,three");
+
+  test.advance(2 * kj::SECONDS);
+  KJ_EXPECT(test.batches.size() == 1);
+  KJ_EXPECT(test.batches[0][0].contentType == kj::none);
+  KJ_EXPECT(test.takeDelivered() == "four");
+
+  // Malformed batches are rejected whole.
+  KJ_EXPECT(test.send("batch", "{\"messages\":[{\"body\":\"!!\"}]}"_kj.asBytes()) == 400);
+  KJ_EXPECT(test.send("batch", binary.asPtr().slice(0, 12), kj::none, kj::none, true) == 400);
+  KJ_EXPECT(test.service->getBacklog() == 1);
+}
+
+KJ_TEST("QueueBroker enforces its limits") {
+  QueueTest test({
+    .maxBatchSize = 10,
+    .maxBatchTimeout = 1 * kj::SECONDS,
+    .maxConcurrency = 1,
+    .maxRetries = 0,
+    .retryDelay = 0 * kj::SECONDS,
+    .maxBacklog = 2,
+    .maxMessageSize = 4,
+  }, false);
+
+  KJ_EXPECT(test.sendMessage("12345") == 413);
+  KJ_EXPECT(test.sendMessage("x", "100000"_kj) == 400);
+  KJ_EXPECT(test.send("message", "x"_kj.asBytes(), "yaml"_kj) == 400);
+  KJ_EXPECT(test.sendMessage("a") == 200);
+  KJ_EXPECT(test.sendMessage("b") == 200);
+  KJ_EXPECT(test.sendMessage("c") == 429);
+  KJ_EXPECT(test.service->getBacklog() == 2);
+
+  // Consuming the backlog makes room again.
+  test.startDelivery();
+  test.advance(1 * kj::SECONDS);
+  KJ_EXPECT(test.takeDelivered() == "a,b");
+  KJ_EXPECT(test.sendMessage("c") == 200);
+}
+
+KJ_TEST("QueueBroker handles an unlimited message size") {
+  QueueTest test({
+    .maxBatchSize = 10,
+    .maxBatchTimeout = 1 * kj::SECONDS,
+    .maxConcurrency = 1,
+    .maxRetries = 0,
+    .retryDelay = 0 * kj::SECONDS,
+    .maxBacklog = 10,
+    .maxMessageSize = kj::maxValue,
+  });
+
+  // The batch size limit derived from maxMessageSize must not overflow to something tiny.
+  auto json = kj::str(
+      "{\"messages\":[{\"body\":\"", kj::encodeBase64("one"_kj.asBytes()), "\"}]}");
+  KJ_EXPECT(test.send("batch", json.asBytes()) == 200);
+  KJ_EXPECT(test.sendMessage("two") == 200);
+
+  test.advance(1 * kj::SECONDS);
+  KJ_EXPECT(test.takeDelivered() == "one,two");
+}
+
+}  // namespace
+}  // namespace workerd::server
@@ -0,0 +1,482 @@
+// Copyright (c) 2017-2022 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+#include "queue-broker.h"
+#include <capnp/compat/json.h>
+#include <capnp/message.h>
+#include <kj/compat/url.h>
+#include <kj/debug.h>
+#include <kj/encoding.h>
+#include <workerd/util/stream-utils.h>
+
+namespace workerd::server {
+
+namespace {
+
+int64_t toUnixMillis(kj::Date date) {
+  return (date - kj::UNIX_EPOCH) / kj::MILLISECONDS;
+}
+
+kj::Date fromUnixMillis(int64_t millis) {
+  return kj::UNIX_EPOCH + millis * kj::MILLISECONDS;
+}
+
+// Returns the content type as a string with static lifetime, or none if it isn't one that
+// QueueEvent knows how to deserialize.
+kj::Maybe<kj::StringPtr> knownContentType(kj::ArrayPtr<const char> name) {
+  for (kj::StringPtr type: { "text"_kj, "bytes"_kj, "json"_kj, "v8"_kj }) {
+    if (name == type.asArray()) return type;
+  }
+  return kj::none;
+}
+
+uint32_t readLittleEndian32(const kj::byte* p) {
+  return uint32_t(p[0]) | uint32_t(p[1]) << 8 | uint32_t(p[2]) << 16 | uint32_t(p[3]) << 24;
+}
+
+}  // namespace
+
+QueueBroker::Database::Database(const SqliteDatabase::Vfs& vfs, kj::PathPtr path)
+    : db(vfs, path, kj::WriteMode::CREATE | kj::WriteMode::MODIFY | kj::WriteMode::CREATE_PARENT) {}
+
+bool QueueBroker::Database::ensureInitialized(SqliteDatabase& db) {
+  db.run("PRAGMA journal_mode=WAL;");
+
+  // Ids increase in the order messages were sent, and AUTOINCREMENT keeps them from being reused,
+  // so a consumer never sees two messages with the same id. Times are Unix milliseconds.
+  db.run(R"(
+    CREATE TABLE IF NOT EXISTS _cf_QUEUE (
+      id INTEGER PRIMARY KEY AUTOINCREMENT,
+      body BLOB NOT NULL,
+      content_type TEXT,
+      timestamp INTEGER NOT NULL,
+      visible_at INTEGER NOT NULL,
+      attempts INTEGER NOT NULL DEFAULT 0
+    );
+  )");
+  db.run(R"(
+    CREATE INDEX IF NOT EXISTS _cf_QUEUE_visible_at ON _cf_QUEUE (visible_at, id);
+  )");
+
+  return true;
+}
+
+QueueBroker::QueueBroker(kj::HttpHeaderTable::Builder& headerTableBuilder, Options options,
+                         kj::Timer& timer, const kj::Clock& clock)
+    : headerTable(headerTableBuilder.getFutureTable()), options(options), timer(timer),
+      clock(clock),
+      hMsgFmt(headerTableBuilder.add("X-Msg-Fmt")),
+      hMsgDelaySecs(headerTableBuilder.add("X-Msg-Delay-Secs")),
+      hCfQueueBatchFormat(headerTableBuilder.add("CF-Queue-Batch-Format")),
+      tasks(*this) {}
+
+QueueBroker::~QueueBroker() noexcept(false) {}
+
+void QueueBroker::open(const SqliteDatabase::Vfs& vfs, kj::PathPtr path) {
+  KJ_REQUIRE(database == kj::none, "already opened");
+  auto& db = *database.emplace(kj::heap<Database>(vfs, path));
+
+  auto query = db.stmtCount.run();
+  backlog = query.getInt64(0);
+}
+
+void QueueBroker::startDelivery(Consumer consumerFunc) {
+  KJ_REQUIRE(database != kj::none, "startDelivery() called before open()");
+  KJ_REQUIRE(consumer == kj::none, "already delivering");
+  consumer = kj::mv(consumerFunc);
+  pump();
+}
+
+QueueBroker::Database& QueueBroker::getDatabase() {
+  return *KJ_REQUIRE_NONNULL(database, "queue used before it was opened");
+}
+
+kj::Promise<void> QueueBroker::request(
+    kj::HttpMethod method, kj::StringPtr urlStr, const kj::HttpHeaders& headers,
+    kj::AsyncInputStream& requestBody, Response& response) {
+  auto url = KJ_UNWRAP_OR(kj::Url::tryParse(urlStr, kj::Url::HTTP_PROXY_REQUEST), {
+    return response.sendError(400, "Bad Request", headerTable);
+  });
+
+  if (method != kj::HttpMethod::POST) {
+    return response.sendError(405, "Method Not Allowed", headerTable);
+  }
+
+  kj::Maybe<uint32_t> delaySeconds;
+  KJ_IF_SOME(d, headers.get(hMsgDelaySecs)) {
+    auto seconds = KJ_UNWRAP_OR(d.tryParseAs<uint32_t>(), {
+      return response.sendError(400, "Bad Request", headerTable);
+    });
+    if (seconds > MAX_DELAY_SECONDS) {
+      return response.sendError(400, "Bad Request", headerTable);
+    }
+    delaySeconds = seconds;
+  }
+
+  // The binding's URL may be prefixed, e.g. with an account and queue id, so go by the last
+  // component only.
+  if (url.path.size() > 0 && url.path.back() == "message") {
+    return handleMessage(delaySeconds, headers, requestBody, response);
+  } else if (url.path.size() > 0 && url.path.back() == "batch") {
+    return handleBatch(delaySeconds, headers, requestBody, response);
+  } else {
+    return response.sendError(404, "Not Found", headerTable);
+  }
+}
+
+kj::Promise<void> QueueBroker::handleMessage(kj::Maybe<uint32_t> delaySeconds,
+                                             const kj::HttpHeaders& headers,
+                                             kj::AsyncInputStream& requestBody,
+                                             Response& response) {
+  kj::Maybe<kj::StringPtr> contentType;
+  KJ_IF_SOME(f, headers.get(hMsgFmt)) {
+    KJ_IF_SOME(type, knownContentType(f)) {
+      contentType = type;
+    } else {
+      co_return co_await response.sendError(400, "Bad Request", headerTable);
+    }
+  }
+
+  auto maybeBody = co_await readAllBytesUpTo(requestBody, options.maxMessageSize);
+  if (maybeBody == kj::none) {
+    co_return co_await response.sendError(413, "Payload Too Large", headerTable);
+  }
+  auto body = kj::mv(KJ_ASSERT_NONNULL(maybeBody));
+
+  NewMessage message { .body = body, .contentType = contentType };
+  if (!enqueue(kj::arrayPtr(&message, 1), delaySeconds)) {
+    co_return co_await response.sendError(429, "Too Many Requests", headerTable);
+  }
+
+  kj::HttpHeaders responseHeaders(headerTable);
+  responseHeaders.set(hCfQueueBatchFormat, "binary");
+  response.send(200, "OK", responseHeaders, uint64_t(0));
+}
+
+kj::Promise<void> QueueBroker::handleBatch(kj::Maybe<uint32_t> delaySeconds,
+                                           const kj::HttpHeaders& headers,
+                                           kj::AsyncInputStream& requestBody,
+                                           Response& response) {
+  bool binary = false;
+  KJ_IF_SOME(f, headers.get(hCfQueueBatchFormat)) {
+    binary = f == "binary";
+  }
+
+  // Allow for base64 expansion and per-message framing in a full batch of the largest messages.
+  // If maxMessageSize is so big that this would overflow, there's effectively no limit.
+  constexpr uint64_t PER_MESSAGE_OVERHEAD = 4 + 1024;
+  uint64_t limit = kj::maxValue;
+  if (options.maxMessageSize / 3 <=
+      (limit / MAX_SEND_BATCH_MESSAGES - PER_MESSAGE_OVERHEAD) / 4) {
+    limit = MAX_SEND_BATCH_MESSAGES * (options.maxMessageSize / 3 * 4 + PER_MESSAGE_OVERHEAD);
+  }
+  auto maybeBody = co_await readAllBytesUpTo(requestBody, limit);
+  if (maybeBody == kj::none) {
+    co_return co_await response.sendError(413, "Payload Too Large", headerTable);
+  }
+  auto body = kj::mv(KJ_ASSERT_NONNULL(maybeBody));
+
+  kj::Vector<kj::Array<kj::byte>> decodedBodies;
+  kj::Maybe<kj::Array<NewMessage>> maybeMessages = binary
+      ? parseBinaryBatch(body)
+      : parseJsonBatch(body.asPtr().asChars(), decodedBodies);
+  if (maybeMessages == kj::none) {
+    co_return co_await response.sendError(400, "Bad Request", headerTable);
+  }
+  auto messages = kj::mv(KJ_ASSERT_NONNULL(maybeMessages));
+  if (messages.size() > MAX_SEND_BATCH_MESSAGES) {
+    co_return co_await response.sendError(400, "Bad Request", headerTable);
+  }
+  for (auto& message: messages) {
+    if (message.body.size() > options.maxMessageSize) {
+      co_return co_await response.sendError(413, "Payload Too Large", headerTable);
+    }
+  }
+
+  if (!enqueue(messages, delaySeconds)) {
+    co_return co_await response.sendError(429, "Too Many Requests", headerTable);
+  }
+
+  kj::HttpHeaders responseHeaders(headerTable);
+  responseHeaders.set(hCfQueueBatchFormat, "binary");
+  response.send(200, "OK", responseHeaders, uint64_t(0));
+}
+
+kj::Maybe<kj::Array<QueueBroker::NewMessage>> QueueBroker::parseJsonBatch(
+    kj::ArrayPtr<const char> text, kj::Vector<kj::Array<kj::byte>>& decodedBodies) {
+  // The batch looks like {"messages":[{"body":"<base64>","contentType":"v8","delaySecs":1}]}.
+  // Content types are mapped to static strings, so nothing points into the parsed message.
+  capnp::MallocMessageBuilder message;
+  auto builder = message.initRoot<capnp::JsonValue>();
+  capnp::JsonCodec json;
+  if (kj::runCatchingExceptions([&]() { json.decodeRaw(text, builder); }) != kj::none) {
+    return kj::none;
+  }
+  auto root = builder.asReader();
+  if (!root.isObject()) return kj::none;
+
+  kj::Maybe<capnp::List<capnp::JsonValue>::Reader> entries;
+  for (auto field: root.getObject()) {
+    if (field.getName() == "messages") {
+      auto value = field.getValue();
+      if (!value.isArray()) return kj::none;
+      entries = value.getArray();
+    }
+  }
+
+  kj::Vector<NewMessage> result;
+  KJ_IF_SOME(list, entries) {
+    result.reserve(list.size());
+    for (auto entry: list) {
+      if (!entry.isObject()) return kj::none;
+      NewMessage parsed;
+      bool hasBody = false;
+      for (auto field: entry.getObject()) {
+        auto name = field.getName();
+        auto value = field.getValue();
+        if (name == "body") {
+          if (!value.isString()) return kj::none;
+          auto decoded = kj::decodeBase64(value.getString());
+          if (decoded.hadErrors) return kj::none;
+          parsed.body = decodedBodies.add(kj::mv(decoded));
+          hasBody = true;
+        } else if (name == "contentType") {
+          if (!value.isString()) return kj::none;
+          parsed.contentType = KJ_UNWRAP_OR_RETURN(knownContentType(value.getString()), kj::none);
+        } else if (name == "delaySecs") {
+          if (!value.isNumber()) return kj::none;
+          double seconds = value.getNumber();
+          if (!(seconds >= 0 && seconds <= MAX_DELAY_SECONDS)) return kj::none;
+          parsed.delaySeconds = uint32_t(seconds);
+        }
+      }
+      if (!hasBody) return kj::none;
+      result.add(kj::mv(parsed));
+    }
+  }
+
+  return result.releaseAsArray();
+}
+
+kj::Maybe<kj::Array<QueueBroker::NewMessage>> QueueBroker::parseBinaryBatch(
+    kj::ArrayPtr<const kj::byte> data) {
+  // Each message is framed as: body size (u32, little-endian), content type length (u8, zero if
+  // unspecified), content type, delay flag (u8), delay in seconds (i32, little-endian, only if the
+  // flag is set), body.
+  kj::Vector<NewMessage> result;
+  while (data.size() > 0) {
+    if (data.size() < 5) return kj::none;
+    uint32_t bodySize = readLittleEndian32(data.begin());
+    size_t typeSize = data[4];
+    data = data.slice(5, data.size());
+
+    if (data.size() < typeSize + 1) return kj::none;
+    NewMessage parsed;
+    if (typeSize > 0) {
+      parsed.contentType = KJ_UNWRAP_OR_RETURN(
+          knownContentType(data.slice(0, typeSize).asChars()), kj::none);
+    }
+    bool hasDelay = data[typeSize] != 0;
+    data = data.slice(typeSize + 1, data.size());
+
+    if (hasDelay) {
+      if (data.size() < 4) return kj::none;
+      auto seconds = int32_t(readLittleEndian32(data.begin()));
+      if (seconds < 0 || seconds > int32_t(MAX_DELAY_SECONDS)) return kj::none;
+      parsed.delaySeconds = uint32_t(seconds);
+      data = data.slice(4, data.size());
+    }
+
+    if (data.size() < bodySize) return kj::none;
+    parsed.body = data.slice(0, bodySize);
+    data = data.slice(bodySize, data.size());
+    result.add(kj::mv(parsed));
+  }
+
+  return result.releaseAsArray();
+}
+
+bool QueueBroker::enqueue(kj::ArrayPtr<const NewMessage> messages,
+                          kj::Maybe<uint32_t> defaultDelay) {
+  if (backlog + messages.size() > options.maxBacklog) return false;
+
+  auto& db = getDatabase();
+  auto now = toUnixMillis(clock.now());
+
+  // Store the whole batch in one transaction, so that it is accepted or rejected as a unit, and
+  // so that it costs one commit rather than one per message.
+  db.db.run("BEGIN TRANSACTION;");
+  KJ_ON_SCOPE_FAILURE(db.db.run("ROLLBACK;"));
+  for (auto& message: messages) {
+    uint32_t delay = message.delaySeconds.orDefault(defaultDelay.orDefault(0));
+
+    SqliteDatabase::Query::ValuePtr bindings[4];
+    bindings[0].init<kj::ArrayPtr<const kj::byte>>(message.body);
+    KJ_IF_SOME(type, message.contentType) {
+      bindings[1].init<kj::StringPtr>(type);
+    } else {
+      bindings[1].init<decltype(nullptr)>(nullptr);
+    }
+    bindings[2].init<int64_t>(now);
+    bindings[3].init<int64_t>(now + int64_t(delay) * 1000);
+    db.stmtInsert.run(kj::ArrayPtr<const SqliteDatabase::Query::ValuePtr>(bindings));
+  }
+  db.db.run("COMMIT;");
+
+  backlog += messages.size();
+  pump();
+  return true;
+}
+
+void QueueBroker::pump() {
+  if (consumer == kj::none) return;
+  auto& db = getDatabase();
+
+  while (outstandingBatches < options.maxConcurrency) {
+    auto now = clock.now();
+    auto nowMillis = toUnixMillis(now);
+
+    // Messages already out for delivery are still in the table, so read past them.
+    kj::Vector<InFlight> batch(options.maxBatchSize);
+    int64_t oldestVisibleAt = nowMillis;
+    {
+      auto query = db.stmtReady.run(nowMillis, int64_t(options.maxBatchSize + inFlight.size()));
+      for (; !query.isDone() && batch.size() < options.maxBatchSize; query.nextRow()) {
+        auto id = query.getInt64(0);
+        if (inFlight.contains(id)) continue;
+        if (batch.empty()) oldestVisibleAt = query.getInt64(1);
+        batch.add(InFlight { .id = id, .attempts = 0 });
+      }
+    }
+
+    if (batch.empty()) {
+      // Nothing is ready; wake when the next delayed or retried message becomes visible.
+      auto query = db.stmtNextVisible.run(nowMillis);
+      KJ_IF_SOME(next, query.getMaybeInt64(0)) {
+        wakeAt(fromUnixMillis(next));
+      }
+      return;
+    }
+
+    auto deadline = fromUnixMillis(oldestVisibleAt) + options.maxBatchTimeout;
+    if (batch.size() < options.maxBatchSize && now < deadline) {
+      // Give the batch a chance to fill.
+      wakeAt(deadline);
+      return;
+    }
+
+    for (auto& message: batch) {
+      inFlight.insert(message.id);
+    }
+    ++outstandingBatches;
+    tasks.add(deliver(batch.releaseAsArray()));
+  }
+}
+
+void QueueBroker::wakeAt(kj::Date when) {
+  KJ_IF_SOME(scheduled, nextWake) {
+    if (scheduled <= when) return;
+  }
+  nextWake = when;
+
+  // An earlier wake-up may still be pending; when it fires, it finds it is no longer the next one
+  // and does nothing, since pump() will have been run by then anyway.
+  tasks.add(timer.afterDelay(when - clock.now()).then([this, when]() {
+    KJ_IF_SOME(scheduled, nextWake) {
+      if (scheduled != when) return;
+    } else {
+      return;
+    }
+    nextWake = kj::none;
+    pump();
+  }));
+}
+
+kj::Promise<void> QueueBroker::deliver(kj::Array<InFlight> batch) {
+  {
+    // However delivery ends, even if it throws, the batch is no longer out, so its messages may be
+    // delivered again and another batch may take its place.
+    KJ_DEFER({
+      for (auto& message: batch) {
+        inFlight.erase(message.id);
+      }
+      --outstandingBatches;
+    });
+
+    auto& db = getDatabase();
+    auto messages = KJ_MAP(message, batch) {
+      auto query = db.stmtGet.run(message.id);
+      KJ_ASSERT(!query.isDone(), "message out for delivery was deleted", message.id);
+      message.attempts = query.getInt64(3);
+      return Message {
+        .id = kj::str(message.id),
+        .timestamp = fromUnixMillis(query.getInt64(2)),
+        .body = kj::heapArray(query.getBlob(0)),
+        .contentType = query.getMaybeText(1).map([](kj::StringPtr t) { return kj::str(t); }),
+      };
+    };
+
+    DeliveryResult result;
+    try {
+      result = co_await KJ_ASSERT_NONNULL(consumer)(kj::mv(messages));
+    } catch (...) {
+      // The consumer couldn't be reached, or failed outside its handler. Retry the batch, as if
+      // the handler had thrown.
+      KJ_LOG(WARNING, "queue delivery failed", kj::getCaughtExceptionAsKj());
+    }
+
+    settle(batch, result);
+  }
+  pump();
+}
+
+void QueueBroker::settle(kj::ArrayPtr<const InFlight> batch, const DeliveryResult& result) {
+  kj::HashSet<kj::StringPtr> acks;
+  kj::HashSet<kj::StringPtr> retries;
+  for (auto& id: result.explicitAcks) acks.insert(id);
+  for (auto& id: result.explicitRetries) retries.insert(id);
+
+  auto& db = getDatabase();
+  auto retryAt = toUnixMillis(clock.now() + options.retryDelay);
+
+  uint64_t deleted = 0;
+  db.db.run("BEGIN TRANSACTION;");
+  KJ_ON_SCOPE_FAILURE(db.db.run("ROLLBACK;"));
+  for (auto& message: batch) {
+    auto id = kj::str(message.id);
+    bool ack;
+    if (acks.contains(id)) {
+      ack = true;
+    } else if (retries.contains(id)) {
+      ack = false;
+    } else if (result.retryAll) {
+      ack = false;
+    } else if (result.ackAll) {
+      ack = true;
+    } else {
+      ack = result.succeeded;
+    }
+
+    if (!ack && message.attempts < options.maxRetries) {
+      db.stmtRetry.run(retryAt, message.id);
+    } else {
+      if (!ack) {
+        KJ_LOG(WARNING, "dropping queue message after too many retries", message.id,
+               message.attempts);
+      }
+      db.stmtDelete.run(message.id);
+      ++deleted;
+    }
+  }
+  db.db.run("COMMIT;");
+
+  // Only once the deletes are committed; if the transaction rolled back, they're still queued.
+  backlog -= deleted;
+}
+
+void QueueBroker::taskFailed(kj::Exception&& exception) {
+  KJ_LOG(ERROR, exception);
+}
+
+}  // namespace workerd::server
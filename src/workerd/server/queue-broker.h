@@ -0,0 +1,219 @@
+// Copyright (c) 2017-2022 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+#pragma once
+
+#include <kj/async.h>
+#include <kj/compat/http.h>
+#include <kj/filesystem.h>
+#include <kj/function.h>
+#include <kj/map.h>
+#include <kj/time.h>
+#include <kj/timer.h>
+#include <kj/vector.h>
+#include <workerd/util/sqlite.h>
+
+namespace workerd::server {
+
+// A queue stored in SQLite, used to implement the `queue` service type. Producers reach it through
+// the protocol that WorkerQueue (api/queue.c++) uses with the service a `queue` binding points at:
+//
+// * POST /message enqueues the request body, in the format named by `X-Msg-Fmt` (`v8` if unset),
+//   to be delivered after `X-Msg-Delay-Secs` seconds.
+// * POST /batch enqueues a batch of messages, either as JSON or, if `CF-Queue-Batch-Format` is
+//   `binary`, in the binary framing. `X-Msg-Delay-Secs` applies to messages that don't set their
+//   own delay. Responses carry `CF-Queue-Batch-Format: binary` so that the binding switches to the
+//   cheaper framing.
+//
+// Messages are delivered in batches to the consumer passed to startDelivery(). A batch is sent
+// once `maxBatchSize` messages are ready, or once the oldest ready message has waited
+// `maxBatchTimeout`, with at most `maxConcurrency` batches outstanding at a time. The consumer's
+// result decides each message's fate: acknowledged messages are deleted, and the rest are retried
+// after `retryDelay`, until they have been retried `maxRetries` times, after which they are
+// dropped.
+//
+// Messages are deleted only once acknowledged, so delivery is at least once: messages that were
+// being delivered when the process stopped are delivered again by the next broker to open the
+// database. The broker assumes it is the database's only user.
+class QueueBroker final: public kj::HttpService, private kj::TaskSet::ErrorHandler {
+public:
+  struct Options {
+    // Most messages to deliver in one batch.
+    uint maxBatchSize;
+
+    // Longest a ready message waits for its batch to fill before the batch is sent anyway.
+    kj::Duration maxBatchTimeout;
+
+    // Most batches to have outstanding with the consumer at once.
+    uint maxConcurrency;
+
+    // Times a message is retried before it is dropped.
+    uint maxRetries;
+
+    // How long a retried message waits before it is delivered again.
+    kj::Duration retryDelay;
+
+    // Most messages to hold at once. Sends that would exceed it fail with 429 Too Many Requests,
+    // which the binding reports as a failed send.
+    uint64_t maxBacklog;
+
+    // Largest message body that can be sent.
+    uint64_t maxMessageSize;
+  };
+
+  // A message being delivered.
+  struct Message {
+    kj::String id;
+    kj::Date timestamp;
+    kj::Array<kj::byte> body;
+    kj::Maybe<kj::String> contentType;
+  };
+
+  // What the consumer did with a batch. Messages named in `explicitAcks` or `explicitRetries` are
+  // acknowledged or retried; otherwise `retryAll` and then `ackAll` decide, and failing that, the
+  // whole batch is acknowledged if the handler `succeeded` and retried if not.
+  struct DeliveryResult {
+    bool succeeded = false;
+    bool retryAll = false;
+    bool ackAll = false;
+    kj::Array<kj::String> explicitRetries;
+    kj::Array<kj::String> explicitAcks;
+  };
+
+  // Delivers a batch to the consumer. If the returned promise rejects, the batch is retried.
+  using Consumer = kj::Function<kj::Promise<DeliveryResult>(kj::Array<Message> batch)>;
+
+  QueueBroker(kj::HttpHeaderTable::Builder& headerTableBuilder, Options options, kj::Timer& timer,
+              const kj::Clock& clock = kj::systemPreciseCalendarClock());
+  ~QueueBroker() noexcept(false);
+  KJ_DISALLOW_COPY_AND_MOVE(QueueBroker);
+
+  // Opens (creating if needed) the database at `path` within `vfs`. Must be called once before
+  // any requests.
+  void open(const SqliteDatabase::Vfs& vfs, kj::PathPtr path);
+
+  // Starts delivering messages to `consumer`, beginning with any left in the database. May be
+  // called at most once, after open(). Until it is called, messages accumulate.
+  void startDelivery(Consumer consumer);
+
+  // Messages currently stored, including those being delivered.
+  uint64_t getBacklog() const { return backlog; }
+
+  kj::Promise<void> request(
+      kj::HttpMethod method, kj::StringPtr url, const kj::HttpHeaders& headers,
+      kj::AsyncInputStream& requestBody, Response& response) override;
+
+  // Most messages accepted in one POST /batch, as in Queues.
+  static constexpr uint MAX_SEND_BATCH_MESSAGES = 100;
+
+  // Longest delay a message can be sent with, as in Queues.
+  static constexpr uint MAX_DELAY_SECONDS = 12 * 60 * 60;
+
+private:
+  // The database, and the statements prepared against it.
+  struct Database {
+    SqliteDatabase db;
+
+    // Creates the table before the statements below are prepared against it.
+    bool initialized = ensureInitialized(db);
+
+    Database(const SqliteDatabase::Vfs& vfs, kj::PathPtr path);
+
+    SqliteDatabase::Statement stmtInsert = db.prepare(R"(
+      INSERT INTO _cf_QUEUE (body, content_type, timestamp, visible_at) VALUES(?, ?, ?, ?)
+    )");
+    SqliteDatabase::Statement stmtReady = db.prepare(R"(
+      SELECT id, visible_at FROM _cf_QUEUE
+      WHERE visible_at <= ?
+      ORDER BY visible_at, id
+      LIMIT ?
+    )");
+    SqliteDatabase::Statement stmtNextVisible = db.prepare(R"(
+      SELECT MIN(visible_at) FROM _cf_QUEUE WHERE visible_at > ?
+    )");
+    SqliteDatabase::Statement stmtGet = db.prepare(R"(
+      SELECT body, content_type, timestamp, attempts FROM _cf_QUEUE WHERE id = ?
+    )");
+    SqliteDatabase::Statement stmtDelete = db.prepare(R"(
+      DELETE FROM _cf_QUEUE WHERE id = ?
+    )");
+    SqliteDatabase::Statement stmtRetry = db.prepare(R"(
+      UPDATE _cf_QUEUE SET attempts = attempts + 1, visible_at = ? WHERE id = ?
+    )");
+    SqliteDatabase::Statement stmtCount = db.prepare(R"(
+      SELECT COUNT(*) FROM _cf_QUEUE
+    )");
+
+    static bool ensureInitialized(SqliteDatabase& db);
+  };
+
+  // A message parsed from a send, not yet stored. It points into the request body or into
+  // storage owned by the caller.
+  struct NewMessage {
+    kj::ArrayPtr<const kj::byte> body;
+    kj::Maybe<kj::StringPtr> contentType;
+    kj::Maybe<uint32_t> delaySeconds;
+  };
+
+  // A message in a batch out for delivery.
+  struct InFlight {
+    int64_t id;
+    int64_t attempts;
+  };
+
+  kj::HttpHeaderTable& headerTable;
+  Options options;
+  kj::Timer& timer;
+  const kj::Clock& clock;
+  kj::Maybe<kj::Own<Database>> database;
+
+  kj::HttpHeaderId hMsgFmt;
+  kj::HttpHeaderId hMsgDelaySecs;
+  kj::HttpHeaderId hCfQueueBatchFormat;
+
+  kj::Maybe<Consumer> consumer;
+  uint64_t backlog = 0;
+
+  // Messages in batches out for delivery, which mustn't be delivered again until settled.
+  kj::HashSet<int64_t> inFlight;
+  uint outstandingBatches = 0;
+
+  // When pump() is next scheduled to run, if it is waiting for a batch to fill or for a message
+  // to become visible.
+  kj::Maybe<kj::Date> nextWake;
+
+  kj::TaskSet tasks;
+
+  kj::Promise<void> handleMessage(kj::Maybe<uint32_t> delaySeconds,
+                                  const kj::HttpHeaders& headers,
+                                  kj::AsyncInputStream& requestBody, Response& response);
+  kj::Promise<void> handleBatch(kj::Maybe<uint32_t> delaySeconds, const kj::HttpHeaders& headers,
+                                kj::AsyncInputStream& requestBody, Response& response);
+
+  // Parse a POST /batch body. Return none if it is malformed. JSON bodies are base64-encoded, so
+  // the decoded bodies are added to `decodedBodies`, which the result points into.
+  static kj::Maybe<kj::Array<NewMessage>> parseJsonBatch(
+      kj::ArrayPtr<const char> text, kj::Vector<kj::Array<kj::byte>>& decodedBodies);
+  static kj::Maybe<kj::Array<NewMessage>> parseBinaryBatch(kj::ArrayPtr<const kj::byte> data);
+
+  // Stores messages and wakes delivery. Returns false, storing nothing, if they would exceed
+  // `maxBacklog`.
+  bool enqueue(kj::ArrayPtr<const NewMessage> messages, kj::Maybe<uint32_t> defaultDelay);
+
+  Database& getDatabase();
+
+  // Sends as many batches as are due and allowed, and schedules itself to run again when the next
+  // one will be.
+  void pump();
+  void wakeAt(kj::Date when);
+
+  kj::Promise<void> deliver(kj::Array<InFlight> batch);
+
+  // Acknowledges or retries each message of a delivered batch according to the consumer's result.
+  void settle(kj::ArrayPtr<const InFlight> batch, const DeliveryResult& result);
+
+  void taskFailed(kj::Exception&& exception) override;
+};
+
+}  // namespace workerd::server
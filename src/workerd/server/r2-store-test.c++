@@ -0,0 +1,387 @@
+// Copyright (c) 2017-2022 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+#include "r2-store.h"
+#include "storage-test-util.h"
+#include <capnp/compat/json.capnp.h>
+#include <capnp/compat/json.h>
+#include <capnp/message.h>
+#include <kj/test.h>
+
+namespace workerd::server {
+namespace {
+
+namespace r2 = api::public_beta;
+
+// An R2 response body starts with the JSON metadata, followed by the object's content if any.
+struct R2Response: public TestResponse {
+  kj::String metadata;
+};
+
+// Drives an R2Store the way a Worker's R2 binding reaches it.
+struct R2Test: public StorageServiceTest<R2Store> {
+  kj::HttpHeaderId hCfR2Request;
+  kj::HttpHeaderId hCfR2MetadataSize;
+  kj::HttpHeaderId hCfR2Error;
+
+  R2Test() { restart(); }
+
+  // Replaces the store with a fresh one over the same directory, as after a restart.
+  void restart() {
+    StorageServiceTest::restart([&](kj::HttpHeaderTable::Builder& builder) {
+      hCfR2Request = builder.add("CF-R2-Request");
+      hCfR2MetadataSize = builder.add("CF-R2-Metadata-Size");
+      hCfR2Error = builder.add("CF-R2-Error");
+      auto store = kj::heap<R2Store>(builder, clock);
+      store->open(*dir);
+      return store;
+    });
+  }
+
+  R2Response split(TestResponse response) {
+    size_t metadataSize = response.body.size();
+    KJ_IF_SOME(size, response.headers.get(hCfR2MetadataSize)) {
+      metadataSize = KJ_ASSERT_NONNULL(size.tryParseAs<size_t>());
+    }
+    auto metadata = kj::str(response.body.slice(0, metadataSize));
+    response.body = kj::str(response.body.slice(metadataSize));
+    return { kj::mv(response), kj::mv(metadata) };
+  }
+
+  // Sends a head, get or list.
+  R2Response read(kj::StringPtr requestJson) {
+    kj::HttpHeaders headers(*headerTable);
+    headers.set(hCfR2Request, requestJson);
+    return split(request(kj::HttpMethod::GET, "https://bucket/", headers));
+  }
+
+  // Sends any other operation, followed by `body`.
+  R2Response write(kj::StringPtr requestJson, kj::StringPtr body = nullptr) {
+    kj::HttpHeaders headers(*headerTable);
+    headers.set(hCfR2MetadataSize, kj::str(requestJson.size()));
+    auto content = kj::str(requestJson, body);
+    return split(request(kj::HttpMethod::PUT, "https://bucket/", headers, content.asBytes()));
+  }
+
+  uint v4Code(const R2Response& response) {
+    capnp::MallocMessageBuilder message;
+    auto error = KJ_ASSERT_NONNULL(response.headers.get(hCfR2Error));
+    capnp::JsonCodec codec;
+    auto value = message.initRoot<capnp::JsonValue>();
+    codec.decode(error, value);
+    for (auto field: value.getObject()) {
+      if (field.getName() == "v4code") return uint(field.getValue().getNumber());
+    }
+    KJ_FAIL_ASSERT("error has no v4code", error);
+  }
+
+  R2Response put(kj::StringPtr key, kj::StringPtr value, kj::StringPtr extra = nullptr) {
+    return write(kj::str("{\"version\":1,\"method\":\"put\",\"object\":\"", key, "\"", extra, "}"),
+                 value);
+  }
+
+  R2Response get(kj::StringPtr key, kj::StringPtr extra = nullptr) {
+    return read(kj::str("{\"version\":1,\"method\":\"get\",\"object\":\"", key, "\"", extra, "}"));
+  }
+
+  // Blob files currently stored.
+  size_t countBlobs() {
+    KJ_IF_SOME(blobs, dir->tryOpenSubdir(kj::Path({ "blobs" }))) {
+      return blobs->listNames().size();
+    }
+    return 0;
+  }
+};
+
+// Decodes a response's JSON metadata into `message`.
+template <typename T>
+typename T::Reader decode(capnp::MallocMessageBuilder& message, kj::StringPtr json) {
+  capnp::JsonCodec codec;
+  codec.handleByAnnotation<T>();
+  auto root = message.initRoot<T>();
+  codec.decode(json, root);
+  return root.asReader();
+}
+
+// MD5 of "hello world".
+constexpr kj::StringPtr HELLO_ETAG = "5eb63bbbe01eeed093cb22bb8f5acdc3"_kj;
+
+KJ_TEST("R2Store put, head, get and delete") {
+  R2Test test;
+
+  auto missing = test.get("a");
+  KJ_EXPECT(missing.statusCode == 404);
+  KJ_EXPECT(test.v4Code(missing) == 10007);
+
+  auto put = test.put("a", "hello world",
+      ",\"httpFields\":{\"contentType\":\"text/plain\"},\"customFields\":[{\"k\":\"x\",\"v\":\"y\"}]");
+  KJ_EXPECT(put.statusCode == 200);
+  {
+    capnp::MallocMessageBuilder message;
+    auto head = decode<r2::R2HeadResponse>(message, put.metadata);
+    KJ_EXPECT(head.getName() == "a");
+    KJ_EXPECT(head.getSize() == 11);
+    KJ_EXPECT(head.getEtag() == HELLO_ETAG);
+    KJ_EXPECT(head.getUploadedMillisecondsSinceEpoch() == 1'000'000'000);
+    KJ_EXPECT(head.getHttpFields().getContentType() == "text/plain");
+    KJ_EXPECT(head.getCustomFields().size() == 1);
+    KJ_EXPECT(head.getChecksums().getMd5().size() == 16);
+  }
+
+  auto head = test.read("{\"version\":1,\"method\":\"head\",\"object\":\"a\"}");
+  KJ_EXPECT(head.statusCode == 200);
+  KJ_EXPECT(head.metadata == put.metadata);
+  KJ_EXPECT(head.body == "");
+
+  auto get = test.get("a");
+  KJ_EXPECT(get.statusCode == 200);
+  KJ_EXPECT(get.metadata == put.metadata);
+  KJ_EXPECT(get.body == "hello world");
+
+  // Overwriting replaces the blob rather than adding one.
+  KJ_EXPECT(test.put("a", "goodbye").statusCode == 200);
+  KJ_EXPECT(test.get("a").body == "goodbye");
+  KJ_EXPECT(test.countBlobs() == 1);
+
+  // Objects survive a restart.
+  test.restart();
+  KJ_EXPECT(test.get("a").body == "goodbye");
+
+  KJ_EXPECT(test.put("b", "").statusCode == 200);
+  KJ_EXPECT(test.get("b").body == "");
+
+  KJ_EXPECT(test.write(
+      "{\"version\":1,\"method\":\"delete\",\"objects\":[\"a\",\"b\",\"c\"]}").statusCode == 200);
+  KJ_EXPECT(test.get("a").statusCode == 404);
+  KJ_EXPECT(test.get("b").statusCode == 404);
+  KJ_EXPECT(test.countBlobs() == 0);
+
+  auto longKey = kj::str(kj::repeat('k', R2Store::MAX_KEY_SIZE + 1));
+  auto tooLong = test.put(longKey, "value");
+  KJ_EXPECT(tooLong.statusCode == 400);
+  KJ_EXPECT(test.v4Code(tooLong) == 10020);
+}
+
+KJ_TEST("R2Store ranged get") {
+  R2Test test;
+  KJ_EXPECT(test.put("a", "hello world").statusCode == 200);
+
+  auto offset = test.get("a", ",\"range\":{\"offset\":6,\"length\":3}");
+  KJ_EXPECT(offset.statusCode == 200);
+  KJ_EXPECT(offset.body == "wor");
+  {
+    capnp::MallocMessageBuilder message;
+    auto head = decode<r2::R2HeadResponse>(message, offset.metadata);
+    KJ_EXPECT(head.getRange().getOffset() == 6);
+    KJ_EXPECT(head.getRange().getLength() == 3);
+  }
+
+  KJ_EXPECT(test.get("a", ",\"range\":{\"offset\":6}").body == "world");
+  KJ_EXPECT(test.get("a", ",\"range\":{\"offset\":6,\"length\":100}").body == "world");
+  KJ_EXPECT(test.get("a", ",\"range\":{\"suffix\":5}").body == "world");
+  KJ_EXPECT(test.get("a", ",\"range\":{\"suffix\":100}").body == "hello world");
+  KJ_EXPECT(test.get("a", ",\"rangeHeader\":\"bytes=0-4\"").body == "hello");
+  KJ_EXPECT(test.get("a", ",\"rangeHeader\":\"bytes=-5\"").body == "world");
+
+  auto unsatisfiable = test.get("a", ",\"range\":{\"offset\":12}");
+  KJ_EXPECT(unsatisfiable.statusCode == 416);
+  KJ_EXPECT(test.v4Code(unsatisfiable) == 10039);
+  KJ_EXPECT(test.get("a", ",\"rangeHeader\":\"bytes=20-30\"").statusCode == 416);
+}
+
+KJ_TEST("R2Store conditional operations and checksums") {
+  R2Test test;
+  KJ_EXPECT(test.put("a", "hello world").statusCode == 200);
+
+  auto matches = kj::str(",\"onlyIf\":{\"etagMatches\":[{\"value\":\"", HELLO_ETAG,
+                         "\",\"type\":\"strong\"}]}");
+  auto doesNotMatch = kj::str(",\"onlyIf\":{\"etagDoesNotMatch\":[{\"value\":\"", HELLO_ETAG,
+                              "\",\"type\":\"strong\"}]}");
+
+  KJ_EXPECT(test.get("a", matches).body == "hello world");
+
+  // A failed precondition on get returns the metadata, but no body.
+  auto failed = test.get("a", doesNotMatch);
+  KJ_EXPECT(failed.statusCode == 412);
+  KJ_EXPECT(test.v4Code(failed) == 10031);
+  KJ_EXPECT(failed.metadata.size() > 0);
+  KJ_EXPECT(failed.body == "");
+
+  // uploadedBefore is ignored when an etag condition held.
+  KJ_EXPECT(test.get("a", ",\"onlyIf\":{\"uploadedBefore\":1}").statusCode == 412);
+  KJ_EXPECT(test.get("a", kj::str(",\"onlyIf\":{\"etagMatches\":[{\"value\":\"", HELLO_ETAG,
+      "\",\"type\":\"strong\"}],\"uploadedBefore\":1}")).statusCode == 200);
+
+  // A conditional put that fails leaves the object and its blob alone.
+  KJ_EXPECT(test.put("a", "other", doesNotMatch).statusCode == 412);
+  KJ_EXPECT(test.get("a").body == "hello world");
+  KJ_EXPECT(test.countBlobs() == 1);
+  KJ_EXPECT(test.put("a", "other", matches).statusCode == 200);
+  KJ_EXPECT(test.get("a").body == "other");
+
+  // Put if absent.
+  auto wildcard = ",\"onlyIf\":{\"etagDoesNotMatch\":[{\"type\":\"wildcard\"}]}"_kj;
+  KJ_EXPECT(test.put("a", "again", wildcard).statusCode == 412);
+  KJ_EXPECT(test.put("b", "new", wildcard).statusCode == 200);
+
+  // md5 is base64 and the SHA digests are hex, as the binding sends them.
+  KJ_EXPECT(test.put("c", "hello world", ",\"md5\":\"XrY7u+Ae7tCTyyK7j1rNww==\"").statusCode == 200);
+  auto badDigest = test.put("c", "hello world!", ",\"md5\":\"XrY7u+Ae7tCTyyK7j1rNww==\"");
+  KJ_EXPECT(badDigest.statusCode == 400);
+  KJ_EXPECT(test.v4Code(badDigest) == 10037);
+  KJ_EXPECT(test.get("c").body == "hello world");
+
+  auto sha1 = test.put("d", "hello world",
+      ",\"sha1\":\"2aae6c35c94fcfb415dbe95f408b9ce91ee846ed\"");
+  KJ_EXPECT(sha1.statusCode == 200);
+  {
+    capnp::MallocMessageBuilder message;
+    auto head = decode<r2::R2HeadResponse>(message, sha1.metadata);
+    KJ_EXPECT(head.getChecksums().getSha1().size() == 20);
+  }
+  KJ_EXPECT(test.put("d", "hello world",
+      ",\"sha1\":\"0000000000000000000000000000000000000000\"").statusCode == 400);
+}
+
+KJ_TEST("R2Store list") {
+  R2Test test;
+  for (auto key: { "a", "b/1", "b/2", "b/3", "c", "d/1" }) {
+    KJ_EXPECT(test.put(key, "value", ",\"customFields\":[{\"k\":\"x\",\"v\":\"y\"}]")
+        .statusCode == 200);
+  }
+
+  auto list = [&](kj::StringPtr extra, capnp::MallocMessageBuilder& message) {
+    auto response = test.read(kj::str(
+        "{\"version\":1,\"method\":\"list\",\"newRuntime\":true", extra, "}"));
+    KJ_EXPECT(response.statusCode == 200);
+    return decode<r2::R2ListResponse>(message, response.metadata);
+  };
+  auto names = [](r2::R2ListResponse::Reader result) {
+    return kj::strArray(KJ_MAP(o, result.getObjects()) { return kj::str(o.getName()); }, ",");
+  };
+
+  {
+    capnp::MallocMessageBuilder message;
+    auto result = list("", message);
+    KJ_EXPECT(names(result) == "a,b/1,b/2,b/3,c,d/1");
+    KJ_EXPECT(!result.getTruncated());
+    // Custom metadata is omitted unless asked for.
+    KJ_EXPECT(!result.getObjects()[0].hasCustomFields());
+  }
+  {
+    capnp::MallocMessageBuilder message;
+    auto result = list(",\"include\":[1]", message);
+    KJ_EXPECT(result.getObjects()[0].getCustomFields().size() == 1);
+  }
+  {
+    capnp::MallocMessageBuilder message;
+    KJ_EXPECT(names(list(",\"prefix\":\"b/\"", message)) == "b/1,b/2,b/3");
+  }
+  {
+    capnp::MallocMessageBuilder message;
+    KJ_EXPECT(names(list(",\"startAfter\":\"b/2\"", message)) == "b/3,c,d/1");
+  }
+  {
+    capnp::MallocMessageBuilder message;
+    auto result = list(",\"delimiter\":\"/\"", message);
+    KJ_EXPECT(names(result) == "a,c");
+    auto prefixes = result.getDelimitedPrefixes();
+    KJ_ASSERT(prefixes.size() == 2);
+    KJ_EXPECT(prefixes[0] == "b/");
+    KJ_EXPECT(prefixes[1] == "d/");
+  }
+
+  // Page through with a cursor, with delimited prefixes counting towards the limit.
+  kj::Vector<kj::String> seen;
+  kj::String cursor;
+  for (;;) {
+    capnp::MallocMessageBuilder message;
+    auto extra = kj::str(",\"limit\":2,\"delimiter\":\"/\"");
+    if (cursor.size() > 0) extra = kj::str(extra, ",\"cursor\":\"", cursor, "\"");
+    auto result = list(extra, message);
+    KJ_EXPECT(result.getObjects().size() + result.getDelimitedPrefixes().size() <= 2);
+    for (auto o: result.getObjects()) seen.add(kj::str(o.getName()));
+    for (auto p: result.getDelimitedPrefixes()) seen.add(kj::str(p));
+    if (!result.getTruncated()) break;
+    cursor = kj::str(result.getCursor());
+  }
+  KJ_EXPECT(kj::strArray(seen, ",") == "a,b/,c,d/");
+}
+
+KJ_TEST("R2Store multipart upload") {
+  R2Test test;
+
+  auto create = test.write(
+      "{\"version\":1,\"method\":\"createMultipartUpload\",\"object\":\"big\","
+      "\"httpFields\":{\"contentType\":\"text/plain\"}}");
+  KJ_EXPECT(create.statusCode == 200);
+  capnp::MallocMessageBuilder createMessage;
+  auto uploadId = decode<r2::R2CreateMultipartUploadResponse>(createMessage, create.metadata)
+      .getUploadId();
+
+  auto uploadPart = [&](uint part, kj::StringPtr value) {
+    auto response = test.write(kj::str(
+        "{\"version\":1,\"method\":\"uploadPart\",\"object\":\"big\",\"uploadId\":\"", uploadId,
+        "\",\"partNumber\":", part, "}"), value);
+    KJ_EXPECT(response.statusCode == 200);
+    capnp::MallocMessageBuilder message;
+    return kj::str(decode<r2::R2UploadPartResponse>(message, response.metadata).getEtag());
+  };
+  auto etag1 = uploadPart(1, "hello ");
+  auto etag2 = uploadPart(2, "world");
+  uploadPart(3, "unused");
+  KJ_EXPECT(etag1 != etag2);
+  KJ_EXPECT(test.countBlobs() == 3);
+
+  auto complete = [&](kj::StringPtr parts) {
+    return test.write(kj::str(
+        "{\"version\":1,\"method\":\"completeMultipartUpload\",\"object\":\"big\","
+        "\"uploadId\":\"", uploadId, "\",\"parts\":[", parts, "]}"));
+  };
+
+  auto wrongEtag = complete(kj::str("{\"part\":1,\"etag\":\"", etag2, "\"}"));
+  KJ_EXPECT(wrongEtag.statusCode == 400);
+  KJ_EXPECT(test.v4Code(wrongEtag) == 10025);
+
+  auto completed = complete(kj::str("{\"part\":1,\"etag\":\"", etag1, "\"},"
+                                    "{\"part\":2,\"etag\":\"", etag2, "\"}"));
+  KJ_EXPECT(completed.statusCode == 200);
+  {
+    capnp::MallocMessageBuilder message;
+    auto head = decode<r2::R2HeadResponse>(message, completed.metadata);
+    KJ_EXPECT(head.getSize() == 11);
+    KJ_EXPECT(head.getEtag().endsWith("-2"));
+    KJ_EXPECT(head.getHttpFields().getContentType() == "text/plain");
+  }
+
+  // The parts' files make up the object; the part left out is discarded.
+  KJ_EXPECT(test.countBlobs() == 2);
+  KJ_EXPECT(test.get("big").body == "hello world");
+  KJ_EXPECT(test.get("big", ",\"range\":{\"offset\":4,\"length\":4}").body == "o wo");
+  KJ_EXPECT(test.get("big", ",\"range\":{\"offset\":6}").body == "world");
+
+  // The upload is gone once complete.
+  auto again = complete(kj::str("{\"part\":1,\"etag\":\"", etag1, "\"}"));
+  KJ_EXPECT(again.statusCode == 404);
+  KJ_EXPECT(test.v4Code(again) == 10024);
+
+  // Aborting discards the parts, and succeeds even if the upload no longer exists.
+  auto create2 = test.write(
+      "{\"version\":1,\"method\":\"createMultipartUpload\",\"object\":\"other\"}");
+  capnp::MallocMessageBuilder create2Message;
+  auto uploadId2 = decode<r2::R2CreateMultipartUploadResponse>(create2Message, create2.metadata)
+      .getUploadId();
+  KJ_EXPECT(test.write(kj::str(
+      "{\"version\":1,\"method\":\"uploadPart\",\"object\":\"other\",\"uploadId\":\"", uploadId2,
+      "\",\"partNumber\":1}"), "part").statusCode == 200);
+  KJ_EXPECT(test.countBlobs() == 3);
+  auto abort = kj::str("{\"version\":1,\"method\":\"abortMultipartUpload\",\"object\":\"other\","
+                       "\"uploadId\":\"", uploadId2, "\"}");
+  KJ_EXPECT(test.write(abort).statusCode == 200);
+  KJ_EXPECT(test.countBlobs() == 2);
+  KJ_EXPECT(test.write(abort).statusCode == 200);
+}
+
+}  // namespace
+}  // namespace workerd::server
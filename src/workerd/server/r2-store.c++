@@ -0,0 +1,977 @@
+// Copyright (c) 2017-2022 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+#include "r2-store.h"
+#include <capnp/compat/json.h>
+#include <capnp/message.h>
+#include <kj/debug.h>
+#include <kj/encoding.h>
+#include <kj/map.h>
+#include <kj/vector.h>
+#include <openssl/evp.h>
+#include <algorithm>
+#include <workerd/util/uuid.h>
+
+namespace workerd::server {
+
+namespace r2 = api::public_beta;
+
+namespace {
+
+// R2's codes for the errors we report, which the binding uses to tell them apart.
+constexpr uint INTERNAL_ERROR = 10001;
+constexpr uint NO_SUCH_KEY = 10007;
+constexpr uint INVALID_OBJECT_NAME = 10020;
+constexpr uint NO_SUCH_UPLOAD = 10024;
+constexpr uint INVALID_PART = 10025;
+constexpr uint INVALID_ARGUMENT = 10029;
+constexpr uint PRECONDITION_FAILED = 10031;
+constexpr uint BAD_DIGEST = 10037;
+constexpr uint INVALID_RANGE = 10039;
+
+kj::StringPtr errorMessage(uint v4Code) {
+  switch (v4Code) {
+    case NO_SUCH_KEY: return "The specified key does not exist.";
+    case INVALID_OBJECT_NAME: return "The specified object name is not valid.";
+    case NO_SUCH_UPLOAD: return "The specified multipart upload does not exist.";
+    case INVALID_PART: return "One or more of the specified parts could not be found.";
+    case INVALID_ARGUMENT: return "The request was not valid.";
+    case PRECONDITION_FAILED:
+      return "At least one of the pre-conditions you specified did not hold.";
+    case BAD_DIGEST: return "The specified digest did not match what we received.";
+    case INVALID_RANGE: return "The requested range is not satisfiable.";
+  }
+  return "This operation is not supported by local R2 buckets.";
+}
+
+kj::StringPtr statusText(uint statusCode) {
+  switch (statusCode) {
+    case 400: return "Bad Request";
+    case 404: return "Not Found";
+    case 405: return "Method Not Allowed";
+    case 412: return "Precondition Failed";
+    case 416: return "Range Not Satisfiable";
+  }
+  return "Not Implemented";
+}
+
+// R2Range and R2Conditional leave unset fields at this value.
+constexpr uint64_t UNSET = 0xffffffffffffffff;
+
+// Bytes to read from a request body at a time.
+constexpr uint64_t CHUNK_SIZE = 64 * 1024;
+
+int64_t toUnixMillis(kj::Date date) {
+  return (date - kj::UNIX_EPOCH) / kj::MILLISECONDS;
+}
+
+// Returns the smallest string greater than every string starting with `prefix`, or none if there
+// is no such string (the prefix is empty or all 0xff bytes).
+kj::Maybe<kj::String> prefixEnd(kj::StringPtr prefix) {
+  auto result = kj::str(prefix);
+  while (result.size() > 0) {
+    auto& last = reinterpret_cast<kj::byte&>(result[result.size() - 1]);
+    if (last != 0xff) {
+      ++last;
+      return kj::mv(result);
+    }
+    result = kj::str(result.slice(0, result.size() - 1));
+  }
+  return kj::none;
+}
+
+// Computes a digest incrementally.
+class Digester {
+public:
+  explicit Digester(const EVP_MD* type): ctx(EVP_MD_CTX_new()) {
+    KJ_ASSERT(ctx != nullptr);
+    KJ_ASSERT(EVP_DigestInit_ex(ctx, type, nullptr) == 1);
+  }
+  ~Digester() noexcept(false) { EVP_MD_CTX_free(ctx); }
+  KJ_DISALLOW_COPY_AND_MOVE(Digester);
+
+  void update(kj::ArrayPtr<const kj::byte> data) {
+    KJ_ASSERT(EVP_DigestUpdate(ctx, data.begin(), data.size()) == 1);
+  }
+
+  kj::Array<kj::byte> finish() {
+    kj::byte out[EVP_MAX_MD_SIZE];
+    uint size = 0;
+    KJ_ASSERT(EVP_DigestFinal_ex(ctx, out, &size) == 1);
+    return kj::heapArray<kj::byte>(out, size);
+  }
+
+private:
+  EVP_MD_CTX* ctx;
+};
+
+// Sets up `json` for the metadata returned to the binding.
+void initMetadataCodec(capnp::JsonCodec& json) {
+  json.handleByAnnotation<r2::R2ListResponse>();
+  json.setHasMode(capnp::HasMode::NON_DEFAULT);
+}
+
+kj::String encodeHead(r2::R2HeadResponse::Reader head) {
+  capnp::JsonCodec json;
+  initMetadataCodec(json);
+  return json.encode(head);
+}
+
+void decodeHead(kj::StringPtr text, r2::R2HeadResponse::Builder head) {
+  capnp::JsonCodec json;
+  initMetadataCodec(json);
+  json.decode(text, head);
+}
+
+bool decodeRequest(kj::ArrayPtr<const char> text, r2::R2BindingRequest::Builder builder) {
+  capnp::JsonCodec json;
+  json.handleByAnnotation<r2::R2BindingRequest>();
+  return kj::runCatchingExceptions([&]() { json.decode(text, builder); }) == kj::none;
+}
+
+// Runs `func` in a transaction, which is committed if it returns true, and rolled back if it
+// returns false or throws.
+template <typename Func>
+bool transact(SqliteDatabase& db, Func&& func) {
+  db.run("BEGIN TRANSACTION;");
+  KJ_ON_SCOPE_FAILURE(db.run("ROLLBACK;"));
+  if (func()) {
+    db.run("COMMIT;");
+    return true;
+  } else {
+    db.run("ROLLBACK;");
+    return false;
+  }
+}
+
+}  // namespace
+
+R2Store::Database::Database(const SqliteDatabase::Vfs& vfs, kj::PathPtr path)
+    : db(vfs, path, kj::WriteMode::CREATE | kj::WriteMode::MODIFY | kj::WriteMode::CREATE_PARENT) {}
+
+bool R2Store::Database::ensureInitialized(SqliteDatabase& db) {
+  db.run("PRAGMA journal_mode=WAL;");
+
+  // Each version of an object is stored in one or more blob files, in order: one for a put, or
+  // one per part for a completed multipart upload. `metadata` is the object's R2HeadResponse as
+  // JSON, which head and put return as is. Times are Unix milliseconds.
+  db.run(R"(
+    CREATE TABLE IF NOT EXISTS _cf_R2_OBJECT (
+      key TEXT PRIMARY KEY,
+      version TEXT NOT NULL,
+      size INTEGER NOT NULL,
+      etag TEXT NOT NULL,
+      uploaded INTEGER NOT NULL,
+      metadata TEXT NOT NULL
+    ) WITHOUT ROWID;
+  )");
+  db.run(R"(
+    CREATE TABLE IF NOT EXISTS _cf_R2_BLOB (
+      version TEXT NOT NULL,
+      idx INTEGER NOT NULL,
+      file TEXT NOT NULL,
+      size INTEGER NOT NULL,
+      PRIMARY KEY (version, idx)
+    ) WITHOUT ROWID;
+  )");
+  db.run(R"(
+    CREATE TABLE IF NOT EXISTS _cf_R2_UPLOAD (
+      upload_id TEXT PRIMARY KEY,
+      key TEXT NOT NULL,
+      metadata TEXT NOT NULL
+    ) WITHOUT ROWID;
+  )");
+  db.run(R"(
+    CREATE TABLE IF NOT EXISTS _cf_R2_PART (
+      upload_id TEXT NOT NULL,
+      part INTEGER NOT NULL,
+      etag TEXT NOT NULL,
+      md5 BLOB NOT NULL,
+      file TEXT NOT NULL,
+      size INTEGER NOT NULL,
+      PRIMARY KEY (upload_id, part)
+    ) WITHOUT ROWID;
+  )");
+
+  return true;
+}
+
+R2Store::R2Store(kj::HttpHeaderTable::Builder& headerTableBuilder, const kj::Clock& clock)
+    : headerTable(headerTableBuilder.getFutureTable()), clock(clock),
+      hCfR2Request(headerTableBuilder.add("CF-R2-Request")),
+      hCfR2MetadataSize(headerTableBuilder.add("CF-R2-Metadata-Size")),
+      hCfR2Error(headerTableBuilder.add("CF-R2-Error")) {}
+
+R2Store::~R2Store() noexcept(false) {}
+
+void R2Store::open(const kj::Directory& dir) {
+  KJ_REQUIRE(database == kj::none, "already opened");
+  directory = dir;
+  auto& v = *vfs.emplace(kj::heap<SqliteDatabase::Vfs>(dir));
+  database = kj::heap<Database>(v, kj::Path({ "metadata.sqlite" }));
+}
+
+const kj::Directory& R2Store::getDirectory() {
+  return KJ_REQUIRE_NONNULL(directory, "R2 bucket used before it was opened");
+}
+
+R2Store::Database& R2Store::getDatabase() {
+  return *KJ_REQUIRE_NONNULL(database, "R2 bucket used before it was opened");
+}
+
+kj::Promise<void> R2Store::request(
+    kj::HttpMethod method, kj::StringPtr url, const kj::HttpHeaders& headers,
+    kj::AsyncInputStream& requestBody, Response& response) {
+  // The URL names the bucket, which is always this one.
+  switch (method) {
+    case kj::HttpMethod::GET:
+      KJ_IF_SOME(r, headers.get(hCfR2Request)) {
+        return handleRead(kj::str(r), response);
+      }
+      return sendError(response, 400, INVALID_ARGUMENT);
+
+    case kj::HttpMethod::PUT: {
+      auto sizeHeader = KJ_UNWRAP_OR(headers.get(hCfR2MetadataSize), {
+        return sendError(response, 400, INVALID_ARGUMENT);
+      });
+      auto size = KJ_UNWRAP_OR(sizeHeader.tryParseAs<uint64_t>(), {
+        return sendError(response, 400, INVALID_ARGUMENT);
+      });
+      if (size > MAX_REQUEST_SIZE) {
+        return sendError(response, 400, INVALID_ARGUMENT);
+      }
+      return handleWrite(size, requestBody, response);
+    }
+
+    default:
+      return sendError(response, 405, INTERNAL_ERROR);
+  }
+}
+
+kj::Promise<void> R2Store::handleRead(kj::String requestJson, Response& response) {
+  capnp::MallocMessageBuilder message;
+  auto builder = message.initRoot<r2::R2BindingRequest>();
+  if (!decodeRequest(requestJson, builder)) {
+    co_return co_await sendError(response, 400, INVALID_ARGUMENT);
+  }
+
+  auto payload = builder.asReader().getPayload();
+  switch (payload.which()) {
+    case r2::R2BindingRequest::Payload::HEAD:
+      co_return co_await handleHead(payload.getHead(), response);
+    case r2::R2BindingRequest::Payload::GET:
+      co_return co_await handleGet(payload.getGet(), response);
+    case r2::R2BindingRequest::Payload::LIST:
+      co_return co_await handleList(payload.getList(), response);
+    default:
+      co_return co_await sendError(response, 501, INTERNAL_ERROR);
+  }
+}
+
+kj::Promise<void> R2Store::handleWrite(size_t requestSize, kj::AsyncInputStream& requestBody,
+                                       Response& response) {
+  auto requestJson = kj::heapArray<char>(requestSize);
+  co_await requestBody.read(requestJson.begin(), requestSize);
+
+  capnp::MallocMessageBuilder message;
+  auto builder = message.initRoot<r2::R2BindingRequest>();
+  if (!decodeRequest(requestJson, builder)) {
+    co_return co_await sendError(response, 400, INVALID_ARGUMENT);
+  }
+
+  // Whatever follows the operation in the body is the object or part being written.
+  auto payload = builder.asReader().getPayload();
+  switch (payload.which()) {
+    case r2::R2BindingRequest::Payload::PUT:
+      co_return co_await handlePut(payload.getPut(), requestBody, response);
+    case r2::R2BindingRequest::Payload::DELETE:
+      co_return co_await handleDelete(payload.getDelete(), response);
+    case r2::R2BindingRequest::Payload::CREATE_MULTIPART_UPLOAD:
+      co_return co_await handleCreateMultipartUpload(payload.getCreateMultipartUpload(), response);
+    case r2::R2BindingRequest::Payload::UPLOAD_PART:
+      co_return co_await handleUploadPart(payload.getUploadPart(), requestBody, response);
+    case r2::R2BindingRequest::Payload::COMPLETE_MULTIPART_UPLOAD:
+      co_return co_await handleCompleteMultipartUpload(
+          payload.getCompleteMultipartUpload(), response);
+    case r2::R2BindingRequest::Payload::ABORT_MULTIPART_UPLOAD:
+      co_return co_await handleAbortMultipartUpload(payload.getAbortMultipartUpload(), response);
+    default:
+      co_return co_await sendError(response, 501, INTERNAL_ERROR);
+  }
+}
+
+namespace {
+
+// Returns whether the conditions hold for `object`, or for a missing object if it is none. As with
+// the HTTP headers they come from, a condition on the upload time is ignored if the corresponding
+// etag condition was given and held.
+bool conditionsHold(r2::R2Conditional::Reader onlyIf, kj::StringPtr etag, int64_t uploaded,
+                    bool exists) {
+  auto anyMatches = [&](capnp::List<r2::R2Etag>::Reader etags) {
+    if (!exists) return false;
+    for (auto e: etags) {
+      if (e.getType().isWildcard() || e.getValue() == etag) return true;
+    }
+    return false;
+  };
+
+  bool etagMatched = false;
+  if (onlyIf.hasEtagMatches()) {
+    if (!anyMatches(onlyIf.getEtagMatches())) return false;
+    etagMatched = true;
+  }
+  bool etagDidNotMatch = false;
+  if (onlyIf.hasEtagDoesNotMatch()) {
+    if (anyMatches(onlyIf.getEtagDoesNotMatch())) return false;
+    etagDidNotMatch = true;
+  }
+
+  if (exists) {
+    if (onlyIf.getSecondsGranularity()) {
+      uploaded = uploaded / 1000 * 1000;
+    }
+    auto before = onlyIf.getUploadedBefore();
+    if (!etagMatched && before != UNSET && uploaded >= int64_t(before)) return false;
+    auto after = onlyIf.getUploadedAfter();
+    if (!etagDidNotMatch && after != UNSET && uploaded <= int64_t(after)) return false;
+  }
+
+  return true;
+}
+
+}  // namespace
+
+kj::Promise<void> R2Store::handleHead(r2::R2HeadRequest::Reader request, Response& response) {
+  KJ_IF_SOME(object, getObject(request.getObject())) {
+    return sendJson(response, kj::mv(object.metadata));
+  } else {
+    return sendError(response, 404, NO_SUCH_KEY);
+  }
+}
+
+kj::Promise<void> R2Store::handleGet(r2::R2GetRequest::Reader request, Response& response) {
+  auto object = KJ_UNWRAP_OR(getObject(request.getObject()), {
+    co_return co_await sendError(response, 404, NO_SUCH_KEY);
+  });
+
+  if (request.hasOnlyIf() &&
+      !conditionsHold(request.getOnlyIf(), object.etag, object.uploaded, true)) {
+    // The binding returns the object's metadata without its body.
+    co_return co_await sendError(response, 412, PRECONDITION_FAILED, object.metadata.asPtr());
+  }
+
+  uint64_t start = 0;
+  uint64_t length = object.size;
+  bool partial = false;
+  if (request.hasRangeHeader()) {
+    KJ_SWITCH_ONEOF(kj::tryParseHttpRangeHeader(request.getRangeHeader().asArray(), object.size)) {
+      KJ_CASE_ONEOF(ranges, kj::Array<kj::HttpByteRange>) {
+        if (ranges.size() != 1) {
+          co_return co_await sendError(response, 416, INVALID_RANGE);
+        }
+        start = ranges[0].start;
+        length = ranges[0].end - ranges[0].start + 1;
+        partial = true;
+      }
+      KJ_CASE_ONEOF(_, kj::HttpEverythingRange) {}
+      KJ_CASE_ONEOF(_, kj::HttpUnsatisfiableRange) {
+        co_return co_await sendError(response, 416, INVALID_RANGE);
+      }
+    }
+  } else if (request.hasRange()) {
+    auto range = request.getRange();
+    if (range.getSuffix() != UNSET) {
+      length = kj::min(range.getSuffix(), object.size);
+      start = object.size - length;
+    } else {
+      start = range.getOffset() == UNSET ? 0 : range.getOffset();
+      if (start > object.size) {
+        co_return co_await sendError(response, 416, INVALID_RANGE);
+      }
+      length = object.size - start;
+      if (range.getLength() != UNSET) {
+        length = kj::min(length, range.getLength());
+      }
+    }
+    partial = true;
+  }
+
+  // Echo the range in the metadata, so that the binding can report it.
+  kj::String metadata;
+  if (partial) {
+    capnp::MallocMessageBuilder message;
+    auto head = message.initRoot<r2::R2HeadResponse>();
+    decodeHead(object.metadata, head);
+    auto echoed = head.initRange();
+    echoed.setOffset(start);
+    echoed.setLength(length);
+    metadata = encodeHead(head);
+  } else {
+    metadata = kj::mv(object.metadata);
+  }
+
+  // Map just the requested range of each blob, so that the body is written from the page cache
+  // without being read into a buffer first.
+  auto& dir = getDirectory();
+  kj::Vector<kj::Array<const kj::byte>> mappings;
+  uint64_t end = start + length;
+  uint64_t blobStart = 0;
+  for (auto& blob: getBlobs(object.version)) {
+    uint64_t blobEnd = blobStart + blob.size;
+    uint64_t from = kj::max(start, blobStart);
+    uint64_t to = kj::min(end, blobEnd);
+    if (from < to) {
+      auto file = dir.openFile(kj::Path::parse(blob.file));
+      mappings.add(file->mmap(from - blobStart, to - from));
+    }
+    blobStart = blobEnd;
+  }
+
+  kj::Vector<kj::ArrayPtr<const kj::byte>> pieces(mappings.size() + 1);
+  pieces.add(metadata.asBytes());
+  for (auto& mapping: mappings) {
+    pieces.add(mapping);
+  }
+
+  kj::HttpHeaders headers(headerTable);
+  headers.set(hCfR2MetadataSize, kj::str(metadata.size()));
+  auto out = response.send(200, "OK", headers, metadata.size() + length);
+  co_await out->write(pieces.asPtr());
+}
+
+kj::Promise<void> R2Store::handleList(r2::R2ListRequest::Reader request, Response& response) {
+  auto& db = getDatabase();
+
+  uint limit = request.getLimit();
+  if (limit == 0 || limit > MAX_LIST_LIMIT) {
+    limit = MAX_LIST_LIMIT;
+  }
+  kj::StringPtr prefix = request.getPrefix();
+  kj::StringPtr delimiter = request.getDelimiter();
+
+  // Runtimes that predate `newRuntime` expect all metadata regardless of `include`.
+  bool includeHttp = !request.getNewRuntime();
+  bool includeCustom = !request.getNewRuntime();
+  if (request.hasInclude()) {
+    includeHttp = false;
+    includeCustom = false;
+    for (auto field: request.getInclude()) {
+      if (field == uint16_t(r2::R2ListRequest::IncludeField::HTTP)) includeHttp = true;
+      if (field == uint16_t(r2::R2ListRequest::IncludeField::CUSTOM)) includeCustom = true;
+    }
+  }
+
+  // Listing starts at the first key that is at least `next`. The cursor is the base64 of where
+  // the next page starts; startAfter starts just past the given key.
+  kj::String next = kj::str(prefix);
+  if (request.hasStartAfter()) {
+    auto afterStart = kj::str(request.getStartAfter(), '\0');
+    if (next < afterStart) next = kj::mv(afterStart);
+  }
+  if (request.hasCursor()) {
+    auto decoded = kj::decodeBase64(request.getCursor().asArray());
+    if (decoded.hadErrors) {
+      co_return co_await sendError(response, 400, INVALID_ARGUMENT);
+    }
+    auto cursorStart = kj::str(decoded.asChars());
+    if (next < cursorStart) next = kj::mv(cursorStart);
+  }
+  kj::Maybe<kj::String> end = prefixEnd(prefix);
+
+  kj::Vector<kj::String> objects;
+  kj::Vector<kj::String> delimitedPrefixes;
+  uint count = 0;
+  bool truncated = false;
+  bool done = false;
+
+  while (!done && !truncated) {
+    // Fetch one more row than fits in the page, to tell whether it is truncated. If a row falls
+    // under a delimited prefix, skip the rest of the prefix's keys by starting a new query past
+    // them.
+    // `next` moves on as rows are read, so the query is given its own copy.
+    int64_t rows = int64_t(limit - count) + 1;
+    auto start = kj::str(next);
+    auto query = [&]() {
+      KJ_IF_SOME(e, end) {
+        return db.stmtListEnd.run(start.asPtr(), e.asPtr(), rows);
+      } else {
+        return db.stmtList.run(start.asPtr(), rows);
+      }
+    }();
+
+    done = true;
+    for (; !query.isDone(); query.nextRow()) {
+      auto key = query.getText(0);
+      if (count == limit) {
+        truncated = true;
+        break;
+      }
+
+      if (delimiter.size() > 0) {
+        auto rest = key.slice(prefix.size());
+        auto found = std::search(rest.begin(), rest.end(), delimiter.begin(), delimiter.end());
+        if (found != rest.end()) {
+          size_t pos = found - rest.begin();
+          auto delimited = kj::str(key.slice(0, prefix.size() + pos + delimiter.size()));
+          KJ_IF_SOME(after, prefixEnd(delimited)) {
+            next = kj::mv(after);
+            done = false;
+          }
+          delimitedPrefixes.add(kj::mv(delimited));
+          ++count;
+          break;
+        }
+      }
+
+      objects.add(kj::str(query.getText(1)));
+      next = kj::str(key, '\0');
+      ++count;
+    }
+  }
+
+  capnp::MallocMessageBuilder message;
+  auto list = message.initRoot<r2::R2ListResponse>();
+  auto objectList = list.initObjects(objects.size());
+  for (auto i: kj::indices(objects)) {
+    auto head = objectList[i];
+    decodeHead(objects[i], head);
+    if (!includeHttp) head.disownHttpFields();
+    if (!includeCustom) head.disownCustomFields();
+  }
+  if (delimitedPrefixes.size() > 0) {
+    auto prefixList = list.initDelimitedPrefixes(delimitedPrefixes.size());
+    for (auto i: kj::indices(delimitedPrefixes)) {
+      prefixList.set(i, delimitedPrefixes[i]);
+    }
+  }
+  list.setTruncated(truncated);
+  if (truncated) {
+    list.setCursor(kj::encodeBase64(next.asBytes()));
+  }
+
+  capnp::JsonCodec json;
+  initMetadataCodec(json);
+  co_return co_await sendJson(response, json.encode(list));
+}
+
+kj::Promise<void> R2Store::handlePut(r2::R2PutRequest::Reader request,
+                                     kj::AsyncInputStream& body, Response& response) {
+  kj::StringPtr key = request.getObject();
+  if (key.size() > MAX_KEY_SIZE) {
+    co_return co_await sendError(response, 400, INVALID_OBJECT_NAME);
+  }
+
+  kj::Maybe<Checksum> checksum;
+  kj::ArrayPtr<const kj::byte> expectedChecksum;
+  if (request.hasSha1()) {
+    checksum = Checksum::SHA1;
+    expectedChecksum = request.getSha1();
+  } else if (request.hasSha256()) {
+    checksum = Checksum::SHA256;
+    expectedChecksum = request.getSha256();
+  } else if (request.hasSha384()) {
+    checksum = Checksum::SHA384;
+    expectedChecksum = request.getSha384();
+  } else if (request.hasSha512()) {
+    checksum = Checksum::SHA512;
+    expectedChecksum = request.getSha512();
+  }
+
+  auto written = co_await writeBlob(body, checksum);
+
+  bool digestMatches = !request.hasMd5() || request.getMd5() == written.md5.asPtr();
+  KJ_IF_SOME(c, written.checksum) {
+    digestMatches = digestMatches && expectedChecksum == c.asPtr();
+  }
+  if (!digestMatches) {
+    removeFiles(kj::arr(kj::mv(written.blob.file)));
+    co_return co_await sendError(response, 400, BAD_DIGEST);
+  }
+
+  Object object {
+    .version = randomUUID(kj::none),
+    .size = written.blob.size,
+    .etag = kj::encodeHex(written.md5),
+    .uploaded = toUnixMillis(clock.now()),
+  };
+
+  capnp::MallocMessageBuilder message;
+  auto head = message.initRoot<r2::R2HeadResponse>();
+  head.setName(key);
+  head.setVersion(object.version);
+  head.setSize(object.size);
+  head.setEtag(object.etag);
+  head.setUploadedMillisecondsSinceEpoch(object.uploaded);
+  if (request.hasHttpFields()) head.setHttpFields(request.getHttpFields());
+  if (request.hasCustomFields()) head.setCustomFields(request.getCustomFields());
+  auto checksums = head.initChecksums();
+  checksums.setMd5(written.md5.asPtr());
+  KJ_IF_SOME(c, written.checksum) {
+    switch (KJ_ASSERT_NONNULL(checksum)) {
+      case Checksum::SHA1: checksums.setSha1(c.asPtr()); break;
+      case Checksum::SHA256: checksums.setSha256(c.asPtr()); break;
+      case Checksum::SHA384: checksums.setSha384(c.asPtr()); break;
+      case Checksum::SHA512: checksums.setSha512(c.asPtr()); break;
+    }
+  }
+  object.metadata = encodeHead(head);
+
+  // Check the conditions against the object as it is now, at the moment of replacing it.
+  kj::Array<kj::String> replacedFiles;
+  bool replaced = transact(getDatabase().db, [&]() {
+    if (request.hasOnlyIf()) {
+      KJ_IF_SOME(current, getObject(key)) {
+        if (!conditionsHold(request.getOnlyIf(), current.etag, current.uploaded, true)) {
+          return false;
+        }
+      } else if (!conditionsHold(request.getOnlyIf(), "", 0, false)) {
+        return false;
+      }
+    }
+    Blob blob { .file = kj::mv(written.blob.file), .size = written.blob.size };
+    replacedFiles = replaceObject(key, object, kj::arrayPtr(&blob, 1));
+    return true;
+  });
+
+  if (!replaced) {
+    removeFiles(kj::arr(kj::mv(written.blob.file)));
+    co_return co_await sendError(response, 412, PRECONDITION_FAILED);
+  }
+
+  removeFiles(replacedFiles);
+  co_return co_await sendJson(response, kj::mv(object.metadata));
+}
+
+kj::Promise<void> R2Store::handleDelete(r2::R2DeleteRequest::Reader request,
+                                        Response& response) {
+  auto& db = getDatabase();
+
+  kj::Vector<kj::String> files;
+  auto deleteKey = [&](kj::StringPtr key) {
+    KJ_IF_SOME(object, getObject(key)) {
+      for (auto& blob: getBlobs(object.version)) {
+        files.add(kj::mv(blob.file));
+      }
+      db.stmtDeleteBlobs.run(object.version.asPtr());
+      db.stmtDeleteObject.run(key);
+    }
+  };
+
+  transact(db.db, [&]() {
+    if (request.isObject()) {
+      deleteKey(request.getObject());
+    } else {
+      for (auto key: request.getObjects()) {
+        deleteKey(key);
+      }
+    }
+    return true;
+  });
+
+  removeFiles(files);
+  return sendJson(response, kj::str("{}"));
+}
+
+kj::Promise<void> R2Store::handleCreateMultipartUpload(
+    r2::R2CreateMultipartUploadRequest::Reader request, Response& response) {
+  kj::StringPtr key = request.getObject();
+  if (key.size() > MAX_KEY_SIZE) {
+    return sendError(response, 400, INVALID_OBJECT_NAME);
+  }
+
+  // Keep the metadata to be given to the object once the upload completes.
+  capnp::MallocMessageBuilder message;
+  auto head = message.initRoot<r2::R2HeadResponse>();
+  if (request.hasHttpFields()) head.setHttpFields(request.getHttpFields());
+  if (request.hasCustomFields()) head.setCustomFields(request.getCustomFields());
+
+  auto uploadId = randomUUID(kj::none);
+  getDatabase().stmtCreateUpload.run(uploadId.asPtr(), key, encodeHead(head).asPtr());
+
+  return sendJson(response, kj::str("{\"uploadId\":\"", uploadId, "\"}"));
+}
+
+kj::Promise<void> R2Store::handleUploadPart(r2::R2UploadPartRequest::Reader request,
+                                            kj::AsyncInputStream& body, Response& response) {
+  auto& db = getDatabase();
+  kj::StringPtr uploadId = request.getUploadId();
+  kj::StringPtr key = request.getObject();
+
+  auto uploadExists = [&]() {
+    auto query = db.stmtGetUpload.run(uploadId);
+    return !query.isDone() && query.getText(0) == key;
+  };
+  if (!uploadExists()) {
+    co_return co_await sendError(response, 404, NO_SUCH_UPLOAD);
+  }
+
+  auto written = co_await writeBlob(body, kj::none);
+  auto etag = kj::encodeHex(written.md5);
+
+  // The upload may have been completed or aborted while the part was being written.
+  kj::Maybe<kj::String> replacedFile;
+  bool stored = transact(db.db, [&]() {
+    if (!uploadExists()) return false;
+    {
+      auto query = db.stmtGetPart.run(uploadId, int64_t(request.getPartNumber()));
+      if (!query.isDone()) replacedFile = kj::str(query.getText(2));
+    }
+    db.stmtPutPart.run(uploadId, int64_t(request.getPartNumber()), etag.asPtr(),
+                       written.md5.asPtr(), written.blob.file.asPtr(),
+                       int64_t(written.blob.size));
+    return true;
+  });
+
+  if (!stored) {
+    removeFiles(kj::arr(kj::mv(written.blob.file)));
+    co_return co_await sendError(response, 404, NO_SUCH_UPLOAD);
+  }
+
+  KJ_IF_SOME(f, replacedFile) {
+    removeFiles(kj::arr(kj::mv(f)));
+  }
+  co_return co_await sendJson(response, kj::str("{\"etag\":\"", etag, "\"}"));
+}
+
+kj::Promise<void> R2Store::handleCompleteMultipartUpload(
+    r2::R2CompleteMultipartUploadRequest::Reader request, Response& response) {
+  auto& db = getDatabase();
+  kj::StringPtr uploadId = request.getUploadId();
+  kj::StringPtr key = request.getObject();
+
+  uint errorCode = 0;
+  kj::String metadata;
+  kj::Vector<kj::String> unusedFiles;
+  kj::Array<kj::String> replacedFiles;
+
+  transact(db.db, [&]() {
+    kj::String uploadMetadata;
+    {
+      auto query = db.stmtGetUpload.run(uploadId);
+      if (query.isDone() || query.getText(0) != key) {
+        errorCode = NO_SUCH_UPLOAD;
+        return false;
+      }
+      uploadMetadata = kj::str(query.getText(1));
+    }
+
+    // The object is made of the parts' files as they are, in order. Its etag, as in R2, is the
+    // MD5 of the parts' MD5s, followed by the number of parts.
+    auto parts = request.getParts();
+    if (parts.size() == 0) {
+      errorCode = INVALID_PART;
+      return false;
+    }
+    kj::Vector<Blob> blobs(parts.size());
+    Digester etagDigest(EVP_md5());
+    uint64_t size = 0;
+    uint32_t lastPart = 0;
+    for (auto part: parts) {
+      if (part.getPart() <= lastPart) {
+        errorCode = INVALID_PART;
+        return false;
+      }
+      lastPart = part.getPart();
+
+      auto query = db.stmtGetPart.run(uploadId, int64_t(part.getPart()));
+      if (query.isDone() || query.getText(0) != part.getEtag()) {
+        errorCode = INVALID_PART;
+        return false;
+      }
+      etagDigest.update(query.getBlob(1));
+      blobs.add(Blob { .file = kj::str(query.getText(2)), .size = uint64_t(query.getInt64(3)) });
+      size += query.getInt64(3);
+    }
+
+    // Parts that were uploaded but not included are discarded.
+    {
+      kj::HashSet<kj::StringPtr> used;
+      for (auto& blob: blobs) used.insert(blob.file);
+      auto query = db.stmtListPartFiles.run(uploadId);
+      for (; !query.isDone(); query.nextRow()) {
+        auto file = query.getText(0);
+        if (!used.contains(file)) unusedFiles.add(kj::str(file));
+      }
+    }
+
+    Object object {
+      .version = randomUUID(kj::none),
+      .size = size,
+      .etag = kj::str(kj::encodeHex(etagDigest.finish()), '-', parts.size()),
+      .uploaded = toUnixMillis(clock.now()),
+    };
+
+    capnp::MallocMessageBuilder message;
+    auto head = message.initRoot<r2::R2HeadResponse>();
+    decodeHead(uploadMetadata, head);
+    head.setName(key);
+    head.setVersion(object.version);
+    head.setSize(object.size);
+    head.setEtag(object.etag);
+    head.setUploadedMillisecondsSinceEpoch(object.uploaded);
+    object.metadata = encodeHead(head);
+    metadata = kj::str(object.metadata);
+
+    replacedFiles = replaceObject(key, object, blobs);
+    db.stmtDeleteParts.run(uploadId);
+    db.stmtDeleteUpload.run(uploadId);
+    return true;
+  });
+
+  if (errorCode == NO_SUCH_UPLOAD) {
+    return sendError(response, 404, NO_SUCH_UPLOAD);
+  } else if (errorCode != 0) {
+    return sendError(response, 400, errorCode);
+  }
+
+  removeFiles(unusedFiles);
+  removeFiles(replacedFiles);
+  return sendJson(response, kj::mv(metadata));
+}
+
+kj::Promise<void> R2Store::handleAbortMultipartUpload(
+    r2::R2AbortMultipartUploadRequest::Reader request, Response& response) {
+  auto& db = getDatabase();
+  kj::StringPtr uploadId = request.getUploadId();
+
+  // Aborting an upload that doesn't exist, perhaps because it was already aborted, succeeds.
+  kj::Vector<kj::String> files;
+  transact(db.db, [&]() {
+    {
+      auto query = db.stmtListPartFiles.run(uploadId);
+      for (; !query.isDone(); query.nextRow()) {
+        files.add(kj::str(query.getText(0)));
+      }
+    }
+    db.stmtDeleteParts.run(uploadId);
+    db.stmtDeleteUpload.run(uploadId);
+    return true;
+  });
+
+  removeFiles(files);
+  return sendJson(response, kj::str("{}"));
+}
+
+kj::Maybe<R2Store::Object> R2Store::getObject(kj::StringPtr key) {
+  auto query = getDatabase().stmtGetObject.run(key);
+  if (query.isDone()) return kj::none;
+  return Object {
+    .version = kj::str(query.getText(0)),
+    .size = uint64_t(query.getInt64(1)),
+    .etag = kj::str(query.getText(2)),
+    .uploaded = query.getInt64(3),
+    .metadata = kj::str(query.getText(4)),
+  };
+}
+
+kj::Array<R2Store::Blob> R2Store::getBlobs(kj::StringPtr version) {
+  kj::Vector<Blob> blobs;
+  auto query = getDatabase().stmtGetBlobs.run(version);
+  for (; !query.isDone(); query.nextRow()) {
+    blobs.add(Blob { .file = kj::str(query.getText(0)), .size = uint64_t(query.getInt64(1)) });
+  }
+  return blobs.releaseAsArray();
+}
+
+kj::Promise<R2Store::WrittenBlob> R2Store::writeBlob(kj::AsyncInputStream& body,
+                                                     kj::Maybe<Checksum> checksum) {
+  auto name = kj::str("blobs/", randomUUID(kj::none));
+  auto replacer = getDirectory().replaceFile(kj::Path::parse(name),
+      kj::WriteMode::CREATE | kj::WriteMode::CREATE_PARENT);
+  auto& file = replacer->get();
+
+  Digester md5(EVP_md5());
+  kj::Maybe<kj::Own<Digester>> extra = checksum.map([](Checksum c) {
+    switch (c) {
+      case Checksum::SHA1: return kj::heap<Digester>(EVP_sha1());
+      case Checksum::SHA256: return kj::heap<Digester>(EVP_sha256());
+      case Checksum::SHA384: return kj::heap<Digester>(EVP_sha384());
+      case Checksum::SHA512: return kj::heap<Digester>(EVP_sha512());
+    }
+    KJ_UNREACHABLE;
+  });
+  auto digest = [&](kj::ArrayPtr<const kj::byte> data) {
+    md5.update(data);
+    KJ_IF_SOME(d, extra) d->update(data);
+  };
+
+  // Written with file.write() rather than through a writable mapping: storing to a mapped page of
+  // a sparse file on a full disk raises SIGBUS, taking down the process instead of failing the put.
+  auto expectedLength = body.tryGetLength();
+  auto buffer = kj::heapArray<kj::byte>(
+      kj::max(kj::min(expectedLength.orDefault(CHUNK_SIZE), CHUNK_SIZE), uint64_t(1)));
+  uint64_t size = 0;
+  for (;;) {
+    auto amount = co_await body.tryRead(buffer.begin(), 1, buffer.size());
+    if (amount == 0) break;
+    auto chunk = buffer.slice(0, amount);
+    file.write(size, chunk);
+    digest(chunk);
+    size += amount;
+  }
+  KJ_IF_SOME(length, expectedLength) {
+    KJ_REQUIRE(size == length, "R2 request body did not match its declared length");
+  }
+  replacer->commit();
+
+  co_return WrittenBlob {
+    .blob = { .file = kj::mv(name), .size = size },
+    .md5 = md5.finish(),
+    .checksum = extra.map([](kj::Own<Digester>& d) { return d->finish(); }),
+  };
+}
+
+kj::Array<kj::String> R2Store::replaceObject(kj::StringPtr key, const Object& object,
+                                             kj::ArrayPtr<const Blob> blobs) {
+  auto& db = getDatabase();
+
+  kj::Array<kj::String> replacedFiles;
+  KJ_IF_SOME(current, getObject(key)) {
+    replacedFiles = KJ_MAP(blob, getBlobs(current.version)) { return kj::mv(blob.file); };
+    db.stmtDeleteBlobs.run(current.version.asPtr());
+  }
+
+  db.stmtPutObject.run(key, object.version.asPtr(), int64_t(object.size), object.etag.asPtr(),
+                       object.uploaded, object.metadata.asPtr());
+  for (auto i: kj::indices(blobs)) {
+    db.stmtPutBlob.run(object.version.asPtr(), int64_t(i), blobs[i].file.asPtr(),
+                       int64_t(blobs[i].size));
+  }
+  return replacedFiles;
+}
+
+void R2Store::removeFiles(kj::ArrayPtr<const kj::String> files) {
+  // Readers that already mapped a file keep their mapping, so files can go as soon as nothing in
+  // the database refers to them.
+  auto& dir = getDirectory();
+  for (auto& file: files) {
+    dir.tryRemove(kj::Path::parse(file));
+  }
+}
+
+kj::Promise<void> R2Store::sendError(Response& response, uint statusCode, uint v4Code,
+                                     kj::Maybe<kj::StringPtr> metadata) {
+  kj::HttpHeaders headers(headerTable);
+  headers.set(hCfR2Error, kj::str(
+      "{\"version\":1,\"v4code\":", v4Code, ",\"message\":\"", errorMessage(v4Code), "\"}"));
+
+  KJ_IF_SOME(m, metadata) {
+    headers.set(hCfR2MetadataSize, kj::str(m.size()));
+    auto out = response.send(statusCode, statusText(statusCode), headers, m.size());
+    co_await out->write(m.begin(), m.size());
+  } else {
+    response.send(statusCode, statusText(statusCode), headers, uint64_t(0));
+  }
+}
+
+kj::Promise<void> R2Store::sendJson(Response& response, kj::String json) {
+  // Reads expect the metadata's length in a header, since a body may follow it; writes read the
+  // whole response, so the header does no harm.
+  kj::HttpHeaders headers(headerTable);
+  headers.set(hCfR2MetadataSize, kj::str(json.size()));
+  auto out = response.send(200, "OK", headers, json.size());
+  co_await out->write(json.begin(), json.size());
+}
+
+}  // namespace workerd::server
@@ -0,0 +1,216 @@
+// Copyright (c) 2017-2022 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+#pragma once
+
+#include <kj/compat/http.h>
+#include <kj/filesystem.h>
+#include <kj/time.h>
+#include <workerd/api/r2-api.capnp.h>
+#include <workerd/util/sqlite.h>
+
+namespace workerd::server {
+
+// An R2 bucket stored in a directory, used to implement the `r2` service type. It speaks the
+// protocol that R2Bucket and R2MultipartUpload (api/r2-bucket.c++, api/r2-multipart.c++) use with
+// the service an `r2Bucket` binding points at. Each operation is a JSON `R2BindingRequest`:
+//
+// * head, get and list are sent as GET requests, with the operation in `CF-R2-Request`.
+// * put, delete and the multipart operations are sent as PUT requests whose body starts with the
+//   operation, `CF-R2-Metadata-Size` bytes long, followed by the object or part body, if any.
+//
+// Successful responses carry JSON metadata, followed for get by the object body. For get, the
+// metadata's length is given in `CF-R2-Metadata-Size`. Errors are described in `CF-R2-Error`.
+//
+// Object bodies are stored as files under `blobs/`, and their metadata in `metadata.sqlite`:
+//
+// * put and uploadPart write the request body into a new file in chunks as it arrives, hashing it
+//   on the way, and rename it into place once complete.
+// * Completing a multipart upload stitches the parts' files together in the metadata rather than
+//   copying them into one file.
+// * get maps the requested range of each file into memory and writes the pieces out with a single
+//   vectored write, so object bodies are never copied through intermediate buffers.
+//
+// Bucket management operations are not supported.
+class R2Store final: public kj::HttpService {
+public:
+  R2Store(kj::HttpHeaderTable::Builder& headerTableBuilder,
+          const kj::Clock& clock = kj::systemPreciseCalendarClock());
+  ~R2Store() noexcept(false);
+  KJ_DISALLOW_COPY_AND_MOVE(R2Store);
+
+  // Opens (creating if needed) the bucket stored in `dir`. Must be called once before any
+  // requests.
+  void open(const kj::Directory& dir);
+
+  kj::Promise<void> request(
+      kj::HttpMethod method, kj::StringPtr url, const kj::HttpHeaders& headers,
+      kj::AsyncInputStream& requestBody, Response& response) override;
+
+  static constexpr size_t MAX_KEY_SIZE = 1024;
+  static constexpr uint MAX_LIST_LIMIT = 1000;
+
+  // Largest operation accepted in `CF-R2-Metadata-Size`.
+  static constexpr size_t MAX_REQUEST_SIZE = 1024 * 1024;
+
+private:
+  // The database, and the statements prepared against it.
+  struct Database {
+    SqliteDatabase db;
+
+    // Creates the tables before the statements below are prepared against them.
+    bool initialized = ensureInitialized(db);
+
+    Database(const SqliteDatabase::Vfs& vfs, kj::PathPtr path);
+
+    SqliteDatabase::Statement stmtGetObject = db.prepare(R"(
+      SELECT version, size, etag, uploaded, metadata FROM _cf_R2_OBJECT WHERE key = ?
+    )");
+    SqliteDatabase::Statement stmtPutObject = db.prepare(R"(
+      INSERT INTO _cf_R2_OBJECT VALUES(?, ?, ?, ?, ?, ?)
+        ON CONFLICT DO UPDATE SET
+          version = excluded.version, size = excluded.size, etag = excluded.etag,
+          uploaded = excluded.uploaded, metadata = excluded.metadata
+    )");
+    SqliteDatabase::Statement stmtDeleteObject = db.prepare(R"(
+      DELETE FROM _cf_R2_OBJECT WHERE key = ?
+    )");
+    SqliteDatabase::Statement stmtList = db.prepare(R"(
+      SELECT key, metadata FROM _cf_R2_OBJECT
+      WHERE key >= ?
+      ORDER BY key
+      LIMIT ?
+    )");
+    SqliteDatabase::Statement stmtListEnd = db.prepare(R"(
+      SELECT key, metadata FROM _cf_R2_OBJECT
+      WHERE key >= ? AND key < ?
+      ORDER BY key
+      LIMIT ?
+    )");
+    SqliteDatabase::Statement stmtGetBlobs = db.prepare(R"(
+      SELECT file, size FROM _cf_R2_BLOB WHERE version = ? ORDER BY idx
+    )");
+    SqliteDatabase::Statement stmtPutBlob = db.prepare(R"(
+      INSERT INTO _cf_R2_BLOB VALUES(?, ?, ?, ?)
+    )");
+    SqliteDatabase::Statement stmtDeleteBlobs = db.prepare(R"(
+      DELETE FROM _cf_R2_BLOB WHERE version = ?
+    )");
+    SqliteDatabase::Statement stmtCreateUpload = db.prepare(R"(
+      INSERT INTO _cf_R2_UPLOAD VALUES(?, ?, ?)
+    )");
+    SqliteDatabase::Statement stmtGetUpload = db.prepare(R"(
+      SELECT key, metadata FROM _cf_R2_UPLOAD WHERE upload_id = ?
+    )");
+    SqliteDatabase::Statement stmtDeleteUpload = db.prepare(R"(
+      DELETE FROM _cf_R2_UPLOAD WHERE upload_id = ?
+    )");
+    SqliteDatabase::Statement stmtGetPart = db.prepare(R"(
+      SELECT etag, md5, file, size FROM _cf_R2_PART WHERE upload_id = ? AND part = ?
+    )");
+    SqliteDatabase::Statement stmtPutPart = db.prepare(R"(
+      INSERT INTO _cf_R2_PART VALUES(?, ?, ?, ?, ?, ?)
+        ON CONFLICT DO UPDATE SET
+          etag = excluded.etag, md5 = excluded.md5, file = excluded.file, size = excluded.size
+    )");
+    SqliteDatabase::Statement stmtListPartFiles = db.prepare(R"(
+      SELECT file FROM _cf_R2_PART WHERE upload_id = ?
+    )");
+    SqliteDatabase::Statement stmtDeleteParts = db.prepare(R"(
+      DELETE FROM _cf_R2_PART WHERE upload_id = ?
+    )");
+
+    static bool ensureInitialized(SqliteDatabase& db);
+  };
+
+  // An object's row in the database.
+  struct Object {
+    kj::String version;
+    uint64_t size;
+    kj::String etag;
+    int64_t uploaded;
+
+    // The object's R2HeadResponse, as JSON.
+    kj::String metadata;
+  };
+
+  // A file holding an object's body, or a piece of it.
+  struct Blob {
+    kj::String file;
+    uint64_t size;
+  };
+
+  // A body written to a new blob file.
+  struct WrittenBlob {
+    Blob blob;
+    kj::Array<kj::byte> md5;
+
+    // The digest requested alongside MD5, if any.
+    kj::Maybe<kj::Array<kj::byte>> checksum;
+  };
+
+  // Digests that a put can ask to be checked and stored alongside MD5.
+  enum class Checksum { SHA1, SHA256, SHA384, SHA512 };
+
+  kj::HttpHeaderTable& headerTable;
+  const kj::Clock& clock;
+  kj::Maybe<const kj::Directory&> directory;
+
+  // Declared before `database` so that it outlives it.
+  kj::Maybe<kj::Own<SqliteDatabase::Vfs>> vfs;
+  kj::Maybe<kj::Own<Database>> database;
+
+  kj::HttpHeaderId hCfR2Request;
+  kj::HttpHeaderId hCfR2MetadataSize;
+  kj::HttpHeaderId hCfR2Error;
+
+  kj::Promise<void> handleRead(kj::String requestJson, Response& response);
+  kj::Promise<void> handleWrite(size_t requestSize, kj::AsyncInputStream& requestBody,
+                                Response& response);
+
+  kj::Promise<void> handleHead(api::public_beta::R2HeadRequest::Reader request,
+                               Response& response);
+  kj::Promise<void> handleGet(api::public_beta::R2GetRequest::Reader request, Response& response);
+  kj::Promise<void> handleList(api::public_beta::R2ListRequest::Reader request,
+                               Response& response);
+  kj::Promise<void> handlePut(api::public_beta::R2PutRequest::Reader request,
+                              kj::AsyncInputStream& body, Response& response);
+  kj::Promise<void> handleDelete(api::public_beta::R2DeleteRequest::Reader request,
+                                 Response& response);
+  kj::Promise<void> handleCreateMultipartUpload(
+      api::public_beta::R2CreateMultipartUploadRequest::Reader request, Response& response);
+  kj::Promise<void> handleUploadPart(api::public_beta::R2UploadPartRequest::Reader request,
+                                     kj::AsyncInputStream& body, Response& response);
+  kj::Promise<void> handleCompleteMultipartUpload(
+      api::public_beta::R2CompleteMultipartUploadRequest::Reader request, Response& response);
+  kj::Promise<void> handleAbortMultipartUpload(
+      api::public_beta::R2AbortMultipartUploadRequest::Reader request, Response& response);
+
+  const kj::Directory& getDirectory();
+  Database& getDatabase();
+
+  kj::Maybe<Object> getObject(kj::StringPtr key);
+  kj::Array<Blob> getBlobs(kj::StringPtr version);
+
+  // Streams `body` into a new blob file, computing its MD5 and, if `checksum` is given, that
+  // digest too.
+  kj::Promise<WrittenBlob> writeBlob(kj::AsyncInputStream& body, kj::Maybe<Checksum> checksum);
+
+  // Replaces any object stored under `key` with one made of `blobs`, within the current
+  // transaction. Returns the files of the replaced object, which the caller must remove once the
+  // transaction commits.
+  kj::Array<kj::String> replaceObject(kj::StringPtr key, const Object& object,
+                                      kj::ArrayPtr<const Blob> blobs);
+
+  // Removes blob files no longer referenced by the database.
+  void removeFiles(kj::ArrayPtr<const kj::String> files);
+
+  // Responds with an error, identified to the binding by R2's `v4Code` for it. A failed
+  // precondition on get also carries the object's metadata.
+  kj::Promise<void> sendError(Response& response, uint statusCode, uint v4Code,
+                              kj::Maybe<kj::StringPtr> metadata = kj::none);
+  kj::Promise<void> sendJson(Response& response, kj::String json);
+};
+
+}  // namespace workerd::server
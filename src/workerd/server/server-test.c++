@@ -1546,6 +1546,74 @@ KJ_TEST("Server: Durable Objects (in memory)") {
       "02b496f65dd35cbac90e3e72dc5a398ee93926ea4a3821e26677082d2e6f9b79: http://foo/bar 2");
 }
 
+KJ_TEST("Server: Durable Objects can't be replicated across threads") {
+  TestServer test(R"((
+    services = [
+      ( name = "hello",
+        worker = (
+          compatibilityDate = "2022-08-17",
+          modules = [
+            ( name = "main.js",
+              esModule =
+                `export default {
+                `  async fetch(request, env) {
+                `    return new Response("ok");
+                `  }
+                `}
+                `export class MyActorClass {
+                `  async fetch(request) {
+                `    return new Response("ok");
+                `  }
+                `}
+            )
+          ],
+          durableObjectNamespaces = [
+            ( className = "MyActorClass",
+              uniqueKey = "mykey",
+            )
+          ],
+          durableObjectStorage = (inMemory = void)
+        )
+      ),
+    ],
+    sockets = [
+      ( name = "main",
+        address = "test-addr",
+        service = "hello"
+      )
+    ],
+    threads = 4
+  ))"_kj);
+
+  test.expectErrors(
+      "Service \"hello\" defines Durable Object namespaces, which are not supported when "
+      "`threads` is greater than 1.\n");
+}
+
+KJ_TEST("Server: KV namespaces on disk can't be replicated across threads") {
+  TestServer test(R"((
+    services = [
+      ( name = "kv",
+        kv = (disk = "kv-disk")
+      ),
+      ( name = "kv-disk",
+        disk = (
+          path = "../../var/kv",
+          writable = true,
+        )
+      ),
+    ],
+    threads = 2
+  ))"_kj);
+
+  test.root->openSubdir(kj::Path({"var"_kj, "kv"_kj}),
+      kj::WriteMode::CREATE | kj::WriteMode::CREATE_PARENT);
+
+  test.expectErrors(
+      "Service \"kv\" is a KV namespace stored on disk, which is not supported when `threads` "
+      "is greater than 1.\n");
+}
+
 KJ_TEST("Server: Durable Objects (on disk)") {
   kj::StringPtr config = R"((
     services = [
@@ -2643,6 +2711,57 @@ KJ_TEST("Server: external server proxy style") {
   conn.recvHttp200("OK");
 }
 
+KJ_TEST("Server: external server connection limit") {
+  TestServer test(R"((
+    services = [
+      (name = "hello", external = (
+        address = "ext-addr",
+        http = (),
+        connectionPool = (maxConnectionsPerOrigin = 1),
+      ))
+    ],
+    sockets = [
+      (name = "main", address = "test-addr", service = "hello")
+    ]
+  ))"_kj);
+
+  test.start();
+
+  auto conn1 = test.connect("test-addr");
+  auto conn2 = test.connect("test-addr");
+  conn1.sendHttpGet("/one");
+  conn2.sendHttpGet("/two");
+
+  auto subreq = test.receiveSubrequest("ext-addr");
+  subreq.recv(R"(
+    GET /one HTTP/1.1
+    Host: foo
+
+  )"_blockquote);
+
+  // The second request waits for the first to finish, then reuses its connection.
+  subreq.send(R"(
+    HTTP/1.1 200 OK
+    Content-Length: 3
+    Content-Type: text/plain;charset=UTF-8
+
+    one)"_blockquote);
+  conn1.recvHttp200("one");
+
+  subreq.recv(R"(
+    GET /two HTTP/1.1
+    Host: foo
+
+  )"_blockquote);
+  subreq.send(R"(
+    HTTP/1.1 200 OK
+    Content-Length: 3
+    Content-Type: text/plain;charset=UTF-8
+
+    two)"_blockquote);
+  conn2.recvHttp200("two");
+}
+
 KJ_TEST("Server: external server forwarded-proto") {
   TestServer test(R"((
     services = [
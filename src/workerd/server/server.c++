@@ -29,13 +29,27 @@
 #include <workerd/io/request-tracker.h>
 #include <workerd/util/http-util.h>
 #include <workerd/api/actor-state.h>
+#include <workerd/api/queue.h>
 #include <workerd/util/mimetype.h>
+#include <workerd/util/strings.h>
 #include <workerd/util/use-perfetto-categories.h>
 #include <workerd/api/worker-rpc.h>
 #include <workerd/util/uuid.h>
+#include "http-cache.h"
+#include "kv-store.h"
+#include "queue-broker.h"
+#include "r2-store.h"
 #include "workerd-api.h"
 #include "workerd/io/hibernation-manager.h"
 #include <stdlib.h>
+#include <atomic>
+
+#if !_WIN32
+#include <netdb.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
 
 namespace workerd::server {
 
@@ -93,33 +107,65 @@ static kj::String httpTime(kj::Date date) {
   return kj::heapString(buf, n);
 }
 
-static kj::Vector<char> escapeJsonString(kj::StringPtr text) {
-  static const char HEXDIGITS[] = "0123456789abcdef";
-  kj::Vector<char> escaped(text.size() + 1);
-
-  for (char c: text) {
-    switch (c) {
-      case '\"': escaped.addAll(kj::StringPtr("\\\"")); break;
-      case '\\': escaped.addAll(kj::StringPtr("\\\\")); break;
-      case '\b': escaped.addAll(kj::StringPtr("\\b")); break;
-      case '\f': escaped.addAll(kj::StringPtr("\\f")); break;
-      case '\n': escaped.addAll(kj::StringPtr("\\n")); break;
-      case '\r': escaped.addAll(kj::StringPtr("\\r")); break;
-      case '\t': escaped.addAll(kj::StringPtr("\\t")); break;
-      default:
-        if (static_cast<uint8_t>(c) < 0x20) {
-          escaped.addAll(kj::StringPtr("\\u00"));
-          uint8_t c2 = c;
-          escaped.add(HEXDIGITS[c2 / 16]);
-          escaped.add(HEXDIGITS[c2 % 16]);
-        } else {
-          escaped.add(c);
-        }
-        break;
-    }
+// Binds a listen socket for `addr` with SO_REUSEPORT, so that replicas of the server running on
+// different threads can each accept connections on the same address (see `Config.threads`).
+// Returns none if the address is of a kind that can't be shared this way, e.g. a Unix socket.
+static kj::Maybe<kj::Own<kj::ConnectionReceiver>> listenReusePort(
+    kj::LowLevelAsyncIoProvider& lowLevelProvider, kj::NetworkAddress& addr) {
+#if _WIN32 || !defined(SO_REUSEPORT)
+  return kj::none;
+#else
+  // kj::NetworkAddress doesn't expose the underlying sockaddr, but its string form is always
+  // numeric: "1.2.3.4:80", "[1234::abcd]:80", "*:80", or "unix:/path".
+  auto str = addr.toString();
+  if (str.startsWith("unix")) return kj::none;
+
+  size_t colon = KJ_UNWRAP_OR(str.findLast(':'), return kj::none);
+  kj::StringPtr port = str.slice(colon + 1);
+  kj::String host = kj::str(str.slice(0, colon));
+  if (host.startsWith("[") && host.endsWith("]")) {
+    host = kj::str(host.slice(1, host.size() - 1));
   }
 
-  return escaped;
+  auto bindTo = [&](kj::StringPtr bindHost, bool dualStack) -> kj::Own<kj::ConnectionReceiver> {
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_NUMERICHOST | AI_NUMERICSERV | AI_PASSIVE;
+    struct addrinfo* info = nullptr;
+    int status = getaddrinfo(bindHost.cStr(), port.cStr(), &hints, &info);
+    KJ_REQUIRE(status == 0, "couldn't parse listen address", str, gai_strerror(status));
+    KJ_DEFER(freeaddrinfo(info));
+
+    int fd_;
+    KJ_SYSCALL(fd_ = socket(info->ai_family, info->ai_socktype, info->ai_protocol));
+    kj::AutoCloseFd fd(fd_);
+
+    int one = 1;
+    KJ_SYSCALL(setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)));
+    KJ_SYSCALL(setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one)));
+    if (dualStack) {
+      int zero = 0;
+      KJ_SYSCALL(setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &zero, sizeof(zero)));
+    }
+    KJ_SYSCALL(bind(fd, info->ai_addr, info->ai_addrlen), str);
+    KJ_SYSCALL(::listen(fd, SOMAXCONN), str);
+
+    return lowLevelProvider.wrapListenSocketFd(
+        fd.release(), kj::LowLevelAsyncIoProvider::TAKE_OWNERSHIP);
+  };
+
+  if (host == "*") {
+    // Like kj, prefer a dual-stack IPv6 socket for the wildcard address, falling back to IPv4 on
+    // systems without IPv6.
+    kj::Maybe<kj::Own<kj::ConnectionReceiver>> result;
+    if (kj::runCatchingExceptions([&]() { result = bindTo("::", true); }) != kj::none) {
+      return bindTo("0.0.0.0", false);
+    }
+    return kj::mv(result);
+  }
+  return bindTo(host, false);
+#endif
 }
 
 }  // namespace
@@ -469,6 +515,187 @@ private:
   kj::Maybe<kj::Own<kj::NetworkAddress>> addr;
 };
 
+// Counts the requests sent through a connection pool, and the connections it had to open for
+// them, reporting how many requests reused a pooled connection (hits) and how many didn't (misses)
+// as trace counters.
+//
+// WebSocket upgrades arrive as requests, so they are counted as such. CONNECT tunnels always open
+// a connection of their own, so the services count each one as a request too, and it shows up as
+// a miss.
+//
+// Every service has its own pool, but they all report into the same trace counters, so those are
+// the totals across the whole process, on every thread.
+class ConnectionPoolCounters {
+public:
+  void countRequest() {
+    ++requests;
+    report();
+  }
+  void countConnection() {
+    ++connections;
+    report();
+  }
+
+private:
+  uint64_t requests = 0;
+  uint64_t connections = 0;
+
+  // This pool's share of the totals, as of the last report().
+  int64_t reportedHits = 0;
+  int64_t reportedMisses = 0;
+
+  static inline std::atomic<int64_t> totalHits = 0;
+  static inline std::atomic<int64_t> totalMisses = 0;
+
+  void report() {
+    int64_t hits = requests - kj::min(connections, requests);
+    int64_t misses = connections;
+    totalHits.fetch_add(hits - reportedHits, std::memory_order_relaxed);
+    totalMisses.fetch_add(misses - reportedMisses, std::memory_order_relaxed);
+    reportedHits = hits;
+    reportedMisses = misses;
+
+    TRACE_COUNTER("workerd", "Connection pool hits", totalHits.load(std::memory_order_relaxed));
+    TRACE_COUNTER("workerd", "Connection pool misses",
+        totalMisses.load(std::memory_order_relaxed));
+  }
+};
+
+// Wraps a NetworkAddress to count the connections made to it.
+class CountingNetworkAddress final: public kj::NetworkAddress {
+public:
+  CountingNetworkAddress(kj::Own<kj::NetworkAddress> inner, ConnectionPoolCounters& counters)
+      : inner(kj::mv(inner)), counters(counters) {}
+
+  kj::Promise<kj::Own<kj::AsyncIoStream>> connect() override {
+    counters.countConnection();
+    return inner->connect();
+  }
+  kj::Promise<kj::AuthenticatedStream> connectAuthenticated() override {
+    counters.countConnection();
+    return inner->connectAuthenticated();
+  }
+  kj::Own<kj::ConnectionReceiver> listen() override {
+    return inner->listen();
+  }
+  kj::Own<kj::NetworkAddress> clone() override {
+    return kj::heap<CountingNetworkAddress>(inner->clone(), counters);
+  }
+  kj::String toString() override {
+    return inner->toString();
+  }
+
+private:
+  kj::Own<kj::NetworkAddress> inner;
+  ConnectionPoolCounters& counters;
+};
+
+// Wraps a Network to count the connections made to any of its addresses.
+class CountingNetwork final: public kj::Network {
+public:
+  CountingNetwork(kj::Own<kj::Network> inner, ConnectionPoolCounters& counters)
+      : inner(kj::mv(inner)), counters(counters) {}
+
+  kj::Promise<kj::Own<kj::NetworkAddress>> parseAddress(
+      kj::StringPtr addr, uint portHint) override {
+    return inner->parseAddress(addr, portHint)
+        .then([&counters = counters](kj::Own<kj::NetworkAddress> result)
+            -> kj::Own<kj::NetworkAddress> {
+      return kj::heap<CountingNetworkAddress>(kj::mv(result), counters);
+    });
+  }
+  kj::Own<kj::NetworkAddress> getSockaddr(const void* sockaddr, uint len) override {
+    return kj::heap<CountingNetworkAddress>(inner->getSockaddr(sockaddr, len), counters);
+  }
+  kj::Own<kj::Network> restrictPeers(
+      kj::ArrayPtr<const kj::StringPtr> allow,
+      kj::ArrayPtr<const kj::StringPtr> deny = nullptr) override {
+    return kj::heap<CountingNetwork>(inner->restrictPeers(allow, deny), counters);
+  }
+
+private:
+  kj::Own<kj::Network> inner;
+  ConnectionPoolCounters& counters;
+};
+
+// Wraps a pooled HttpClient to limit the requests in flight to each origin, and so the connections
+// opened to it. Requests over the limit wait for an earlier one to finish and free up its
+// connection. CONNECT tunnels are passed straight through, since they never return their
+// connection to the pool.
+class OriginLimitingHttpClient final: public kj::HttpClient {
+public:
+  // If `singleOrigin` is true, every request is known to go to the same place, so URLs needn't be
+  // parsed to tell origins apart.
+  OriginLimitingHttpClient(kj::HttpClient& inner, uint maxPerOrigin, bool singleOrigin)
+      : inner(inner), maxPerOrigin(maxPerOrigin), singleOrigin(singleOrigin) {}
+
+  Request request(kj::HttpMethod method, kj::StringPtr url, const kj::HttpHeaders& headers,
+                  kj::Maybe<uint64_t> expectedBodySize = kj::none) override {
+    return getClient(url).request(method, url, headers, expectedBodySize);
+  }
+
+  kj::Promise<WebSocketResponse> openWebSocket(
+      kj::StringPtr url, const kj::HttpHeaders& headers) override {
+    return getClient(url).openWebSocket(url, headers);
+  }
+
+  ConnectRequest connect(kj::StringPtr host, const kj::HttpHeaders& headers,
+                         kj::HttpConnectSettings settings) override {
+    return inner.connect(host, headers, kj::mv(settings));
+  }
+
+private:
+  kj::HttpClient& inner;
+  uint maxPerOrigin;
+  bool singleOrigin;
+
+  struct Limiter {
+    kj::Own<kj::HttpClient> client;
+
+    // True when the limiter has no requests in flight or queued, so it can be dropped.
+    bool idle = false;
+  };
+
+  // Limiters for the origins with requests in flight or queued. Idle ones are dropped on the next
+  // request, so that the map doesn't grow with every origin ever contacted.
+  kj::HashMap<kj::String, kj::Own<Limiter>> limiters;
+
+  kj::HttpClient& getClient(kj::StringPtr url) {
+    kj::String origin;
+    if (!singleOrigin) {
+      KJ_IF_SOME(parsed, kj::Url::tryParse(url, kj::Url::HTTP_PROXY_REQUEST)) {
+        origin = kj::str(parsed.scheme, "://", parsed.host);
+      } else {
+        // Let the pool report the bad URL.
+        return inner;
+      }
+    }
+
+    // A limiter can't be dropped from its own callback, which runs while it's still in use, so
+    // it's done here instead.
+    limiters.eraseAll([](auto&, kj::Own<Limiter>& limiter) { return limiter->idle; });
+
+    return *limiters.findOrCreate(origin, [&]() -> decltype(limiters)::Entry {
+      auto limiter = kj::heap<Limiter>();
+      limiter->client = kj::newConcurrencyLimitingHttpClient(inner, maxPerOrigin,
+          [&state = *limiter](uint runningCount, uint pendingCount) {
+        state.idle = runningCount == 0 && pendingCount == 0;
+      });
+      return { kj::str(origin), kj::mv(limiter) };
+    })->client;
+  }
+};
+
+// Returns `pool`, wrapped to apply the connection limit from `conf` if it has one.
+kj::Own<kj::HttpClient> limitConnections(kj::HttpClient& pool,
+                                         config::ConnectionPoolOptions::Reader conf,
+                                         bool singleOrigin) {
+  if (conf.getMaxConnectionsPerOrigin() == 0) {
+    return { &pool, kj::NullDisposer::instance };
+  }
+  return kj::heap<OriginLimitingHttpClient>(pool, conf.getMaxConnectionsPerOrigin(), singleOrigin);
+}
+
 class Server::ExternalTcpService final: public Service, private WorkerInterface {
 public:
   ExternalTcpService(kj::Own<kj::NetworkAddress> addrParam)
@@ -533,15 +760,19 @@ private:
 class Server::ExternalHttpService final: public Service, private kj::TaskSet::ErrorHandler {
 public:
   ExternalHttpService(kj::Own<kj::NetworkAddress> addrParam,
-                      kj::Own<HttpRewriter> rewriter, kj::HttpHeaderTable& headerTable,
+                      kj::Own<HttpRewriter> rewriter,
+                      config::ConnectionPoolOptions::Reader poolConf,
+                      kj::HttpHeaderTable& headerTable,
                       kj::Timer& timer, kj::EntropySource& entropySource,
                       capnp::ByteStreamFactory& byteStreamFactory,
                       capnp::HttpOverCapnpFactory& httpOverCapnpFactory)
-      : addr(kj::mv(addrParam)),
-        inner(kj::newHttpClient(timer, headerTable, *addr, {
+      : addr(kj::heap<CountingNetworkAddress>(kj::mv(addrParam), poolCounters)),
+        pool(kj::newHttpClient(timer, headerTable, *addr, {
+          .idleTimeout = poolConf.getIdleTimeoutMs() * kj::MILLISECONDS,
           .entropySource = entropySource,
           .webSocketCompressionMode = kj::HttpClientSettings::MANUAL_COMPRESSION
         })),
+        inner(limitConnections(*pool, poolConf, true)),
         serviceAdapter(kj::newHttpService(*inner)),
         rewriter(kj::mv(rewriter)),
         headerTable(headerTable),
@@ -558,8 +789,10 @@ public:
   }
 
 private:
+  ConnectionPoolCounters poolCounters;
   kj::Own<kj::NetworkAddress> addr;
 
+  kj::Own<kj::HttpClient> pool;
   kj::Own<kj::HttpClient> inner;
   kj::Own<kj::HttpService> serviceAdapter;
 
@@ -625,6 +858,7 @@ private:
       TRACE_EVENT("workerd", "ExternalHttpServer::request()");
       KJ_REQUIRE(wrappedResponse == kj::none, "object should only receive one request");
       wrappedResponse = response;
+      parent.poolCounters.countRequest();
       if (parent.rewriter->needsRewriteRequest()) {
         auto rewrite = parent.rewriter->rewriteOutgoingRequest(url, headers, metadata.cfBlobJson);
         return parent.serviceAdapter->request(method, url, *rewrite.headers, requestBody, *this)
@@ -638,6 +872,7 @@ private:
         kj::StringPtr host, const kj::HttpHeaders& headers, kj::AsyncIoStream& connection,
         ConnectResponse& tunnel, kj::HttpConnectSettings settings) override {
       TRACE_EVENT("workerd", "ExternalHttpServer::connect()");
+      parent.poolCounters.countRequest();
       return parent.serviceAdapter->connect(host, headers, connection, tunnel, kj::mv(settings));
     }
 
@@ -722,7 +957,8 @@ kj::Own<Server::Service> Server::makeExternalService(
       auto rewriter = kj::heap<HttpRewriter>(conf.getHttp(), headerTableBuilder);
       auto addr = kj::heap<PromisedNetworkAddress>(network.parseAddress(addrStr, 80));
       return kj::heap<ExternalHttpService>(
-          kj::mv(addr), kj::mv(rewriter), headerTableBuilder.getFutureTable(),
+          kj::mv(addr), kj::mv(rewriter), conf.getConnectionPool(),
+          headerTableBuilder.getFutureTable(),
           timer, entropySource, globalContext->byteStreamFactory,
           globalContext->httpOverCapnpFactory);
     }
@@ -736,7 +972,8 @@ kj::Own<Server::Service> Server::makeExternalService(
       auto addr = kj::heap<PromisedNetworkAddress>(
           makeTlsNetworkAddress(httpsConf.getTlsOptions(), addrStr, certificateHost, 443));
       return kj::heap<ExternalHttpService>(
-          kj::mv(addr), kj::mv(rewriter), headerTableBuilder.getFutureTable(),
+          kj::mv(addr), kj::mv(rewriter), conf.getConnectionPool(),
+          headerTableBuilder.getFutureTable(),
           timer, entropySource, globalContext->byteStreamFactory,
           globalContext->httpOverCapnpFactory);
     }
@@ -767,13 +1004,20 @@ public:
                  kj::Timer& timer, kj::EntropySource& entropySource,
                  kj::Own<kj::Network> networkParam,
                  kj::Maybe<kj::Own<kj::Network>> tlsNetworkParam,
-                 kj::Maybe<kj::SecureNetworkWrapper&> tlsContext)
-      : network(kj::mv(networkParam)), tlsNetwork(kj::mv(tlsNetworkParam)),
-        inner(kj::newHttpClient(timer, headerTable, *network, tlsNetwork, {
+                 kj::Maybe<kj::SecureNetworkWrapper&> tlsContext,
+                 config::ConnectionPoolOptions::Reader poolConf)
+      : network(kj::heap<CountingNetwork>(kj::mv(networkParam), poolCounters)),
+        tlsNetwork(kj::mv(tlsNetworkParam).map([this](kj::Own<kj::Network> n)
+            -> kj::Own<kj::Network> {
+          return kj::heap<CountingNetwork>(kj::mv(n), poolCounters);
+        })),
+        pool(kj::newHttpClient(timer, headerTable, *network, tlsNetwork, {
+          .idleTimeout = poolConf.getIdleTimeoutMs() * kj::MILLISECONDS,
           .entropySource = entropySource,
           .webSocketCompressionMode = kj::HttpClientSettings::MANUAL_COMPRESSION,
           .tlsContext = tlsContext
         })),
+        inner(limitConnections(*pool, poolConf, false)),
         serviceAdapter(kj::newHttpService(*inner)) {}
 
   kj::Own<WorkerInterface> startRequest(IoChannelFactory::SubrequestMetadata metadata) override {
@@ -785,8 +1029,10 @@ public:
   }
 
 private:
+  ConnectionPoolCounters poolCounters;
   kj::Own<kj::Network> network;
   kj::Maybe<kj::Own<kj::Network>> tlsNetwork;
+  kj::Own<kj::HttpClient> pool;
   kj::Own<kj::HttpClient> inner;
   kj::Own<kj::HttpService> serviceAdapter;
 
@@ -794,6 +1040,7 @@ private:
       kj::HttpMethod method, kj::StringPtr url, const kj::HttpHeaders& headers,
       kj::AsyncInputStream& requestBody, kj::HttpService::Response& response) override {
     TRACE_EVENT("workerd", "NetworkService::request()");
+    poolCounters.countRequest();
     return serviceAdapter->request(method, url, headers, requestBody, response);
   }
 
@@ -801,6 +1048,7 @@ private:
       kj::StringPtr host, const kj::HttpHeaders& headers, kj::AsyncIoStream& connection,
       ConnectResponse& tunnel, kj::HttpConnectSettings settings) override {
     TRACE_EVENT("workerd", "NetworkService::connect()");
+    poolCounters.countRequest();
     // This code is hit when the global `connect` function is called in a JS worker script.
     // It represents a proxy-less TCP connection, which means we can simply defer the handling of
     // the connection to the service adapter (likely NetworkHttpClient). Its behaviour will be to
@@ -974,7 +1222,8 @@ kj::Own<Server::Service> Server::makeNetworkService(config::Network::Reader conf
   }
 
   return kj::heap<NetworkService>(globalContext->headerTable, timer, entropySource,
-                                  kj::mv(restrictedNetwork), kj::mv(tlsNetwork), tlsContext);
+                                  kj::mv(restrictedNetwork), kj::mv(tlsNetwork), tlsContext,
+                                  conf.getConnectionPool());
 }
 
 // Service used when the service is configured as disk directory service.
@@ -1255,6 +1504,351 @@ kj::Own<Server::Service> Server::makeDiskDirectoryService(
   }
 }
 
+kj::Maybe<const kj::Directory&> Server::resolveWritableDisk(
+    config::ServiceDesignator::Reader designator, kj::StringPtr what) {
+  auto& svc = lookupService(designator, kj::str(what, "'s disk"));
+  auto diskSvc = dynamic_cast<DiskDirectoryService*>(&svc);
+  if (diskSvc == nullptr) {
+    reportConfigError(kj::str(what, " refers to the service \"", designator.getName(),
+        "\" for storage, but that service is not a local disk service."));
+    return kj::none;
+  }
+  KJ_IF_SOME(dir, diskSvc->getWritable()) {
+    return dir;
+  } else {
+    reportConfigError(kj::str(what, " refers to the disk service \"", designator.getName(),
+        "\" for storage, but that service is defined read-only."));
+    return kj::none;
+  }
+}
+
+// =======================================================================================
+
+// Base class for the local storage services (cache, KV, queues, R2), which are only used through
+// HTTP. Subclasses implement `request()` and `linkTo()`; every other event type fails.
+class Server::HttpOnlyService: public Service, protected WorkerInterface {
+public:
+  kj::Own<WorkerInterface> startRequest(IoChannelFactory::SubrequestMetadata metadata) override {
+    return { this, kj::NullDisposer::instance };
+  }
+
+  bool hasHandler(kj::StringPtr handlerName) override {
+    return handlerName == "fetch"_kj;
+  }
+
+  // What the service is linked to: the directory in which to store its data, if any, and the
+  // service to deliver to, if any (only queues have one).
+  struct Links {
+    kj::Maybe<const kj::Directory&> dir;
+    kj::Maybe<Service&> consumer;
+  };
+
+  // Called at link time to resolve the service's links.
+  using LinkCallback = kj::Function<Links()>;
+
+  void link() override final {
+    LinkCallback callback = kj::mv(KJ_REQUIRE_NONNULL(linkCallback, "already called link()"));
+    linkCallback = kj::none;
+    linkTo(callback());
+  }
+
+protected:
+  // `serviceType` names the kind of service in errors, e.g. "KV store services".
+  HttpOnlyService(kj::StringPtr serviceType, LinkCallback linkCallback)
+      : serviceType(serviceType), linkCallback(kj::mv(linkCallback)) {}
+
+  virtual void linkTo(Links links) = 0;
+
+  // Returns an SQLite VFS over `dir`, or over a new in-memory directory if there is none.
+  SqliteDatabase::Vfs& openVfs(kj::Maybe<const kj::Directory&> dir) {
+    KJ_IF_SOME(d, dir) {
+      vfs = kj::heap<SqliteDatabase::Vfs>(d);
+    } else {
+      auto memoryDir = kj::newInMemoryDirectory(kj::nullClock());
+      vfs = kj::heap<SqliteDatabase::Vfs>(*memoryDir).attach(kj::mv(memoryDir));
+    }
+    return *vfs;
+  }
+
+  // Returns `dir`'s subdirectory `name`, creating it if needed, or a new in-memory directory if
+  // there is no `dir`.
+  const kj::Directory& openSubdir(kj::Maybe<const kj::Directory&> dir, kj::StringPtr name) {
+    KJ_IF_SOME(d, dir) {
+      subdir = d.openSubdir(kj::Path({ name }),
+          kj::WriteMode::CREATE | kj::WriteMode::MODIFY | kj::WriteMode::CREATE_PARENT);
+    } else {
+      subdir = kj::newInMemoryDirectory(kj::nullClock());
+    }
+    return *subdir;
+  }
+
+  kj::Promise<void> connect(kj::StringPtr host, const kj::HttpHeaders& headers,
+      kj::AsyncIoStream& connection, kj::HttpService::ConnectResponse& response,
+      kj::HttpConnectSettings settings) override {
+    throwUnsupported();
+  }
+  void prewarm(kj::StringPtr url) override {}
+  kj::Promise<ScheduledResult> runScheduled(kj::Date scheduledTime, kj::StringPtr cron) override {
+    throwUnsupported();
+  }
+  kj::Promise<AlarmResult> runAlarm(kj::Date scheduledTime, uint32_t retryCount) override {
+    throwUnsupported();
+  }
+  kj::Promise<CustomEvent::Result> customEvent(kj::Own<CustomEvent> event) override {
+    throwUnsupported();
+  }
+
+private:
+  kj::StringPtr serviceType;
+  kj::Maybe<LinkCallback> linkCallback;
+
+  // Owned here rather than by subclasses so that they outlive whatever the subclass opens in them.
+  kj::Own<SqliteDatabase::Vfs> vfs;
+  kj::Own<const kj::Directory> subdir;
+
+  [[noreturn]] void throwUnsupported() {
+    JSG_FAIL_REQUIRE(Error, serviceType, " don't support this event type.");
+  }
+};
+
+// =======================================================================================
+
+class Server::CacheService final: public HttpOnlyService {
+public:
+  CacheService(config::CacheService::Reader conf,
+               kj::HttpHeaderTable::Builder& headerTableBuilder, LinkCallback linkCallback)
+      : HttpOnlyService("Cache services", kj::mv(linkCallback)),
+        cache(headerTableBuilder, HttpCache::Options {
+          .memoryLimit = conf.getMemoryLimit(),
+          .maxEntrySize = conf.getMaxEntrySize(),
+        }) {}
+
+private:
+  HttpCache cache;
+
+  void linkTo(Links links) override {
+    // Without a disk, entries are only kept in memory.
+    KJ_IF_SOME(dir, links.dir) {
+      cache.setDirectory(dir);
+    }
+  }
+
+  kj::Promise<void> request(
+      kj::HttpMethod method, kj::StringPtr url, const kj::HttpHeaders& headers,
+      kj::AsyncInputStream& requestBody, kj::HttpService::Response& response) override {
+    TRACE_EVENT("workerd", "CacheService::request()", "url", url.cStr());
+    return cache.request(method, url, headers, requestBody, response);
+  }
+};
+
+kj::Own<Server::Service> Server::makeCacheService(
+    kj::StringPtr name, config::CacheService::Reader conf,
+    kj::HttpHeaderTable::Builder& headerTableBuilder) {
+  TRACE_EVENT("workerd", "Server::makeCacheService()");
+
+  HttpOnlyService::LinkCallback linkCallback = [this, name, conf]() {
+    HttpOnlyService::Links links;
+    if (conf.hasDisk()) {
+      links.dir = resolveWritableDisk(conf.getDisk(), kj::str("Cache service \"", name, "\""));
+    }
+    return links;
+  };
+
+  return kj::heap<CacheService>(conf, headerTableBuilder, kj::mv(linkCallback));
+}
+
+// =======================================================================================
+
+class Server::KvStoreService final: public HttpOnlyService {
+public:
+  KvStoreService(config::KvStore::Reader conf, kj::String id,
+                 kj::HttpHeaderTable::Builder& headerTableBuilder, LinkCallback linkCallback)
+      : HttpOnlyService("KV store services", kj::mv(linkCallback)),
+        store(headerTableBuilder, KvStore::Options {
+          .cacheLimit = conf.getCacheLimit(),
+          .maxValueSize = conf.getMaxValueSize(),
+        }),
+        id(kj::mv(id)) {}
+
+private:
+  KvStore store;
+  kj::String id;
+
+  void linkTo(Links links) override {
+    store.open(openVfs(links.dir), kj::Path({ kj::str(id, ".sqlite") }));
+  }
+
+  kj::Promise<void> request(
+      kj::HttpMethod method, kj::StringPtr url, const kj::HttpHeaders& headers,
+      kj::AsyncInputStream& requestBody, kj::HttpService::Response& response) override {
+    TRACE_EVENT("workerd", "KvStoreService::request()", "url", url.cStr());
+    return store.request(method, url, headers, requestBody, response);
+  }
+};
+
+kj::Own<Server::Service> Server::makeKvStoreService(
+    kj::StringPtr name, config::KvStore::Reader conf,
+    kj::HttpHeaderTable::Builder& headerTableBuilder) {
+  TRACE_EVENT("workerd", "Server::makeKvStoreService()");
+
+  HttpOnlyService::LinkCallback linkCallback = [this, name, conf]() {
+    HttpOnlyService::Links links;
+    if (conf.hasDisk()) {
+      links.dir = resolveWritableDisk(conf.getDisk(), kj::str("KV store \"", name, "\""));
+    }
+    return links;
+  };
+
+  auto id = kj::str(conf.hasId() ? conf.getId() : name);
+  return kj::heap<KvStoreService>(conf, kj::mv(id), headerTableBuilder, kj::mv(linkCallback));
+}
+
+// =======================================================================================
+
+class Server::QueueService final: public HttpOnlyService {
+public:
+  QueueService(config::QueueService::Reader conf, kj::String id, kj::String queueName,
+               kj::HttpHeaderTable::Builder& headerTableBuilder, kj::Timer& timer,
+               LinkCallback linkCallback)
+      : HttpOnlyService("Queue services", kj::mv(linkCallback)),
+        broker(headerTableBuilder, QueueBroker::Options {
+          .maxBatchSize = kj::max(conf.getMaxBatchSize(), 1u),
+          .maxBatchTimeout = conf.getMaxBatchTimeoutMs() * kj::MILLISECONDS,
+          .maxConcurrency = kj::max(conf.getMaxConcurrency(), 1u),
+          .maxRetries = conf.getMaxRetries(),
+          .retryDelay = conf.getRetryDelaySecs() * kj::SECONDS,
+          .maxBacklog = conf.getMaxBacklog(),
+          .maxMessageSize = conf.getMaxMessageSize(),
+        }, timer),
+        id(kj::mv(id)),
+        queueName(kj::mv(queueName)) {}
+
+private:
+  QueueBroker broker;
+  kj::String id;
+  kj::String queueName;
+
+  void linkTo(Links links) override {
+    broker.open(openVfs(links.dir), kj::Path({ kj::str(id, ".sqlite") }));
+
+    KJ_IF_SOME(consumer, links.consumer) {
+      broker.startDelivery([this, &consumer](kj::Array<QueueBroker::Message> batch) {
+        return deliver(consumer, kj::mv(batch));
+      });
+    }
+  }
+
+  // Delivers a batch to the consumer's queue() handler as a queue event, and reports what the
+  // handler did with its messages.
+  kj::Promise<QueueBroker::DeliveryResult> deliver(
+      Service& consumer, kj::Array<QueueBroker::Message> batch) {
+    auto messages = KJ_MAP(message, batch) {
+      return api::IncomingQueueMessage {
+        .id = kj::mv(message.id),
+        .timestamp = message.timestamp,
+        .body = kj::mv(message.body),
+        .contentType = kj::mv(message.contentType),
+      };
+    };
+    auto event = kj::refcounted<api::QueueCustomEventImpl>(api::QueueEvent::Params {
+      .queueName = kj::str(queueName),
+      .messages = kj::mv(messages),
+    });
+
+    auto worker = consumer.startRequest({});
+    auto result = co_await worker->customEvent(kj::addRef(*event));
+
+    co_return QueueBroker::DeliveryResult {
+      .succeeded = result.outcome == EventOutcome::OK,
+      .retryAll = event->getRetryAll(),
+      .ackAll = event->getAckAll(),
+      .explicitRetries = event->getExplicitRetries(),
+      .explicitAcks = event->getExplicitAcks(),
+    };
+  }
+
+  kj::Promise<void> request(
+      kj::HttpMethod method, kj::StringPtr url, const kj::HttpHeaders& headers,
+      kj::AsyncInputStream& requestBody, kj::HttpService::Response& response) override {
+    TRACE_EVENT("workerd", "QueueService::request()", "url", url.cStr());
+    return broker.request(method, url, headers, requestBody, response);
+  }
+};
+
+kj::Own<Server::Service> Server::makeQueueService(
+    kj::StringPtr name, config::QueueService::Reader conf,
+    kj::HttpHeaderTable::Builder& headerTableBuilder) {
+  TRACE_EVENT("workerd", "Server::makeQueueService()");
+
+  HttpOnlyService::LinkCallback linkCallback = [this, name, conf]() {
+    HttpOnlyService::Links links;
+
+    if (conf.hasDisk()) {
+      links.dir = resolveWritableDisk(conf.getDisk(), kj::str("Queue \"", name, "\""));
+    }
+
+    if (conf.hasConsumer()) {
+      auto& svc = lookupService(conf.getConsumer(), kj::str("Queue \"", name, "\"'s consumer"));
+      if (svc.hasHandler("queue"_kj)) {
+        links.consumer = svc;
+      } else {
+        reportConfigError(kj::str("Queue \"", name, "\" delivers to the service \"",
+            conf.getConsumer().getName(), "\", but that service has no queue() handler."));
+      }
+    }
+
+    return links;
+  };
+
+  auto id = kj::str(conf.hasId() ? conf.getId() : name);
+  auto queueName = kj::str(conf.hasQueueName() ? conf.getQueueName() : name);
+  return kj::heap<QueueService>(conf, kj::mv(id), kj::mv(queueName), headerTableBuilder, timer,
+                                kj::mv(linkCallback));
+}
+
+// =======================================================================================
+
+class Server::R2BucketService final: public HttpOnlyService {
+public:
+  R2BucketService(kj::String id, kj::HttpHeaderTable::Builder& headerTableBuilder,
+                  LinkCallback linkCallback)
+      : HttpOnlyService("R2 bucket services", kj::mv(linkCallback)),
+        store(headerTableBuilder),
+        id(kj::mv(id)) {}
+
+private:
+  R2Store store;
+  kj::String id;
+
+  void linkTo(Links links) override {
+    store.open(openSubdir(links.dir, id));
+  }
+
+  kj::Promise<void> request(
+      kj::HttpMethod method, kj::StringPtr url, const kj::HttpHeaders& headers,
+      kj::AsyncInputStream& requestBody, kj::HttpService::Response& response) override {
+    TRACE_EVENT("workerd", "R2BucketService::request()", "url", url.cStr());
+    return store.request(method, url, headers, requestBody, response);
+  }
+};
+
+kj::Own<Server::Service> Server::makeR2BucketService(
+    kj::StringPtr name, config::R2Bucket::Reader conf,
+    kj::HttpHeaderTable::Builder& headerTableBuilder) {
+  TRACE_EVENT("workerd", "Server::makeR2BucketService()");
+
+  HttpOnlyService::LinkCallback linkCallback = [this, name, conf]() {
+    HttpOnlyService::Links links;
+    if (conf.hasDisk()) {
+      links.dir = resolveWritableDisk(conf.getDisk(), kj::str("R2 bucket \"", name, "\""));
+    }
+    return links;
+  };
+
+  auto id = kj::str(conf.hasId() ? conf.getId() : name);
+  return kj::heap<R2BucketService>(kj::mv(id), headerTableBuilder, kj::mv(linkCallback));
+}
+
 // =======================================================================================
 
 // This class exists to update the InspectorService's table of isolates when a config
@@ -1514,6 +2108,7 @@ public:
     kj::Maybe<Service&> cache;
     kj::Maybe<kj::Own<SqliteDatabase::Vfs>> actorStorage;
     AlarmScheduler& alarmScheduler;
+    SqliteDatabase::PageCachePool& sqlitePageCachePool;
   };
   using LinkCallback = kj::Function<LinkedIoChannels(WorkerService&)>;
   using AbortActorsCallback = kj::Function<void()>;
@@ -1971,6 +2566,9 @@ public:
           // We don't have an actor so we need to create it.
           auto& channels = KJ_ASSERT_NONNULL(service.ioChannels.tryGet<LinkedIoChannels>());
 
+          auto observer = kj::refcounted<ActorObserver>();
+          auto& observerRef = *observer;
+
           auto makeActorCache =
               [&](const ActorCache::SharedLru& sharedLru, OutputGate& outputGate,
                   ActorCache::Hooks& hooks) {
@@ -1989,6 +2587,14 @@ public:
                 auto db = kj::heap<SqliteDatabase>(*as,
                     kj::Path({d.uniqueKey, kj::str(idPtr, ".sqlite")}),
                     kj::WriteMode::CREATE | kj::WriteMode::MODIFY | kj::WriteMode::CREATE_PARENT);
+                if (d.sqlitePageCacheLimit > 0) {
+                  db->setPageCacheLimit(d.sqlitePageCacheLimit);
+                }
+                db->joinPageCachePool(channels.sqlitePageCachePool);
+                db->onPageCacheStats([observer = kj::addRef(observerRef)](
+                    const SqliteDatabase::PageCacheStats& stats) {
+                  observer->sqlitePageCacheStats(stats.hits, stats.misses, stats.bytesUsed);
+                });
                 return kj::heap<ActorSqlite>(kj::mv(db), outputGate,
                     []() -> kj::Promise<void> { return kj::READY_NOW; },
                     *sqliteHooks).attach(kj::mv(sqliteHooks));
@@ -2021,7 +2627,7 @@ public:
                 kj::refcounted<Worker::Actor>(
                     *service.worker, actorContainer->getTracker(), kj::str(idPtr), true,
                     kj::mv(makeActorCache), className, kj::mv(makeStorage), lock, kj::mv(loopback),
-                    timerChannel, kj::refcounted<ActorObserver>(),
+                    timerChannel, kj::mv(observer),
                     actorContainer->tryGetManagerRef(),
                     hibernationEventTypeId));
 
@@ -3149,7 +3755,10 @@ kj::Own<Server::Service> Server::makeWorker(kj::StringPtr name, config::Worker::
       [this, name, conf, subrequestChannels = kj::mv(subrequestChannels),
        actorChannels = kj::mv(actorChannels),
        &reportConfigError](WorkerService& workerService) mutable {
-    WorkerService::LinkedIoChannels result{.alarmScheduler = *alarmScheduler};
+    WorkerService::LinkedIoChannels result{
+      .alarmScheduler = *alarmScheduler,
+      .sqlitePageCachePool = sqlitePageCachePool,
+    };
 
     auto services = kj::heapArrayBuilder<Service*>(subrequestChannels.size() +
               IoContext::SPECIAL_SUBREQUEST_CHANNEL_COUNT);
@@ -3260,6 +3869,18 @@ kj::Own<Server::Service> Server::makeService(
 
     case config::Service::DISK:
       return makeDiskDirectoryService(name, conf.getDisk(), headerTableBuilder);
+
+    case config::Service::CACHE:
+      return makeCacheService(name, conf.getCache(), headerTableBuilder);
+
+    case config::Service::KV:
+      return makeKvStoreService(name, conf.getKv(), headerTableBuilder);
+
+    case config::Service::QUEUE:
+      return makeQueueService(name, conf.getQueue(), headerTableBuilder);
+
+    case config::Service::R2:
+      return makeR2BucketService(name, conf.getR2(), headerTableBuilder);
   }
 
   reportConfigError(kj::str(
@@ -3607,6 +4228,17 @@ kj::Promise<void> Server::handleDrain(kj::Promise<void> drainWhen) {
   co_await kj::joinPromisesFailFast(drainPromises.finish());
 }
 
+kj::Promise<void> Server::sqlitePageCacheLoop() {
+  constexpr auto INTERVAL = 1 * kj::SECONDS;
+
+  while (true) {
+    co_await timer.afterDelay(INTERVAL);
+    KJ_IF_SOME(exception, kj::runCatchingExceptions([&]() { sqlitePageCachePool.update(); })) {
+      KJ_LOG(ERROR, "failed to update SQLite page cache pool", exception);
+    }
+  }
+}
+
 kj::Promise<void> Server::run(jsg::V8System& v8System, config::Config::Reader config,
                               kj::Promise<void> drainWhen) {
   TRACE_EVENT("workerd", "Server.run");
@@ -3691,13 +4323,7 @@ uint startInspector(kj::StringPtr inspectorAddress,
   );
 }
 
-void Server::startServices(jsg::V8System& v8System, config::Config::Reader config,
-                           kj::HttpHeaderTable::Builder& headerTableBuilder,
-                           kj::ForkedPromise<void>& forkedDrainWhen) {
-  // ---------------------------------------------------------------------------
-  // Configure services
-  TRACE_EVENT("workerd", "startServices");
-  // First pass: Extract actor namespace configs.
+void Server::collectActorConfigs(config::Config::Reader config) {
   for (auto serviceConf: config.getServices()) {
     kj::StringPtr name = serviceConf.getName();
     kj::HashMap<kj::String, ActorConfig> serviceActorConfigs;
@@ -3712,7 +4338,8 @@ void Server::startServices(jsg::V8System& v8System, config::Config::Reader confi
             serviceActorConfigs.insert(kj::str(ns.getClassName()),
                 Durable {
                     .uniqueKey = kj::str(ns.getUniqueKey()),
-                    .isEvictable = !ns.getPreventEviction() });
+                    .isEvictable = !ns.getPreventEviction(),
+                    .sqlitePageCacheLimit = ns.getSqlitePageCacheLimit() });
             continue;
           case config::Worker::DurableObjectNamespace::EPHEMERAL_LOCAL:
             if (!experimental) {
@@ -3759,6 +4386,44 @@ void Server::startServices(jsg::V8System& v8System, config::Config::Reader confi
       reportConfigError(kj::str("Config defines multiple services named \"", name, "\"."));
     });
   }
+}
+
+void Server::startServices(jsg::V8System& v8System, config::Config::Reader config,
+                           kj::HttpHeaderTable::Builder& headerTableBuilder,
+                           kj::ForkedPromise<void>& forkedDrainWhen) {
+  // ---------------------------------------------------------------------------
+  // Configure services
+  TRACE_EVENT("workerd", "startServices");
+  sqlitePageCachePool.setLimit(config.getSqlitePageCacheLimit());
+  sqlitePageCacheTask = sqlitePageCacheLoop().eagerlyEvaluate(nullptr);
+
+  // First pass: Extract actor namespace configs.
+  collectActorConfigs(config);
+
+  if (config.getThreads() > 1) {
+    for (auto& service: actorConfigs) {
+      if (service.value.size() > 0) {
+        reportConfigError(kj::str(
+            "Service \"", service.key, "\" defines Durable Object namespaces, which are not "
+            "supported when `threads` is greater than 1."));
+      }
+    }
+    for (auto serviceConf: config.getServices()) {
+      if (serviceConf.isQueue()) {
+        reportConfigError(kj::str(
+            "Service \"", serviceConf.getName(), "\" is a queue, which is not supported when "
+            "`threads` is greater than 1."));
+      } else if (serviceConf.isR2()) {
+        reportConfigError(kj::str(
+            "Service \"", serviceConf.getName(), "\" is an R2 bucket, which is not supported "
+            "when `threads` is greater than 1."));
+      } else if (serviceConf.isKv() && serviceConf.getKv().hasDisk()) {
+        reportConfigError(kj::str(
+            "Service \"", serviceConf.getName(), "\" is a KV namespace stored on disk, which is "
+            "not supported when `threads` is greater than 1."));
+      }
+    }
+  }
 
   // If we are using the inspector, we need to register the Worker::Isolate
   // with the inspector service.
@@ -3889,10 +4554,20 @@ kj::Promise<void> Server::listenOnSockets(config::Config::Reader config,
     KJ_IF_SOME(l, listenerOverride) {
       listener = kj::mv(l);
     } else {
-      listener = ([](kj::Promise<kj::Own<kj::NetworkAddress>> promise) -> PromisedReceived {
+      listener = ([](kj::Promise<kj::Own<kj::NetworkAddress>> promise,
+                     kj::Maybe<Replication> replication) -> PromisedReceived {
         auto parsed = co_await promise;
+        KJ_IF_SOME(r, replication) {
+          KJ_IF_SOME(receiver, listenReusePort(r.lowLevelProvider, *parsed)) {
+            co_return kj::mv(receiver);
+          } else if (!r.primary) {
+            // This address can't be shared between threads, so leave it to the primary.
+            co_await kj::Promise<void>(kj::NEVER_DONE);
+            KJ_UNREACHABLE;
+          }
+        }
         co_return parsed->listen();
-      })(network.parseAddress(addrStr, defaultPort));
+      })(network.parseAddress(addrStr, defaultPort), replication);
     }
 
     KJ_IF_SOME(t, tls) {
@@ -3967,6 +4642,33 @@ kj::Promise<void> Server::listenOnSockets(config::Config::Reader config,
   co_await kj::evalLast([]() {});
 }
 
+// =======================================================================================
+// Server::preload()
+
+void Server::preload(jsg::V8System& v8System, config::Config::Reader config) {
+  kj::HttpHeaderTable::Builder headerTableBuilder;
+  globalContext = kj::heap<GlobalContext>(*this, v8System, headerTableBuilder);
+  invalidConfigServiceSingleton = kj::heap<InvalidConfigService>();
+
+  collectActorConfigs(config);
+
+  // Only Workers are built, and nothing is linked, so no storage is opened and nothing is left
+  // running: all we want is the code they compiled.
+  for (auto serviceConf: config.getServices()) {
+    if (!serviceConf.isWorker()) continue;
+
+    kj::StringPtr name = serviceConf.getName();
+    auto service = makeWorker(name, serviceConf.getWorker(), config.getExtensions(),
+        [this](auto err) { return this->reportConfigError(kj::mv(err)); });
+
+    services.upsert(kj::str(name), kj::mv(service), [&](auto&&...) {
+      reportConfigError(kj::str("Config defines multiple services named \"", name, "\"."));
+    });
+  }
+
+  auto ownHeaderTable = headerTableBuilder.build();
+}
+
 // =======================================================================================
 // Server::test()
 
@@ -58,6 +58,14 @@ public:
     controlOverride = kj::heap<kj::FdOutputStream>(fd);
   }
 
+  // Marks this Server as one of several replicas serving the same config from different threads
+  // (see `Config.threads`). IP sockets will be bound with SO_REUSEPORT so that all replicas can
+  // listen on them. Sockets that can't be shared that way (Unix sockets) are only bound by the
+  // primary replica.
+  void enableReplication(kj::LowLevelAsyncIoProvider& lowLevelProvider, bool primary) {
+    replication = Replication { lowLevelProvider, primary };
+  }
+
   // Runs the server using the given config.
   kj::Promise<void> run(jsg::V8System& v8System, config::Config::Reader conf,
                         kj::Promise<void> drainWhen = kj::NEVER_DONE);
@@ -71,9 +79,14 @@ public:
                          kj::StringPtr servicePattern = "*"_kj,
                          kj::StringPtr entrypointPattern = "*"_kj);
 
+  // Constructs every Worker in the config, which compiles its code, without starting any other
+  // service. `workerd compile --code-cache` uses this to populate a code cache.
+  void preload(jsg::V8System& v8System, config::Config::Reader conf);
+
   struct Durable {
     kj::String uniqueKey;
     bool isEvictable;
+    uint64_t sqlitePageCacheLimit = 0;
   };
   struct Ephemeral {
     bool isEvictable;
@@ -107,6 +120,12 @@ private:
   kj::Maybe<kj::Own<InspectorServiceIsolateRegistrar>> inspectorIsolateRegistrar;
   kj::Maybe<kj::Own<kj::FdOutputStream>> controlOverride;
 
+  struct Replication {
+    kj::LowLevelAsyncIoProvider& lowLevelProvider;
+    bool primary;
+  };
+  kj::Maybe<Replication> replication;
+
   struct GlobalContext;
   // General context needed to construct workers. Initilaized early in run().
   kj::Own<GlobalContext> globalContext;
@@ -119,6 +138,13 @@ private:
   // correctly construct dependent services.
   kj::HashMap<kj::String, kj::HashMap<kj::String, ActorConfig>> actorConfigs;
 
+  // Shared by the SQLite databases of all Durable Objects stored on local disk. Declared before
+  // `services` so that it outlives them. The limit is set from the config in startServices().
+  SqliteDatabase::PageCachePool sqlitePageCachePool { 0 };
+
+  // Runs sqlitePageCacheLoop(). Declared after `sqlitePageCachePool` so that it is canceled first.
+  kj::Promise<void> sqlitePageCacheTask = nullptr;
+
   kj::HashMap<kj::String, kj::Own<Service>> services;
 
   kj::Own<kj::PromiseFulfiller<void>> fatalFulfiller;
@@ -156,6 +182,10 @@ private:
   // request in flight.
   kj::Promise<void> handleDrain(kj::Promise<void> drainWhen);
 
+  // Periodically calls `sqlitePageCachePool.update()`, which charges the pool for the page cache
+  // use of its databases, evicts pages if it is over its limit, and reports per-database stats.
+  kj::Promise<void> sqlitePageCacheLoop();
+
   kj::Own<kj::TlsContext> makeTlsContext(config::TlsOptions::Reader conf);
   kj::Promise<kj::Own<kj::NetworkAddress>> makeTlsNetworkAddress(
       config::TlsOptions::Reader conf, kj::StringPtr addrStr,
@@ -171,6 +201,18 @@ private:
   kj::Own<Service> makeDiskDirectoryService(
       kj::StringPtr name, config::DiskDirectory::Reader conf,
       kj::HttpHeaderTable::Builder& headerTableBuilder);
+  kj::Own<Service> makeCacheService(
+      kj::StringPtr name, config::CacheService::Reader conf,
+      kj::HttpHeaderTable::Builder& headerTableBuilder);
+  kj::Own<Service> makeKvStoreService(
+      kj::StringPtr name, config::KvStore::Reader conf,
+      kj::HttpHeaderTable::Builder& headerTableBuilder);
+  kj::Own<Service> makeQueueService(
+      kj::StringPtr name, config::QueueService::Reader conf,
+      kj::HttpHeaderTable::Builder& headerTableBuilder);
+  kj::Own<Service> makeR2BucketService(
+      kj::StringPtr name, config::R2Bucket::Reader conf,
+      kj::HttpHeaderTable::Builder& headerTableBuilder);
   kj::Own<Service> makeWorker(kj::StringPtr name, config::Worker::Reader conf,
       capnp::List<config::Extension>::Reader extensions,
       kj::Function<void(kj::String)> reportConfigError,
@@ -186,6 +228,12 @@ private:
   // Can only be called in the link stage.
   Service& lookupService(config::ServiceDesignator::Reader designator, kj::String errorContext);
 
+  // Can only be called in the link stage. Looks up the disk service that `what` (e.g.
+  // `KV store "foo"`) uses for storage and returns its directory. Reports a config error and
+  // returns none if the service isn't a writable local disk service.
+  kj::Maybe<const kj::Directory&> resolveWritableDisk(
+      config::ServiceDesignator::Reader designator, kj::StringPtr what);
+
   kj::Promise<void> listenHttp(kj::Own<kj::ConnectionReceiver> listener, Service& service,
                                kj::StringPtr physicalProtocol, kj::Own<HttpRewriter> rewriter);
 
@@ -194,11 +242,19 @@ private:
   class ExternalTcpService;
   class NetworkService;
   class DiskDirectoryService;
+  class HttpOnlyService;
+  class CacheService;
+  class KvStoreService;
+  class QueueService;
+  class R2BucketService;
   class WorkerService;
   class WorkerEntrypointService;
   class HttpListener;
   class WorkerdApiService;
 
+  // Fills in `actorConfigs` from the Durable Object namespaces of every Worker in the config.
+  void collectActorConfigs(config::Config::Reader config);
+
   void startServices(jsg::V8System& v8System, config::Config::Reader config,
                      kj::HttpHeaderTable::Builder& headerTableBuilder,
                      kj::ForkedPromise<void>& forkedDrainWhen);
@@ -0,0 +1,79 @@
+// Copyright (c) 2017-2022 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+#pragma once
+// Scaffolding shared by the tests of the services that back local storage bindings (HttpCache,
+// KvStore, QueueBroker and R2Store). Each of them is a kj::HttpService, reached by Workers
+// through an HttpClient.
+
+#include <kj/async.h>
+#include <kj/compat/http.h>
+#include <kj/filesystem.h>
+#include <kj/time.h>
+#include <workerd/util/sqlite.h>
+
+namespace workerd::server {
+
+class FakeClock final: public kj::Clock {
+public:
+  kj::Date now() const override { return time; }
+
+  kj::Date time = kj::UNIX_EPOCH + 1'000'000 * kj::SECONDS;
+};
+
+struct TestResponse {
+  uint statusCode;
+  kj::HttpHeaders headers;
+  kj::String body;
+};
+
+// Drives a `Service` through an HttpClient, the way a Worker's binding reaches it. Subclasses
+// build the service in `restart()`, registering the headers they use.
+template <typename Service>
+struct StorageServiceTest {
+  kj::EventLoop loop;
+  kj::WaitScope waitScope { loop };
+  FakeClock clock;
+  kj::Own<kj::Directory> dir = kj::newInMemoryDirectory(kj::nullClock());
+  kj::Own<SqliteDatabase::Vfs> vfs = kj::heap<SqliteDatabase::Vfs>(*dir);
+  kj::Own<Service> service;
+  kj::Own<kj::HttpHeaderTable> headerTable;
+  kj::Own<kj::HttpClient> client;
+
+  // Replaces the service with the one `makeService(builder)` returns, over the same `dir`, as
+  // after a restart.
+  template <typename MakeService>
+  void restart(MakeService&& makeService) {
+    client = nullptr;
+    service = nullptr;
+    kj::HttpHeaderTable::Builder builder;
+    service = makeService(builder);
+    headerTable = builder.build();
+    client = kj::newHttpClient(*headerTable, *service);
+  }
+
+  TestResponse request(kj::HttpMethod method, kj::StringPtr url, const kj::HttpHeaders& headers,
+                       kj::ArrayPtr<const kj::byte> body = nullptr) {
+    auto req = client->request(method, url, headers, uint64_t(body.size()));
+
+    // The service may respond without reading the body, e.g. if it's too large, so don't wait for
+    // the write to finish before waiting for the response.
+    auto write = req.body->write(body.begin(), body.size()).attach(kj::mv(req.body))
+        .catch_([](kj::Exception&&) {}).eagerlyEvaluate(nullptr);
+    auto resp = req.response.wait(waitScope);
+    auto text = resp.body->readAllText().wait(waitScope);
+    return {
+      .statusCode = resp.statusCode,
+      .headers = resp.headers->clone(),
+      .body = kj::mv(text),
+    };
+  }
+
+  TestResponse request(kj::HttpMethod method, kj::StringPtr url,
+                       kj::ArrayPtr<const kj::byte> body = nullptr) {
+    return request(method, url, kj::HttpHeaders(*headerTable), body);
+  }
+};
+
+}  // namespace workerd::server
@@ -7,6 +7,8 @@
 #include <kj/filesystem.h>
 #include <kj/map.h>
 #include <kj/async-queue.h>
+#include <kj/mutex.h>
+#include <kj/thread.h>
 #include <capnp/message.h>
 #include <capnp/serialize.h>
 #include <capnp/schema-parser.h>
@@ -17,6 +19,7 @@
 #include <fcntl.h>
 #include <sys/stat.h>
 #include "server.h"
+#include "code-cache.h"
 #include <workerd/jsg/setup.h>
 #include <openssl/rand.h>
 #include <workerd/io/compatibility-date.capnp.h>
@@ -729,7 +732,13 @@ public:
         .addOption({'w', "watch"}, CLI_METHOD(watch),
                    "Watch configuration files (and server binary) and reload if they change. "
                    "Useful for development, but not recommended in production.")
-        .addOption({"experimental"}, [this]() { server.allowExperimental(); return true; },
+        .addOption({"experimental"}, [this]() {
+                     server.allowExperimental();
+                     replicaOverrides.add([](Server& replica, kj::LowLevelAsyncIoProvider&) {
+                       replica.allowExperimental();
+                     });
+                     return true;
+                   },
                    "Permit the use of experimental features which may break backwards "
                    "compatibility in a future release.");
   }
@@ -819,6 +828,11 @@ public:
           "Only write the encoded binary config to stdout. Do not attach it to an executable. "
           "The encoded config can be used as input to the \"serve\" command, without the need "
           "for any other files to be present.")
+        .addOption({"code-cache"}, [this]() { embedCodeCache = true; return true; },
+          "Compile every Worker in the config ahead of time and embed the resulting V8 code "
+          "cache in the output, so that the server can start without compiling any Worker code. "
+          "Top-level code is still evaluated at startup. The embedded cache replaces the "
+          "config's `compileCache` setting.")
         .callAfterParsing(CLI_METHOD(compile))
         .build();
   }
@@ -850,6 +864,10 @@ public:
 
   void overrideSocketAddr(kj::StringPtr param) {
     auto [ name, value ] = parseOverride(param);
+    replicaOverrides.add([name = kj::str(name), value = kj::str(value)]
+                         (Server& replica, kj::LowLevelAsyncIoProvider&) {
+      replica.overrideSocket(kj::str(name), kj::str(value));
+    });
     server.overrideSocket(kj::mv(name), kj::str(value));
   }
 
@@ -906,17 +924,35 @@ public:
     validateSocketFd(fd, name);
 
     inheritedFds.add(fd);
+#if !_WIN32
+    // Replicas accept connections on a duplicate of the same listen socket.
+    replicaOverrides.add([name = kj::str(name), fd]
+                         (Server& replica, kj::LowLevelAsyncIoProvider& lowLevelProvider) {
+      int dupFd;
+      KJ_SYSCALL(dupFd = dup(fd));
+      replica.overrideSocket(kj::str(name), lowLevelProvider.wrapListenSocketFd(
+          dupFd, kj::LowLevelAsyncIoProvider::TAKE_OWNERSHIP));
+    });
+#endif
     server.overrideSocket(kj::mv(name), io.lowLevelProvider->wrapListenSocketFd(
         fd, kj::LowLevelAsyncIoProvider::TAKE_OWNERSHIP));
   }
 
   void overrideDirectory(kj::StringPtr param) {
     auto [ name, value ] = parseOverride(param);
+    replicaOverrides.add([name = kj::str(name), value = kj::str(value)]
+                         (Server& replica, kj::LowLevelAsyncIoProvider&) {
+      replica.overrideDirectory(kj::str(name), kj::str(value));
+    });
     server.overrideDirectory(kj::mv(name), kj::str(value));
   }
 
   void overrideExternal(kj::StringPtr param) {
     auto [ name, value ] = parseOverride(param);
+    replicaOverrides.add([name = kj::str(name), value = kj::str(value)]
+                         (Server& replica, kj::LowLevelAsyncIoProvider&) {
+      replica.overrideExternal(kj::str(name), kj::str(value));
+    });
     server.overrideExternal(kj::mv(name), kj::str(value));
   }
 
@@ -1096,6 +1132,44 @@ public:
 
     config::Config::Reader config = getConfig();
 
+    // With --code-cache, this holds the V8 instance which compiled the config's Workers. It must
+    // outlive the server's isolates, so we exit without running destructors below.
+    struct CompileV8 {
+      kj::Own<v8::Platform> platform = jsg::defaultPlatform(0);
+      WorkerdPlatform v8Platform { *platform };
+      jsg::V8System v8System;
+
+      explicit CompileV8(kj::ArrayPtr<const kj::StringPtr> flags)
+          : v8System(v8Platform, flags) {}
+    };
+    kj::Maybe<kj::Own<CompileV8>> compileV8;
+    capnp::MallocMessageBuilder codeCacheConfig;
+    if (embedCodeCache) {
+      auto& v8System = compileV8.emplace(kj::heap<CompileV8>(
+          KJ_MAP(flag, config.getV8Flags()) -> kj::StringPtr { return flag; }))->v8System;
+      auto ownCache = kj::heap<CodeCacheImpl>();
+      auto& cache = *ownCache;
+      v8System.setCodeCache(kj::mv(ownCache));
+
+      server.preload(v8System, config);
+      if (hadErrors) {
+        context.exit();
+      }
+
+      codeCacheConfig.setRoot(config);
+      auto root = codeCacheConfig.getRoot<config::Config>();
+      size_t count = 0;
+      cache.forEachEntry([&](kj::StringPtr, kj::ArrayPtr<const kj::byte>) { ++count; });
+      auto entries = root.initCompileCache().initEmbedded(count);
+      size_t i = 0;
+      cache.forEachEntry([&](kj::StringPtr key, kj::ArrayPtr<const kj::byte> data) {
+        auto entry = entries[i++];
+        entry.setKey(key);
+        entry.setData(data);
+      });
+      config = root.asReader();
+    }
+
 #if _WIN32
     if (_isatty(_fileno(stdout))) {
 #else
@@ -1180,6 +1254,10 @@ public:
       }
 #endif
     }
+
+    if (embedCodeCache) {
+      context.exit();
+    }
   }
 
   template <typename Func>
@@ -1211,6 +1289,7 @@ public:
       WorkerdPlatform v8Platform(*platform);
       jsg::V8System v8System(v8Platform,
           KJ_MAP(flag, config.getV8Flags()) -> kj::StringPtr { return flag; });
+      installCodeCache(v8System, config.getCompileCache());
       auto promise = func(v8System, config);
       KJ_IF_SOME(w, watcher) {
         promise = promise.exclusiveJoin(waitForChanges(w).then([this]() {
@@ -1229,6 +1308,40 @@ public:
     }
   }
 
+  void installCodeCache(jsg::V8System& v8System, config::CompileCache::Reader conf) {
+    switch (conf.which()) {
+      case config::CompileCache::DISABLED:
+        return;
+      case config::CompileCache::IN_MEMORY:
+        v8System.setCodeCache(kj::heap<CodeCacheImpl>());
+        return;
+      case config::CompileCache::EMBEDDED: {
+        auto cache = kj::heap<CodeCacheImpl>();
+        for (auto entry: conf.getEmbedded()) {
+          // The config outlives the cache, so the data needn't be copied.
+          auto data = entry.getData();
+          cache->addEntry(kj::str(entry.getKey()), kj::Array<const kj::byte>(
+              data.begin(), data.size(), kj::NullArrayDisposer::instance));
+        }
+        v8System.setCodeCache(kj::mv(cache));
+        return;
+      }
+      case config::CompileCache::DIRECTORY: {
+        auto path = fs->getCurrentPath().evalNative(conf.getDirectory());
+        KJ_IF_SOME(dir, fs->getRoot().tryOpenSubdir(path, kj::WriteMode::MODIFY)) {
+          v8System.setCodeCache(kj::heap<CodeCacheImpl>(kj::mv(dir)));
+        } else {
+          context.exitError(kj::str(
+              "Compile cache directory does not exist: ", conf.getDirectory()));
+        }
+        return;
+      }
+    }
+    context.exitError(
+        "Encountered unknown compileCache type. Was the config compiled with a newer version of "
+        "the schema?");
+  }
+
   void measure() {
     if (hadErrors) context.exit();
     auto measurement = workerd::server::measureConfig(
@@ -1244,16 +1357,69 @@ public:
 
   [[noreturn]] void serve() noexcept {
     serveImpl([&](jsg::V8System& v8System, config::Config::Reader config) {
+      kj::Vector<kj::Promise<void>> replicasDone;
+      if (config.getThreads() > 1) {
+        server.enableReplication(*io.lowLevelProvider, true);
+        for (uint i = 1; i < config.getThreads(); i++) {
+          auto paf = kj::newPromiseAndCrossThreadFulfiller<void>();
+          replicasDone.add(kj::mv(paf.promise));
+          kj::Thread([this, &v8System, config, fulfiller = kj::mv(paf.fulfiller)]() mutable {
+            runReplica(v8System, config);
+            fulfiller->fulfill();
+          }).detach();
+        }
+      }
+
+      // The primary finishing its own drain doesn't mean the replicas have finished theirs, and
+      // they use `v8System`, so wait for all of them before returning.
+      auto joinReplicas = [replicasDone = kj::mv(replicasDone)]() mutable {
+        return kj::joinPromises(replicasDone.releaseAsArray());
+      };
+
 #if _WIN32
-      return server.run(v8System, config);
+      return server.run(v8System, config).then(kj::mv(joinReplicas));
 #else
       return server.run(v8System, config,
           // Gracefully drain when SIGTERM is received.
-          io.unixEventPort.onSignal(SIGTERM).ignoreResult());
+          io.unixEventPort.onSignal(SIGTERM).ignoreResult().then([this]() {
+        // Replicas don't see the signal themselves, so pass it on.
+        auto lock = replicaDrain.lockExclusive();
+        lock->draining = true;
+        for (auto& fulfiller: lock->fulfillers) {
+          fulfiller->fulfill();
+        }
+      })).then(kj::mv(joinReplicas));
 #endif
     });
   }
 
+  // Runs an additional replica of the server on the calling thread, with its own event loop and
+  // isolates (see `Config.threads`). Like serveImpl(), any failure here is fatal.
+  void runReplica(jsg::V8System& v8System, config::Config::Reader config) noexcept {
+    auto replicaIo = kj::setupAsyncIo();
+    NetworkWithLoopback replicaNetwork { replicaIo.provider->getNetwork(), *replicaIo.provider };
+    auto replicaFs = kj::newDiskFilesystem();
+    EntropySourceImpl replicaEntropySource;
+
+    // The primary server loads the same config and reports any errors in it, so the replicas
+    // don't need to repeat them.
+    Server replica(*replicaFs, replicaIo.provider->getTimer(), replicaNetwork,
+        replicaEntropySource, Worker::ConsoleMode::STDOUT, [](kj::String) {});
+    for (auto& override: replicaOverrides) {
+      override(replica, *replicaIo.lowLevelProvider);
+    }
+    replica.enableReplication(*replicaIo.lowLevelProvider, false);
+
+    auto paf = kj::newPromiseAndCrossThreadFulfiller<void>();
+    {
+      auto lock = replicaDrain.lockExclusive();
+      if (lock->draining) paf.fulfiller->fulfill();
+      lock->fulfillers.add(kj::mv(paf.fulfiller));
+    }
+
+    replica.run(v8System, config, kj::mv(paf.promise)).wait(replicaIo.waitScope);
+  }
+
   [[noreturn]] void test() noexcept {
     // Always turn on info logging when running tests so that uncaught exceptions are displayed.
     // TODO(beta): This can be removed once we improve our error logging story.
@@ -1321,6 +1487,7 @@ private:
 
   bool binaryConfig = false;
   bool configOnly = false;
+  bool embedCodeCache = false;
   kj::Maybe<FileWatcher> watcher;
 
   kj::Own<kj::Filesystem> fs = kj::newDiskFilesystem();
@@ -1339,6 +1506,17 @@ private:
 
   kj::Vector<int> inheritedFds;
 
+  // Overrides from the command line which must also be applied to replica Servers when
+  // `Config.threads` is greater than 1. Each replica runs them on its own thread, so they must
+  // not mutate any captured state.
+  kj::Vector<kj::Function<void(Server&, kj::LowLevelAsyncIoProvider&)>> replicaOverrides;
+
+  struct ReplicaDrain {
+    bool draining = false;
+    kj::Vector<kj::Own<kj::CrossThreadPromiseFulfiller<void>>> fulfillers;
+  };
+  kj::MutexGuarded<ReplicaDrain> replicaDrain;
+
   kj::Maybe<kj::String> testServicePattern;
   kj::Maybe<kj::String> testEntrypointPattern;
 
@@ -0,0 +1,88 @@
+// Copyright (c) 2023 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+#include <workerd/tests/bench-tools.h>
+#include <workerd/util/base64.h>
+#include <kj/encoding.h>
+
+namespace workerd {
+namespace {
+
+kj::Array<kj::byte> makeBytes(size_t size) {
+  auto bytes = kj::heapArray<kj::byte>(size);
+  for (auto i: kj::indices(bytes)) bytes[i] = i * 37 + 11;
+  return bytes;
+}
+
+static void Base64_EncodeKj(benchmark::State& state) {
+  auto bytes = makeBytes(state.range(0));
+  for (auto _: state) {
+    benchmark::DoNotOptimize(kj::encodeBase64(bytes));
+  }
+  state.SetBytesProcessed(int64_t(state.iterations()) * bytes.size());
+}
+
+static void Base64_Encode(benchmark::State& state) {
+  auto bytes = makeBytes(state.range(0));
+  auto text = kj::heapArray<kj::byte>(base64EncodedSize(bytes.size()));
+  for (auto _: state) {
+    benchmark::DoNotOptimize(encodeBase64Into(bytes, text));
+  }
+  state.SetBytesProcessed(int64_t(state.iterations()) * bytes.size());
+}
+
+static void Base64_DecodeKj(benchmark::State& state) {
+  auto text = kj::encodeBase64(makeBytes(state.range(0)));
+  for (auto _: state) {
+    benchmark::DoNotOptimize(kj::decodeBase64(text));
+  }
+  state.SetBytesProcessed(int64_t(state.iterations()) * text.size());
+}
+
+static void Base64_Decode(benchmark::State& state) {
+  auto text = kj::encodeBase64(makeBytes(state.range(0)));
+  auto bytes = kj::heapArray<kj::byte>(state.range(0));
+  for (auto _: state) {
+    benchmark::DoNotOptimize(decodeBase64Prefix(text.asBytes(), bytes));
+  }
+  state.SetBytesProcessed(int64_t(state.iterations()) * text.size());
+}
+
+static void Hex_EncodeKj(benchmark::State& state) {
+  auto bytes = makeBytes(state.range(0));
+  for (auto _: state) {
+    benchmark::DoNotOptimize(kj::encodeHex(bytes));
+  }
+  state.SetBytesProcessed(int64_t(state.iterations()) * bytes.size());
+}
+
+static void Hex_Encode(benchmark::State& state) {
+  auto bytes = makeBytes(state.range(0));
+  auto text = kj::heapArray<kj::byte>(bytes.size() * 2);
+  for (auto _: state) {
+    benchmark::DoNotOptimize(encodeHexInto(bytes, text));
+  }
+  state.SetBytesProcessed(int64_t(state.iterations()) * bytes.size());
+}
+
+static void Hex_Decode(benchmark::State& state) {
+  auto text = kj::encodeHex(makeBytes(state.range(0)));
+  auto bytes = kj::heapArray<kj::byte>(state.range(0));
+  for (auto _: state) {
+    benchmark::DoNotOptimize(decodeHexPrefix(text.asBytes(), bytes));
+  }
+  state.SetBytesProcessed(int64_t(state.iterations()) * text.size());
+}
+
+// A JWT signature, and a 64 KiB body.
+WD_BENCHMARK(Base64_EncodeKj)->Arg(256)->Arg(64 * 1024);
+WD_BENCHMARK(Base64_Encode)->Arg(256)->Arg(64 * 1024);
+WD_BENCHMARK(Base64_DecodeKj)->Arg(256)->Arg(64 * 1024);
+WD_BENCHMARK(Base64_Decode)->Arg(256)->Arg(64 * 1024);
+WD_BENCHMARK(Hex_EncodeKj)->Arg(32)->Arg(64 * 1024);
+WD_BENCHMARK(Hex_Encode)->Arg(32)->Arg(64 * 1024);
+WD_BENCHMARK(Hex_Decode)->Arg(32)->Arg(64 * 1024);
+
+}  // namespace
+}  // namespace workerd
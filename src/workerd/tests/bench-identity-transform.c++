@@ -0,0 +1,57 @@
+// Copyright (c) 2023 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+#include <workerd/tests/bench-tools.h>
+#include <workerd/api/streams/internal.h>
+
+namespace workerd {
+namespace {
+
+constexpr size_t TOTAL_BYTES = 1024 * 1024;
+
+kj::Promise<void> writeAll(api::IdentityTransformStreamImpl& stream,
+                           kj::ArrayPtr<const kj::byte> chunk) {
+  for (size_t i = 0; i < TOTAL_BYTES / chunk.size(); i++) {
+    co_await stream.write(chunk.begin(), chunk.size());
+  }
+  co_await stream.end();
+}
+
+// Pushes 1 MiB through an identity transform in writes of `range(0)` bytes, while a reader drains
+// it with reads for at least `range(1)` bytes, as when a Worker proxies a TransformStream fed with
+// many small chunks.
+void IdentityTransformSmallWrites(benchmark::State& state) {
+  kj::EventLoop loop;
+  kj::WaitScope waitScope(loop);
+
+  auto chunk = kj::heapArray<kj::byte>(state.range(0));
+  memset(chunk.begin(), 'x', chunk.size());
+  auto buffer = kj::heapArray<kj::byte>(64 * 1024);
+  size_t minBytes = state.range(1);
+
+  for (auto _: state) {
+    auto stream = kj::refcounted<api::IdentityTransformStreamImpl>();
+    auto writer = writeAll(*stream, chunk);
+
+    size_t total = 0;
+    for (;;) {
+      auto amount = stream->tryRead(buffer.begin(), minBytes, buffer.size()).wait(waitScope);
+      if (amount == 0) break;
+      total += amount;
+    }
+    writer.wait(waitScope);
+    KJ_ASSERT(total == TOTAL_BYTES);
+  }
+
+  state.SetBytesProcessed(int64_t(state.iterations()) * TOTAL_BYTES);
+}
+
+WD_BENCHMARK(IdentityTransformSmallWrites)
+    ->Args({16, 1})
+    ->Args({16, 16 * 1024})
+    ->Args({256, 1})
+    ->Args({256, 16 * 1024});
+
+}  // namespace
+}  // namespace workerd
@@ -0,0 +1,73 @@
+// Copyright (c) 2023 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+#include <workerd/tests/bench-tools.h>
+#include <workerd/util/utf8.h>
+#include <algorithm>
+
+namespace workerd {
+namespace {
+
+constexpr size_t TEXT_SIZE = 64 * 1024;
+
+kj::Array<kj::byte> makeText(kj::StringPtr pattern) {
+  auto text = kj::heapArray<kj::byte>(TEXT_SIZE / pattern.size() * pattern.size());
+  for (size_t i = 0; i < text.size(); i += pattern.size()) {
+    memcpy(text.begin() + i, pattern.begin(), pattern.size());
+  }
+  return text;
+}
+
+// The byte-at-a-time check TextDecoder used before.
+static void Utf8_AsciiScalar(benchmark::State& state) {
+  auto text = makeText("The quick brown fox jumps over the lazy dog. ");
+  for (auto _: state) {
+    bool result = std::all_of(text.begin(), text.end(), [](kj::byte b) { return b < 0x80; });
+    benchmark::DoNotOptimize(result);
+  }
+  state.SetBytesProcessed(int64_t(state.iterations()) * text.size());
+}
+
+static void Utf8_Ascii(benchmark::State& state) {
+  auto text = makeText("The quick brown fox jumps over the lazy dog. ");
+  for (auto _: state) {
+    benchmark::DoNotOptimize(isAscii(text));
+  }
+  state.SetBytesProcessed(int64_t(state.iterations()) * text.size());
+}
+
+static void Utf8_ValidateAscii(benchmark::State& state) {
+  auto text = makeText("The quick brown fox jumps over the lazy dog. ");
+  for (auto _: state) {
+    benchmark::DoNotOptimize(isValidUtf8(text));
+  }
+  state.SetBytesProcessed(int64_t(state.iterations()) * text.size());
+}
+
+// Mostly ASCII with the odd accented letter or symbol, like most European-language text.
+static void Utf8_ValidateMixed(benchmark::State& state) {
+  auto text = makeText("Le c\xc5\x93ur a ses raisons que la raison ne conna\xc3\xaet point \xe2\x80\x94 ");
+  for (auto _: state) {
+    benchmark::DoNotOptimize(isValidUtf8(text));
+  }
+  state.SetBytesProcessed(int64_t(state.iterations()) * text.size());
+}
+
+// Entirely multi-byte sequences, as in CJK text.
+static void Utf8_ValidateCjk(benchmark::State& state) {
+  auto text = makeText("\xe6\x97\xa5\xe6\x9c\xac\xe8\xaa\x9e\xe3\x81\xae\xe6\x96\x87\xe7\xab\xa0");
+  for (auto _: state) {
+    benchmark::DoNotOptimize(isValidUtf8(text));
+  }
+  state.SetBytesProcessed(int64_t(state.iterations()) * text.size());
+}
+
+WD_BENCHMARK(Utf8_AsciiScalar);
+WD_BENCHMARK(Utf8_Ascii);
+WD_BENCHMARK(Utf8_ValidateAscii);
+WD_BENCHMARK(Utf8_ValidateMixed);
+WD_BENCHMARK(Utf8_ValidateCjk);
+
+}  // namespace
+}  // namespace workerd
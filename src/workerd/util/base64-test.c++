@@ -0,0 +1,100 @@
+// Copyright (c) 2017-2022 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+#include "base64.h"
+#include <kj/encoding.h>
+#include <kj/test.h>
+
+namespace workerd {
+namespace {
+
+kj::String encode(kj::ArrayPtr<const kj::byte> bytes,
+                  Base64Alphabet alphabet = Base64Alphabet::STANDARD) {
+  auto text = kj::heapArray<char>(base64EncodedSize(bytes.size(), alphabet) + 1);
+  auto size = encodeBase64Into(bytes, text.asBytes(), alphabet);
+  KJ_EXPECT(size == text.size() - 1);
+  text.back() = '\0';
+  return kj::String(kj::mv(text));
+}
+
+kj::Array<kj::byte> makeBytes(size_t size) {
+  auto bytes = kj::heapArray<kj::byte>(size);
+  for (auto i: kj::indices(bytes)) bytes[i] = i * 37 + 11;
+  return bytes;
+}
+
+KJ_TEST("encodeBase64Into") {
+  KJ_EXPECT(encode(nullptr) == "");
+  KJ_EXPECT(encode("f"_kj.asBytes()) == "Zg==");
+  KJ_EXPECT(encode("fo"_kj.asBytes()) == "Zm8=");
+  KJ_EXPECT(encode("foo"_kj.asBytes()) == "Zm9v");
+  KJ_EXPECT(encode("f"_kj.asBytes(), Base64Alphabet::URL) == "Zg");
+  KJ_EXPECT(encode("fo"_kj.asBytes(), Base64Alphabet::URL) == "Zm8");
+
+  // Long enough to go through the vector loop, with every length of tail after it.
+  for (size_t size = 0; size < 100; size++) {
+    auto bytes = makeBytes(size);
+    KJ_EXPECT(encode(bytes) == kj::encodeBase64(bytes), size);
+    KJ_EXPECT(encode(bytes, Base64Alphabet::URL) == kj::encodeBase64Url(bytes), size);
+  }
+}
+
+KJ_TEST("decodeBase64Prefix") {
+  auto bytes = makeBytes(96);
+  auto text = kj::encodeBase64(bytes);
+  auto out = kj::heapArray<kj::byte>(bytes.size());
+
+  auto progress = decodeBase64Prefix(text.asBytes(), out);
+  KJ_EXPECT(progress.consumed == text.size());
+  KJ_EXPECT(progress.written == bytes.size());
+  KJ_EXPECT(out == bytes);
+
+  // Stops at the group holding anything outside the alphabet.
+  for (size_t i: {0, 5, 17, 70, 127}) {
+    auto copy = kj::heapString(text);
+    copy[i] = ' ';
+    progress = decodeBase64Prefix(copy.asBytes(), out);
+    KJ_EXPECT(progress.consumed == i / 4 * 4, i);
+    KJ_EXPECT(progress.written == i / 4 * 3, i);
+    KJ_EXPECT(out.first(progress.written) == bytes.first(progress.written), i);
+  }
+
+  // Padding ends the prefix, as does the other alphabet.
+  progress = decodeBase64Prefix("Zm9vZg=="_kj.asBytes(), out);
+  KJ_EXPECT(progress.consumed == 4);
+  KJ_EXPECT(decodeBase64Prefix("Zm9v-_-_"_kj.asBytes(), out).consumed == 4);
+  KJ_EXPECT(decodeBase64Prefix("Zm9v-_-_"_kj.asBytes(), out, Base64Alphabet::URL).consumed == 8);
+  KJ_EXPECT(decodeBase64Prefix("Zm9v+/+/"_kj.asBytes(), out, Base64Alphabet::URL).consumed == 4);
+
+  // Stops when the output is full.
+  progress = decodeBase64Prefix(text.asBytes(), out.first(20));
+  KJ_EXPECT(progress.consumed == 24);
+  KJ_EXPECT(progress.written == 18);
+}
+
+KJ_TEST("hex") {
+  for (size_t size = 0; size < 100; size++) {
+    auto bytes = makeBytes(size);
+    auto text = kj::heapArray<kj::byte>(size * 2);
+    KJ_EXPECT(encodeHexInto(bytes, text) == text.size());
+    KJ_EXPECT(kj::str(text.asChars()) == kj::encodeHex(bytes), size);
+
+    auto out = kj::heapArray<kj::byte>(size);
+    KJ_EXPECT(decodeHexPrefix(text, out) == size);
+    KJ_EXPECT(out == bytes);
+  }
+
+  auto out = kj::heapArray<kj::byte>(32);
+  KJ_EXPECT(decodeHexPrefix("0aFf"_kj.asBytes(), out) == 2);
+  KJ_EXPECT(out[0] == 0x0a && out[1] == 0xff);
+
+  // Stops at the first pair that isn't hex, or a trailing odd digit.
+  auto text = kj::str(kj::encodeHex(makeBytes(20)), "zz00");
+  KJ_EXPECT(decodeHexPrefix(text.asBytes(), out) == 20);
+  KJ_EXPECT(decodeHexPrefix("abc"_kj.asBytes(), out) == 1);
+  KJ_EXPECT(decodeHexPrefix("0g"_kj.asBytes(), out) == 0);
+}
+
+}  // namespace
+}  // namespace workerd
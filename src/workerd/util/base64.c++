@@ -0,0 +1,303 @@
+// Copyright (c) 2017-2022 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+#include "base64.h"
+
+#if defined(__x86_64__)
+#include <emmintrin.h>
+#include <tmmintrin.h>
+#endif
+
+namespace workerd {
+namespace {
+
+constexpr char STANDARD_CHARS[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+constexpr char URL_CHARS[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
+constexpr char HEX_DIGITS[] = "0123456789abcdef";
+
+struct DecodeTable {
+  // The value of each character, or -1 for those that aren't digits.
+  int8_t values[256];
+};
+
+template <size_t size>
+constexpr DecodeTable makeDecodeTable(const char (&digits)[size]) {
+  DecodeTable table {};
+  for (auto& value: table.values) value = -1;
+  for (size_t i = 0; i < size - 1; i++) {
+    table.values[static_cast<kj::byte>(digits[i])] = i;
+  }
+  return table;
+}
+
+constexpr DecodeTable STANDARD_VALUES = makeDecodeTable(STANDARD_CHARS);
+constexpr DecodeTable URL_VALUES = makeDecodeTable(URL_CHARS);
+
+constexpr DecodeTable makeHexDecodeTable() {
+  DecodeTable table = makeDecodeTable(HEX_DIGITS);
+  for (char c = 'A'; c <= 'F'; c++) table.values[static_cast<kj::byte>(c)] = c - 'A' + 10;
+  return table;
+}
+
+constexpr DecodeTable HEX_VALUES = makeHexDecodeTable();
+
+#if defined(__x86_64__)
+
+// SSE2 is part of x86-64, but SSSE3 (for PSHUFB, which the base64 kernels are built around) is
+// not, so those are compiled for it separately and only called when the CPU turns out to have it.
+#if defined(__SSSE3__)
+#define WD_TARGET_SSSE3
+bool hasSsse3() { return true; }
+#elif defined(_WIN32)
+#define WD_TARGET_SSSE3 __attribute__((target("ssse3")))
+bool hasSsse3() { return false; }
+#else
+#define WD_TARGET_SSSE3 __attribute__((target("ssse3")))
+bool hasSsse3() {
+  static const bool result = __builtin_cpu_supports("ssse3");
+  return result;
+}
+#endif
+
+// Encodes 12 bytes at a time, as long as 16 can be loaded, and returns how many were encoded.
+//
+// This follows Wojciech Muła's "Base64 encoding with SIMD instructions": the input is shuffled so
+// that each 32-bit lane holds one group of three bytes, multiplies stand in for the per-lane
+// variable shifts SSE lacks to split the group into four 6-bit values, and each value is mapped to
+// its character by adding an offset looked up by which range of the alphabet it falls in.
+WD_TARGET_SSSE3 size_t encodeBase64Ssse3(
+    const kj::byte* in, size_t size, kj::byte* out, Base64Alphabet alphabet) {
+  const __m128i shuffle = _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1);
+  const __m128i offsets = alphabet == Base64Alphabet::STANDARD
+      ? _mm_setr_epi8('A', 'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                      '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 0, 0)
+      : _mm_setr_epi8('A', 'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                      '0' - 52, '0' - 52, '0' - 52, '0' - 52, '-' - 62, '_' - 63, 0, 0);
+
+  size_t i = 0;
+  for (; size - i >= 16; i += 12, out += 16) {
+    __m128i groups = _mm_shuffle_epi8(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i)), shuffle);
+    __m128i high = _mm_mulhi_epu16(_mm_and_si128(groups, _mm_set1_epi32(0x0fc0fc00)),
+                                   _mm_set1_epi32(0x04000040));
+    __m128i low = _mm_mullo_epi16(_mm_and_si128(groups, _mm_set1_epi32(0x003f03f0)),
+                                  _mm_set1_epi32(0x01000010));
+    __m128i values = _mm_or_si128(high, low);
+
+    // 0 for values below 26, 1 for those below 52, and 2 to 13 for the rest.
+    __m128i ranges = _mm_subs_epu8(values, _mm_set1_epi8(51));
+    ranges = _mm_sub_epi8(ranges, _mm_cmpgt_epi8(values, _mm_set1_epi8(25)));
+
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out),
+                     _mm_add_epi8(values, _mm_shuffle_epi8(offsets, ranges)));
+  }
+  return i;
+}
+
+// Decodes 16 characters at a time, as long as there's room to store 16 bytes, until it meets a
+// character outside the alphabet.
+//
+// This follows Muła's "Base64 decoding with SIMD instructions": a character is in the alphabet
+// exactly when the sets of bits looked up by its high and low nibbles are disjoint, and its value
+// is found by adding an offset looked up by its high nibble, corrected for the one character whose
+// offset differs from the rest of its column.
+WD_TARGET_SSSE3 Base64DecodeProgress decodeBase64Ssse3(
+    const kj::byte* in, size_t size, kj::byte* out, size_t outSize, Base64Alphabet alphabet) {
+  bool url = alphabet == Base64Alphabet::URL;
+  // Bit 0x10 rules out every high nibble but 2 to 7. The URL alphabet has "_" in column 5, but
+  // nothing in column 7 past "z", so that column gets a bit of its own.
+  const __m128i highBits = url
+      ? _mm_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x20,
+                      0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10)
+      : _mm_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+                      0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+  const __m128i lowBits = url
+      ? _mm_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+                      0x11, 0x11, 0x13, 0x3b, 0x3b, 0x3a, 0x3b, 0x33)
+      : _mm_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+                      0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a);
+  const __m128i offsets = _mm_setr_epi8(0, 0, url ? 62 - '-' : 62 - '+', 52 - '0',
+                                        -'A', -'A', 26 - 'a', 26 - 'a', 0, 0, 0, 0, 0, 0, 0, 0);
+  const __m128i oddOne = _mm_set1_epi8(url ? '_' : '/');
+  const __m128i oddOneCorrection = _mm_set1_epi8(url ? (63 - '_') - -'A' : (63 - '/') - (62 - '+'));
+  const __m128i nibble = _mm_set1_epi8(0x0f);
+
+  size_t i = 0;
+  size_t k = 0;
+  for (; size - i >= 16 && outSize - k >= 16; i += 16, k += 12) {
+    __m128i chars = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+    __m128i highNibbles = _mm_and_si128(_mm_srli_epi16(chars, 4), nibble);
+    __m128i lowNibbles = _mm_and_si128(chars, nibble);
+    __m128i invalid = _mm_and_si128(_mm_shuffle_epi8(highBits, highNibbles),
+                                    _mm_shuffle_epi8(lowBits, lowNibbles));
+    if (_mm_movemask_epi8(_mm_cmpeq_epi8(invalid, _mm_setzero_si128())) != 0xffff) break;
+
+    __m128i values = _mm_add_epi8(chars, _mm_add_epi8(
+        _mm_shuffle_epi8(offsets, highNibbles),
+        _mm_and_si128(_mm_cmpeq_epi8(chars, oddOne), oddOneCorrection)));
+
+    // Merge pairs of 6-bit values into 12 bits, then pairs of those into 24, and finally pick out
+    // the bytes of each group in big-endian order.
+    __m128i pairs = _mm_maddubs_epi16(values, _mm_set1_epi32(0x01400140));
+    __m128i groups = _mm_madd_epi16(pairs, _mm_set1_epi32(0x00011000));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + k), _mm_shuffle_epi8(groups,
+        _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1)));
+  }
+  return { i, k };
+}
+
+#undef WD_TARGET_SSSE3
+
+// Maps 16 values from 0 to 15 to their hex digits.
+__m128i toHexDigits(__m128i values) {
+  __m128i letters = _mm_cmpgt_epi8(values, _mm_set1_epi8(9));
+  return _mm_add_epi8(_mm_add_epi8(values, _mm_set1_epi8('0')),
+                      _mm_and_si128(letters, _mm_set1_epi8('a' - '0' - 10)));
+}
+
+// Returns a mask of the bytes of `chars` between `low` and `high` inclusive.
+__m128i inRange(__m128i chars, char low, char high) {
+  // SSE2 only compares signed bytes, so shift the range down to start at -128.
+  __m128i shifted = _mm_add_epi8(chars, _mm_set1_epi8(static_cast<char>(-128 - low)));
+  return _mm_cmplt_epi8(shifted, _mm_set1_epi8(static_cast<char>(-128 + (high - low) + 1)));
+}
+
+// Maps 16 hex digits to their values, leaving zeros in `valid` for characters that aren't any.
+__m128i fromHexDigits(__m128i chars, __m128i& valid) {
+  __m128i lower = _mm_or_si128(chars, _mm_set1_epi8(0x20));
+  __m128i digits = inRange(chars, '0', '9');
+  __m128i letters = inRange(lower, 'a', 'f');
+  valid = _mm_or_si128(digits, letters);
+  return _mm_or_si128(
+      _mm_and_si128(digits, _mm_sub_epi8(chars, _mm_set1_epi8('0'))),
+      _mm_and_si128(letters, _mm_sub_epi8(lower, _mm_set1_epi8('a' - 10))));
+}
+
+// Combines each pair of values, high nibble first, into the low byte of a 16-bit lane.
+__m128i mergeNibbles(__m128i values) {
+  return _mm_or_si128(_mm_slli_epi16(_mm_and_si128(values, _mm_set1_epi16(0x00ff)), 4),
+                      _mm_srli_epi16(values, 8));
+}
+
+#endif  // defined(__x86_64__)
+
+}  // namespace
+
+size_t encodeBase64Into(kj::ArrayPtr<const kj::byte> in, kj::ArrayPtr<kj::byte> out,
+                        Base64Alphabet alphabet) {
+  KJ_DASSERT(out.size() >= base64EncodedSize(in.size(), alphabet));
+  const char* chars = alphabet == Base64Alphabet::STANDARD ? STANDARD_CHARS : URL_CHARS;
+
+  size_t i = 0;
+  kj::byte* pos = out.begin();
+#if defined(__x86_64__)
+  if (hasSsse3()) {
+    i = encodeBase64Ssse3(in.begin(), in.size(), pos, alphabet);
+    pos += i / 3 * 4;
+  }
+#endif
+
+  for (; in.size() - i >= 3; i += 3) {
+    uint32_t n = (uint32_t(in[i]) << 16) | (uint32_t(in[i + 1]) << 8) | in[i + 2];
+    *pos++ = chars[n >> 18];
+    *pos++ = chars[(n >> 12) & 63];
+    *pos++ = chars[(n >> 6) & 63];
+    *pos++ = chars[n & 63];
+  }
+  if (i < in.size()) {
+    uint32_t n = uint32_t(in[i]) << 16;
+    if (i + 1 < in.size()) n |= uint32_t(in[i + 1]) << 8;
+    *pos++ = chars[n >> 18];
+    *pos++ = chars[(n >> 12) & 63];
+    if (i + 1 < in.size()) {
+      *pos++ = chars[(n >> 6) & 63];
+    } else if (alphabet == Base64Alphabet::STANDARD) {
+      *pos++ = '=';
+    }
+    if (alphabet == Base64Alphabet::STANDARD) *pos++ = '=';
+  }
+  return pos - out.begin();
+}
+
+Base64DecodeProgress decodeBase64Prefix(kj::ArrayPtr<const kj::byte> in,
+                                        kj::ArrayPtr<kj::byte> out, Base64Alphabet alphabet) {
+  const int8_t* values = alphabet == Base64Alphabet::STANDARD
+      ? STANDARD_VALUES.values : URL_VALUES.values;
+
+  Base64DecodeProgress progress { 0, 0 };
+#if defined(__x86_64__)
+  if (hasSsse3()) {
+    progress = decodeBase64Ssse3(in.begin(), in.size(), out.begin(), out.size(), alphabet);
+  }
+#endif
+
+  auto& [i, k] = progress;
+  for (; in.size() - i >= 4 && out.size() - k >= 3; i += 4, k += 3) {
+    int32_t a = values[in[i]];
+    int32_t b = values[in[i + 1]];
+    int32_t c = values[in[i + 2]];
+    int32_t d = values[in[i + 3]];
+    // Any -1 sets the sign bit.
+    if ((a | b | c | d) < 0) break;
+    uint32_t n = (a << 18) | (b << 12) | (c << 6) | d;
+    out[k] = n >> 16;
+    out[k + 1] = n >> 8;
+    out[k + 2] = n;
+  }
+  return progress;
+}
+
+size_t encodeHexInto(kj::ArrayPtr<const kj::byte> in, kj::ArrayPtr<kj::byte> out) {
+  KJ_DASSERT(out.size() >= in.size() * 2);
+
+  size_t i = 0;
+  kj::byte* pos = out.begin();
+#if defined(__x86_64__)
+  const __m128i nibble = _mm_set1_epi8(0x0f);
+  for (; in.size() - i >= 16; i += 16, pos += 32) {
+    __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in.begin() + i));
+    __m128i high = _mm_and_si128(_mm_srli_epi16(bytes, 4), nibble);
+    __m128i low = _mm_and_si128(bytes, nibble);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(pos),
+                     toHexDigits(_mm_unpacklo_epi8(high, low)));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(pos + 16),
+                     toHexDigits(_mm_unpackhi_epi8(high, low)));
+  }
+#endif
+
+  for (; i < in.size(); i++) {
+    *pos++ = HEX_DIGITS[in[i] >> 4];
+    *pos++ = HEX_DIGITS[in[i] & 15];
+  }
+  return pos - out.begin();
+}
+
+size_t decodeHexPrefix(kj::ArrayPtr<const kj::byte> in, kj::ArrayPtr<kj::byte> out) {
+  size_t i = 0;
+  size_t k = 0;
+#if defined(__x86_64__)
+  for (; in.size() - i >= 32 && out.size() - k >= 16; i += 32, k += 16) {
+    __m128i validFirst, validSecond;
+    __m128i first = fromHexDigits(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(in.begin() + i)), validFirst);
+    __m128i second = fromHexDigits(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(in.begin() + i + 16)), validSecond);
+    if (_mm_movemask_epi8(_mm_and_si128(validFirst, validSecond)) != 0xffff) break;
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out.begin() + k),
+                     _mm_packus_epi16(mergeNibbles(first), mergeNibbles(second)));
+  }
+#endif
+
+  for (; in.size() - i >= 2 && k < out.size(); i += 2, k++) {
+    int high = HEX_VALUES.values[in[i]];
+    int low = HEX_VALUES.values[in[i + 1]];
+    if ((high | low) < 0) break;
+    out[k] = (high << 4) | low;
+  }
+  return k;
+}
+
+}  // namespace workerd
@@ -0,0 +1,59 @@
+// Copyright (c) 2017-2022 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+#pragma once
+
+#include <kj/common.h>
+
+namespace workerd {
+
+// Base64 and hex codecs shared by Buffer, atob()/btoa(), and the internal encoders. Unlike the
+// kj::encodeBase64() family, these write into caller-provided buffers, so callers can encode
+// straight into a V8 string's backing store or a write buffer, and the decoders only take the
+// well-formed prefix of their input, leaving the caller to apply its own rules (Node's leniency,
+// or the WHATWG forgiving-base64 algorithm) to whatever remains.
+//
+// On x86-64 the base64 kernels use SSSE3 when the CPU has it, chosen at runtime, and the hex
+// kernels use SSE2. Elsewhere they fall back to portable table-driven loops.
+
+enum class Base64Alphabet {
+  // RFC 4648 section 4: "+" and "/", padded with "=".
+  STANDARD,
+
+  // RFC 4648 section 5: "-" and "_", unpadded (as Node.js and JWTs do).
+  URL,
+};
+
+// Returns the number of characters encodeBase64Into() will write for `size` bytes.
+constexpr size_t base64EncodedSize(size_t size, Base64Alphabet alphabet = Base64Alphabet::STANDARD) {
+  return alphabet == Base64Alphabet::STANDARD ? (size + 2) / 3 * 4 : (size * 4 + 2) / 3;
+}
+
+// Base64-encodes `in` into the start of `out`, which must have room for base64EncodedSize()
+// characters. Returns the number of characters written.
+size_t encodeBase64Into(kj::ArrayPtr<const kj::byte> in, kj::ArrayPtr<kj::byte> out,
+                        Base64Alphabet alphabet = Base64Alphabet::STANDARD);
+
+struct Base64DecodeProgress {
+  size_t consumed;  // Characters of input decoded.
+  size_t written;   // Bytes of output written.
+};
+
+// Decodes the longest prefix of `in` made of whole groups of four characters from `alphabet`,
+// stopping at the first group containing anything else (padding and whitespace included), or
+// when `out` has no room for another three bytes. Since base64 groups decode independently, the
+// caller can decode the rest of the input with a slower, more forgiving decoder and append it.
+Base64DecodeProgress decodeBase64Prefix(kj::ArrayPtr<const kj::byte> in, kj::ArrayPtr<kj::byte> out,
+                                        Base64Alphabet alphabet = Base64Alphabet::STANDARD);
+
+// Hex-encodes `in`, in lower case, into the start of `out`, which must have room for twice as
+// many characters. Returns the number of characters written.
+size_t encodeHexInto(kj::ArrayPtr<const kj::byte> in, kj::ArrayPtr<kj::byte> out);
+
+// Decodes pairs of hex digits (of either case) from the start of `in` into `out`, stopping at the
+// first pair that isn't one, at a trailing odd digit, or when `out` is full. Returns the number of
+// bytes written; twice that many characters were consumed.
+size_t decodeHexPrefix(kj::ArrayPtr<const kj::byte> in, kj::ArrayPtr<kj::byte> out);
+
+}  // namespace workerd
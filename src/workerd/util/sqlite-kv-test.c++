@@ -91,5 +91,61 @@ KJ_TEST("SQLite-KV") {
   KJ_EXPECT(list(nullptr, kj::none, kj::none, F) == "");
 }
 
+KJ_TEST("SQLite-KV multi-key operations") {
+  auto dir = kj::newInMemoryDirectory(kj::nullClock());
+  SqliteDatabase::Vfs vfs(*dir);
+  SqliteDatabase db(vfs, kj::Path({"foo"}), kj::WriteMode::CREATE | kj::WriteMode::MODIFY);
+  SqliteKv kv(db);
+
+  // Use enough keys to span several batches, including a partial one.
+  constexpr size_t COUNT = SqliteKv::MULTI_BATCH_SIZE * 2 + 3;
+  auto keys = KJ_MAP(i, kj::zeroTo(COUNT)) { return kj::str("key", kj::hex(i)); };
+  auto values = KJ_MAP(i, kj::zeroTo(COUNT)) { return kj::str("value", i); };
+
+  auto pairs = KJ_MAP(i, kj::zeroTo(COUNT)) -> SqliteKv::KeyValuePtr {
+    return { keys[i], values[i].asBytes() };
+  };
+  kv.putMultiple(pairs);
+
+  auto count = kv.list(nullptr, kj::none, kj::none, SqliteKv::FORWARD,
+      [&](kj::StringPtr key, kj::ArrayPtr<const byte> value) {});
+  KJ_EXPECT(count == COUNT);
+
+  // A later pair for the same key wins, even within a single batch.
+  {
+    SqliteKv::KeyValuePtr overwrite[] = {
+      { "key0"_kj, "first"_kj.asBytes() },
+      { "key0"_kj, "second"_kj.asBytes() },
+    };
+    kv.putMultiple(overwrite);
+  }
+
+  auto get = [&](kj::ArrayPtr<const kj::StringPtr> keys) {
+    kj::Vector<kj::String> results;
+    kv.getMultiple(keys, [&](kj::StringPtr key, kj::ArrayPtr<const byte> value) {
+      results.add(kj::str(key, "=", value.asChars()));
+    });
+    return kj::strArray(results, ", ");
+  };
+
+  {
+    kj::StringPtr lookup[] = { "key1"_kj, "corge"_kj, "key0"_kj };
+    KJ_EXPECT(get(lookup) == "key0=second, key1=value1");
+  }
+
+  {
+    auto keyPtrs = KJ_MAP(key, keys) -> kj::StringPtr { return key; };
+    kj::Vector<kj::String> results;
+    kv.getMultiple(keyPtrs, [&](kj::StringPtr key, kj::ArrayPtr<const byte> value) {
+      results.add(kj::str(key));
+    });
+    KJ_EXPECT(results.size() == COUNT);
+
+    KJ_EXPECT(kv.deleteMultiple(keyPtrs.slice(0, COUNT - 1)) == COUNT - 1);
+    KJ_EXPECT(kv.deleteMultiple(keyPtrs) == 1);
+    KJ_EXPECT(kv.deleteMultiple(keyPtrs) == 0);
+  }
+}
+
 }  // namespace
 }  // namespace workerd
@@ -36,4 +36,56 @@ uint SqliteKv::deleteAll() {
   return query.changeCount();
 }
 
+void SqliteKv::putMultiple(kj::ArrayPtr<const KeyValuePtr> pairs) {
+  SqliteDatabase::Query::ValuePtr bindings[MULTI_BATCH_SIZE * 2];
+
+  while (pairs.size() > 0) {
+    auto batch = pairs.slice(0, kj::min(pairs.size(), MULTI_BATCH_SIZE));
+    pairs = pairs.slice(batch.size(), pairs.size());
+
+    for (auto i: kj::zeroTo(MULTI_BATCH_SIZE)) {
+      // Rows are applied in order, so repeating the last pair leaves it as the final write.
+      auto& pair = batch[kj::min(i, batch.size() - 1)];
+      bindings[i * 2].init<kj::StringPtr>(pair.key);
+      bindings[i * 2 + 1].init<kj::ArrayPtr<const byte>>(pair.value);
+    }
+
+    stmtPutMultiple.run(
+        kj::ArrayPtr<const SqliteDatabase::Query::ValuePtr>(bindings, MULTI_BATCH_SIZE * 2));
+  }
+}
+
+uint SqliteKv::deleteMultiple(kj::ArrayPtr<const KeyPtr> keys) {
+  SqliteDatabase::Query::ValuePtr bindings[MULTI_BATCH_SIZE];
+  uint count = 0;
+
+  while (keys.size() > 0) {
+    auto batch = keys.slice(0, kj::min(keys.size(), MULTI_BATCH_SIZE));
+    keys = keys.slice(batch.size(), keys.size());
+
+    for (auto i: kj::indices(bindings)) {
+      if (i < batch.size()) {
+        bindings[i].init<kj::StringPtr>(batch[i]);
+      } else {
+        bindings[i].init<decltype(nullptr)>(nullptr);
+      }
+    }
+
+    auto query = stmtDeleteMultiple.run(
+        kj::ArrayPtr<const SqliteDatabase::Query::ValuePtr>(bindings, MULTI_BATCH_SIZE));
+    count += query.changeCount();
+  }
+
+  return count;
+}
+
+kj::String SqliteKv::batchSql(kj::StringPtr prefix, kj::StringPtr placeholder,
+                              kj::StringPtr suffix) {
+  auto placeholders = kj::heapArray<kj::StringPtr>(MULTI_BATCH_SIZE);
+  for (auto& p: placeholders) {
+    p = placeholder;
+  }
+  return kj::str(prefix, kj::strArray(placeholders, ", "), suffix);
+}
+
 }  // namespace workerd
@@ -48,10 +48,28 @@ public:
 
   uint deleteAll();
 
-  // TODO(perf): Should we provide multi-get, multi-put, and multi-delete? It's a bit tricky to
-  //   implement them as single SQL queries, while still using prepared statements. The c-array
-  //   extension might help here, though it can only support arrays of NUL-terminated strings, not
-  //   byte blobs or strings containing NUL bytes.
+  // Multi-key variants of get(), put(), and delete_(). Each executes one statement per
+  // MULTI_BATCH_SIZE keys rather than one per key. The statements are prepared with a fixed number
+  // of parameters, so a short batch pads the parameter list: with NULL for lookups and deletes
+  // (which never matches a key), or by repeating the last pair for puts (which is idempotent).
+
+  // Calls `callback(KeyPtr, ValuePtr)` for each of `keys` that is found. Within each batch the
+  // results are in key order, so if `keys` is sorted, all results are.
+  template <typename Func>
+  void getMultiple(kj::ArrayPtr<const KeyPtr> keys, Func&& callback);
+
+  struct KeyValuePtr {
+    KeyPtr key;
+    ValuePtr value;
+  };
+  void putMultiple(kj::ArrayPtr<const KeyValuePtr> pairs);
+
+  // Returns the number of keys that matched.
+  uint deleteMultiple(kj::ArrayPtr<const KeyPtr> keys);
+
+  // putMultiple() binds two parameters per key, so this must be no more than half of the
+  // SQLITE_LIMIT_VARIABLE_NUMBER set in SqliteDatabase::setupSecurity().
+  static constexpr size_t MULTI_BATCH_SIZE = 32;
 
 private:
   SqliteDatabase& db;
@@ -113,6 +131,18 @@ private:
   SqliteDatabase::Statement stmtDeleteAll = db.prepare(R"(
     DELETE FROM _cf_KV
   )");
+  SqliteDatabase::Statement stmtGetMultiple = db.prepare(SqliteDatabase::TRUSTED, batchSql(
+      "SELECT key, value FROM _cf_KV WHERE key IN (", "?", ") ORDER BY key"));
+  SqliteDatabase::Statement stmtPutMultiple = db.prepare(SqliteDatabase::TRUSTED, batchSql(
+      "INSERT INTO _cf_KV VALUES ", "(?, ?)",
+      " ON CONFLICT DO UPDATE SET value = excluded.value"));
+  SqliteDatabase::Statement stmtDeleteMultiple = db.prepare(SqliteDatabase::TRUSTED, batchSql(
+      "DELETE FROM _cf_KV WHERE key IN (", "?", ")"));
+
+  // Builds SQL with MULTI_BATCH_SIZE comma-separated copies of `placeholder`. The result only
+  // depends on string literals, so it is safe to prepare with the TRUSTED regulator.
+  static kj::String batchSql(kj::StringPtr prefix, kj::StringPtr placeholder,
+                             kj::StringPtr suffix);
 
   SqliteDatabase& ensureInitialized(SqliteDatabase& db);
   // Make sure the KV table is created, then return the same object.
@@ -139,6 +169,31 @@ bool SqliteKv::get(KeyPtr key, Func&& callback) {
   }
 }
 
+template <typename Func>
+void SqliteKv::getMultiple(kj::ArrayPtr<const KeyPtr> keys, Func&& callback) {
+  SqliteDatabase::Query::ValuePtr bindings[MULTI_BATCH_SIZE];
+
+  while (keys.size() > 0) {
+    auto batch = keys.slice(0, kj::min(keys.size(), MULTI_BATCH_SIZE));
+    keys = keys.slice(batch.size(), keys.size());
+
+    for (auto i: kj::indices(bindings)) {
+      if (i < batch.size()) {
+        bindings[i].init<kj::StringPtr>(batch[i]);
+      } else {
+        bindings[i].init<decltype(nullptr)>(nullptr);
+      }
+    }
+
+    auto query = stmtGetMultiple.run(
+        kj::ArrayPtr<const SqliteDatabase::Query::ValuePtr>(bindings, MULTI_BATCH_SIZE));
+    while (!query.isDone()) {
+      callback(query.getText(0), query.getBlob(1));
+      query.nextRow();
+    }
+  }
+}
+
 template <typename Func>
 uint SqliteKv::list(KeyPtr begin, kj::Maybe<KeyPtr> end, kj::Maybe<uint> limit, Order order,
                     Func&& callback) {
@@ -636,5 +636,63 @@ KJ_TEST("DELETE with LIMIT") {
   KJ_EXPECT(q.getInt(0) == 3);
 }
 
+KJ_TEST("SQLite page cache pool") {
+  auto dir = kj::newInMemoryDirectory(kj::nullClock());
+  SqliteDatabase::Vfs vfs(*dir);
+
+  constexpr uint64_t POOL_LIMIT = 256u << 10;
+  SqliteDatabase::PageCachePool pool(POOL_LIMIT);
+
+  SqliteDatabase db1(vfs, kj::Path({"db1"}), kj::WriteMode::CREATE | kj::WriteMode::MODIFY);
+  SqliteDatabase db2(vfs, kj::Path({"db2"}), kj::WriteMode::CREATE | kj::WriteMode::MODIFY);
+  db1.joinPageCachePool(pool);
+  db2.joinPageCachePool(pool);
+
+  // Each database stores about 800KB, which fits in its own (default) cache but not in the pool.
+  auto fill = [](SqliteDatabase& db) {
+    db.run(R"(
+      CREATE TABLE things (id INTEGER PRIMARY KEY, data BLOB);
+      WITH RECURSIVE n(i) AS (SELECT 1 UNION ALL SELECT i + 1 FROM n WHERE i < 200)
+      INSERT INTO things SELECT i, randomblob(4000) FROM n;
+    )");
+    db.run("SELECT SUM(LENGTH(data)) FROM things");
+  };
+
+  uint64_t db2Reported = 0;
+  db2.onPageCacheStats([&](const SqliteDatabase::PageCacheStats& stats) {
+    db2Reported = stats.bytesUsed;
+  });
+
+  fill(db1);
+  auto db1Used = db1.getPageCacheStats().bytesUsed;
+  KJ_EXPECT(db1Used > POOL_LIMIT);
+
+  // Queries alone don't do any accounting.
+  KJ_EXPECT(pool.getBytesUsed() < db1Used);
+  pool.update();
+  KJ_EXPECT(pool.getBytesUsed() == db1Used);
+  KJ_EXPECT(pool.getEvictionCount() == 0);
+
+  // Using db2 pushes the pool over its limit, so the less recently used db1 gives up its cache.
+  fill(db2);
+  pool.update();
+  KJ_EXPECT(pool.getEvictionCount() > 0);
+  KJ_EXPECT(db2Reported == db2.getPageCacheStats().bytesUsed);
+  KJ_EXPECT(db1.getPageCacheStats().bytesUsed < db1Used);
+  KJ_EXPECT(pool.getBytesUsed() ==
+      db1.getPageCacheStats().bytesUsed + db2.getPageCacheStats().bytesUsed);
+
+  // Reading db1 again must now go to the VFS for pages it released.
+  auto missesBefore = db1.getPageCacheStats().misses;
+  db1.run("SELECT SUM(LENGTH(data)) FROM things");
+  KJ_EXPECT(db1.getPageCacheStats().misses > missesBefore);
+
+  // A per-database limit bounds the cache even when the pool has room.
+  pool.setLimit(64u << 20);
+  db2.setPageCacheLimit(64u << 10);
+  db2.run("SELECT SUM(LENGTH(data)) FROM things");
+  KJ_EXPECT(db2.getPageCacheStats().bytesUsed < db1Used);
+}
+
 }  // namespace
 }  // namespace workerd
@@ -361,6 +361,10 @@ SqliteDatabase::SqliteDatabase(const Vfs& vfs, kj::PathPtr path, kj::WriteMode m
 }
 
 SqliteDatabase::~SqliteDatabase() noexcept(false) {
+  KJ_IF_SOME(pool, pageCachePool) {
+    pool.remove(*this);
+  }
+
   auto err = sqlite3_close(db);
   if (err == SQLITE_BUSY) {
     KJ_LOG(ERROR, "sqlite database destroyed while dependent objects still exist");
@@ -386,6 +390,97 @@ kj::StringPtr SqliteDatabase::getCurrentQueryForDebug() {
   }
 }
 
+void SqliteDatabase::setPageCacheLimit(uint64_t bytes) {
+  // A negative cache_size is interpreted as a limit in KiB rather than in pages.
+  run(TRUSTED, kj::str("PRAGMA cache_size = -", kj::max(bytes / 1024, uint64_t(1))));
+}
+
+void SqliteDatabase::joinPageCachePool(PageCachePool& pool) {
+  KJ_REQUIRE(pageCachePool == kj::none, "database already belongs to a page cache pool");
+  pageCachePool = pool;
+  pool.add(*this);
+}
+
+SqliteDatabase::PageCacheStats SqliteDatabase::getPageCacheStats() {
+  auto get = [&](int op) -> uint64_t {
+    int current = 0;
+    int highwater = 0;
+    SQLITE_CALL_NODB(sqlite3_db_status(db, op, &current, &highwater, 0));
+    return current;
+  };
+
+  return {
+    .hits = get(SQLITE_DBSTATUS_CACHE_HIT),
+    .misses = get(SQLITE_DBSTATUS_CACHE_MISS),
+    .bytesUsed = get(SQLITE_DBSTATUS_CACHE_USED),
+  };
+}
+
+// =======================================================================================
+
+SqliteDatabase::PageCachePool::~PageCachePool() noexcept(false) {
+  KJ_REQUIRE(members.empty(), "PageCachePool destroyed while databases still use it") {
+    break;
+  }
+}
+
+void SqliteDatabase::PageCachePool::add(SqliteDatabase& db) {
+  members.add(db);
+  recharge(db);
+}
+
+void SqliteDatabase::PageCachePool::remove(SqliteDatabase& db) {
+  members.remove(db);
+  bytesUsed -= db.pageCacheBytesCharged;
+  db.pageCacheBytesCharged = 0;
+}
+
+void SqliteDatabase::PageCachePool::update() {
+  kj::Vector<SqliteDatabase*> touched;
+  for (auto& db: members) {
+    if (db.pageCacheTouched) touched.add(&db);
+  }
+
+  for (auto db: touched) {
+    db->pageCacheTouched = false;
+    members.remove(*db);
+    members.add(*db);
+    recharge(*db);
+  }
+
+  if (bytesUsed > limitBytes) {
+    SqliteDatabase* firstTouched = touched.size() > 0 ? touched[0] : nullptr;
+
+    for (auto& victim: members) {
+      // The databases just queried are last in the list, so this ends the loop. We never evict
+      // those, even if they alone exceed the pool's limit -- their own cache_size bounds them.
+      if (&victim == firstTouched || bytesUsed <= limitBytes) break;
+      if (victim.pageCacheBytesCharged == 0) continue;
+
+      // This only frees pages that aren't pinned by a running statement, so it's safe even if the
+      // victim is in the middle of a query.
+      sqlite3_db_release_memory(victim.db);
+      recharge(victim);
+      ++evictionCount;
+    }
+  }
+
+  for (auto db: touched) {
+    KJ_IF_SOME(callback, db->onPageCacheStatsCallback) {
+      callback(db->getPageCacheStats());
+    }
+  }
+}
+
+void SqliteDatabase::PageCachePool::recharge(SqliteDatabase& db) {
+  int current = 0;
+  int highwater = 0;
+  SQLITE_CALL_NODB(sqlite3_db_status(db.db, SQLITE_DBSTATUS_CACHE_USED, &current, &highwater, 0));
+
+  bytesUsed = bytesUsed - db.pageCacheBytesCharged + current;
+  db.pageCacheBytesCharged = current;
+}
+
 // Set up the regulator that will be used for authorizer callbacks while preparing this
 // statement.
 kj::Own<sqlite3_stmt> SqliteDatabase::prepareSql(
@@ -753,14 +848,11 @@ void SqliteDatabase::setupSecurity() {
   // This happens inside LimitEnforcer.
 
   // 5. Limit heap size.
-  // Annoyingly, this sets a process-wide limit. We'll set 128MB "soft" limit (to try to control
-  // how much page caching SQLite does) and 512MB "hard" limit (to block DoS attacks from taking
-  // down the whole system).
-  // TODO(perf): Revisit as popularity grows. Maybe make configurable? Maybe patch SQLite to allow
-  //   these to be controlled per-database? Is page caching even all that important when the kernel
-  //   does its own page caching?
+  // Annoyingly, this sets a process-wide limit. We set a 512MB "hard" limit to block DoS attacks
+  // from taking down the whole system. Page caching is controlled per-database instead, using
+  // setPageCacheLimit() and PageCachePool: a process-wide "soft" limit would let one busy
+  // database starve all the others of cache.
   static bool doOnce KJ_UNUSED = []() {
-    sqlite3_soft_heap_limit64(128u << 20);
     sqlite3_hard_heap_limit64(512u << 20);
     return false;
   }();
@@ -811,6 +903,8 @@ SqliteDatabase::Query::~Query() noexcept(false) {
     // should be interpreted, so we ignore it.
     sqlite3_clear_bindings(statement);
   }
+
+  db.pageCacheTouched = true;
 }
 
 void SqliteDatabase::Query::checkRequirements(size_t size) {
@@ -5,6 +5,7 @@
 #pragma once
 
 #include <kj/filesystem.h>
+#include <kj/list.h>
 #include <kj/one-of.h>
 #include <utility>
 
@@ -34,6 +35,7 @@ public:
   class Lock;
   class LockManager;
   class Regulator;
+  class PageCachePool;
   struct VfsOptions;
 
   SqliteDatabase(const Vfs& vfs, kj::PathPtr path);
@@ -90,6 +92,31 @@ public:
   // debug logs.
   kj::StringPtr getCurrentQueryForDebug();
 
+  // Limits this database's page cache to approximately `bytes`, rounded down to whole KiB. Without
+  // this, SQLite's default of about 2MB per database applies.
+  void setPageCacheLimit(uint64_t bytes);
+
+  // Adds this database to a pool whose members share a page cache budget. May be called at most
+  // once. The pool must outlive the database.
+  void joinPageCachePool(PageCachePool& pool);
+
+  struct PageCacheStats {
+    // Number of page lookups satisfied from / not satisfied from the page cache since the
+    // database was opened.
+    uint64_t hits;
+    uint64_t misses;
+
+    // Memory currently used by the page cache.
+    uint64_t bytesUsed;
+  };
+  PageCacheStats getPageCacheStats();
+
+  // Invokes the given callback with this database's page cache statistics each time its pool
+  // updates them (see PageCachePool::update()).
+  void onPageCacheStats(kj::Function<void(const PageCacheStats&)> callback) {
+    onPageCacheStatsCallback = kj::mv(callback);
+  }
+
 private:
   sqlite3* db;
 
@@ -101,6 +128,18 @@ private:
 
   kj::Maybe<kj::Function<void()>> onWriteCallback;
 
+  kj::Maybe<PageCachePool&> pageCachePool;
+  kj::ListLink<SqliteDatabase> pageCachePoolLink;
+
+  // Page cache bytes last reported to `pageCachePool` for this database.
+  uint64_t pageCacheBytesCharged = 0;
+
+  // Set when a query on this database completes, so that the next PageCachePool::update() knows
+  // to recompute its usage.
+  bool pageCacheTouched = false;
+
+  kj::Maybe<kj::Function<void(const PageCacheStats&)>> onPageCacheStatsCallback;
+
   void close();
 
   enum Multi { SINGLE, MULTI };
@@ -171,6 +210,53 @@ public:
   virtual bool allowTransactions() { return true; }
 };
 
+// Shares a page cache budget between a set of databases, so that a few busy databases can use a
+// large cache while idle ones give theirs up. Each database is still limited by its own
+// `setPageCacheLimit()`.
+//
+// Queries only mark their database as used; the accounting happens when the owner calls
+// `update()`, which is too costly to do for every query. If the pool's total then exceeds its
+// limit, the least-recently-queried databases are asked to release unused cache pages until the
+// total is back under the limit.
+//
+// A pool is not thread-safe: all member databases must be used from the same thread.
+class SqliteDatabase::PageCachePool {
+public:
+  explicit PageCachePool(uint64_t limitBytes): limitBytes(limitBytes) {}
+  ~PageCachePool() noexcept(false);
+  KJ_DISALLOW_COPY_AND_MOVE(PageCachePool);
+
+  void setLimit(uint64_t bytes) { limitBytes = bytes; }
+
+  uint64_t getLimit() { return limitBytes; }
+  uint64_t getBytesUsed() { return bytesUsed; }
+
+  // Number of times a database has been asked to release its cache to make room for another.
+  uint64_t getEvictionCount() { return evictionCount; }
+
+  // Recomputes the usage of each member queried since the last update, marking it most-recently
+  // used and reporting its stats to its onPageCacheStats() callback, then releases memory from
+  // members that haven't been queried since if the pool is over its limit. Call this periodically,
+  // e.g. on a timer or at transaction boundaries.
+  void update();
+
+private:
+  uint64_t limitBytes;
+  uint64_t bytesUsed = 0;
+  uint64_t evictionCount = 0;
+
+  // Ordered from least- to most-recently queried.
+  kj::List<SqliteDatabase, &SqliteDatabase::pageCachePoolLink> members;
+
+  void add(SqliteDatabase& db);
+  void remove(SqliteDatabase& db);
+
+  // Recomputes the usage charged to `db`.
+  void recharge(SqliteDatabase& db);
+
+  friend class SqliteDatabase;
+};
+
 // Represents a prepared SQL statement, which can be executed many times.
 class SqliteDatabase::Statement {
 public:
@@ -3,6 +3,7 @@
 #include <kj/exception.h>
 #include <kj/one-of.h>
 #include <kj/debug.h>
+#include <kj/vector.h>
 
 namespace workerd {
 
@@ -211,4 +212,31 @@ kj::Own<NeuterableIoStream> newNeuterableIoStream(kj::AsyncIoStream& inner) {
   return kj::heap<NeuterableIoStreamImpl>(inner);
 }
 
+kj::Promise<kj::Maybe<kj::Array<kj::byte>>> readAllBytesUpTo(
+    kj::AsyncInputStream& input, uint64_t limit) {
+  // Clamp the limit so that `limit + 1` below can't wrap around. No buffer could grow that big
+  // anyway.
+  limit = kj::min(limit, uint64_t(kj::maxValue) - 1);
+
+  kj::Vector<kj::byte> buffer;
+  KJ_IF_SOME(length, input.tryGetLength()) {
+    if (length > limit) co_return kj::none;
+    buffer.reserve(length);
+  }
+
+  for (;;) {
+    size_t offset = buffer.size();
+    // Ask for one byte past the limit so that we notice if the input exceeds it.
+    size_t amount = kj::min(kj::max(buffer.capacity() - offset, size_t(4096)),
+                            limit + 1 - offset);
+    buffer.resize(offset + amount);
+    size_t n = co_await input.tryRead(buffer.begin() + offset, 1, amount);
+    buffer.resize(offset + n);
+    if (buffer.size() > limit) co_return kj::none;
+    if (n == 0) break;
+  }
+
+  co_return buffer.releaseAsArray();
+}
+
 }  // namespace workerd
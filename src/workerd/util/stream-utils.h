@@ -26,5 +26,10 @@ public:
 kj::Own<NeuterableInputStream> newNeuterableInputStream(kj::AsyncInputStream&);
 kj::Own<NeuterableIoStream> newNeuterableIoStream(kj::AsyncIoStream&);
 
+// Reads all of `input`, or returns none if it is longer than `limit` bytes. Unlike
+// `readAllBytes(limit)`, exceeding the limit is not an error, so callers can respond to it.
+kj::Promise<kj::Maybe<kj::Array<kj::byte>>> readAllBytesUpTo(
+    kj::AsyncInputStream& input, uint64_t limit);
+
 
 }  // namespace workerd
@@ -4,6 +4,7 @@
 #pragma once
 
 #include <kj/string.h>
+#include <kj/vector.h>
 
 namespace workerd {
 
@@ -23,4 +24,34 @@ inline kj::String toLowerCopy(kj::ArrayPtr<const char> ptr) {
   return kj::mv(str);
 }
 
+// Escapes `text` for inclusion in a JSON string literal.
+inline kj::Vector<char> escapeJsonString(kj::StringPtr text) {
+  static const char HEXDIGITS[] = "0123456789abcdef";
+  kj::Vector<char> escaped(text.size() + 1);
+
+  for (char c: text) {
+    switch (c) {
+      case '\"': escaped.addAll(kj::StringPtr("\\\"")); break;
+      case '\\': escaped.addAll(kj::StringPtr("\\\\")); break;
+      case '\b': escaped.addAll(kj::StringPtr("\\b")); break;
+      case '\f': escaped.addAll(kj::StringPtr("\\f")); break;
+      case '\n': escaped.addAll(kj::StringPtr("\\n")); break;
+      case '\r': escaped.addAll(kj::StringPtr("\\r")); break;
+      case '\t': escaped.addAll(kj::StringPtr("\\t")); break;
+      default:
+        if (static_cast<uint8_t>(c) < 0x20) {
+          escaped.addAll(kj::StringPtr("\\u00"));
+          uint8_t c2 = c;
+          escaped.add(HEXDIGITS[c2 / 16]);
+          escaped.add(HEXDIGITS[c2 % 16]);
+        } else {
+          escaped.add(c);
+        }
+        break;
+    }
+  }
+
+  return escaped;
+}
+
 }  // namespace workerd
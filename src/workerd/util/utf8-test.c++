@@ -0,0 +1,88 @@
+// Copyright (c) 2017-2022 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+#include "utf8.h"
+#include <kj/test.h>
+#include <kj/string.h>
+#include <kj/vector.h>
+
+namespace workerd {
+namespace {
+
+kj::ArrayPtr<const kj::byte> bytes(kj::StringPtr text) {
+  return text.asBytes();
+}
+
+KJ_TEST("asciiPrefixLength") {
+  KJ_EXPECT(asciiPrefixLength(nullptr) == 0);
+  KJ_EXPECT(asciiPrefixLength(bytes("hello")) == 5);
+  KJ_EXPECT(asciiPrefixLength(bytes("h\xc3\xa9llo")) == 1);
+
+  // Check every position across the vector, word, and byte-at-a-time loops.
+  auto text = kj::heapArray<kj::byte>(100);
+  for (size_t i = 0; i < text.size(); i++) {
+    memset(text.begin(), 'x', text.size());
+    text[i] = 0x80;
+    KJ_EXPECT(asciiPrefixLength(text) == i, i);
+    KJ_EXPECT(!isAscii(text));
+    KJ_EXPECT(isAscii(text.slice(0, i)));
+  }
+}
+
+KJ_TEST("isValidUtf8") {
+  KJ_EXPECT(isValidUtf8(nullptr));
+  KJ_EXPECT(isValidUtf8(bytes("plain ASCII")));
+  KJ_EXPECT(isValidUtf8(bytes("caf\xc3\xa9 \xe2\x82\xac \xf0\x9f\x98\x80")));
+  KJ_EXPECT(isValidUtf8(bytes("\xef\xbb\xbf" "BOM")));
+  KJ_EXPECT(isValidUtf8(bytes("\xed\x9f\xbf")));      // U+D7FF
+  KJ_EXPECT(isValidUtf8(bytes("\xf4\x8f\xbf\xbf")));  // U+10FFFF
+
+  KJ_EXPECT(!isValidUtf8(bytes("\x80")));              // stray continuation byte
+  KJ_EXPECT(!isValidUtf8(bytes("\xc0\xaf")));          // overlong
+  KJ_EXPECT(!isValidUtf8(bytes("\xe0\x9f\xbf")));      // overlong
+  KJ_EXPECT(!isValidUtf8(bytes("\xf0\x8f\xbf\xbf")));  // overlong
+  KJ_EXPECT(!isValidUtf8(bytes("\xed\xa0\x80")));      // surrogate
+  KJ_EXPECT(!isValidUtf8(bytes("\xf4\x90\x80\x80")));  // beyond U+10FFFF
+  KJ_EXPECT(!isValidUtf8(bytes("\xf5\x80\x80\x80")));
+  KJ_EXPECT(!isValidUtf8(bytes("\xff")));
+  KJ_EXPECT(!isValidUtf8(bytes("\xe2\x28\xa1")));      // bad continuation byte
+
+  // Sequences cut short, including at the very end.
+  KJ_EXPECT(!isValidUtf8(bytes("abc\xc3")));
+  KJ_EXPECT(!isValidUtf8(bytes("abc\xe2\x82")));
+  KJ_EXPECT(!isValidUtf8(bytes("abc\xf0\x9f\x98")));
+  KJ_EXPECT(!isValidUtf8(bytes("\xe2\x82" "abc")));
+
+  // Multi-byte sequences after long runs of ASCII.
+  auto text = kj::str(kj::repeat('x', 40), "\xc3\xa9", kj::repeat('y', 40), "\xe2\x82\xac");
+  KJ_EXPECT(isValidUtf8(bytes(text)));
+  KJ_EXPECT(!isValidUtf8(bytes(text).slice(0, text.size() - 1)));
+}
+
+KJ_TEST("isValidUtf8 at every position across blocks") {
+  // Two-, three- and four-byte sequences, so that some straddle every block boundary.
+  kj::Vector<kj::StringPtr> pieces;
+  for (auto i KJ_UNUSED: kj::zeroTo(8)) pieces.add("\xc3\xa9\xe2\x82\xac\xf0\x9f\x98\x80"_kj);
+  auto valid = kj::strArray(pieces, "");
+  KJ_EXPECT(isValidUtf8(bytes(valid)));
+
+  kj::StringPtr invalid[] = {
+    "\x80"_kj, "\xc0\xaf"_kj, "\xe0\x9f\xbf"_kj, "\xf0\x8f\xbf\xbf"_kj, "\xed\xa0\x80"_kj,
+    "\xf4\x90\x80\x80"_kj, "\xf5\x80\x80\x80"_kj, "\xff"_kj, "\xe2\x28\xa1"_kj,
+    "\xc3"_kj, "\xe2\x82"_kj, "\xf0\x9f\x98"_kj,
+  };
+  for (auto bad: invalid) {
+    for (size_t i = 0; i <= 48; i++) {
+      auto ascii = kj::str(kj::repeat('x', i), bad, kj::repeat('y', 48 - i));
+      KJ_EXPECT(!isValidUtf8(bytes(ascii)), i);
+      auto text = kj::str(kj::repeat('x', i), bad, valid);
+      KJ_EXPECT(!isValidUtf8(bytes(text)), i);
+      auto atEnd = kj::str(valid.slice(0, 9 * (i / 9)), kj::repeat('x', i % 9), bad);
+      KJ_EXPECT(!isValidUtf8(bytes(atEnd)), i);
+    }
+  }
+}
+
+}  // namespace
+}  // namespace workerd
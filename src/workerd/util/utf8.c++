@@ -0,0 +1,281 @@
+// Copyright (c) 2017-2022 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+#include "utf8.h"
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#endif
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+namespace workerd {
+
+size_t asciiPrefixLength(kj::ArrayPtr<const kj::byte> bytes) {
+  const kj::byte* pos = bytes.begin();
+  const kj::byte* end = bytes.end();
+
+#if defined(__SSE2__)
+  for (; end - pos >= 16; pos += 16) {
+    // Gathers the top bit of each byte.
+    int mask = _mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(pos)));
+    if (mask != 0) {
+      return pos - bytes.begin() + __builtin_ctz(mask);
+    }
+  }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+  for (; end - pos >= 16; pos += 16) {
+    if (vmaxvq_u8(vld1q_u8(pos)) >= 0x80) {
+      // The loops below find which byte it was.
+      break;
+    }
+  }
+#endif
+
+  for (; end - pos >= 8; pos += 8) {
+    uint64_t word;
+    memcpy(&word, pos, sizeof(word));
+    if (word & 0x8080808080808080ull) {
+      break;
+    }
+  }
+
+  while (pos < end && *pos < 0x80) {
+    ++pos;
+  }
+  return pos - bytes.begin();
+}
+
+namespace {
+
+bool isValidUtf8Scalar(kj::ArrayPtr<const kj::byte> bytes) {
+  const kj::byte* pos = bytes.begin();
+  const kj::byte* end = bytes.end();
+
+  while (pos < end) {
+    if (*pos < 0x80) {
+      // Text is mostly ASCII, so skip as much of it as we can at once.
+      pos += asciiPrefixLength(kj::arrayPtr(pos, end));
+      continue;
+    }
+
+    // The number of continuation bytes to follow, and the range allowed for the first of them,
+    // which is narrower after some lead bytes to rule out overlong encodings, surrogates, and code
+    // points beyond U+10FFFF.
+    size_t count;
+    kj::byte low = 0x80;
+    kj::byte high = 0xbf;
+
+    kj::byte lead = *pos;
+    if (lead >= 0xc2 && lead <= 0xdf) {
+      count = 1;
+    } else if (lead == 0xe0) {
+      count = 2;
+      low = 0xa0;
+    } else if (lead == 0xed) {
+      count = 2;
+      high = 0x9f;
+    } else if (lead >= 0xe1 && lead <= 0xef) {
+      count = 2;
+    } else if (lead == 0xf0) {
+      count = 3;
+      low = 0x90;
+    } else if (lead == 0xf4) {
+      count = 3;
+      high = 0x8f;
+    } else if (lead >= 0xf1 && lead <= 0xf3) {
+      count = 3;
+    } else {
+      return false;
+    }
+
+    if (size_t(end - pos) <= count) return false;
+    if (pos[1] < low || pos[1] > high) return false;
+    for (size_t i = 2; i <= count; i++) {
+      if ((pos[i] & 0xc0) != 0x80) return false;
+    }
+    pos += count + 1;
+  }
+
+  return true;
+}
+
+#if defined(__SSSE3__) || (defined(__ARM_NEON) && defined(__aarch64__))
+#define WORKERD_UTF8_SIMD 1
+
+// Thin wrappers over the 16-byte vector operations the validator below needs, so that it reads
+// the same for SSSE3 and NEON.
+#if defined(__SSSE3__)
+using Vec = __m128i;
+inline Vec load(const kj::byte* pos) { return _mm_loadu_si128(reinterpret_cast<const Vec*>(pos)); }
+inline Vec splat(kj::byte b) { return _mm_set1_epi8(char(b)); }
+inline Vec bitAnd(Vec a, Vec b) { return _mm_and_si128(a, b); }
+inline Vec bitOr(Vec a, Vec b) { return _mm_or_si128(a, b); }
+inline Vec bitXor(Vec a, Vec b) { return _mm_xor_si128(a, b); }
+inline Vec subSaturated(Vec a, Vec b) { return _mm_subs_epu8(a, b); }
+inline Vec highNibbles(Vec v) { return bitAnd(_mm_srli_epi16(v, 4), splat(0x0f)); }
+inline Vec lowNibbles(Vec v) { return bitAnd(v, splat(0x0f)); }
+inline Vec lookup(Vec table, Vec nibbles) { return _mm_shuffle_epi8(table, nibbles); }
+inline bool anyHighBit(Vec v) { return _mm_movemask_epi8(v) != 0; }
+inline bool anyNonZero(Vec v) {
+  return _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_setzero_si128())) != 0xffff;
+}
+// The last 16 bytes of `previous` followed by `current`, starting `n` bytes before `current`.
+template <int n>
+inline Vec shiftIn(Vec previous, Vec current) { return _mm_alignr_epi8(current, previous, 16 - n); }
+#else
+using Vec = uint8x16_t;
+inline Vec load(const kj::byte* pos) { return vld1q_u8(pos); }
+inline Vec splat(kj::byte b) { return vdupq_n_u8(b); }
+inline Vec bitAnd(Vec a, Vec b) { return vandq_u8(a, b); }
+inline Vec bitOr(Vec a, Vec b) { return vorrq_u8(a, b); }
+inline Vec bitXor(Vec a, Vec b) { return veorq_u8(a, b); }
+inline Vec subSaturated(Vec a, Vec b) { return vqsubq_u8(a, b); }
+inline Vec highNibbles(Vec v) { return vshrq_n_u8(v, 4); }
+inline Vec lowNibbles(Vec v) { return vandq_u8(v, splat(0x0f)); }
+inline Vec lookup(Vec table, Vec nibbles) { return vqtbl1q_u8(table, nibbles); }
+inline bool anyHighBit(Vec v) { return vmaxvq_u8(v) >= 0x80; }
+inline bool anyNonZero(Vec v) { return vmaxvq_u8(v) != 0; }
+template <int n>
+inline Vec shiftIn(Vec previous, Vec current) { return vextq_u8(previous, current, 16 - n); }
+#endif
+
+// The errors a pair of consecutive bytes can show, each of which the pair's first byte, its low
+// nibble, and the second byte's high nibble must all allow for it to be reported.
+constexpr kj::byte TOO_SHORT = 1 << 0;       // Lead byte followed by a lead byte or ASCII.
+constexpr kj::byte TOO_LONG = 1 << 1;        // ASCII followed by a continuation byte.
+constexpr kj::byte OVERLONG_3 = 1 << 2;      // E0 80..9F
+constexpr kj::byte TOO_LARGE = 1 << 3;       // F4 90..BF, or F5..FF 90..BF
+constexpr kj::byte SURROGATE = 1 << 4;       // ED A0..BF
+constexpr kj::byte OVERLONG_2 = 1 << 5;      // C0..C1 80..BF
+constexpr kj::byte TOO_LARGE_1000 = 1 << 6;  // F5..FF 80..8F
+constexpr kj::byte OVERLONG_4 = 1 << 6;      // F0 80..8F
+constexpr kj::byte TWO_CONTS = 1 << 7;       // Continuation byte followed by another.
+constexpr kj::byte CARRY = TOO_SHORT | TOO_LONG | TWO_CONTS;
+
+// Indexed by the high nibble of the first byte of a pair.
+alignas(16) constexpr kj::byte FIRST_HIGH[16] = {
+  // ASCII
+  TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+  // Continuation byte
+  TWO_CONTS, TWO_CONTS, TWO_CONTS, TWO_CONTS,
+  // Two-byte lead: C0..CF, D0..DF
+  TOO_SHORT | OVERLONG_2,
+  TOO_SHORT,
+  // Three-byte lead
+  TOO_SHORT | OVERLONG_3 | SURROGATE,
+  // Four-byte lead, or not a valid byte at all
+  TOO_SHORT | TOO_LARGE | TOO_LARGE_1000 | OVERLONG_4,
+};
+
+// Indexed by the low nibble of the first byte of a pair.
+alignas(16) constexpr kj::byte FIRST_LOW[16] = {
+  CARRY | OVERLONG_3 | OVERLONG_2 | OVERLONG_4,
+  CARRY | OVERLONG_2,
+  CARRY,
+  CARRY,
+  CARRY | TOO_LARGE,
+  CARRY | TOO_LARGE | TOO_LARGE_1000,
+  CARRY | TOO_LARGE | TOO_LARGE_1000,
+  CARRY | TOO_LARGE | TOO_LARGE_1000,
+  CARRY | TOO_LARGE | TOO_LARGE_1000,
+  CARRY | TOO_LARGE | TOO_LARGE_1000,
+  CARRY | TOO_LARGE | TOO_LARGE_1000,
+  CARRY | TOO_LARGE | TOO_LARGE_1000,
+  CARRY | TOO_LARGE | TOO_LARGE_1000,
+  CARRY | TOO_LARGE | TOO_LARGE_1000 | SURROGATE,
+  CARRY | TOO_LARGE | TOO_LARGE_1000,
+  CARRY | TOO_LARGE | TOO_LARGE_1000,
+};
+
+// Indexed by the high nibble of the second byte of a pair.
+alignas(16) constexpr kj::byte SECOND_HIGH[16] = {
+  // ASCII
+  TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+  // Continuation byte: 80..8F, 90..9F, A0..BF
+  TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE_1000 | OVERLONG_4,
+  TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE,
+  TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+  TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+  // Lead byte
+  TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+};
+
+// For each byte position, the largest byte that doesn't start a sequence running past the end of
+// a 16-byte block.
+alignas(16) constexpr kj::byte LAST_COMPLETE[16] = {
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xf0 - 1, 0xe0 - 1, 0xc0 - 1,
+};
+
+// Validates 16 bytes at a time, using the lookup algorithm of Keiser and Lemire, "Validating UTF-8
+// In Less Than One Instruction Per Byte" (2021). Every pair of consecutive bytes is checked with
+// three table lookups; the rest of a sequence only needs the right number of continuation bytes,
+// which is where TWO_CONTS is expected rather than an error.
+bool isValidUtf8Simd(kj::ArrayPtr<const kj::byte> bytes) {
+  const Vec firstHigh = load(FIRST_HIGH);
+  const Vec firstLow = load(FIRST_LOW);
+  const Vec secondHigh = load(SECOND_HIGH);
+  const Vec lastComplete = load(LAST_COMPLETE);
+
+  Vec error = splat(0);
+  Vec previous = splat(0);
+  // Nonzero if `previous` ends partway through a sequence.
+  Vec previousIncomplete = splat(0);
+
+  auto check = [&](Vec input) {
+    if (!anyHighBit(input)) {
+      // ASCII can't continue a sequence.
+      error = bitOr(error, previousIncomplete);
+    } else {
+      Vec prev1 = shiftIn<1>(previous, input);
+      Vec pairErrors = bitAnd(bitAnd(
+          lookup(firstHigh, highNibbles(prev1)),
+          lookup(firstLow, lowNibbles(prev1))),
+          lookup(secondHigh, highNibbles(input)));
+
+      // Only bytes two or three into a three- or four-byte sequence may follow a continuation byte.
+      Vec thirdByte = subSaturated(shiftIn<2>(previous, input), splat(0xe0 - 0x80));
+      Vec fourthByte = subSaturated(shiftIn<3>(previous, input), splat(0xf0 - 0x80));
+      Vec mustContinue = bitAnd(bitOr(thirdByte, fourthByte), splat(0x80));
+
+      error = bitOr(error, bitXor(mustContinue, pairErrors));
+      previousIncomplete = subSaturated(input, lastComplete);
+    }
+    previous = input;
+  };
+
+  const kj::byte* pos = bytes.begin();
+  const kj::byte* end = bytes.end();
+  for (; end - pos >= 16; pos += 16) {
+    check(load(pos));
+  }
+  if (pos < end) {
+    // Pad the rest with ASCII, which ends any sequence cut short.
+    kj::byte tail[16] = {};
+    memcpy(tail, pos, end - pos);
+    check(load(tail));
+  }
+
+  return !anyNonZero(bitOr(error, previousIncomplete));
+}
+#endif
+
+}  // namespace
+
+bool isValidUtf8(kj::ArrayPtr<const kj::byte> bytes) {
+#ifdef WORKERD_UTF8_SIMD
+  // Below a block, the vector code would only pay for padding.
+  if (bytes.size() >= 16) {
+    return isValidUtf8Simd(bytes);
+  }
+#endif
+  return isValidUtf8Scalar(bytes);
+}
+
+}  // namespace workerd
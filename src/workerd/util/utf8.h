@@ -0,0 +1,29 @@
+// Copyright (c) 2017-2022 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+#pragma once
+
+#include <kj/common.h>
+
+namespace workerd {
+
+// Scanning kernels shared by the text codecs (TextDecoder, Buffer, and friends), so that the common
+// case of ASCII or well-formed UTF-8 input can be handed straight to V8 instead of going through
+// a general-purpose converter. They work on 16 bytes at a time with SSE2 or NEON where the target
+// guarantees them, and on 8 bytes at a time otherwise. isValidUtf8() also needs a byte shuffle, so
+// on x86 it only validates non-ASCII text a block at a time when built for SSSE3.
+
+// Returns the length of the longest prefix of `bytes` containing only ASCII (bytes below 0x80).
+size_t asciiPrefixLength(kj::ArrayPtr<const kj::byte> bytes);
+
+inline bool isAscii(kj::ArrayPtr<const kj::byte> bytes) {
+  return asciiPrefixLength(bytes) == bytes.size();
+}
+
+// Returns true if `bytes` is entirely well-formed UTF-8, per the Unicode Standard, table 3-7: no
+// stray continuation bytes, overlong encodings, surrogates, code points beyond U+10FFFF, or
+// sequence cut short at the end.
+bool isValidUtf8(kj::ArrayPtr<const kj::byte> bytes);
+
+}  // namespace workerd